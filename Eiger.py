@@ -18,15 +18,20 @@ import shutil
 import os
 from ast import literal_eval
 import json
+import struct
+import subprocess
 import sys
+from distutils.spawn import find_executable
 from collections import namedtuple
 from tabulate import tabulate
 
 from sklearn.cluster import KMeans
-from eiger import database, PCA, LinearRegression
+from eiger import database, PCA, LinearRegression, MARS, native, Incremental
 
 Model = namedtuple('Model', ['metric_names', 'means', 'stdevs',
                             'rotation_matrix', 'kmeans', 'models'])
+# the part of a fitted KMeans a model file is written from
+Centers = namedtuple('Centers', ['cluster_centers_'])
 
 def import_model(args):
     database.addModelFromFile(args.database, args.file, args.source_name, args.description)
@@ -39,6 +44,12 @@ def list_models(args):
     print tabulate(all_models, headers=['ID', 'Description', 'Created', 'Source'])
 
 def trainModel(args):
+    if args.incremental is not None:
+        if os.path.isdir(args.database):
+            print "Incremental training needs the database file, not an extract."
+            return
+        if not args.rebuild and updateModel(args):
+            return
     print "Training the model..."
     training_DC = database.DataCollection(args.training_dc, args.database)
     try:
@@ -59,15 +70,38 @@ def trainModel(args):
         return
     training_profile = training_DC.profile[:,metric_ids]
 
+    use_native = args.engine == 'native' or \
+                 (args.engine == 'auto' and native.available())
+    if args.engine == 'native' and not native.available():
+        print "Unable to load libeigertrain; set EIGER_TRAIN_LIBRARY to its path."
+        return
+    if args.mars_terms and not use_native:
+        print "MARS models need libeigertrain; set EIGER_TRAIN_LIBRARY to its path."
+        return
+
     #pca
-    training_pca = PCA.PCA(training_profile)
+    if use_native:
+        rows = 65536
+        training_pca = PCA.PCA.fromChunks(
+            (training_profile[i:i+rows] for i in
+             range(0, training_profile.shape[0], rows)),
+            training_profile.shape[1], threads=args.threads)
+    else:
+        training_pca = PCA.PCA(training_profile)
     nonzero_components = training_pca.nonzeroComponents()
     rotation_matrix = training_pca.components[:,nonzero_components]
     rotated_training_profile = np.dot(training_profile, rotation_matrix)
 
     #kmeans
     n_clusters = args.clusters
-    kmeans = KMeans(n_clusters)
+    if use_native:
+        batch = args.kmeans_batch
+        if batch is None:
+            batch = 1024 if rotated_training_profile.shape[0] > 100000 else 0
+        kmeans = native.KMeans(n_clusters, batch_size=batch,
+                               threads=args.threads)
+    else:
+        kmeans = KMeans(n_clusters)
     means = np.mean(rotated_training_profile, axis=0)
     stdevs = np.std(rotated_training_profile - means, axis=0, ddof=1)
     stdevs[stdevs==0.0] = 1.0
@@ -76,12 +110,30 @@ def trainModel(args):
     # reserve a vector for each model created per cluster
     models = [0] * len(clusters)
 
-    print "Modeling..."
+    print "Modeling%s..." % (" with libeigertrain" if use_native else "",)
     for i in range(n_clusters):
         cluster_profile = rotated_training_profile[clusters==i,:]
         cluster_performance = training_performance[clusters==i]
+        if args.mars_terms:
+            mars = MARS.MARS(cluster_profile, cluster_performance,
+                             args.mars_terms, 1, use_native=True,
+                             threads=args.threads)
+            models[i] = mars.toModel()
+            n = len(cluster_performance)
+            k = len(models[i].functions) - 1
+            tss = np.sum((cluster_performance - np.mean(cluster_performance))**2)
+            r_squared = 1 - mars.rss / tss if tss > 0 else 1.0
+            r_squared_adj = 1 - (1 - r_squared) * (n - 1) / (n - k - 1) \
+                            if n > k + 1 else float('-inf')
+            print "Model:\n" + str(models[i])
+            print "Finished modeling cluster %s:" % (i,)
+            print "r squared = %s" % (r_squared,)
+            print "adjusted r squared = %s" % (r_squared_adj,)
+            continue
         regression = LinearRegression.LinearRegression(cluster_profile,
-                                                       cluster_performance)
+                                                       cluster_performance,
+                                                       use_native,
+                                                       args.threads)
         pool = [LinearRegression.identityFunction()]
         for col in range(cluster_profile.shape[1]):
             if('inv_quadratic' in args.regressor_functions):
@@ -126,23 +178,133 @@ def trainModel(args):
         writeToFileJSON(model, outfilename)
     else:
         writeToFile(model, outfilename)
+    if args.incremental is not None:
+        stats = Incremental.Statistics.fromTraining(args.training_dc,
+                args.target, metric_names, training_DC.lastTrial(),
+                training_profile, training_performance, rotation_matrix,
+                means, stdevs, kmeans.cluster_centers_, clusters, models,
+                args.threads if use_native else 0)
+        _storeModel(args, outfilename, stats, "trained on %s trials of %s" %
+                    (stats.count, args.training_dc))
     if args.test_fit:
         args.experiment_dc = args.training_dc
         args.model = outfilename
         testModel(args)
 
 
+def updateModel(args):
+    """
+    Updates the newest model of source args.incremental with the trials added
+    to its data collection since, if it was stored with its statistics and
+    they have not drifted past args.drift. Returns False if the model must
+    be trained in full instead.
+    """
+    stored = database.getModelStatistics(args.database, args.incremental)
+    if stored is None:
+        print "No statistics stored for model source '%s'." % (args.incremental,)
+        return False
+    (model_id, data) = stored
+    stats = Incremental.Statistics.fromJSON(str(data))
+    if stats.collection != args.training_dc or stats.target != args.target:
+        print "Model %s predicts %s of %s." % (model_id, stats.target,
+                                              stats.collection)
+        return False
+    last_trial = database.getLastTrial(args.database, args.training_dc)
+    if last_trial is None or last_trial <= stats.last_trial:
+        print "No trials have been added since model %s." % (model_id,)
+        return True
+
+    print "Updating model %s..." % (model_id,)
+    threads = args.threads if native.available() else 0
+    count = stats.count
+    for block in database.iterProfile(args.database, args.training_dc,
+                                      stats.metric_names + [args.target],
+                                      after=stats.last_trial, upto=last_trial):
+        stats.add(block[:,:-1], block[:,-1], threads)
+    stats.last_trial = last_trial
+    drift = stats.drift()
+    print "Added %s trials; the profile has drifted %s standard deviations." \
+          % (stats.count - count, drift)
+    if drift > args.drift:
+        print "Drift is over %s." % (args.drift,)
+        return False
+
+    (centers, models, r_squared) = stats.fit()
+    for i in range(len(models)):
+        print "Model:\n" + str(models[i])
+        print "Finished modeling cluster %s:" % (i,)
+        print "r squared = %s" % (r_squared[i],)
+    model = Model(stats.metric_names, stats.means, stats.stdevs,
+                  stats.rotation_matrix, Centers(centers), models)
+    outfilename = args.training_dc + '.model' if args.output == None else args.output
+    if args.json == True:
+        writeToFileJSON(model, outfilename)
+    else:
+        writeToFile(model, outfilename)
+    _storeModel(args, outfilename, stats, "updated from model %s to %s "
+                "trials of %s" % (model_id, stats.count, args.training_dc))
+    if args.test_fit:
+        args.experiment_dc = args.training_dc
+        args.model = outfilename
+        testModel(args)
+    return True
+
+def _storeModel(args, outfilename, stats, description):
+    model_id = database.addModelFromFile(args.database, outfilename,
+                                         args.incremental, description)
+    database.addModelStatistics(args.database, model_id, stats.toJSON())
+    print "Stored as model %s of source '%s'." % (model_id, args.incremental)
+
+def _formatValue(x):
+    """
+    x as eiger-export writes it: whole numbers below 1e15 as integers, and
+    anything else in the fewest of 15, 16 and 17 significant digits that
+    read back as x.
+    """
+    if abs(x) < 1e15 and x == int(x) and \
+       not (x == 0 and math.copysign(1.0, x) < 0):
+        return '%d' % x
+    # subnormals carry fewer digits and are searched from the start
+    first = 1 if abs(x) < sys.float_info.min else 15
+    for precision in range(first, 17):
+        text = '%.*g' % (precision, x)
+        if float(text) == x:
+            return text
+    return '%.17g' % x
+
 def dumpCSV(args):
+    # eiger-export streams the collection from the database rather than
+    # loading all of it, and formats the values in C++
+    exporter = find_executable('eiger-export')
+    if exporter is not None and not os.path.isdir(args.database):
+        command = [exporter, args.database, args.training_dc]
+        if args.metrics != None:
+            command += ['--metrics', ','.join(args.metrics)]
+        if args.output != None:
+            command += ['--output', args.output]
+        if subprocess.call(command) != 0:
+            print "Unable to dump data collection '%s'." % (args.training_dc,)
+        return
     training_DC = database.DataCollection(args.training_dc, args.database)
     names = [met[0] for met in training_DC.metrics]
     if args.metrics != None:
         names = args.metrics
     header = ','.join(names)
-    idxs = training_DC.metricIndexByName(names)
+    # in the order of the header
+    all_names = [met[0] for met in training_DC.metrics]
+    for name in names:
+        if name not in all_names:
+            print "Unable to find metric '%s'." % (name,)
+            return
+    idxs = [all_names.index(name) for name in names]
     profile = training_DC.profile[:,idxs]
-    outfile = sys.stdout if args.output == None else args.output
-    np.savetxt(outfile, profile, delimiter=',', 
-            header=header, comments='')
+    # the same text eiger-export writes
+    outfile = sys.stdout if args.output == None else open(args.output, 'w')
+    outfile.write(header + '\n')
+    for row in profile:
+        outfile.write(','.join(_formatValue(x) for x in row) + '\n')
+    if outfile is not sys.stdout:
+        outfile.close()
 
 def testModel(args):
     print "Testing the model fit..."
@@ -153,13 +315,19 @@ def testModel(args):
             model.rotation_matrix, test_DC,
             args, model.metric_names)
 
-def readFile(infile):
-    with open(infile, 'r') as modelfile:
-        first_char = modelfile.readline()[0]
+def _modelFormat(infile):
+    with open(infile, 'rb') as modelfile:
+        first_char = modelfile.read(1)
     if first_char == '{':
-        return readJSONFile(infile)
-    else:
-        return readBespokeFile(infile)
+        return 'json'
+    elif first_char == BINARY_MAGIC[0]:
+        return 'binary'
+    return 'text'
+
+def readFile(infile):
+    readers = {'text': readBespokeFile, 'json': readJSONFile,
+               'binary': readBinaryFile}
+    return readers[_modelFormat(infile)](infile)
 
 def plotModel(args):
     print "Plotting model..."
@@ -306,16 +474,128 @@ def readBespokeFile(infile):
     kmeans.cluster_centers_ = np.array(centroids)
     return Model(metric_names, means, stdevs, rotation_matrix, kmeans, models)
 
+# The binary model format, which the C++ runtime (api/eigermodel.h) can
+# memory-map and evaluate in place: a header of BINARY_HEADER, then the
+# sections of BINARY_SECTIONS as little-endian arrays, each starting on a
+# multiple of 64 bytes. Functions are stored as BINARY_FUNCTION records.
+BINARY_MAGIC = '\x89EIGMOD\n'
+BINARY_VERSION = 1
+BINARY_HEADER = struct.Struct('<8sIIIIIIQQ8Q16x')
+BINARY_FUNCTION = np.dtype([('kind', '<i4'), ('i', '<i4'), ('j', '<i4'),
+                            ('reserved', '<i4'), ('exponent', '<f8')])
+BINARY_SECTIONS = ['names', 'means', 'stdevs', 'rotation', 'centers',
+                   'starts', 'weights', 'functions']
+
+def _encodeFunction(function):
+    """The (kind, i, j, exponent) of a function, from its encoding."""
+    encoding = repr(function).split()
+    kind = int(encoding[0])
+    args = encoding[1:]
+    i = int(args[0]) if args else -1
+    if kind in (1, 6, 7):
+        return (kind, i, -1, float(args[1]))
+    j = int(args[1]) if kind in (2, 5) and len(args) > 1 else -1
+    return (kind, i, j, 0.0)
+
+def _decodeFunction(kind, i, j, exponent):
+    if kind == 0:
+        return LinearRegression.identityFunction()
+    elif kind == 1:
+        return LinearRegression.powerFunction(i, exponent)
+    elif kind == 2:
+        return LinearRegression.crossFunction(i, j)
+    elif kind == 3:
+        return LinearRegression.sqrtFunction(i)
+    elif kind == 4:
+        return LinearRegression.logFunction(i)
+    elif kind == 5:
+        return LinearRegression.divFunction(i, j)
+    elif kind == 6:
+        return LinearRegression.hingeFunction(i, exponent)
+    elif kind == 7:
+        return LinearRegression.mirrorFunction(i, exponent)
+    raise ValueError("unknown function encoding %s in binary model" % kind)
+
+def writeToFileBinary(model, outfile):
+    centers = np.asarray(model.kmeans.cluster_centers_, dtype='<f8')
+    weights = [np.asarray(m.weights, dtype='<f8').ravel() for m in model.models]
+    starts = np.cumsum([0] + [len(w) for w in weights]).astype('<u4')
+    functions = [_encodeFunction(f) for m in model.models for f in m.functions]
+    records = np.zeros(len(functions), dtype=BINARY_FUNCTION)
+    for k, (kind, i, j, exponent) in enumerate(functions):
+        records[k] = (kind, i, j, 0, exponent)
+    sections = [''.join(str(name) + '\0' for name in model.metric_names),
+                np.asarray(model.means, dtype='<f8').tobytes(),
+                np.asarray(model.stdevs, dtype='<f8').tobytes(),
+                np.asarray(model.rotation_matrix, dtype='<f8').tobytes(),
+                centers.tobytes(),
+                starts.tobytes(),
+                np.concatenate(weights + [np.zeros(0)]).astype('<f8').tobytes(),
+                records.tobytes()]
+    offsets = []
+    end = BINARY_HEADER.size
+    for section in sections:
+        end += -end % 64
+        offsets.append(end)
+        end += len(section)
+    header = BINARY_HEADER.pack(BINARY_MAGIC, BINARY_VERSION, 0x01020304,
+                                len(model.metric_names), len(model.means),
+                                len(centers), len(records), end,
+                                len(sections[0]), *offsets)
+    with open(outfile, 'wb') as modelfile:
+        modelfile.write(header)
+        for offset, section in zip(offsets, sections):
+            modelfile.write('\0' * (offset - modelfile.tell()))
+            modelfile.write(section)
+
+def readBinaryFile(infile):
+    with open(infile, 'rb') as modelfile:
+        data = modelfile.read()
+    if len(data) < BINARY_HEADER.size:
+        raise ValueError("%s is not a binary model" % infile)
+    fields = BINARY_HEADER.unpack_from(data)
+    (magic, version, byte_order, n_inputs, n_components, n_clusters,
+     n_functions, size, names_size) = fields[:9]
+    offsets = dict(zip(BINARY_SECTIONS, fields[9:]))
+    if magic != BINARY_MAGIC or byte_order != 0x01020304 or size != len(data):
+        raise ValueError("%s is not a binary model" % infile)
+    if version != BINARY_VERSION:
+        raise ValueError("%s is version %s of the binary model format" %
+                         (infile, version))
+    def array(section, dtype, count):
+        return np.frombuffer(data, dtype, count, offsets[section])
+    names = data[offsets['names']:offsets['names'] + names_size]
+    metric_names = names.split('\0')[:n_inputs]
+    means = array('means', '<f8', n_components).astype(float)
+    stdevs = array('stdevs', '<f8', n_components).astype(float)
+    rotation_matrix = array('rotation', '<f8', n_inputs * n_components)
+    rotation_matrix = rotation_matrix.reshape(n_inputs, n_components).astype(float)
+    centroids = array('centers', '<f8', n_clusters * n_components)
+    centroids = centroids.reshape(n_clusters, n_components).astype(float)
+    starts = array('starts', '<u4', n_clusters + 1)
+    weights = array('weights', '<f8', n_functions).astype(float)
+    records = array('functions', BINARY_FUNCTION, n_functions)
+    models = []
+    for first, last in zip(starts[:-1], starts[1:]):
+        functions = [_decodeFunction(int(r['kind']), int(r['i']), int(r['j']),
+                                     float(r['exponent']))
+                     for r in records[first:last]]
+        models.append(LinearRegression.Model(functions, weights[first:last]))
+    kmeans = KMeans(n_clusters)
+    kmeans.cluster_centers_ = centroids
+    return Model(metric_names, means, stdevs, rotation_matrix, kmeans, models)
+
 def convert(args):
     print "Converting model..."
-    with open(args.input, 'r') as modelfile:
-        first_char = modelfile.readline()[0]
-    if first_char == '{':
-        model = readJSONFile(args.input)
-        writeToFile(model, args.output)
-    else:
-        model = readBespokeFile(args.input)
-        writeToFileJSON(model, args.output)
+    input_format = _modelFormat(args.input)
+    model = readFile(args.input)
+    # by default, text and JSON models swap formats and binary become JSON
+    output_format = args.to
+    if output_format is None:
+        output_format = 'text' if input_format == 'json' else 'json'
+    writers = {'text': writeToFile, 'json': writeToFileJSON,
+               'binary': writeToFileBinary}
+    writers[output_format](model, args.output)
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description = \
@@ -331,7 +611,9 @@ if __name__ == "__main__":
     train_parser.set_defaults(func=trainModel)
     dump_parser = subparsers.add_parser('dump',
             help='dump data collection to CSV',
-            description='Dump data collection as CSV')
+            description='Dump data collection as CSV, with eiger-export if '
+            'it is on the path; either way, values are written in the fewest '
+            'digits that read back exactly')
     dump_parser.set_defaults(func=dumpCSV)
     test_parser = subparsers.add_parser('test',
             help='test how well a model predicts a data collection',
@@ -359,7 +641,9 @@ if __name__ == "__main__":
     export_model_parser.set_defaults(func=export_model)
 
     """TRAINING ARGUMENTS"""
-    train_parser.add_argument('database', type=str, help='Name of the database file')
+    train_parser.add_argument('database', type=str,
+            help='Name of the database file, or a directory of '
+            'collections written by eiger-extract')
     train_parser.add_argument('training_dc', type=str,
             help='Name of the training data collection')
     train_parser.add_argument('target', type=str,
@@ -388,17 +672,49 @@ if __name__ == "__main__":
             'Defaults to all.')
     train_parser.add_argument('--json', action='store_true', default=False,
             help='Output model in JSON format, rather than bespoke')
+    train_parser.add_argument('--engine', choices=['auto', 'native', 'python'],
+            default='auto',
+            help='Find principal components and clusters and search for '
+            'regressors with libeigertrain (native) or numpy and sklearn '
+            '(python); auto uses libeigertrain when it can be loaded')
+    train_parser.add_argument('--threads', type=int, default=0,
+            help='Threads libeigertrain searches the folds on, 0 for one per '
+            'core; the model does not depend on it')
+    train_parser.add_argument('--mars-terms', type=int,
+            help='Fit each cluster with MARS of up to this many terms, hinge '
+            'functions of the principal components found by libeigertrain, '
+            'rather than searching the regressor functions')
+    train_parser.add_argument('--kmeans-batch', type=int,
+            help='Points libeigertrain samples to each mini-batch of kmeans, '
+            '0 to cluster with every point each iteration; defaults to 1024 '
+            'for profiles over 100000 rows, otherwise 0')
+    train_parser.add_argument('--incremental', type=str, metavar='SOURCE',
+            help='Store the model in the database under this model source, '
+            'with the statistics to update it from; if the newest model of '
+            'the source has them, update it from the trials added since '
+            'rather than training again')
+    train_parser.add_argument('--rebuild', action='store_true', default=False,
+            help='With --incremental, train in full even if the model could '
+            'be updated')
+    train_parser.add_argument('--drift', type=float, default=0.25,
+            help='With --incremental, train in full once the mean or '
+            'standard deviation of a principal component over all trials '
+            'has moved this many of the model\'s standard deviations')
 
     """DUMP CSV ARGUMENTS"""
-    dump_parser.add_argument('database', type=str, help='Name of the database file')
+    dump_parser.add_argument('database', type=str,
+            help='Name of the database file, or a directory of '
+            'collections written by eiger-extract')
     dump_parser.add_argument('training_dc', type=str,
             help='Name of the data collection to dump')
     dump_parser.add_argument('--metrics', nargs='*',
-            help='Only dump these metrics.')
+            help='Only dump these metrics, in this order.')
     dump_parser.add_argument('--output', type=str, help='Name of file to dump CSV to')
 
     """TEST ARGUMENTS"""
-    test_parser.add_argument('database', type=str, help='Name of the database file')
+    test_parser.add_argument('database', type=str,
+            help='Name of the database file, or a directory of '
+            'collections written by eiger-extract')
     test_parser.add_argument('experiment_dc', type=str,
             help='Name of the data collection to experiment on')
     test_parser.add_argument('model', type=str,
@@ -425,6 +741,9 @@ if __name__ == "__main__":
             help='Name of input model to convert from')
     convert_parser.add_argument('output', type=str,
             help='Name of output model to convert to')
+    convert_parser.add_argument('--to', choices=['text', 'json', 'binary'],
+            help='Format of the output model; JSON for a text or binary '
+            'input model and text for a JSON one by default')
 
     """LIST ARGUMENTS"""
     list_model_parser.add_argument('database', type=str, help='Name of the database file')
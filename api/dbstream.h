@@ -0,0 +1,74 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Record-at-a-time writing into an Eiger database, used by
+* the sqlite backend and by eiger-loader's streaming mode.
+*
+**********************************************************/
+
+#ifndef DBSTREAM_H_INCLUDED
+#define DBSTREAM_H_INCLUDED
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "eiger.h"
+#include "ledger.h"
+
+namespace eiger{
+
+  // Inserts records into db as they are added, committing every chunk rows
+  // (0 for a single transaction). The IDs inside each record must already
+  // be database IDs; adding a named object or trial returns its database
+  // ID. A named object that is already in the database keeps its ID. With
+  // distinct, as eiger-loader writes, a dataset or machine metric value that
+  // is already there is not added again.
+  class DatabaseStream {
+    public:
+      DatabaseStream(const std::string& db, size_t chunk,
+                     bool distinct = false);
+      // commits whatever is pending
+      ~DatabaseStream();
+
+      int add(const DataCollection& dc);
+      int add(const Application& app);
+      int add(const Dataset& ds);
+      int add(const Machine& ma);
+      int add(const Metric& me);
+      int add(const Trial& tr);
+      void add(const NondeterministicMetric& ndm);
+      void add(const DeterministicMetric& dm);
+      void add(const MachineMetric& mm);
+      // writes or replaces a ledger row in the current transaction
+      void record(const LoadedLog& log);
+      // records log again, as it is then, before every later commit
+      void track(const LoadedLog* log);
+      // removes the ledger row of the log with the given hash
+      void unrecord(const std::string& hash);
+      // removes the trials an earlier load of a log inserted, with their
+      // metrics, and its ledger row
+      void erase(const std::string& hash);
+      // the trials the ledger says the log inserted, as runs (first, last)
+      std::vector< std::pair<int,int> > trials(const std::string& hash);
+      // commits the current transaction and closes the database
+      void finish();
+      // rolls back the current transaction and closes the database
+      void rollback();
+
+    private:
+      struct state;
+      state* s_;
+
+      void row();
+      // creates the ledger tables if need be and prepares their statements
+      void ledger();
+      // ends the transaction with end and closes the database
+      void close(const char* end);
+      DatabaseStream(const DatabaseStream&);
+      DatabaseStream& operator=(const DatabaseStream&);
+  };
+
+} // end namespace eiger
+
+#endif
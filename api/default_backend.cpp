@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <fstream>
 #include <string>
@@ -8,6 +9,8 @@
 #include "sqlite3.h"
 
 #include "eiger.h"
+#include "dbstream.h"
+#include "ledger.h"
 
 using namespace std;
 
@@ -23,26 +26,20 @@ int db_check_callback(void* is_db_already, int num_cols, char** col_text, char**
   return 0;
 }
 
-void do_disconnect(const string& dbname, 
-                   const vector<DataCollection>& datacollections_e,
-                   const vector<Application>& applications_e,
-                   const vector<Dataset>& datasets_e,
-                   const vector<Machine>& machines_e,
-                   const vector<Trial>& trials_e,
-                   const vector<Metric>& metrics_e,
-                   const vector<NondeterministicMetric>& nondet_metrics_e,
-                   const vector<DeterministicMetric>& det_metrics_e,
-                   const vector<MachineMetric>& machine_metrics_e){
-  vector<DataCollection> datacollections = datacollections_e;
-  vector<Application> applications = applications_e;
-  vector<Dataset> datasets = datasets_e;
-  vector<Machine> machines = machines_e;
-  vector<Trial> trials = trials_e;
-  vector<Metric> metrics = metrics_e;
-  vector<NondeterministicMetric> nondet_metrics = nondet_metrics_e;
-  vector<DeterministicMetric> det_metrics = det_metrics_e;
-  vector<MachineMetric> machine_metrics = machine_metrics_e;
+// Everything is written to the database at disconnect.
+void do_connect(const string&){}
+void do_commit(const DataCollection&, int){}
+void do_commit(const Application&, int){}
+void do_commit(const Dataset&, int){}
+void do_commit(const Machine&, int){}
+void do_commit(const Trial&, int){}
+void do_commit(const Metric&, int){}
+void do_commit(const NondeterministicMetric&){}
+void do_commit(const DeterministicMetric&){}
+void do_commit(const MachineMetric&){}
 
+// Opens dbname, creating the schema if the file isn't a database yet.
+static sqlite3* open_db(const string& dbname){
   sqlite3* db;
   int err = sqlite3_open(dbname.c_str(), &db);
   if(err != SQLITE_OK){
@@ -67,224 +64,497 @@ void do_disconnect(const string& dbname,
       exit(-1);
     }
   }
+  return db;
+}
 
-  sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+// Same as schema.sql; databases created before the ledger get it on their
+// first ledgered load.
+static const char* ledger_schema[] = {
+  "CREATE TABLE IF NOT EXISTS loaded_logs("
+  "hash TEXT PRIMARY KEY, filename TEXT, status TEXT, databases INTEGER, "
+  "loaded TEXT, records INTEGER, prefix TEXT)",
+  "CREATE TABLE IF NOT EXISTS loaded_log_trials("
+  "hash TEXT REFERENCES loaded_logs(hash), first INTEGER, last INTEGER)",
+  "CREATE INDEX IF NOT EXISTS loaded_log_trials_idx "
+  "ON loaded_log_trials(hash)"
+};
 
-  vector<int> dc_ids, machine_ids, app_ids, metric_ids, dataset_ids, trial_ids;
-  sqlite3_stmt* insert_statement;
+static void create_ledger(sqlite3* db){
+  for(const char* sql : ledger_schema){
+    if(sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK){
+      cerr << sqlite3_errmsg(db) << endl;
+      exit(-1);
+    }
+  }
+}
+
+static string column_text(sqlite3_stmt* statement, int column){
+  const unsigned char* text = sqlite3_column_text(statement, column);
+  return text == NULL ? string() : string((const char*)text);
+}
+
+void add_trial(vector< pair<int,int> >& runs, int id){
+  if(!runs.empty() && runs.back().second + 1 == id){
+    runs.back().second = id;
+  } else {
+    runs.push_back(make_pair(id, id));
+  }
+}
+
+map<string,LoadedLog> loaded_logs(const string& dbname){
+  map<string,LoadedLog> logs;
+  sqlite3* db = open_db(dbname);
   sqlite3_stmt* select_statement;
+  // no statement without the table: nothing has been ledgered yet
+  if(sqlite3_prepare_v2(db, "SELECT hash, filename, status, databases, "
+                        "records, prefix FROM loaded_logs", -1,
+                        &select_statement, NULL) == SQLITE_OK){
+    while(sqlite3_step(select_statement) == SQLITE_ROW){
+      LoadedLog log;
+      log.hash = column_text(select_statement, 0);
+      log.filename = column_text(select_statement, 1);
+      log.status = column_text(select_statement, 2);
+      log.databases = sqlite3_column_int(select_statement, 3);
+      log.records = sqlite3_column_int64(select_statement, 4);
+      log.prefix = column_text(select_statement, 5);
+      logs[log.hash] = log;
+    }
+    sqlite3_finalize(select_statement);
+  }
+  sqlite3_close(db);
+  return logs;
+}
+
+/********
+ * DatabaseStream
+ */
+
+struct DatabaseStream::state {
+  sqlite3* db;
+  size_t chunk;
+  size_t pending; // rows in the open transaction
+  bool ledgered;  // the ledger tables are known to exist
+  const LoadedLog* tracked; // recorded before every commit, if not NULL
+  sqlite3_stmt *insert_dc, *select_dc, *insert_app, *select_app,
+               *insert_ds, *select_ds, *insert_ma, *select_ma,
+               *insert_me, *select_me, *insert_trial, *insert_ndm,
+               *insert_dm, *insert_mm, *insert_log, *delete_log,
+               *insert_run, *delete_runs, *select_runs;
+};
+
+static sqlite3_stmt* prepare(sqlite3* db, const char* sql){
+  sqlite3_stmt* statement = NULL;
+  sqlite3_prepare_v2(db, sql, -1, &statement, NULL);
+  return statement;
+}
+
+// INSERT OR IGNORE the object, then read back the ID it has in the database
+static int named_id(sqlite3_stmt* insert_statement,
+                    sqlite3_stmt* select_statement, const string& name){
+  sqlite3_step(insert_statement);
+  sqlite3_reset(insert_statement);
+
+  sqlite3_bind_text(select_statement, 1, name.c_str(), -1, SQLITE_STATIC);
+  sqlite3_step(select_statement);
+  int id = sqlite3_column_int(select_statement, 0);
+  sqlite3_reset(select_statement);
+  return id;
+}
+
+static const char* metric_type_name(metric_type_t type){
+  switch(type){
+    case DETERMINISTIC:
+      return "deterministic";
+    case NONDETERMINISTIC:
+      return "nondeterministic";
+    case MACHINE:
+      return "machine";
+    default:
+      throw "BAAAD metric type";
+  }
+}
+
+DatabaseStream::DatabaseStream(const string& dbname, size_t chunk,
+                               bool distinct)
+  : s_(new state) {
+  sqlite3* db = s_->db = open_db(dbname);
+  s_->chunk = chunk;
+  s_->pending = 0;
+  s_->ledgered = false;
+  s_->tracked = NULL;
+  s_->insert_dc = prepare(db, "INSERT OR IGNORE INTO datacollections"
+                              "(name, description) VALUES(?,?)");
+  s_->select_dc = prepare(db, "SELECT ID FROM datacollections WHERE name=?");
+  s_->insert_app = prepare(db, "INSERT OR IGNORE INTO applications"
+                               "(name, description) VALUES(?,?)");
+  s_->select_app = prepare(db, "SELECT ID FROM applications WHERE name=?");
+  s_->insert_ds = prepare(db, "INSERT OR IGNORE INTO datasets"
+                              "(applicationID, name, description, created, url) "
+                              "VALUES(?,?,?,?,?)");
+  s_->select_ds = prepare(db, "SELECT ID FROM datasets WHERE name=?");
+  s_->insert_ma = prepare(db, "INSERT OR IGNORE INTO machines"
+                              "(name, description) VALUES(?,?)");
+  s_->select_ma = prepare(db, "SELECT ID FROM machines WHERE name=?");
+  s_->insert_me = prepare(db, "INSERT OR IGNORE INTO metrics"
+                              "(type, name, description) VALUES(?,?,?)");
+  s_->select_me = prepare(db, "SELECT ID FROM metrics WHERE name=?");
+  s_->insert_trial = prepare(db, "INSERT OR IGNORE INTO trials"
+                                 "(dataCollectionID, machineID, applicationID, "
+                                 "datasetID) VALUES(?,?,?,?)");
+  s_->insert_ndm = prepare(db, "INSERT OR IGNORE INTO nondeterministic_metrics"
+                               "(trialID, metricID, metric) VALUES(?,?,?)");
+  if(distinct){
+    // a dataset or machine keeps one copy of a value, however many logs of
+    // its trials are loaded, or loaded again
+    sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS mach_metrics_machine_idx "
+                     "ON machine_metrics(machineID)", NULL, NULL, NULL);
+    s_->insert_dm = prepare(db, "INSERT INTO deterministic_metrics"
+                                "(datasetID, metricID, metric) "
+                                "SELECT ?1,?2,?3 WHERE NOT EXISTS (SELECT 1 "
+                                "FROM deterministic_metrics WHERE "
+                                "datasetID=?1 AND metricID=?2 AND metric=?3)");
+    s_->insert_mm = prepare(db, "INSERT INTO machine_metrics"
+                                "(machineID, metricID, metric) "
+                                "SELECT ?1,?2,?3 WHERE NOT EXISTS (SELECT 1 "
+                                "FROM machine_metrics WHERE machineID=?1 "
+                                "AND metricID=?2 AND metric=?3)");
+  } else {
+    s_->insert_dm = prepare(db, "INSERT INTO deterministic_metrics"
+                                "(datasetID, metricID, metric) "
+                                "VALUES(?,?,?)");
+    s_->insert_mm = prepare(db, "INSERT INTO machine_metrics"
+                                "(machineID, metricID, metric) "
+                                "VALUES(?,?,?)");
+  }
+  // prepared once the ledger tables surely exist
+  s_->insert_log = s_->delete_log = NULL;
+  s_->insert_run = s_->delete_runs = s_->select_runs = NULL;
+  sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+}
+
+DatabaseStream::~DatabaseStream(){
+  finish();
+  delete s_;
+}
+
+// Called before each row is written, so that a tracked log is recorded as
+// it stands after the records already written, and no further.
+void DatabaseStream::row(){
+  if(s_->chunk > 0 && s_->pending >= s_->chunk){
+    if(s_->tracked != NULL) record(*s_->tracked);
+    sqlite3_exec(s_->db, "COMMIT", NULL, NULL, NULL);
+    sqlite3_exec(s_->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    s_->pending = 0;
+  }
+  s_->pending++;
+}
+
+int DatabaseStream::add(const DataCollection& dc){
+  row();
+  sqlite3_bind_text(s_->insert_dc, 1, dc.name.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_dc, 2, dc.description.c_str(), -1,
+                    SQLITE_STATIC);
+  return named_id(s_->insert_dc, s_->select_dc, dc.name);
+}
+
+int DatabaseStream::add(const Application& app){
+  row();
+  sqlite3_bind_text(s_->insert_app, 1, app.name.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_app, 2, app.description.c_str(), -1,
+                    SQLITE_STATIC);
+  return named_id(s_->insert_app, s_->select_app, app.name);
+}
+
+int DatabaseStream::add(const Dataset& ds){
+  row();
+  sqlite3_bind_int(s_->insert_ds, 1, ds.applicationID);
+  sqlite3_bind_text(s_->insert_ds, 2, ds.name.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_ds, 3, ds.description.c_str(), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_ds, 4, ds.created.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_ds, 5, ds.url.c_str(), -1, SQLITE_STATIC);
+  return named_id(s_->insert_ds, s_->select_ds, ds.name);
+}
+
+int DatabaseStream::add(const Machine& ma){
+  row();
+  sqlite3_bind_text(s_->insert_ma, 1, ma.name.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_ma, 2, ma.description.c_str(), -1,
+                    SQLITE_STATIC);
+  return named_id(s_->insert_ma, s_->select_ma, ma.name);
+}
+
+int DatabaseStream::add(const Metric& me){
+  row();
+  sqlite3_bind_text(s_->insert_me, 1, metric_type_name(me.type), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_me, 2, me.name.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_me, 3, me.description.c_str(), -1,
+                    SQLITE_STATIC);
+  return named_id(s_->insert_me, s_->select_me, me.name);
+}
+
+int DatabaseStream::add(const Trial& trial){
+  row();
+  sqlite3_bind_int(s_->insert_trial, 1, trial.dataCollectionID);
+  sqlite3_bind_int(s_->insert_trial, 2, trial.machineID);
+  sqlite3_bind_int(s_->insert_trial, 3, trial.applicationID);
+  sqlite3_bind_int(s_->insert_trial, 4, trial.datasetID);
+  sqlite3_step(s_->insert_trial);
+  sqlite3_reset(s_->insert_trial);
+  return sqlite3_last_insert_rowid(s_->db);
+}
+
+void DatabaseStream::add(const NondeterministicMetric& ndmet){
+  row();
+  sqlite3_bind_int(s_->insert_ndm, 1, ndmet.trialID);
+  sqlite3_bind_int(s_->insert_ndm, 2, ndmet.metricID);
+  sqlite3_bind_double(s_->insert_ndm, 3, ndmet.value);
+  sqlite3_step(s_->insert_ndm);
+  sqlite3_reset(s_->insert_ndm);
+}
+
+void DatabaseStream::add(const DeterministicMetric& dmet){
+  row();
+  sqlite3_bind_int(s_->insert_dm, 1, dmet.datasetID);
+  sqlite3_bind_int(s_->insert_dm, 2, dmet.metricID);
+  sqlite3_bind_double(s_->insert_dm, 3, dmet.value);
+  sqlite3_step(s_->insert_dm);
+  sqlite3_reset(s_->insert_dm);
+}
+
+void DatabaseStream::add(const MachineMetric& mmet){
+  row();
+  sqlite3_bind_int(s_->insert_mm, 1, mmet.machineID);
+  sqlite3_bind_int(s_->insert_mm, 2, mmet.metricID);
+  sqlite3_bind_double(s_->insert_mm, 3, mmet.value);
+  sqlite3_step(s_->insert_mm);
+  sqlite3_reset(s_->insert_mm);
+}
+
+void DatabaseStream::ledger(){
+  if(!s_->ledgered){
+    create_ledger(s_->db);
+    s_->insert_log = prepare(s_->db, "INSERT OR REPLACE INTO loaded_logs"
+                                     "(hash, filename, status, databases, "
+                                     "loaded, records, prefix) "
+                                     "VALUES(?,?,?,?,datetime('now'),?,?)");
+    s_->delete_log = prepare(s_->db, "DELETE FROM loaded_logs WHERE hash=?");
+    s_->insert_run = prepare(s_->db, "INSERT INTO loaded_log_trials"
+                                     "(hash, first, last) VALUES(?,?,?)");
+    s_->delete_runs = prepare(s_->db, "DELETE FROM loaded_log_trials "
+                                      "WHERE hash=?");
+    s_->select_runs = prepare(s_->db, "SELECT first, last FROM "
+                                      "loaded_log_trials WHERE hash=? "
+                                      "ORDER BY first");
+    s_->ledgered = true;
+  }
+}
+
+void DatabaseStream::record(const LoadedLog& log){
+  ledger();
+  sqlite3_bind_text(s_->insert_log, 1, log.hash.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_log, 2, log.filename.c_str(), -1,
+                    SQLITE_STATIC);
+  sqlite3_bind_text(s_->insert_log, 3, log.status.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int(s_->insert_log, 4, log.databases);
+  sqlite3_bind_int64(s_->insert_log, 5, log.records);
+  sqlite3_bind_text(s_->insert_log, 6, log.prefix.c_str(), -1, SQLITE_STATIC);
+  sqlite3_step(s_->insert_log);
+  sqlite3_reset(s_->insert_log);
 
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO datacollections"
-                     "(name, description) VALUES(?,?)", 
-                     -1, &insert_statement, NULL);
-  sqlite3_prepare_v2(db,
-                     "SELECT ID FROM datacollections WHERE name=?",
-                     -1, &select_statement, NULL);
+  sqlite3_bind_text(s_->delete_runs, 1, log.hash.c_str(), -1, SQLITE_STATIC);
+  sqlite3_step(s_->delete_runs);
+  sqlite3_reset(s_->delete_runs);
+  for(const auto& run : log.trials){
+    sqlite3_bind_text(s_->insert_run, 1, log.hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(s_->insert_run, 2, run.first);
+    sqlite3_bind_int(s_->insert_run, 3, run.second);
+    sqlite3_step(s_->insert_run);
+    sqlite3_reset(s_->insert_run);
+  }
+}
+
+void DatabaseStream::track(const LoadedLog* log){
+  s_->tracked = log;
+}
+
+void DatabaseStream::unrecord(const string& hash){
+  ledger();
+  sqlite3_stmt* statements[] = { s_->delete_log, s_->delete_runs };
+  for(sqlite3_stmt* statement : statements){
+    sqlite3_bind_text(statement, 1, hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_step(statement);
+    sqlite3_reset(statement);
+  }
+}
+
+void DatabaseStream::erase(const string& hash){
+  sqlite3_stmt* delete_ndm = prepare(s_->db, "DELETE FROM "
+                                     "nondeterministic_metrics WHERE "
+                                     "trialID BETWEEN ? AND ?");
+  sqlite3_stmt* delete_trials = prepare(s_->db, "DELETE FROM trials WHERE "
+                                        "ID BETWEEN ? AND ?");
+  sqlite3_stmt* statements[] = { delete_ndm, delete_trials };
+  for(const auto& run : trials(hash)){
+    for(sqlite3_stmt* statement : statements){
+      sqlite3_bind_int(statement, 1, run.first);
+      sqlite3_bind_int(statement, 2, run.second);
+      sqlite3_step(statement);
+      sqlite3_reset(statement);
+    }
+  }
+  sqlite3_finalize(delete_ndm);
+  sqlite3_finalize(delete_trials);
+  unrecord(hash);
+}
+
+vector< pair<int,int> > DatabaseStream::trials(const string& hash){
+  ledger();
+  vector< pair<int,int> > runs;
+  sqlite3_bind_text(s_->select_runs, 1, hash.c_str(), -1, SQLITE_STATIC);
+  while(sqlite3_step(s_->select_runs) == SQLITE_ROW){
+    runs.push_back(make_pair(sqlite3_column_int(s_->select_runs, 0),
+                             sqlite3_column_int(s_->select_runs, 1)));
+  }
+  sqlite3_reset(s_->select_runs);
+  return runs;
+}
+
+void DatabaseStream::finish(){
+  if(s_->db == NULL) return;
+  if(s_->tracked != NULL) record(*s_->tracked);
+  close("COMMIT");
+}
+
+void DatabaseStream::rollback(){
+  if(s_->db == NULL) return;
+  close("ROLLBACK");
+}
+
+void DatabaseStream::close(const char* end){
+  sqlite3_stmt* statements[] = {
+    s_->insert_dc, s_->select_dc, s_->insert_app, s_->select_app,
+    s_->insert_ds, s_->select_ds, s_->insert_ma, s_->select_ma,
+    s_->insert_me, s_->select_me, s_->insert_trial, s_->insert_ndm,
+    s_->insert_dm, s_->insert_mm, s_->insert_log, s_->delete_log,
+    s_->insert_run, s_->delete_runs, s_->select_runs
+  };
+  for(sqlite3_stmt* statement : statements){
+    sqlite3_finalize(statement);
+  }
+  sqlite3_exec(s_->db, end, NULL, NULL, NULL);
+  sqlite3_close(s_->db);
+  s_->db = NULL;
+}
+
+/********
+ * Disconnect
+ */
+
+// Writes everything in one transaction; distinct as for DatabaseStream.
+static void write_all(const string& dbname,
+                      const vector<DataCollection>& datacollections,
+                      const vector<Application>& applications,
+                      const vector<Dataset>& datasets,
+                      const vector<Machine>& machines,
+                      const vector<Trial>& trials,
+                      const vector<Metric>& metrics,
+                      const vector<NondeterministicMetric>& nondet_metrics,
+                      const vector<DeterministicMetric>& det_metrics,
+                      const vector<MachineMetric>& machine_metrics,
+                      const vector<LoadedLog>& logs, bool distinct){
+  DatabaseStream stream(dbname, 0, distinct);
+  for(const auto& log : logs){
+    if(!log.replaces.empty()) stream.erase(log.replaces);
+  }
+
+  vector<int> dc_ids, machine_ids, app_ids, metric_ids, dataset_ids, trial_ids;
   for(const auto& dc : datacollections){
-    sqlite3_bind_text(insert_statement, 1, dc.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 2, dc.description.c_str(), -1, 
-                      SQLITE_STATIC);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-
-    sqlite3_bind_text(select_statement, 1, dc.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(select_statement);
-    dc_ids.push_back(sqlite3_column_int(select_statement, 0));
-    sqlite3_reset(select_statement);
+    dc_ids.push_back(stream.add(dc));
   }
-  sqlite3_finalize(insert_statement);
-  sqlite3_finalize(select_statement);
-
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO machines"
-                     "(name, description) VALUES(?,?)", 
-                     -1, &insert_statement, NULL);
-  sqlite3_prepare_v2(db,
-                     "SELECT ID FROM machines WHERE name=?",
-                     -1, &select_statement, NULL);
   for(const auto& ma : machines){
-    sqlite3_bind_text(insert_statement, 1, ma.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 2, ma.description.c_str(), -1, 
-                      SQLITE_STATIC);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-
-    sqlite3_bind_text(select_statement, 1, ma.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(select_statement);
-    machine_ids.push_back(sqlite3_column_int(select_statement, 0));
-    sqlite3_reset(select_statement);
+    machine_ids.push_back(stream.add(ma));
   }
-  sqlite3_finalize(insert_statement);
-  sqlite3_finalize(select_statement);
-
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO applications"
-                     "(name, description) VALUES(?,?)", 
-                     -1, &insert_statement, NULL);
-  sqlite3_prepare_v2(db,
-                     "SELECT ID FROM applications WHERE name=?",
-                     -1, &select_statement, NULL);
   for(const auto& ap : applications){
-    sqlite3_bind_text(insert_statement, 1, ap.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 2, ap.description.c_str(), -1, 
-                      SQLITE_STATIC);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-
-    sqlite3_bind_text(select_statement, 1, ap.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(select_statement);
-    app_ids.push_back(sqlite3_column_int(select_statement, 0));
-    sqlite3_reset(select_statement);
+    app_ids.push_back(stream.add(ap));
   }
-  sqlite3_finalize(insert_statement);
-  sqlite3_finalize(select_statement);
-
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO metrics"
-                     "(type, name, description) VALUES(?,?,?)", 
-                     -1, &insert_statement, NULL);
-  sqlite3_prepare_v2(db,
-                     "SELECT ID FROM metrics WHERE name=?",
-                     -1, &select_statement, NULL);
   for(const auto& me : metrics){
-    switch(me.type){
-      case DETERMINISTIC:
-        sqlite3_bind_text(insert_statement, 1, "deterministic", -1, SQLITE_STATIC);
-        break;
-      case NONDETERMINISTIC:
-        sqlite3_bind_text(insert_statement, 1, "nondeterministic", -1, SQLITE_STATIC);
-        break;
-      case MACHINE:
-        sqlite3_bind_text(insert_statement, 1, "machine", -1, SQLITE_STATIC);
-        break;
-      default:
-        throw "BAAAD metric type";
-    }
-    sqlite3_bind_text(insert_statement, 2, me.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 3, me.description.c_str(), -1, 
-                      SQLITE_STATIC);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-
-    sqlite3_bind_text(select_statement, 1, me.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(select_statement);
-    metric_ids.push_back(sqlite3_column_int(select_statement, 0));
-    sqlite3_reset(select_statement);
+    metric_ids.push_back(stream.add(me));
   }
-  sqlite3_finalize(insert_statement);
-  sqlite3_finalize(select_statement);
-
-  for(auto& dset : datasets){
-    dset.applicationID = app_ids[dset.applicationID];
-  }
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO datasets"
-                     "(applicationID, name, description, created, url) "
-                     "VALUES(?,?,?,?,?)", 
-                     -1, &insert_statement, NULL);
-  sqlite3_prepare_v2(db,
-                     "SELECT ID FROM datasets WHERE name=?",
-                     -1, &select_statement, NULL);
   for(const auto& ds : datasets){
-    sqlite3_bind_int(insert_statement, 1, ds.applicationID);
-    sqlite3_bind_text(insert_statement, 2, ds.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 3, ds.description.c_str(), -1, 
-                      SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 4, ds.created.c_str(), -1, 
-                      SQLITE_STATIC);
-    sqlite3_bind_text(insert_statement, 5, ds.url.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-
-    sqlite3_bind_text(select_statement, 1, ds.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(select_statement);
-    dataset_ids.push_back(sqlite3_column_int(select_statement, 0));
-    sqlite3_reset(select_statement);
+    Dataset dset = ds;
+    dset.applicationID = app_ids[dset.applicationID];
+    dataset_ids.push_back(stream.add(dset));
   }
-  sqlite3_finalize(insert_statement);
-  sqlite3_finalize(select_statement);
-
-  for(auto& mach_met : machine_metrics){
+  for(const auto& mm : machine_metrics){
+    MachineMetric mach_met = mm;
     mach_met.machineID = machine_ids[mach_met.machineID];
     mach_met.metricID = metric_ids[mach_met.metricID];
+    stream.add(mach_met);
   }
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO machine_metrics"
-                     "(machineID, metricID, metric) "
-                     "VALUES(?,?,?)", 
-                     -1, &insert_statement, NULL);
-  for(const auto& mmet : machine_metrics){
-    sqlite3_bind_int(insert_statement, 1, mmet.machineID);
-    sqlite3_bind_int(insert_statement, 2, mmet.metricID);
-    sqlite3_bind_double(insert_statement, 3, mmet.value);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-  }
-  sqlite3_finalize(insert_statement);
-
-  for(auto& trial : trials){
+  for(const auto& tr : trials){
+    Trial trial = tr;
     trial.dataCollectionID = dc_ids[trial.dataCollectionID];
     trial.machineID = machine_ids[trial.machineID];
     trial.applicationID = app_ids[trial.applicationID];
     trial.datasetID = dataset_ids[trial.datasetID];
+    trial_ids.push_back(stream.add(trial));
   }
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO trials"
-                     "(dataCollectionID, machineID, applicationID, datasetID) "
-                     "VALUES(?,?,?,?)", 
-                     -1, &insert_statement, NULL);
-  for(const auto& trial : trials){
-    sqlite3_bind_int(insert_statement, 1, trial.dataCollectionID);
-    sqlite3_bind_int(insert_statement, 2, trial.machineID);
-    sqlite3_bind_int(insert_statement, 3, trial.applicationID);
-    sqlite3_bind_int(insert_statement, 4, trial.datasetID);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-
-    trial_ids.push_back(sqlite3_last_insert_rowid(db));
-  }
-  sqlite3_finalize(insert_statement);
-
-  for(auto& ndm : nondet_metrics){
+  for(const auto& nd : nondet_metrics){
+    NondeterministicMetric ndm = nd;
     ndm.trialID = trial_ids[ndm.trialID];
     ndm.metricID = metric_ids[ndm.metricID];
+    stream.add(ndm);
   }
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO nondeterministic_metrics"
-                     "(trialID, metricID, metric) "
-                     "VALUES(?,?,?)", 
-                     -1, &insert_statement, NULL);
-  for(const auto& ndmet : nondet_metrics){
-    sqlite3_bind_int(insert_statement, 1, ndmet.trialID);
-    sqlite3_bind_int(insert_statement, 2, ndmet.metricID);
-    sqlite3_bind_double(insert_statement, 3, ndmet.value);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-  }
-  sqlite3_finalize(insert_statement);
-
-  for(auto& dm : det_metrics){
+  for(const auto& d : det_metrics){
+    DeterministicMetric dm = d;
     dm.datasetID = dataset_ids[dm.datasetID];
     dm.metricID = metric_ids[dm.metricID];
+    stream.add(dm);
   }
-  sqlite3_prepare_v2(db, 
-                     "INSERT OR IGNORE INTO deterministic_metrics"
-                     "(datasetID, metricID, metric) "
-                     "VALUES(?,?,?)", 
-                     -1, &insert_statement, NULL);
-  for(const auto& dmet : det_metrics){
-    sqlite3_bind_int(insert_statement, 1, dmet.datasetID);
-    sqlite3_bind_int(insert_statement, 2, dmet.metricID);
-    sqlite3_bind_double(insert_statement, 3, dmet.value);
-    sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
+  for(const auto& log : logs){
+    LoadedLog loaded = log;
+    loaded.trials.clear();
+    for(const auto& run : log.trials){
+      for(int k = run.first; k <= run.second; k++){
+        add_trial(loaded.trials, trial_ids[k]);
+      }
+    }
+    stream.record(loaded);
   }
-  sqlite3_finalize(insert_statement);
+  stream.finish();
+}
 
-  sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
-  sqlite3_close(db);
+void do_disconnect(const string& dbname, 
+                   const vector<DataCollection>& datacollections,
+                   const vector<Application>& applications,
+                   const vector<Dataset>& datasets,
+                   const vector<Machine>& machines,
+                   const vector<Trial>& trials,
+                   const vector<Metric>& metrics,
+                   const vector<NondeterministicMetric>& nondet_metrics,
+                   const vector<DeterministicMetric>& det_metrics,
+                   const vector<MachineMetric>& machine_metrics){
+  write_all(dbname, datacollections, applications, datasets, machines,
+            trials, metrics, nondet_metrics, det_metrics, machine_metrics,
+            vector<LoadedLog>(), false);
 }
 
-} // namespace eiger
+void do_disconnect(const string& dbname, 
+                   const vector<DataCollection>& datacollections,
+                   const vector<Application>& applications,
+                   const vector<Dataset>& datasets,
+                   const vector<Machine>& machines,
+                   const vector<Trial>& trials,
+                   const vector<Metric>& metrics,
+                   const vector<NondeterministicMetric>& nondet_metrics,
+                   const vector<DeterministicMetric>& det_metrics,
+                   const vector<MachineMetric>& machine_metrics,
+                   const vector<LoadedLog>& logs){
+  write_all(dbname, datacollections, applications, datasets, machines,
+            trials, metrics, nondet_metrics, det_metrics, machine_metrics,
+            logs, true);
+}
 
+} // namespace eiger
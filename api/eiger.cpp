@@ -34,6 +34,19 @@ namespace eiger{
                      const vector<NondeterministicMetric>& nondet_metrics,
                      const vector<DeterministicMetric>& det_metrics,
                      const vector<MachineMetric>& machine_metrics);
+
+  // Backends that record commits as they happen implement these; the others
+  // leave them empty. Only objects new to this connection are passed on.
+  void do_connect(const string& db);
+  void do_commit(const DataCollection& dc, int id);
+  void do_commit(const Application& app, int id);
+  void do_commit(const Dataset& ds, int id);
+  void do_commit(const Machine& ma, int id);
+  void do_commit(const Trial& tr, int id);
+  void do_commit(const Metric& me, int id);
+  void do_commit(const NondeterministicMetric& ndm);
+  void do_commit(const DeterministicMetric& dm);
+  void do_commit(const MachineMetric& mm);
   
   template<typename T>
   struct nameCompare{
@@ -93,6 +106,7 @@ namespace eiger{
 
 	void Connect(std::string database){
     db = database;
+    do_connect(db);
 	}
 
 	void Disconnect(){
@@ -124,6 +138,7 @@ namespace eiger{
     } else {
       ID = metrics.size();
       metrics.push_back(*this);
+      do_commit(metrics.back(), ID);
     }
     ecs = ecs_ok;
 	}
@@ -132,18 +147,21 @@ namespace eiger{
 
 	void NondeterministicMetric::commit() {
     nondet_metrics.push_back(*this);
+    do_commit(nondet_metrics.back());
 	}
 
 	DeterministicMetric::DeterministicMetric(DatasetID datasetID, MetricID metricID, double value) : datasetID(datasetID), metricID(metricID), value(value) {}
 
 	void DeterministicMetric::commit() {
     det_metrics.push_back(*this);
+    do_commit(det_metrics.back());
 	}
 
 	MachineMetric::MachineMetric(MachineID machineID, MetricID metricID, double value) : machineID(machineID), metricID(metricID), value(value) {}
 
 	void MachineMetric::commit() {
     machine_metrics.push_back(*this);
+    do_commit(machine_metrics.back());
 	}
 
 	Trial::Trial(DataCollectionID dataCollectionID, MachineID machineID,
@@ -154,6 +172,7 @@ namespace eiger{
 	void Trial::commit() {
     ID = trials.size();
     trials.push_back(*this);
+    do_commit(trials.back(), ID);
     ecs = ecs_ok;
 	}
 
@@ -168,6 +187,7 @@ namespace eiger{
     } else {
       ID = machines.size();
       machines.push_back(*this);
+      do_commit(machines.back(), ID);
     }
     ecs = ecs_ok;
 	}
@@ -186,6 +206,7 @@ namespace eiger{
     } else {
       ID = datasets.size();
       datasets.push_back(*this);
+      do_commit(datasets.back(), ID);
     }
     ecs = ecs_ok;
 	}
@@ -202,6 +223,7 @@ namespace eiger{
     } else {
       ID = applications.size();
       applications.push_back(*this);
+      do_commit(applications.back(), ID);
     }
     ecs = ecs_ok;
 	}
@@ -218,6 +240,7 @@ namespace eiger{
     } else {
       ID = datacollections.size();
       datacollections.push_back(*this);
+      do_commit(datacollections.back(), ID);
     }
     ecs = ecs_ok;
 	}
@@ -0,0 +1,101 @@
+/**********************************************************
+* Eiger Profile Exporter
+*
+* Writes a data collection of an Eiger database as CSV, or
+* as a .npy file of its columns, a trial at a time, so that
+* collections of any size can be handed to other tools.
+* Eiger.py dump uses it when it is installed.
+**********************************************************/
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "profileextract.h"
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [-f csv|npy] [-m metric,...] "
+            << "[-o file] database collection" << std::endl
+            << "  -f, --format   csv, the default, or npy, a NumPy array of "
+            << "the columns" << std::endl
+            << "                 in Fortran order" << std::endl
+            << "  -m, --metrics  metrics to write, in order, separated by "
+            << "commas; every" << std::endl
+            << "                 metric of the collection by default" << std::endl
+            << "  -o, --output   file to write to; CSV goes to standard "
+            << "output by default" << std::endl;
+}
+
+int main(int argc, char **argv){
+  static struct option longopts[] = {
+    {"format", required_argument, NULL, 'f'},
+    {"metrics", required_argument, NULL, 'm'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  std::string format = "csv";
+  std::string output;
+  std::vector<std::string> metrics;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "f:m:o:h", longopts, NULL)) != -1) {
+    switch (opt) {
+    case 'f':
+      format = optarg;
+      break;
+    case 'm': {
+      const std::string names = optarg;
+      size_t begin = 0;
+      for(size_t end; (end = names.find(',', begin)) != std::string::npos;
+          begin = end + 1)
+        metrics.push_back(names.substr(begin, end - begin));
+      metrics.push_back(names.substr(begin));
+      break;
+    }
+    case 'o':
+      output = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(argc - optind != 2 || (format != "csv" && format != "npy")){
+    usage(argv[0]);
+    return -1;
+  }
+  if(format == "npy" && output.empty()){
+    std::cerr << "Error: a .npy file needs --output" << std::endl;
+    return -1;
+  }
+  const std::string dbname = argv[optind];
+  const std::string collection = argv[optind + 1];
+
+  try{
+    if(format == "npy")
+      eiger::writeColumns(dbname, collection, metrics, output);
+    else if(output.empty()){
+      std::ios::sync_with_stdio(false);
+      eiger::writeCSV(dbname, collection, metrics, std::cout);
+      std::cout.flush();
+    }
+    else{
+      std::ofstream out(output.c_str(), std::ios::out | std::ios::trunc);
+      if(!out.is_open()){
+        std::cerr << "Error: unable to write " << output << std::endl;
+        return -1;
+      }
+      eiger::writeCSV(dbname, collection, metrics, out);
+    }
+  }
+  catch(const char* msg){
+    std::cerr << "Error: " << collection << ": " << msg << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**********************************************************
+* Eiger Profile Extractor
+*
+* Writes data collections of an Eiger database as NumPy
+* arrays, a row to each trial and a column to each metric,
+* with a JSON file of their metric, trial and application,
+* machine and dataset names beside each. Eiger.py maps the
+* arrays when given the directory in place of the database.
+**********************************************************/
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include "profileextract.h"
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [-o directory] database [collection...]"
+            << std::endl
+            << "  -o, --output  directory to write collection.npy and "
+            << "collection.json to;" << std::endl
+            << "                the current directory by default" << std::endl
+            << "Every data collection in the database is written unless some "
+            << "are named." << std::endl;
+}
+
+// writes with write to path, false if it couldn't
+template<class Write>
+bool write_file(const std::string& path, Write write){
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary |
+                    std::ios::trunc);
+  if(!out.is_open())
+    return false;
+  write(out);
+  out.close();
+  return !out.fail();
+}
+
+int main(int argc, char **argv){
+  static struct option longopts[] = {
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  std::string directory = ".";
+  int opt;
+  while ((opt = getopt_long(argc, argv, "o:h", longopts, NULL)) != -1) {
+    switch (opt) {
+    case 'o':
+      directory = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(optind == argc){
+    usage(argv[0]);
+    return -1;
+  }
+  const std::string dbname = argv[optind];
+  std::vector<std::string> collections(argv + optind + 1, argv + argc);
+
+  try{
+    if(collections.empty())
+      collections = eiger::dataCollections(dbname);
+  }
+  catch(const char* msg){
+    std::cerr << "Error: " << dbname << ": " << msg << std::endl;
+    return -1;
+  }
+  if(mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST){
+    std::cerr << "Error: unable to make " << directory << std::endl;
+    return -1;
+  }
+
+  for(size_t k = 0; k < collections.size(); ++k){
+    const std::string& name = collections[k];
+    if(name.empty() || name.find('/') != std::string::npos){
+      std::cerr << "Error: data collection \"" << name
+                << "\" can't be a file name" << std::endl;
+      return -1;
+    }
+    eiger::Profile profile;
+    try{
+      profile = eiger::extractProfile(dbname, name);
+    }
+    catch(const char* msg){
+      std::cerr << "Error: " << name << ": " << msg << std::endl;
+      return -1;
+    }
+    const std::string base = directory + "/" + name;
+    if(!write_file(base + ".npy", [&](std::ostream& out){
+         eiger::writeNpy(profile, out);
+       })){
+      std::cerr << "Error: unable to write " << base << ".npy" << std::endl;
+      return -1;
+    }
+    if(!write_file(base + ".json", [&](std::ostream& out){
+         eiger::writeMetadata(profile, name + ".npy", out);
+       })){
+      std::cerr << "Error: unable to write " << base << ".json" << std::endl;
+      return -1;
+    }
+    std::cout << name << ": " << profile.trials.size() << " trials, "
+              << profile.metrics.size() << " metrics" << std::endl;
+  }
+  return 0;
+}
@@ -11,223 +11,916 @@
 // C++ string includes
 #include <string>
 // STL includes
-#include <fstream>
-#include <sstream>
+#include <algorithm>
 #include <map>
+#include <set>
 #include <vector>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
 
-#include "fakekeywords.h" 
+#include "fakelog.h"
 #include "eiger.h"
+#include "dbstream.h"
+#include "ledger.h"
+
+void report(const std::string& filename, eiger::log_status_t status) {
+  if (status == eiger::LOG_MISSING) {
+    std::cerr << "unable to open " << filename << "\n";
+  } else if (status == eiger::LOG_TRUNCATED) {
+    std::cerr << "warning: " << filename << " was cut short; "
+              << "loading every complete record\n";
+  }
+}
 
-static const int version = 2;
-
-enum dispatch {
-  Metric,
-  Metric_commit,
-  DataCollection,
-  DataCollection_commit,
-  Application,
-  Application_commit,
-  Dataset,
-  Dataset_commit,
-  Machine,
-  Machine_commit,
-  Trial,
-  Trial_commit,
-  MachineMetric,
-  MachineMetric_commit,
-  DeterministicMetric,
-  DeterministicMetric_commit,
-  NondeterministicMetric,
-  NondeterministicMetric_commit,
-  CONNECT,
-  LVERSION,
-  LFORMAT,
-  DISCONNECT
+/********
+ * Merging
+ */
+
+// Accumulates sessions bound for one database into a single global ID space.
+// Named objects are deduplicated by name, first definition wins, exactly as
+// repeated commits are resolved within a single run.
+struct Merge {
+  eiger::Session all;
+  std::map<std::string,int> dc_index, app_index, ds_index, machine_index,
+                            metric_index;
 };
 
-std::map<std::string,dispatch> domap;
+static int remap(const std::vector<int>& ids, int local) {
+  if (local < 0 || local >= (int)ids.size()) {
+    throw "fakeeiger log references an undefined ID.";
+  }
+  return ids[local];
+}
 
-double toDouble(std::string s) {
-  std::istringstream is(s);
-  double i;
-  is >> i;
-  return i;
+template<typename T>
+static std::vector<int> mergeNamed(const std::vector<T>& local,
+                                   std::vector<T>& global,
+                                   std::map<std::string,int>& index) {
+  std::vector<int> ids;
+  ids.reserve(local.size());
+  for (const auto& obj : local) {
+    std::map<std::string,int>::iterator it = index.find(obj.name);
+    if (it == index.end()) {
+      it = index.insert(std::make_pair(obj.name, (int)global.size())).first;
+      global.push_back(obj);
+    }
+    ids.push_back(it->second);
+  }
+  return ids;
 }
 
-int toInt(std::string s) {
-  std::istringstream is(s);
-  int i;
-  is >> i;
-  return i;
+void mergeSession(const eiger::Session& s, Merge& m) {
+  eiger::Session& all = m.all;
+  std::vector<int> dc_ids = mergeNamed(s.datacollections, all.datacollections,
+                                       m.dc_index);
+  std::vector<int> app_ids = mergeNamed(s.applications, all.applications,
+                                        m.app_index);
+  std::vector<int> machine_ids = mergeNamed(s.machines, all.machines,
+                                            m.machine_index);
+  std::vector<int> metric_ids = mergeNamed(s.metrics, all.metrics,
+                                           m.metric_index);
+
+  std::vector<eiger::Dataset> datasets = s.datasets;
+  for (auto& ds : datasets) {
+    ds.applicationID = remap(app_ids, ds.applicationID);
+  }
+  std::vector<int> ds_ids = mergeNamed(datasets, all.datasets, m.ds_index);
+
+  // trials are never shared between sessions
+  int trial_offset = all.trials.size();
+  for (const auto& tr : s.trials) {
+    all.trials.push_back(tr);
+    eiger::Trial& t = all.trials.back();
+    t.dataCollectionID = remap(dc_ids, t.dataCollectionID);
+    t.machineID = remap(machine_ids, t.machineID);
+    t.applicationID = remap(app_ids, t.applicationID);
+    t.datasetID = remap(ds_ids, t.datasetID);
+  }
+  for (const auto& ndm : s.nondet_metrics) {
+    if (ndm.trialID < 0 || ndm.trialID >= (int)s.trials.size()) {
+      throw "fakeeiger log references an undefined ID.";
+    }
+    all.nondet_metrics.push_back(ndm);
+    all.nondet_metrics.back().trialID += trial_offset;
+    all.nondet_metrics.back().metricID = remap(metric_ids, ndm.metricID);
+  }
+  for (const auto& dm : s.det_metrics) {
+    all.det_metrics.push_back(dm);
+    all.det_metrics.back().datasetID = remap(ds_ids, dm.datasetID);
+    all.det_metrics.back().metricID = remap(metric_ids, dm.metricID);
+  }
+  for (const auto& mm : s.machine_metrics) {
+    all.machine_metrics.push_back(mm);
+    all.machine_metrics.back().machineID = remap(machine_ids, mm.machineID);
+    all.machine_metrics.back().metricID = remap(metric_ids, mm.metricID);
+  }
 }
 
-void one(std::string s) {
-  std::vector<std::string> v;
-  if (s.size()==0 ) return;
-  std::stringstream sstream{s};
-  std::string elem;
-  while(std::getline(sstream, elem, ';')){
-    v.push_back(elem);
-  }
-  dispatch d;
-  if (domap.find(v[0]) != domap.end()) {
-    d = domap[v[0]];
-  } else {
-    std::cerr << "unknown fakeeiger keyword "<< v[0] << "\n";
-    return;
-  }
-  // we will merrily assume enough and correct args
-  switch (d) {
-  case CONNECT:
-    eiger::Connect(v[1]);
-    break;
-  case DISCONNECT:
-    eiger::Disconnect();
-    break;
-  case LVERSION:
-    {
-      int filever = toInt(v[1]);
-      if (filever != version) {
-        std::cout << "VERSION: " << version <<" != " << filever <<"\n";
-        throw "fakeeiger log file version mismatch.";
-      }
-    }
-    break;
-  case LFORMAT:
-    {
-      if (v[1] != KWFORMAT) {
-        std::cout << FEFORMAT ": " << v[1] <<" does not match compiled in format " KWFORMAT "\n";
-        throw "fakeeiger log file format mismatch.";
-      }
-    }
-    break;
-  /* this batch don't really need to do anything yet. ctors. */
-  case DataCollection:
-  case Application:
-  case Dataset:
-  case Machine:
-  case Trial:
-  case MachineMetric:
-  case DeterministicMetric:
-  case NondeterministicMetric:
-  case Metric:
-    break;
-  /* these do something */
-  case DataCollection_commit:
-    eiger::DataCollection(v[1], v[2]).commit();
-    break;
-  case Application_commit:
-    eiger::Application(v[1], v[2]).commit();
-    break;
-  case Dataset_commit:
-    {
-      eiger::ApplicationID ai(toInt(v[1]),0);
-      eiger::Dataset(ai, v[2], v[3], v[4]).commit();
-    }
-    break;
-  case Machine_commit:
-    eiger::Machine(v[1], v[2]).commit();
-    break;
-  case Trial_commit:
-    {
-      eiger::DataCollectionID dci(toInt(v[1]),0);
-      eiger::MachineID mi(toInt(v[2]),0);
-      eiger::ApplicationID ai(toInt(v[3]),0);
-      eiger::DatasetID dsi(toInt(v[4]),0);
-      eiger::Trial(dci,mi,ai,dsi).commit();
-    }
-    break;
-  case MachineMetric_commit:
-    {
-      eiger::MachineID mai(toInt(v[1]),0);
-      eiger::MetricID mi(toInt(v[2]),0);
-      eiger::MachineMetric(mai,mi,toDouble(v[3])).commit();
-    }
-    break;
-  case DeterministicMetric_commit:
-    {
-      eiger::DatasetID dsi(toInt(v[1]),0);
-      eiger::MetricID mi(toInt(v[2]),0);
-      eiger::DeterministicMetric(dsi,mi,toDouble(v[3])).commit();
-    }
-    break;
-  case NondeterministicMetric_commit:
-    {
-      eiger::TrialID ti(toInt(v[1]),0);
-      eiger::MetricID mi(toInt(v[2]),0);
-      eiger::NondeterministicMetric(ti,mi,toDouble(v[3])).commit();
-    }
-    break;
-  case Metric_commit:
-    eiger::metric_type_t type;
-    if(v[1].compare("deterministic") == 0) type = eiger::DETERMINISTIC;
-    else if(v[1].compare("nondeterministic") == 0) type = eiger::NONDETERMINISTIC;
-    else if(v[1].compare("machine") == 0) type = eiger::MACHINE;
-    else throw "unexpected metric commit type";
-
-    eiger::Metric(type,v[2],v[3]).commit();
-    break;
-  default:
-    throw "unexpected enum value in one() handling";
-  } // end switch
-} // end one()
-
-void parse(std::vector<std::string> filenames) {
-  std::string line;
+/********
+ * Ledger
+ */
+
+static const unsigned long long fnv_basis = 14695981039346656037ULL;
+
+static unsigned long long fnv1a(unsigned long long h, const char* bytes,
+                                size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    h = (h ^ (unsigned char)bytes[k]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// FNV-1a over the bytes of a log as stored, compressed or not, followed by
+// its length. Empty if the file can't be read.
+static std::string hashFile(const std::string& filename) {
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!in.is_open()) return "";
+  unsigned long long h = fnv_basis, length = 0;
+  std::vector<char> buf(1 << 20);
+  while (in) {
+    in.read(&buf[0], buf.size());
+    std::streamsize n = in.gcount();
+    h = fnv1a(h, &buf[0], n);
+    length += n;
+  }
+  char hash[48];
+  snprintf(hash, sizeof(hash), "%016llx-%llu", h, length);
+  return hash;
+}
+
+// The database a log first connects to, reading it no further than that
+// CONNECT; empty if it has none or can't be read.
+static std::string firstDatabase(const std::string& filename) {
+  struct Found { std::string db; };
+  struct FirstConnect : public eiger::Sink {
+    void connect(const std::string& db) { throw Found{db}; }
+    void disconnect() {}
+    void add(const eiger::DataCollection&) {}
+    void add(const eiger::Application&) {}
+    void add(const eiger::Dataset&) {}
+    void add(const eiger::Machine&) {}
+    void add(const eiger::Trial&) {}
+    void add(const eiger::Metric&) {}
+    void add(const eiger::NondeterministicMetric&) {}
+    void add(const eiger::DeterministicMetric&) {}
+    void add(const eiger::MachineMetric&) {}
+  } sink;
+  try {
+    eiger::parseFile(filename, sink);
+  } catch (const Found& found) {
+    return found.db;
+  }
+  return "";
+}
+
+// How far a log has been read for one database: how many of its records,
+// and an FNV-1a hash of them, which tells a log that has grown since part of
+// it was loaded from one that was rewritten. The same in either format.
+class Position {
+  public:
+    Position() : records(0), h(fnv_basis) {}
+
+    void add(const eiger::DataCollection& dc) {
+      tag('C'); mix(dc.name); mix(dc.description);
+    }
+    void add(const eiger::Application& app) {
+      tag('A'); mix(app.name); mix(app.description);
+    }
+    void add(const eiger::Dataset& ds) {
+      tag('D'); mix(ds.applicationID); mix(ds.name); mix(ds.description);
+      mix(ds.url);
+    }
+    void add(const eiger::Machine& ma) {
+      tag('F'); mix(ma.name); mix(ma.description);
+    }
+    void add(const eiger::Trial& tr) {
+      tag('T'); mix(tr.dataCollectionID); mix(tr.machineID);
+      mix(tr.applicationID); mix(tr.datasetID);
+    }
+    void add(const eiger::Metric& me) {
+      tag('M'); mix((int)me.type); mix(me.name); mix(me.description);
+    }
+    void add(const eiger::NondeterministicMetric& ndm) {
+      tag('N'); mix(ndm.trialID); mix(ndm.metricID); mix(ndm.value);
+    }
+    void add(const eiger::DeterministicMetric& dm) {
+      tag('E'); mix(dm.datasetID); mix(dm.metricID); mix(dm.value);
+    }
+    void add(const eiger::MachineMetric& mm) {
+      tag('X'); mix(mm.machineID); mix(mm.metricID); mix(mm.value);
+    }
+
+    std::string hash() const {
+      char text[17];
+      snprintf(text, sizeof(text), "%016llx", h);
+      return text;
+    }
+
+    long long records;
+
+  private:
+    unsigned long long h;
+
+    void tag(char t) { records++; h = fnv1a(h, &t, 1); }
+    void mix(int x) { h = fnv1a(h, (const char*)&x, sizeof(x)); }
+    void mix(double x) { h = fnv1a(h, (const char*)&x, sizeof(x)); }
+    void mix(const std::string& s) {
+      mix((int)s.size());
+      h = fnv1a(h, s.data(), s.size());
+    }
+};
+
+// Passes a log on to another sink, keeping its Position for each database.
+class Tally : public eiger::Sink {
+  public:
+    std::map<std::string,Position> positions;
+
+    Tally(eiger::Sink& sink) : sink(sink), current(NULL) {}
+
+    void connect(const std::string& db) {
+      sink.connect(db);
+      current = &positions[db];
+    }
+    void disconnect() { sink.disconnect(); current = NULL; }
+    void add(const eiger::DataCollection& dc) { pass(dc); }
+    void add(const eiger::Application& app) { pass(app); }
+    void add(const eiger::Dataset& ds) { pass(ds); }
+    void add(const eiger::Machine& ma) { pass(ma); }
+    void add(const eiger::Trial& tr) { pass(tr); }
+    void add(const eiger::Metric& me) { pass(me); }
+    void add(const eiger::NondeterministicMetric& ndm) { pass(ndm); }
+    void add(const eiger::DeterministicMetric& dm) { pass(dm); }
+    void add(const eiger::MachineMetric& mm) { pass(mm); }
+
+  private:
+    eiger::Sink& sink;
+    Position* current;
+
+    // the sink rejects records outside of a session before they are counted
+    template<typename T>
+    void pass(const T& record) {
+      sink.add(record);
+      current->add(record);
+    }
+};
+
+// What loading a log into a database comes to.
+enum Action {
+  LOAD,    // the database has none of it
+  SKIP,    // it has all of it
+  RESUME,  // it has the start of it: load the rest
+  REPLACE  // -f: remove what it has, then load all of it
+};
+
+// The ledgers of the databases this run writes to, read on first use and
+// kept up to date as logs are added to the load.
+class Ledger {
+  public:
+    Ledger(bool force) : force_(force) {}
+
+    // What to do with the log in db, after saying why if it is skipped.
+    // earlier is set to the earlier load of the log, if there is one: with
+    // the same hash, or unfinished and of the same file, which may have
+    // grown since.
+    Action check(const std::string& db, const std::string& filename,
+                 const std::string& hash, eiger::LoadedLog& earlier) {
+      std::map<std::string,eiger::LoadedLog>& ledger = of(db);
+      std::map<std::string,eiger::LoadedLog>::const_iterator it =
+        ledger.find(hash);
+      for (std::map<std::string,eiger::LoadedLog>::const_iterator other =
+             ledger.begin(); it == ledger.end() && other != ledger.end();
+           ++other) {
+        if (other->second.filename == filename &&
+            other->second.status != "complete") {
+          it = other;
+        }
+      }
+      if (it == ledger.end()) return LOAD;
+      earlier = it->second;
+      // a second copy of a log in this run is skipped, even with -f
+      if (added_.count(std::make_pair(db, earlier.hash)) ||
+          (!force_ && earlier.hash == hash && earlier.status != "partial")) {
+        std::cout << "skipping " << filename << ", already loaded into " << db
+                  << "\n";
+        return SKIP;
+      }
+      if (force_) return REPLACE;
+      if (earlier.prefix.empty()) {
+        std::cerr << "warning: skipping " << filename << ", an older "
+                  << "eiger-loader left it partly loaded into " << db
+                  << " without saying how far\n";
+        return SKIP;
+      }
+      return RESUME;
+    }
+    // true if the log was loaded into db, the first database it writes to,
+    // and writes to no other, so it need not even be parsed. May be called
+    // from several threads at once while nothing is being added.
+    bool loadedWhole(const std::string& hash, const std::string& db) {
+      if (force_ || db.empty()) return false;
+      std::lock_guard<std::mutex> lock(read_);
+      const std::map<std::string,eiger::LoadedLog>& ledger = of(db);
+      std::map<std::string,eiger::LoadedLog>::const_iterator it =
+        ledger.find(hash);
+      return it != ledger.end() && it->second.databases == 1;
+    }
+    // Adds log, in place of the load it replaces.
+    void add(const std::string& db, const eiger::LoadedLog& log) {
+      std::map<std::string,eiger::LoadedLog>& ledger = of(db);
+      if (!log.replaces.empty()) ledger.erase(log.replaces);
+      eiger::LoadedLog& entry = ledger[log.hash] = log;
+      entry.trials.clear();
+      added_.insert(std::make_pair(db, log.hash));
+    }
+
+  private:
+    bool force_;
+    std::map<std::string, std::map<std::string,eiger::LoadedLog> > ledgers_;
+    std::set< std::pair<std::string,std::string> > added_; // (db, hash)
+    std::mutex read_; // guards ledgers_ being read by loadedWhole
+
+    std::map<std::string,eiger::LoadedLog>& of(const std::string& db) {
+      std::map<std::string, std::map<std::string,eiger::LoadedLog> >::iterator
+        it = ledgers_.find(db);
+      if (it == ledgers_.end()) {
+        it = ledgers_.insert(std::make_pair(db, eiger::loaded_logs(db))).first;
+      }
+      return it->second;
+    }
+};
+
+/********
+ * Loading
+ */
+
+// The databases being written and the logs going into each.
+struct Load {
+  std::vector<std::string> dbs; // in order of first appearance
+  std::map<std::string,Merge> merges;
+  std::map<std::string, std::vector<eiger::LoadedLog> > logs;
+};
+
+// Adds the sessions of one parsed log to load, except those for databases
+// whose ledger already has the log. false, having added nothing, if the log
+// is to resume an earlier load instead, which only a StreamSink can do.
+static bool addLog(const std::string& filename, const std::string& hash,
+                   eiger::log_status_t status, const eiger::SessionSink& parsed,
+                   const std::map<std::string,Position>& positions,
+                   Ledger& ledger, Load& load) {
+  std::vector<std::string> dbs;
+  for (const auto& s : parsed.sessions) {
+    if (std::find(dbs.begin(), dbs.end(), s.db) == dbs.end()) {
+      dbs.push_back(s.db);
+    }
+  }
+  std::vector<Action> actions;
+  std::vector<eiger::LoadedLog> earlier(dbs.size());
+  for (size_t k = 0; k < dbs.size(); k++) {
+    actions.push_back(ledger.check(dbs[k], filename, hash, earlier[k]));
+    if (actions.back() == RESUME) return false;
+  }
+  for (size_t k = 0; k < dbs.size(); k++) {
+    const std::string& db = dbs[k];
+    if (actions[k] == SKIP) continue;
+    if (load.merges.find(db) == load.merges.end()) {
+      load.dbs.push_back(db);
+      load.merges[db].all.db = db;
+    }
+    eiger::LoadedLog log;
+    log.hash = hash;
+    log.filename = filename;
+    log.status = status == eiger::LOG_TRUNCATED ? "truncated" : "complete";
+    log.databases = dbs.size();
+    const Position& position = positions.find(db)->second;
+    log.records = position.records;
+    log.prefix = position.hash();
+    if (actions[k] == REPLACE) log.replaces = earlier[k].hash;
+    // its trials are the ones merged now, after those of the logs before it
+    std::vector<eiger::Trial>& trials = load.merges[db].all.trials;
+    int first = trials.size();
+    for (const auto& s : parsed.sessions) {
+      if (s.db == db) mergeSession(s, load.merges[db]);
+    }
+    if ((int)trials.size() > first) {
+      log.trials.push_back(std::make_pair(first, (int)trials.size() - 1));
+    }
+    load.logs[db].push_back(log);
+    // so that another copy of the same log in this run is skipped too
+    ledger.add(db, log);
+  }
+  return true;
+}
+
+// Write every database of load, recording its logs in the same transaction.
+static void write(Load& load) {
+  for (const auto& db : load.dbs) {
+    const eiger::Session& all = load.merges[db].all;
+    std::cout << "writing " << all.trials.size() << " trials to " << db
+              << std::endl;
+    eiger::do_disconnect(db, all.datacollections, all.applications,
+                         all.datasets, all.machines, all.trials, all.metrics,
+                         all.nondet_metrics, all.det_metrics,
+                         all.machine_metrics, load.logs[db]);
+  }
+}
+
+static void streamFile(const std::string& filename, const std::string& hash,
+                       Ledger& ledger, size_t chunk);
+
+// Load the files one at a time, each with its own transaction, so that an
+// interrupted load picks up at the first file it had not finished. The parsed
+// sessions go straight to do_disconnect, which eiger::Disconnect would have
+// called with the same lists had the records been replayed through the API:
+// the log holds each named object once, with the ID the API gave it.
+void parse(const std::vector<std::string>& filenames, Ledger& ledger) {
   std::vector< std::string>::size_type nf = filenames.size();
   std::cout << "Parsing " << nf << " logs" << std::endl;
   for (std::vector< std::string>::size_type i = 0; i < nf; i++) {
-    std::ifstream myfile (filenames[i].c_str());
-    if (myfile.is_open())
-    {
-      std::cout << "parsing " << filenames[i] <<"\n";
-      while ( myfile.good() )
-      {
-        getline (myfile,line);
-        one(line);
+    std::string hash = hashFile(filenames[i]);
+    if (hash.empty()) {
+      report(filenames[i], eiger::LOG_MISSING);
+      continue;
+    }
+    if (ledger.loadedWhole(hash, firstDatabase(filenames[i]))) {
+      std::cout << "skipping " << filenames[i] << ", already loaded\n";
+      continue;
+    }
+    std::cout << "parsing " << filenames[i] <<"\n";
+    eiger::SessionSink parsed;
+    Tally tally(parsed);
+    eiger::log_status_t status = eiger::parseFile(filenames[i], tally);
+    Load load;
+    if (addLog(filenames[i], hash, status, parsed, tally.positions, ledger,
+               load)) {
+      report(filenames[i], status);
+      write(load);
+    } else {
+      streamFile(filenames[i], hash, ledger, 0);
+    }
+  }
+}
+
+// Parse all files on a pool of nthreads workers, merge their sessions in file
+// order and write each target database with a single bulk insert. Logs that
+// resume an earlier load are streamed afterwards.
+void parseMerged(const std::vector<std::string>& filenames, unsigned nthreads,
+                 Ledger& ledger) {
+  std::vector< std::string>::size_type nf = filenames.size();
+  std::cout << "Parsing " << nf << " logs on " << nthreads << " threads"
+            << std::endl;
+  std::vector<eiger::SessionSink> parsed(nf);
+  std::vector< std::map<std::string,Position> > positions(nf);
+  std::vector<std::string> hashes(nf);
+  std::vector<std::exception_ptr> errors(nf);
+  std::vector<eiger::log_status_t> status(nf, eiger::LOG_MISSING);
+  // logs the ledger already has whole are neither parsed nor kept
+  std::vector<char> loaded(nf, 0);
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < nf; i = next++) {
+      try {
+        hashes[i] = hashFile(filenames[i]);
+        if (!hashes[i].empty() &&
+            ledger.loadedWhole(hashes[i], firstDatabase(filenames[i]))) {
+          loaded[i] = 1;
+        } else if (!hashes[i].empty()) {
+          Tally tally(parsed[i]);
+          status[i] = eiger::parseFile(filenames[i], tally);
+          positions[i].swap(tally.positions);
+        }
+      } catch (...) {
+        errors[i] = std::current_exception();
       }
-      myfile.close();
     }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < nthreads; t++) {
+    pool.push_back(std::thread(worker));
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+
+  Load load;
+  std::vector<size_t> resumed;
+  for (size_t i = 0; i < nf; i++) {
+    if (errors[i]) {
+      std::cerr << "failed parsing " << filenames[i] << "\n";
+      std::rethrow_exception(errors[i]);
+    }
+    if (loaded[i]) {
+      std::cout << "skipping " << filenames[i] << ", already loaded\n";
+    } else if (status[i] == eiger::LOG_MISSING) {
+      report(filenames[i], status[i]);
+    } else if (addLog(filenames[i], hashes[i], status[i], parsed[i],
+                      positions[i], ledger, load)) {
+      report(filenames[i], status[i]);
+    } else {
+      resumed.push_back(i);
+    }
+    // release the per-file copy as soon as it is merged
+    std::vector<eiger::Session>().swap(parsed[i].sessions);
+  }
+  write(load);
+  for (size_t i : resumed) {
+    streamFile(filenames[i], hashes[i], ledger, 0);
   }
 }
 
-// set up a hash map to convert switching over strings into switching on enum.
-void initmaps() {
-  domap[DATACOLLECTION_COMMIT] =DataCollection_commit;
-  domap[DATACOLLECTION] =DataCollection;
-  domap[APPLICATION_COMMIT] =Application_commit;
-  domap[APPLICATION] =Application;
-  domap[DATASET_COMMIT] =Dataset_commit;
-  domap[DATASET] =Dataset;
-  domap[FEMACHINE_COMMIT] =Machine_commit;
-  domap[FEMACHINE] =Machine;
-  domap[TRIAL_COMMIT] =Trial_commit;
-  domap[TRIAL] =Trial;
-  domap[MACHINEMETRIC_COMMIT]=MachineMetric_commit;
-  domap[MACHINEMETRIC]=MachineMetric;
-  domap[DETERMINISTICMETRIC_COMMIT]=DeterministicMetric_commit;
-  domap[DETERMINISTICMETRIC]=DeterministicMetric;
-  domap[NONDETERMINISTICMETRIC_COMMIT]=NondeterministicMetric_commit;
-  domap[NONDETERMINISTICMETRIC]=NondeterministicMetric;
-  domap[METRIC_COMMIT]=Metric_commit;
-  domap[FEMETRIC]=Metric;
-  domap[FECONNECT]=CONNECT;
-  domap[FEDISCONNECT]=DISCONNECT;
-  domap[FEVERSION]=LVERSION;
-  domap[FEFORMAT]=LFORMAT;
+/********
+ * Streaming
+ */
+
+// rows per transaction of a streaming load
+static const size_t stream_chunk = 1000000;
+
+// Database IDs of the trials of one session, by local ID. sqlite hands out
+// consecutive rowids, so they are kept as runs of consecutive IDs; a session
+// is usually a single run however many trials it has.
+class TrialIds {
+  public:
+    TrialIds() : count_(0) {}
+
+    void push_back(int id) {
+      if (runs_.empty() ||
+          runs_.back().second + (count_ - runs_.back().first) != id) {
+        runs_.push_back(std::make_pair(count_, id));
+      }
+      count_++;
+    }
+    int operator[](int local) const {
+      if (local < 0 || local >= count_) {
+        throw "fakeeiger log references an undefined ID.";
+      }
+      std::vector< std::pair<int,int> >::const_iterator run =
+        std::upper_bound(runs_.begin(), runs_.end(),
+                         std::make_pair(local, INT_MAX)) - 1;
+      return run->second + (local - run->first);
+    }
+    void clear() { runs_.clear(); count_ = 0; }
+
+  private:
+    std::vector< std::pair<int,int> > runs_; // (first local ID, its database ID)
+    int count_;
+};
+
+// Writes the records of one log straight into the databases it names as
+// they are parsed. Only the IDs of named objects are held in memory, so
+// memory grows with the number of distinct names rather than with the log.
+//
+// A log whose earlier load stopped part way, because the load was
+// interrupted or the log was still being written, is resumed: its first
+// records are read again but not written, their trials taking the IDs the
+// ledger has for them, until the records loaded before are passed. Those
+// must hash the same as they did, or the database is left as it was.
+class StreamSink : public eiger::Sink {
+  public:
+    StreamSink(const std::string& filename, const std::string& hash,
+               Ledger& ledger, size_t chunk)
+      : filename(filename), hash(hash), ledger(&ledger), chunk(chunk),
+        current(NULL), open(false) {}
+
+    void connect(const std::string& db) {
+      resetIds();
+      open = true;
+      std::map<std::string,Target>::iterator it = targets.find(db);
+      if (it == targets.end()) {
+        dbs.push_back(db);
+        it = targets.insert(std::make_pair(db, Target())).first;
+        start(db, it->second);
+      }
+      current = &it->second;
+    }
+    void disconnect() {
+      session();
+      resetIds();
+      open = false;
+      current = NULL;
+    }
+    void add(const eiger::DataCollection& dc) {
+      if (!session()) return;
+      dc_ids.push_back(current->stream->add(dc));
+      advance(dc);
+    }
+    void add(const eiger::Application& app) {
+      if (!session()) return;
+      app_ids.push_back(current->stream->add(app));
+      advance(app);
+    }
+    void add(const eiger::Dataset& ds) {
+      if (!session()) return;
+      eiger::Dataset dset = ds;
+      dset.applicationID = remap(app_ids, dset.applicationID);
+      ds_ids.push_back(current->stream->add(dset));
+      advance(ds);
+    }
+    void add(const eiger::Machine& ma) {
+      if (!session()) return;
+      machine_ids.push_back(current->stream->add(ma));
+      advance(ma);
+    }
+    void add(const eiger::Trial& tr) {
+      if (!session()) return;
+      int id;
+      if (skipping()) {
+        id = earlierTrial(*current);
+        if (id < 0) {
+          abandon(*current);
+          return;
+        }
+      } else {
+        eiger::Trial trial = tr;
+        trial.dataCollectionID = remap(dc_ids, trial.dataCollectionID);
+        trial.machineID = remap(machine_ids, trial.machineID);
+        trial.applicationID = remap(app_ids, trial.applicationID);
+        trial.datasetID = remap(ds_ids, trial.datasetID);
+        id = current->stream->add(trial);
+        eiger::add_trial(current->log.trials, id);
+      }
+      trial_ids.push_back(id);
+      advance(tr);
+    }
+    void add(const eiger::Metric& me) {
+      if (!session()) return;
+      metric_ids.push_back(current->stream->add(me));
+      advance(me);
+    }
+    void add(const eiger::NondeterministicMetric& ndm) {
+      if (!session()) return;
+      if (!skipping()) {
+        eiger::NondeterministicMetric m = ndm;
+        m.trialID = trial_ids[m.trialID];
+        m.metricID = remap(metric_ids, m.metricID);
+        current->stream->add(m);
+      }
+      advance(ndm);
+    }
+    void add(const eiger::DeterministicMetric& dm) {
+      if (!session()) return;
+      if (!skipping()) {
+        eiger::DeterministicMetric m = dm;
+        m.datasetID = remap(ds_ids, m.datasetID);
+        m.metricID = remap(metric_ids, m.metricID);
+        current->stream->add(m);
+      }
+      advance(dm);
+    }
+    void add(const eiger::MachineMetric& mm) {
+      if (!session()) return;
+      if (!skipping()) {
+        eiger::MachineMetric m = mm;
+        m.machineID = remap(machine_ids, m.machineID);
+        m.metricID = remap(metric_ids, m.metricID);
+        current->stream->add(m);
+      }
+      advance(mm);
+    }
+
+    // Records the log as loaded with the given status and commits.
+    void finish(eiger::log_status_t status) {
+      for (const auto& db : dbs) {
+        Target& t = targets[db];
+        if (t.stream == NULL) continue;
+        // the log is now shorter than what was loaded from it
+        if (t.position.records < t.skip) {
+          abandon(t);
+          continue;
+        }
+        t.log.status = status == eiger::LOG_TRUNCATED ? "truncated"
+                                                      : "complete";
+        t.log.databases = dbs.size();
+        t.stream->track(NULL);
+        t.stream->record(t.log);
+        t.stream->finish();
+        ledger->add(db, t.log);
+      }
+    }
+
+    ~StreamSink() {
+      // commits what was written, with the ledger saying how far it got
+      for (auto& target : targets) {
+        delete target.second.stream;
+      }
+    }
+
+  private:
+    // The load of the log into one database.
+    struct Target {
+      std::string db;
+      eiger::DatabaseStream* stream; // NULL if the log is not loaded into it
+      eiger::LoadedLog log;          // as much of it as has been written
+      Position position;             // of the records read for db so far
+      long long skip;                // records an earlier load wrote
+      std::string expected;          // their hash
+      size_t run;                    // the next of them to take an ID from
+      int offset;                    // log.trials, as (run, offset in it)
+
+      Target() : stream(NULL), skip(0), run(0), offset(0) {}
+    };
+
+    std::string filename, hash;
+    Ledger* ledger;
+    size_t chunk;
+    std::vector<std::string> dbs;
+    std::map<std::string,Target> targets;
+    Target* current;
+    bool open;
+    std::vector<int> dc_ids, app_ids, ds_ids, machine_ids, metric_ids;
+    TrialIds trial_ids;
+
+    void start(const std::string& db, Target& t) {
+      eiger::LoadedLog earlier;
+      Action action = ledger->check(db, filename, hash, earlier);
+      if (action == SKIP) return;
+      t.db = db;
+      t.stream = new eiger::DatabaseStream(db, chunk, true);
+      t.log.hash = hash;
+      t.log.filename = filename;
+      t.log.status = "partial";
+      t.log.replaces = earlier.hash;
+      if (action == RESUME) {
+        std::cout << "resuming " << filename << " in " << db << " after "
+                  << earlier.records << " records\n";
+        t.skip = earlier.records;
+        t.expected = earlier.prefix;
+        t.log.trials = t.stream->trials(earlier.hash);
+        if (t.skip == 0) begin(t);
+      } else {
+        if (action == REPLACE) t.stream->erase(earlier.hash);
+        begin(t);
+      }
+    }
+    // Marks the log as partly loaded, taking over from the earlier load, and
+    // keeps that up to date at every commit until finish().
+    void begin(Target& t) {
+      t.log.records = t.position.records;
+      t.log.prefix = t.position.hash();
+      if (!t.log.replaces.empty()) t.stream->unrecord(t.log.replaces);
+      t.stream->record(t.log);
+      t.stream->track(&t.log);
+    }
+    // Leaves db as it was, since the log does not begin as it did when it
+    // was loaded, and ignores the rest of the log for it. Only named objects
+    // have been written for it, in the open transaction.
+    void abandon(Target& t) {
+      std::cerr << "warning: skipping " << filename << ", which no longer "
+                << "begins with what was loaded from it into " << t.db
+                << "; load it with -f to replace that\n";
+      t.stream->rollback();
+      delete t.stream;
+      t.stream = NULL;
+    }
+    // true if the next record for the current database was written by the
+    // earlier load
+    bool skipping() const { return current->position.records < current->skip; }
+    // the database ID of the next trial the earlier load wrote, or -1
+    static int earlierTrial(Target& t) {
+      if (t.run >= t.log.trials.size()) return -1;
+      const std::pair<int,int>& run = t.log.trials[t.run];
+      int id = run.first + t.offset++;
+      if (id == run.second) {
+        t.run++;
+        t.offset = 0;
+      }
+      return id;
+    }
+    template<typename T>
+    void advance(const T& record) {
+      Target& t = *current;
+      t.position.add(record);
+      if (t.position.records < t.skip) return;
+      if (t.position.records == t.skip) {
+        if (t.position.hash() == t.expected) {
+          begin(t);
+        } else {
+          abandon(t);
+        }
+        return;
+      }
+      t.log.records = t.position.records;
+      t.log.prefix = t.position.hash();
+    }
+
+    // true if the current session is being loaded
+    bool session() {
+      if (!open) throw "fakeeiger record outside of CONNECT/DISCONNECT.";
+      return current != NULL && current->stream != NULL;
+    }
+    void resetIds() {
+      dc_ids.clear();
+      app_ids.clear();
+      ds_ids.clear();
+      machine_ids.clear();
+      metric_ids.clear();
+      trial_ids.clear();
+    }
+    StreamSink(const StreamSink&);
+    StreamSink& operator=(const StreamSink&);
+};
+
+static void streamFile(const std::string& filename, const std::string& hash,
+                       Ledger& ledger, size_t chunk) {
+  std::cout << "streaming " << filename << "\n";
+  StreamSink sink(filename, hash, ledger, chunk);
+  eiger::log_status_t status = eiger::parseFile(filename, sink);
+  report(filename, status);
+  sink.finish(status);
+}
+
+// Load the files one at a time, writing records as they are parsed in
+// transactions of stream_chunk rows.
+void parseStream(const std::vector<std::string>& filenames, Ledger& ledger) {
+  std::vector< std::string>::size_type nf = filenames.size();
+  std::cout << "Streaming " << nf << " logs" << std::endl;
+  for (std::vector< std::string>::size_type i = 0; i < nf; i++) {
+    std::string hash = hashFile(filenames[i]);
+    if (hash.empty()) {
+      report(filenames[i], eiger::LOG_MISSING);
+      continue;
+    }
+    if (ledger.loadedWhole(hash, firstDatabase(filenames[i]))) {
+      std::cout << "skipping " << filenames[i] << ", already loaded\n";
+      continue;
+    }
+    streamFile(filenames[i], hash, ledger, stream_chunk);
+  }
+}
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [-f] [-j threads | -s] file..." << std::endl
+            << "  -j, --jobs=N  parse the files on N threads (0 for one per "
+               "core) and" << std::endl
+            << "                write all of them in a single merged load"
+            << std::endl
+            << "  -s, --stream  write records as they are parsed, in bounded "
+               "memory" << std::endl
+            << "  -f, --force   load files again even if the database has "
+               "them already," << std::endl
+            << "                replacing what was loaded from them before"
+            << std::endl;
 }
 
 int main(int argc, char **argv){
-  if(argc == 1){
+  static struct option longopts[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {"force", no_argument, NULL, 'f'},
+    {"stream", no_argument, NULL, 's'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int jobs = -1; // one-file-at-a-time load
+  bool force = false;
+  bool stream = false;
+  int c;
+  while ((c = getopt_long(argc, argv, "fj:sh", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'f':
+      force = true;
+      break;
+    case 's':
+      stream = true;
+      break;
+    case 'j':
+      jobs = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(stream && jobs >= 0){
+    std::cerr << "Error: -s and -j can't be combined. Exiting..." << std::endl;
+    return -1;
+  }
+  if(optind == argc){
     std::cerr << "Error: Must provide file names to parse. Exiting..." << std::endl;
     return -1;
   }
-  std::vector<std::string> names(argv+1, argv+argc);
+  std::vector<std::string> names(argv+optind, argv+argc);
   std::cout << "Initializing" << std::endl;
   // log file object/step name string to enum for switching
-  initmaps();
-  parse(names);
+  eiger::initmaps();
+  Ledger ledger(force);
+  if (stream) {
+    parseStream(names, ledger);
+  } else if (jobs < 0) {
+    parse(names, ledger);
+  } else {
+    unsigned nthreads = jobs;
+    if (nthreads == 0) nthreads = std::thread::hardware_concurrency();
+    if (nthreads == 0) nthreads = 1;
+    parseMerged(names, nthreads, ledger);
+  }
   return 0;
 }
-
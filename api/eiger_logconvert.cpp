@@ -0,0 +1,96 @@
+/**********************************************************
+* Eiger Log Converter
+*
+* Rewrites a fakeeiger log in the character or the binary
+* format, optionally gzipped. The input format is taken from
+* its FORMAT line and compression is detected automatically.
+**********************************************************/
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "fakelog.h"
+#include "eiger.h"
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [-b|-t] [-z] input output" << std::endl
+            << "  -b, --binary     write the binary format (default)"
+            << std::endl
+            << "  -t, --character  write the character format" << std::endl
+            << "  -z, --gzip       gzip the output" << std::endl;
+}
+
+int main(int argc, char **argv){
+  static struct option longopts[] = {
+    {"binary", no_argument, NULL, 'b'},
+    {"character", no_argument, NULL, 't'},
+    {"gzip", no_argument, NULL, 'z'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  eiger::log_format_t format = eiger::BINARY_LOG;
+  bool gzip = false;
+  int c;
+  while ((c = getopt_long(argc, argv, "btzh", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'b':
+      format = eiger::BINARY_LOG;
+      break;
+    case 't':
+      format = eiger::CHARACTER_LOG;
+      break;
+    case 'z':
+      gzip = true;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(argc - optind != 2){
+    usage(argv[0]);
+    return -1;
+  }
+  eiger::initmaps();
+  eiger::SessionSink parsed;
+  eiger::log_status_t status = eiger::parseFile(argv[optind], parsed);
+  if(status == eiger::LOG_MISSING){
+    std::cerr << "Error: unable to open " << argv[optind] << std::endl;
+    return -1;
+  }
+  if(status == eiger::LOG_TRUNCATED){
+    std::cerr << "Warning: " << argv[optind] << " was cut short; "
+              << "converting every complete record" << std::endl;
+  }
+  std::ofstream outfile(argv[optind+1], std::ios::out | std::ios::trunc |
+                                        std::ios::binary);
+  if(!outfile.is_open()){
+    std::cerr << "Error: unable to open " << argv[optind+1] << std::endl;
+    return -1;
+  }
+  std::unique_ptr<eiger::gz_ostreambuf> gzbuf;
+  if(gzip){
+    gzbuf.reset(new eiger::gz_ostreambuf(outfile, 6));
+  }
+  std::ostream out(gzbuf ? (std::streambuf*)gzbuf.get() : outfile.rdbuf());
+  eiger::LogWriter writer(out, format);
+  writer.header();
+  for(const auto& s : parsed.sessions){
+    eiger::write_log_session(writer, s.db, s.datacollections,
+                             s.applications, s.datasets, s.machines,
+                             s.trials, s.metrics, s.nondet_metrics,
+                             s.det_metrics, s.machine_metrics);
+  }
+  writer.end();
+  writer.flush();
+  if(gzbuf) gzbuf->finish();
+  outfile.close();
+  return 0;
+}
@@ -0,0 +1,282 @@
+/**********************************************************
+* Eiger Model Compiler
+*
+* Turns a model file into a C++ header: the model's
+* coefficients as constexpr members and a predict function
+* unrolled for its functions, specializing
+* eiger::CompiledModel (eigermodel_compiled.h) so that
+* simulators can build models into their binaries.
+**********************************************************/
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "eigermodel.h"
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [-n name] [-o header] model" << std::endl
+            << "  -n, --name    tag type of the model, eiger::models::name;"
+            << std::endl
+            << "                the model file name by default" << std::endl
+            << "  -o, --output  header to write; standard output by default"
+            << std::endl;
+}
+
+// an identifier from the model file name: gold-0.1.model -> gold_0_1
+std::string identifier(const std::string& filename){
+  std::string base = filename.substr(filename.find_last_of('/') + 1);
+  base = base.substr(0, base.find('.'));
+  std::string id;
+  for(size_t k = 0; k < base.size(); ++k)
+    id += isalnum((unsigned char)base[k]) ? base[k] : '_';
+  if(id.empty() || isdigit((unsigned char)id[0]))
+    id = "model_" + id;
+  return id;
+}
+
+// a literal that reads back as exactly x
+std::string literal(double x){
+  if(std::isnan(x))
+    return "std::numeric_limits<double>::quiet_NaN()";
+  if(std::isinf(x))
+    return x > 0 ? "std::numeric_limits<double>::infinity()"
+                 : "-std::numeric_limits<double>::infinity()";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", x);
+  std::string s(buf);
+  if(s.find_first_of(".e") == std::string::npos)
+    s += ".0";
+  return s;
+}
+
+std::string quoted(const std::string& s){
+  std::string q = "\"";
+  for(size_t k = 0; k < s.size(); ++k){
+    unsigned char c = s[k];
+    if(c == '"' || c == '\\'){
+      q += '\\';
+      q += c;
+    }
+    else if(c < 0x20 || c >= 0x7f){
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\%03o", c);
+      q += buf;
+    }
+    else
+      q += c;
+  }
+  return q + "\"";
+}
+
+std::string index(const char* prefix, size_t a){
+  std::ostringstream s;
+  s << prefix << a;
+  return s.str();
+}
+
+std::string index(const char* prefix, size_t a, size_t b){
+  std::ostringstream s;
+  s << prefix << "_" << a << "_" << b;
+  return s.str();
+}
+
+// the term of one function of the model, over the rotated metrics r<k>
+std::string term(const eiger::ModelFunction& fn){
+  std::string xi = index("r", fn.i), xj = index("r", fn.j);
+  switch(fn.kind){
+    case eiger::ModelFunction::IDENTITY:
+      return "1.0";
+    case eiger::ModelFunction::POWER:
+      return "compiled::power(" + xi + ", " + literal(fn.exponent) + ")";
+    case eiger::ModelFunction::PRODUCT:
+      return "(" + xi + " * " + xj + ")";
+    case eiger::ModelFunction::SQRT:
+      return "std::sqrt(std::fabs(" + xi + "))";
+    case eiger::ModelFunction::LOG:
+      return "compiled::log2(" + xi + ")";
+    case eiger::ModelFunction::QUOTIENT:
+      return fn.j < 0 ? "(1.0 / " + xi + ")" : "(" + xi + " / " + xj + ")";
+    case eiger::ModelFunction::HINGE:
+      return "(" + xi + " > " + literal(fn.exponent) + " ? " + xi + " - " +
+             literal(fn.exponent) + " : 0.0)";
+    case eiger::ModelFunction::MIRROR:
+      return "(" + xi + " < " + literal(fn.exponent) + " ? " +
+             literal(fn.exponent) + " - " + xi + " : 0.0)";
+  }
+  return "0.0";
+}
+
+// Writes the specialization. Every operation happens in the order
+// eiger::Model::predict does it, so the two round alike apart from what
+// the compiler makes of constant exponents.
+void compile(const eiger::Model& model, const std::string& name,
+             const std::string& source, std::ostream& out){
+  const size_t n = model.inputs(), c = model.components();
+  const std::vector<eiger::ModelCluster>& clusters = model.clusters();
+  std::string guard = "EIGER_MODEL_" + name + "_H_INCLUDED";
+  for(size_t k = 0; k < guard.size(); ++k)
+    guard[k] = toupper((unsigned char)guard[k]);
+
+  out << "// Generated by eiger-modelc from " << source << "; regenerate it"
+      << " rather\n// than editing it when the model changes.\n\n"
+      << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+      << "#include <cmath>\n#include <cstddef>\n#include <limits>\n\n"
+      << "#include \"eigermodel_compiled.h\"\n\n"
+      << "namespace eiger{\n\n"
+      << "  namespace models{ struct " << name << "; }\n\n"
+      << "  template<> struct CompiledModel<models::" << name << "> {\n"
+      << "    static constexpr std::size_t inputs = " << n << ";\n"
+      << "    static constexpr std::size_t components = " << c << ";\n"
+      << "    static constexpr std::size_t clusters = " << clusters.size()
+      << ";\n\n"
+      << "    static const char* metric(std::size_t m){\n"
+      << "      static const char* const names[] = {";
+  for(size_t m = 0; m < n; ++m)
+    out << (m ? ",\n        " : "\n        ")
+        << quoted(model.metricNames()[m]);
+  if(n == 0)
+    out << "\"\"";
+  out << "};\n      return names[m];\n    }\n\n";
+
+  out << "    // metrics x rotation\n";
+  for(size_t m = 0; m < n; ++m)
+    for(size_t k = 0; k < c; ++k)
+      out << "    static constexpr double " << index("rotation", m, k)
+          << " = " << literal(model.rotation()[m * c + k]) << ";\n";
+  if(clusters.size() > 1){
+    out << "    // normalization of the components, 1 for a deviation of 0"
+        << "\n";
+    for(size_t k = 0; k < c; ++k){
+      double sd = model.stdevs()[k];
+      out << "    static constexpr double " << index("mean", k) << " = "
+          << literal(model.means()[k]) << ";\n"
+          << "    static constexpr double " << index("scale", k) << " = "
+          << literal(sd == 0.0 ? 1.0 : sd) << ";\n";
+    }
+    out << "    // cluster centers\n";
+    for(size_t cl = 0; cl < clusters.size(); ++cl)
+      for(size_t k = 0; k < c; ++k)
+        out << "    static constexpr double " << index("center", cl, k)
+            << " = " << literal(clusters[cl].center[k]) << ";\n";
+  }
+  out << "    // regression weights\n";
+  for(size_t cl = 0; cl < clusters.size(); ++cl)
+    for(size_t f = 0; f < clusters[cl].weights.size(); ++f)
+      out << "    static constexpr double " << index("beta", cl, f) << " = "
+          << literal(clusters[cl].weights[f]) << ";\n";
+
+  out << "\n    static double predict(const double* x){\n";
+  for(size_t k = 0; k < c; ++k){
+    out << "      double " << index("r", k) << " = 0.0;\n";
+    for(size_t m = 0; m < n; ++m)
+      out << "      " << index("r", k) << " += x[" << m << "] * "
+          << index("rotation", m, k) << ";\n";
+  }
+  std::string indent = "      ";
+  if(clusters.size() > 1){
+    for(size_t k = 0; k < c; ++k)
+      out << "      const double " << index("n", k) << " = ("
+          << index("r", k) << " - " << index("mean", k) << ") / "
+          << index("scale", k) << ";\n";
+    out << "      std::size_t cluster = 0;\n"
+        << "      double best = std::numeric_limits<double>::infinity();\n"
+        << "      double d;\n";
+    for(size_t cl = 0; cl < clusters.size(); ++cl){
+      out << "      d = 0.0;\n";
+      for(size_t k = 0; k < c; ++k){
+        std::string diff = index("n", k) + " - " + index("center", cl, k);
+        out << "      d += (" << diff << ") * (" << diff << ");\n";
+      }
+      out << "      if(d < best){ best = d; cluster = " << cl << "; }\n";
+    }
+    out << "      double s = 0.0;\n      switch(cluster){\n";
+    indent = "          ";
+  }
+  else
+    out << "      double s = 0.0;\n";
+  for(size_t cl = 0; cl < clusters.size(); ++cl){
+    if(clusters.size() > 1)
+      out << "        case " << cl << ":\n";
+    for(size_t f = 0; f < clusters[cl].functions.size(); ++f)
+      out << indent << "s += " << index("beta", cl, f) << " * "
+          << term(clusters[cl].functions[f]) << ";\n";
+    if(clusters.size() > 1)
+      out << indent << "break;\n";
+  }
+  if(clusters.size() > 1)
+    out << "      }\n";
+  out << "      return std::fabs(s);\n    }\n  };\n\n"
+      << "} // end namespace eiger\n\n#endif\n";
+}
+
+int main(int argc, char **argv){
+  static struct option longopts[] = {
+    {"name", required_argument, NULL, 'n'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  std::string name, output;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:o:h", longopts, NULL)) != -1) {
+    switch (opt) {
+    case 'n':
+      name = optarg;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(argc - optind != 1){
+    usage(argv[0]);
+    return -1;
+  }
+  std::string source = argv[optind];
+  if(name.empty())
+    name = identifier(source);
+  else if(identifier(name + ".") != name){
+    std::cerr << "Error: " << name << " is not a C++ identifier" << std::endl;
+    return -1;
+  }
+
+  eiger::Model model;
+  try{
+    model = eiger::Model::readFile(source);
+  }
+  catch(const char* msg){
+    std::cerr << "Error: " << source << ": " << msg << std::endl;
+    return -1;
+  }
+
+  std::string base = source.substr(source.find_last_of('/') + 1);
+  if(output.empty()){
+    compile(model, name, base, std::cout);
+    return 0;
+  }
+  std::ofstream out(output.c_str(), std::ios::out | std::ios::trunc);
+  if(!out.is_open()){
+    std::cerr << "Error: unable to open " << output << std::endl;
+    return -1;
+  }
+  compile(model, name, base, out);
+  out.close();
+  if(!out){
+    std::cerr << "Error: unable to write " << output << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+/**********************************************************
+* Eiger Prediction Daemon
+*
+* Serves the models of an Eiger database to the processes
+* of one machine over a Unix domain socket, so that they
+* share one copy of each model (see predictionclient.h).
+* Requests for a model that arrive together are predicted
+* as one batch.
+**********************************************************/
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <getopt.h>
+#include <pthread.h>
+
+#include "modelregistry.h"
+#include "predictionserver.h"
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog
+            << " [-s socket] [-b vectors] [-w microseconds] [-i seconds]"
+            << " database" << std::endl
+            << "  -s, --socket    socket to listen on; "
+            << "/tmp/eiger-predictd.sock by default" << std::endl
+            << "  -b, --batch     run a batch once this many vectors are "
+            << "queued (4096)" << std::endl
+            << "  -w, --window    how long a smaller batch waits for more "
+            << "requests (100)" << std::endl
+            << "  -i, --interval  seconds between statistics lines on "
+            << "standard output," << std::endl
+            << "                  0 for none (10)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  static struct option longopts[] = {
+    {"socket", required_argument, NULL, 's'},
+    {"batch", required_argument, NULL, 'b'},
+    {"window", required_argument, NULL, 'w'},
+    {"interval", required_argument, NULL, 'i'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  std::string socket = "/tmp/eiger-predictd.sock";
+  eiger::PredictionServer::Options options;
+  options.report = &std::cout;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "s:b:w:i:h", longopts, NULL)) != -1) {
+    switch (opt) {
+    case 's':
+      socket = optarg;
+      break;
+    case 'b':
+      options.batch = strtoul(optarg, NULL, 10);
+      break;
+    case 'w':
+      options.window = std::chrono::microseconds(strtoul(optarg, NULL, 10));
+      break;
+    case 'i':
+      options.interval = std::chrono::seconds(strtoul(optarg, NULL, 10));
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (argc - optind != 1) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // only the signal thread takes these; the server's threads inherit the mask
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  int status = 0;
+  const eiger::ModelRegistry models(argv[optind]);
+  {
+    eiger::PredictionServer server(models, options);
+    std::thread stopper([&server, &signals]() {
+      int sig;
+      sigwait(&signals, &sig);
+      server.stop();
+    });
+    try {
+      std::cout << "Serving " << argv[optind] << " on " << socket << std::endl;
+      server.run(socket);
+    } catch (const char* msg) {
+      std::cerr << "Error: " << msg << std::endl;
+      status = -1;
+    }
+    // wake the signal thread if run() gave up by itself
+    pthread_kill(stopper.native_handle(), SIGTERM);
+    stopper.join();
+    std::cout << server.statsLine() << std::endl;
+  }
+  return status;
+}
@@ -0,0 +1,423 @@
+/**********************************************************
+* Eiger Workload Generator
+*
+* Produces synthetic performance data at any scale for
+* benchmarking collection and loading. Either writes
+* fakeeiger logs directly or drives the Eiger API, so that
+* the backend the program is linked with does the writing.
+* The output depends only on the options and the seed.
+**********************************************************/
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+
+#include <getopt.h>
+
+#include "fakelog.h"
+#include "eiger.h"
+
+// Random numbers from mt19937_64, whose output the standard fixes, with our
+// own transforms rather than std:: distributions, whose output it does not;
+// a seed gives the same workload with any compiler.
+class Rng {
+  public:
+    Rng(uint64_t seed) : gen_(seed), spare_(0), has_spare_(false) {}
+
+    // uniform on [0, 1)
+    double uniform() { return (gen_() >> 11) * (1.0 / 9007199254740992.0); }
+    // uniform on [0, n)
+    int below(int n) { return (int)(uniform() * n); }
+    double normal() {
+      if (has_spare_) {
+        has_spare_ = false;
+        return spare_;
+      }
+      // Box-Muller
+      double u = 1.0 - uniform();
+      double v = uniform();
+      double r = std::sqrt(-2.0 * std::log(u));
+      spare_ = r * std::sin(2 * M_PI * v);
+      has_spare_ = true;
+      return r * std::cos(2 * M_PI * v);
+    }
+    double lognormal(double mu, double sigma) {
+      return std::exp(mu + sigma * normal());
+    }
+    // identifier-like word with a log-normal length around 8 characters
+    std::string word(int minlen, int maxlen) {
+      static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+      int len = (int)lognormal(std::log(8.0), 0.5);
+      if (len < minlen) len = minlen;
+      if (len > maxlen) len = maxlen;
+      std::string w;
+      w += letters[below(26)];
+      while ((int)w.size() < len) w += letters[below(sizeof(letters) - 1)];
+      return w;
+    }
+
+  private:
+    std::mt19937_64 gen_;
+    double spare_;
+    bool has_spare_;
+};
+
+struct Workload {
+  uint64_t seed;
+  std::string db;
+  int datacollections, applications, datasets, machines;
+  int metrics;          // nondeterministic
+  int det_metrics;      // per dataset
+  int machine_metrics;  // per machine
+  long trials;          // over all ranks
+  int values;           // nondeterministic values per trial
+  int ranks;            // sessions, each its own log or connection
+
+  Workload() : seed(1), db("workload.db"), datacollections(1),
+               applications(1), datasets(16), machines(4), metrics(8),
+               det_metrics(4), machine_metrics(4), trials(10000), values(8),
+               ranks(1) {}
+};
+
+// The kinds of value a metric records.
+enum value_kind_t { COUNT, TIME, RATIO };
+
+// Names and descriptions shared by every rank, as a real application
+// declares the same metadata in each run.
+struct Metadata {
+  std::vector<eiger::DataCollection> datacollections;
+  std::vector<eiger::Application> applications;
+  std::vector<eiger::Dataset> datasets;
+  std::vector<eiger::Machine> machines;
+  std::vector<eiger::Metric> metrics;
+  std::vector<value_kind_t> kinds; // of the nondeterministic metrics
+  std::vector<int> nondet, det, machine; // indices into metrics by type
+};
+
+static std::string name(Rng& rng, const char* prefix, int i) {
+  std::ostringstream s;
+  s << prefix << "_" << rng.word(3, 40) << "_" << i;
+  return s.str();
+}
+
+static std::string description(Rng& rng) {
+  std::string d = rng.word(2, 12);
+  int words = 1 + rng.below(6);
+  for (int i = 0; i < words; i++) d += " " + rng.word(2, 12);
+  return d;
+}
+
+static Metadata makeMetadata(const Workload& w) {
+  Rng rng(w.seed);
+  Metadata m;
+  for (int i = 0; i < w.datacollections; i++) {
+    m.datacollections.push_back(eiger::DataCollection(name(rng, "dc", i),
+                                                      description(rng)));
+  }
+  for (int i = 0; i < w.applications; i++) {
+    m.applications.push_back(eiger::Application(name(rng, "app", i),
+                                                description(rng)));
+  }
+  for (int i = 0; i < w.datasets; i++) {
+    eiger::ApplicationID app(i % w.applications, 0);
+    std::string n = name(rng, "ds", i);
+    m.datasets.push_back(eiger::Dataset(app, n, description(rng),
+                                        "file:///data/" + n));
+  }
+  for (int i = 0; i < w.machines; i++) {
+    m.machines.push_back(eiger::Machine(name(rng, "machine", i),
+                                        description(rng)));
+  }
+  for (int i = 0; i < w.metrics; i++) {
+    m.nondet.push_back(m.metrics.size());
+    m.kinds.push_back((value_kind_t)rng.below(3));
+    m.metrics.push_back(eiger::Metric(eiger::NONDETERMINISTIC,
+                                      name(rng, "nd", i), description(rng)));
+  }
+  for (int i = 0; i < w.det_metrics; i++) {
+    m.det.push_back(m.metrics.size());
+    m.metrics.push_back(eiger::Metric(eiger::DETERMINISTIC,
+                                      name(rng, "det", i), description(rng)));
+  }
+  for (int i = 0; i < w.machine_metrics; i++) {
+    m.machine.push_back(m.metrics.size());
+    m.metrics.push_back(eiger::Metric(eiger::MACHINE, name(rng, "mach", i),
+                                      description(rng)));
+  }
+  return m;
+}
+
+static double value(Rng& rng, value_kind_t kind) {
+  switch (kind) {
+  case COUNT:
+    // event counters: integers over many orders of magnitude
+    return std::floor(rng.lognormal(12, 2.5));
+  case TIME:
+    // seconds, heavy-tailed
+    return rng.lognormal(-3, 1.5);
+  case RATIO:
+  default:
+    return rng.uniform();
+  }
+}
+
+// Writes records straight into a log; IDs are positions, as libfakeeiger
+// assigns them.
+class LogOut {
+  public:
+    LogOut(eiger::LogWriter& w) : w_(w) {}
+
+    void connect(const std::string& db) {
+      w_.connect(db);
+      for (int i = 0; i < KINDS; i++) next_[i] = 0;
+    }
+    void disconnect() { w_.disconnect(); }
+    int add(const eiger::DataCollection& dc) { return put(dc, 0); }
+    int add(const eiger::Application& app) { return put(app, 1); }
+    int add(const eiger::Dataset& ds) { return put(ds, 2); }
+    int add(const eiger::Machine& ma) { return put(ma, 3); }
+    int add(const eiger::Metric& me) { return put(me, 4); }
+    int add(const eiger::Trial& tr) { return put(tr, 5); }
+    void add(const eiger::NondeterministicMetric& ndm) { w_.write(ndm); }
+    void add(const eiger::DeterministicMetric& dm) { w_.write(dm); }
+    void add(const eiger::MachineMetric& mm) { w_.write(mm); }
+
+  private:
+    static const int KINDS = 6;
+    eiger::LogWriter& w_;
+    int next_[KINDS];
+
+    template<typename T>
+    int put(const T& obj, int kind) {
+      w_.write(obj, next_[kind]);
+      return next_[kind]++;
+    }
+};
+
+// Commits through the Eiger API of whichever library this is linked with.
+class ApiOut {
+  public:
+    void connect(const std::string& db) { eiger::Connect(db); }
+    void disconnect() { eiger::Disconnect(); }
+    int add(const eiger::DataCollection& dc) { return commit(dc); }
+    int add(const eiger::Application& app) { return commit(app); }
+    int add(const eiger::Dataset& ds) { return commit(ds); }
+    int add(const eiger::Machine& ma) { return commit(ma); }
+    int add(const eiger::Metric& me) { return commit(me); }
+    int add(const eiger::Trial& tr) { return commit(tr); }
+    void add(const eiger::NondeterministicMetric& ndm) {
+      eiger::NondeterministicMetric(ndm).commit();
+    }
+    void add(const eiger::DeterministicMetric& dm) {
+      eiger::DeterministicMetric(dm).commit();
+    }
+    void add(const eiger::MachineMetric& mm) {
+      eiger::MachineMetric(mm).commit();
+    }
+
+  private:
+    template<typename T>
+    int commit(const T& obj) {
+      T copy(obj);
+      copy.commit();
+      return copy.getID();
+    }
+};
+
+// One rank's session: the metadata, then its share of the trials. Returns
+// the number of records written.
+template<typename Out>
+static long session(Out& out, const Workload& w, const Metadata& m, int rank) {
+  long records = 0;
+  // each rank draws its own values, independent of how many ranks there are
+  Rng rng(w.seed ^ (0x9e3779b97f4a7c15ULL * (rank + 1)));
+  out.connect(w.db);
+
+  std::vector<int> dc_ids, app_ids, ds_ids, machine_ids, metric_ids;
+  for (const auto& dc : m.datacollections) dc_ids.push_back(out.add(dc));
+  for (const auto& app : m.applications) app_ids.push_back(out.add(app));
+  for (const auto& ds : m.datasets) {
+    eiger::Dataset d(ds);
+    d.applicationID = app_ids[ds.applicationID];
+    ds_ids.push_back(out.add(d));
+  }
+  for (const auto& ma : m.machines) machine_ids.push_back(out.add(ma));
+  for (const auto& me : m.metrics) metric_ids.push_back(out.add(me));
+  records += dc_ids.size() + app_ids.size() + ds_ids.size() +
+             machine_ids.size() + metric_ids.size();
+
+  // problem sizes and machine characteristics
+  for (size_t d = 0; d < ds_ids.size(); d++) {
+    for (size_t k = 0; k < m.det.size(); k++) {
+      double size = std::ldexp(1.0, 4 + (int)((d * 7 + k * 3) % 20));
+      out.add(eiger::DeterministicMetric(eiger::DatasetID(ds_ids[d], 0),
+                                         eiger::MetricID(metric_ids[m.det[k]], 0),
+                                         size));
+      records++;
+    }
+  }
+  for (size_t a = 0; a < machine_ids.size(); a++) {
+    for (size_t k = 0; k < m.machine.size(); k++) {
+      double x = 1e8 * (10 + (a * 13 + k * 5) % 30);
+      out.add(eiger::MachineMetric(eiger::MachineID(machine_ids[a], 0),
+                                   eiger::MetricID(metric_ids[m.machine[k]], 0),
+                                   x));
+      records++;
+    }
+  }
+
+  long first = w.trials * rank / w.ranks;
+  long last = w.trials * (rank + 1) / w.ranks;
+  for (long t = first; t < last; t++) {
+    int d = rng.below(m.datasets.size());
+    eiger::Trial tr(eiger::DataCollectionID(dc_ids[rng.below(dc_ids.size())], 0),
+                    eiger::MachineID(machine_ids[rng.below(machine_ids.size())], 0),
+                    eiger::ApplicationID(app_ids[m.datasets[d].applicationID], 0),
+                    eiger::DatasetID(ds_ids[d], 0));
+    eiger::TrialID id(out.add(tr), 0);
+    for (int v = 0; v < w.values && !m.nondet.empty(); v++) {
+      int k = v % m.nondet.size();
+      out.add(eiger::NondeterministicMetric(id,
+                eiger::MetricID(metric_ids[m.nondet[k]], 0),
+                value(rng, m.kinds[k])));
+    }
+    records += 1 + (m.nondet.empty() ? 0 : w.values);
+  }
+  out.disconnect();
+  return records;
+}
+
+void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [options]" << std::endl
+            << "  -S, --seed=N              random seed (1)" << std::endl
+            << "  -d, --database=NAME       database named in the output "
+               "(workload.db)" << std::endl
+            << "      --datacollections=N   (1)" << std::endl
+            << "      --applications=N      (1)" << std::endl
+            << "      --datasets=N          (16)" << std::endl
+            << "      --machines=N          (4)" << std::endl
+            << "      --metrics=N           nondeterministic metrics (8)"
+            << std::endl
+            << "      --det-metrics=N       deterministic metrics (4)"
+            << std::endl
+            << "      --machine-metrics=N   machine metrics (4)" << std::endl
+            << "  -n, --trials=N            trials over all ranks (10000)"
+            << std::endl
+            << "  -v, --values=N            values per trial (8)" << std::endl
+            << "  -r, --ranks=N             sessions to split the trials over "
+               "(1)" << std::endl
+            << "  -a, --api                 commit through the Eiger API "
+               "instead of" << std::endl
+            << "                            writing logs" << std::endl
+            << "  -o, --output=PREFIX       logs are PREFIX.<rank> "
+               "(workload.log)" << std::endl
+            << "  -b, --binary              write binary logs" << std::endl
+            << "  -z, --gzip                gzip the logs" << std::endl;
+}
+
+int main(int argc, char **argv){
+  enum { OPT_DC = 256, OPT_APP, OPT_DS, OPT_MA, OPT_ME, OPT_DET, OPT_MM };
+  static struct option longopts[] = {
+    {"seed", required_argument, NULL, 'S'},
+    {"database", required_argument, NULL, 'd'},
+    {"datacollections", required_argument, NULL, OPT_DC},
+    {"applications", required_argument, NULL, OPT_APP},
+    {"datasets", required_argument, NULL, OPT_DS},
+    {"machines", required_argument, NULL, OPT_MA},
+    {"metrics", required_argument, NULL, OPT_ME},
+    {"det-metrics", required_argument, NULL, OPT_DET},
+    {"machine-metrics", required_argument, NULL, OPT_MM},
+    {"trials", required_argument, NULL, 'n'},
+    {"values", required_argument, NULL, 'v'},
+    {"ranks", required_argument, NULL, 'r'},
+    {"api", no_argument, NULL, 'a'},
+    {"output", required_argument, NULL, 'o'},
+    {"binary", no_argument, NULL, 'b'},
+    {"gzip", no_argument, NULL, 'z'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  Workload w;
+  bool api = false;
+  bool gzip = false;
+  eiger::log_format_t format = eiger::CHARACTER_LOG;
+  std::string prefix = "workload.log";
+  int c;
+  while ((c = getopt_long(argc, argv, "S:d:n:v:r:ao:bzh", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'S': w.seed = strtoull(optarg, NULL, 10); break;
+    case 'd': w.db = optarg; break;
+    case OPT_DC: w.datacollections = atoi(optarg); break;
+    case OPT_APP: w.applications = atoi(optarg); break;
+    case OPT_DS: w.datasets = atoi(optarg); break;
+    case OPT_MA: w.machines = atoi(optarg); break;
+    case OPT_ME: w.metrics = atoi(optarg); break;
+    case OPT_DET: w.det_metrics = atoi(optarg); break;
+    case OPT_MM: w.machine_metrics = atoi(optarg); break;
+    case 'n': w.trials = atol(optarg); break;
+    case 'v': w.values = atoi(optarg); break;
+    case 'r': w.ranks = atoi(optarg); break;
+    case 'a': api = true; break;
+    case 'o': prefix = optarg; break;
+    case 'b': format = eiger::BINARY_LOG; break;
+    case 'z': gzip = true; break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(optind != argc || w.datacollections < 1 || w.applications < 1 ||
+     w.datasets < 1 || w.machines < 1 || w.metrics < 0 ||
+     w.det_metrics < 0 || w.machine_metrics < 0 || w.trials < 0 ||
+     w.values < 0 || w.ranks < 1){
+    usage(argv[0]);
+    return -1;
+  }
+
+  Metadata m = makeMetadata(w);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  long records = 0;
+  for(int rank = 0; rank < w.ranks; rank++){
+    if(api){
+      ApiOut out;
+      records += session(out, w, m, rank);
+      continue;
+    }
+    std::ostringstream filename;
+    filename << prefix << "." << rank;
+    std::ofstream outfile(filename.str().c_str(), std::ios::out |
+                          std::ios::trunc | std::ios::binary);
+    if(!outfile.is_open()){
+      std::cerr << "Error: unable to open " << filename.str() << std::endl;
+      return -1;
+    }
+    std::unique_ptr<eiger::gz_ostreambuf> gzbuf;
+    if(gzip){
+      gzbuf.reset(new eiger::gz_ostreambuf(outfile, 1));
+    }
+    std::ostream out(gzbuf ? (std::streambuf*)gzbuf.get() : outfile.rdbuf());
+    eiger::LogWriter writer(out, format);
+    writer.header();
+    LogOut logout(writer);
+    records += session(logout, w, m, rank);
+    writer.end();
+    writer.flush();
+    if(gzbuf) gzbuf->finish();
+  }
+  double seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start).count();
+  std::cout << records << " records in " << seconds << " s ("
+            << (long)(records / (seconds > 0 ? seconds : 1)) << " records/s)"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,775 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Reads the model files written by Eiger.py and evaluates
+* them the way Eiger.py does.
+*
+**********************************************************/
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "eigermodel.h"
+#include "eigermodel_kernel.h"
+
+using namespace std;
+
+namespace eiger{
+
+  double ModelFunction::operator()(const double* x, size_t stride) const {
+    const double xi = i < 0 ? 0.0 : x[i * stride];
+    switch(kind){
+      case IDENTITY:
+        return 1.0;
+      case POWER: {
+        if(xi == 0.0)
+          return 1.0;
+        double p = pow(fabs(xi), exponent);
+        // Python's math.pow raises on overflow and Eiger.py scores it as 0
+        return std::isinf(p) ? 0.0 : p;
+      }
+      case PRODUCT:
+        return xi * x[j * stride];
+      case SQRT:
+        return sqrt(fabs(xi));
+      case LOG:
+        // math.log(x, 2) divides natural logs; keep its rounding
+        return xi == 0.0 ? 1.0 : log(fabs(xi)) / log(2.0);
+      case QUOTIENT:
+        return j < 0 ? 1.0 / xi : xi / x[j * stride];
+      // the knots of MARS hinges are kept in exponent
+      case HINGE:
+        return xi > exponent ? xi - exponent : 0.0;
+      case MIRROR:
+        return xi < exponent ? exponent - xi : 0.0;
+    }
+    return 0.0;
+  }
+
+  bool ModelFunction::valid(size_t components) const {
+    const int c = (int)components;
+    switch(kind){
+      case IDENTITY:
+        return i == -1 && j == -1;
+      case PRODUCT:
+        return i >= 0 && i < c && j >= 0 && j < c;
+      case QUOTIENT:
+        return i >= 0 && i < c && j >= -1 && j < c;
+      case POWER:
+      case SQRT:
+      case LOG:
+      case HINGE:
+      case MIRROR:
+        return i >= 0 && i < c;
+    }
+    return false;
+  }
+
+  namespace{
+
+    // Line-at-a-time reader of the sections of a model file.
+    class ModelParser {
+      public:
+        explicit ModelParser(istream& in) : in_(in) {}
+
+        bool next(string& line){
+          while(getline(in_, line)){
+            if(!line.empty() && line[line.size()-1] == '\r')
+              line.erase(line.size()-1);
+            if(!line.empty())
+              return true;
+          }
+          return false;
+        }
+
+        string need(){
+          string line;
+          if(!next(line))
+            fail("model file ends early.");
+          return line;
+        }
+
+        void fail(const char* why){
+          throw why;
+        }
+
+        // "[d0,d1,...](v, v, ...)" with any nesting of parentheses; returns
+        // the values and checks them against the product of the dimensions.
+        vector<double> array(const string& line, vector<size_t>& dims){
+          dims.clear();
+          size_t open = line.find('(');
+          if(line.empty() || line[0] != '[' || open == string::npos)
+            fail("expected [dimensions](values) in model file.");
+          size_t want = 1;
+          const char* p = line.c_str() + 1;
+          while(*p != ']'){
+            char* end;
+            long d = strtol(p, &end, 10);
+            if(end == p || d < 0)
+              fail("malformed array dimensions in model file.");
+            dims.push_back(d);
+            want *= d;
+            p = end;
+            while(*p == ',' || *p == ' ')
+              ++p;
+          }
+          vector<double> values;
+          values.reserve(want);
+          p = line.c_str() + open;
+          while(*p){
+            if(*p == '(' || *p == ')' || *p == ',' || *p == ' ' || *p == '\t'){
+              ++p;
+              continue;
+            }
+            char* end;
+            double v = strtod(p, &end);
+            if(end == p)
+              fail("malformed number in model file.");
+            values.push_back(v);
+            p = end;
+          }
+          if(values.size() != want)
+            fail("array does not match its dimensions in model file.");
+          return values;
+        }
+
+        vector<double> vec(size_t n){
+          vector<size_t> dims;
+          vector<double> v = array(need(), dims);
+          if(dims.size() != 1 || dims[0] != n)
+            fail("vector has the wrong length in model file.");
+          return v;
+        }
+
+        ModelFunction function(){
+          string line = need();
+          const char* p = line.c_str();
+          double f[4];
+          int n = 0;
+          for(;;){
+            char* end;
+            double v = strtod(p, &end);
+            if(end == p)
+              break;
+            if(n == 4)
+              fail("too many fields in model function in model file.");
+            f[n++] = v;
+            p = end;
+          }
+          while(*p == ' ' || *p == '\t')
+            ++p;
+          if(n == 0 || *p)
+            fail("malformed model function in model file.");
+          ModelFunction fn;
+          fn.kind = ModelFunction::IDENTITY;
+          fn.i = fn.j = -1;
+          fn.exponent = 0.0;
+          int fields[] = {1, 3, 3, 2, 2, 3, 3, 3};
+          if(f[0] < 0 || f[0] > 7 || f[0] != (int)f[0])
+            fail("unknown model function in model file.");
+          int kind = (int)f[0];
+          // "5 i" is the single index form of 1 / x_i
+          if(n != fields[kind] && !(kind == ModelFunction::QUOTIENT && n == 2))
+            fail("wrong number of fields in model function in model file.");
+          fn.kind = (ModelFunction::kind_t)kind;
+          if(n > 1)
+            fn.i = index(f[1]);
+          if(kind == ModelFunction::POWER || kind == ModelFunction::HINGE ||
+             kind == ModelFunction::MIRROR)
+            fn.exponent = f[2];
+          else if(n > 2)
+            fn.j = index(f[2]);
+          return fn;
+        }
+
+      private:
+        istream& in_;
+
+        int index(double v){
+          if(v < 0 || v > numeric_limits<int>::max() || v != (int)v)
+            fail("malformed index in model function in model file.");
+          return (int)v;
+        }
+    };
+
+
+    // Single pass reader of the JSON written by writeToFileJSON, filling the
+    // model as it goes rather than building a document first. Members may
+    // come in any order and unknown ones are skipped.
+    class JSONModelParser {
+      public:
+        explicit JSONModelParser(const string& text)
+          : p_(text.c_str()), end_(text.c_str() + text.size()) {}
+
+        void model(vector<string>& names, vector<double>& means,
+                   vector<double>& stdevs, vector<double>& rotation,
+                   size_t& cols, vector<ModelCluster>& clusters){
+          size_t rows = 0;
+          cols = 0;
+          bool seen = false;
+          string key;
+          for(bool more = begin('{'); more; more = next('}')){
+            member(key);
+            if(key == "metric_names"){
+              names.clear();
+              for(bool m = begin('['); m; m = next(']')){
+                names.push_back(string());
+                str(names.back());
+              }
+            }
+            else if(key == "means")
+              numbers(means);
+            else if(key == "std_devs")
+              numbers(stdevs);
+            else if(key == "rotation_matrix"){
+              rotation.clear();
+              rows = 0;
+              for(bool m = begin('['); m; m = next(']')){
+                size_t before = rotation.size();
+                for(bool c = begin('['); c; c = next(']'))
+                  rotation.push_back(number());
+                if(rows == 0)
+                  cols = rotation.size();
+                else if(rotation.size() - before != cols)
+                  fail("rotation matrix rows differ in length in model file.");
+                ++rows;
+              }
+            }
+            else if(key == "clusters"){
+              clusters.clear();
+              for(bool m = begin('['); m; m = next(']')){
+                clusters.push_back(ModelCluster());
+                cluster(clusters.back());
+              }
+              seen = true;
+            }
+            else
+              skip();
+          }
+          space();
+          if(p_ != end_)
+            fail("trailing characters after JSON model.");
+          if(!seen)
+            fail("JSON model has no clusters.");
+          if(rows != names.size())
+            fail("rotation matrix does not match the metrics in model file.");
+        }
+
+      private:
+        const char* p_;
+        const char* end_;
+
+        void fail(const char* why){
+          throw why;
+        }
+
+        void space(){
+          while(p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\t'
+                               || *p_ == '\r'))
+            ++p_;
+        }
+
+        void expect(char c){
+          space();
+          if(p_ == end_ || *p_ != c)
+            fail("malformed JSON model.");
+          ++p_;
+        }
+
+        // opens an object or array; true if it has a first element
+        bool begin(char open){
+          expect(open);
+          space();
+          if(p_ != end_ && *p_ == (open == '{' ? '}' : ']')){
+            ++p_;
+            return false;
+          }
+          return true;
+        }
+
+        // after an element: true if another follows, false at close
+        bool next(char close){
+          space();
+          if(p_ != end_ && *p_ == ','){
+            ++p_;
+            return true;
+          }
+          expect(close);
+          return false;
+        }
+
+        void member(string& key){
+          str(key);
+          expect(':');
+        }
+
+        bool literal(const char* word){
+          size_t n = strlen(word);
+          if((size_t)(end_ - p_) < n || strncmp(p_, word, n) != 0)
+            return false;
+          p_ += n;
+          return true;
+        }
+
+        double number(){
+          space();
+          // json.dump writes these for non-finite doubles
+          if(literal("NaN"))
+            return numeric_limits<double>::quiet_NaN();
+          if(literal("Infinity"))
+            return numeric_limits<double>::infinity();
+          if(literal("-Infinity"))
+            return -numeric_limits<double>::infinity();
+          // Eiger.py keeps the fields of converted bespoke functions as strings
+          if(p_ != end_ && *p_ == '"'){
+            string s;
+            str(s);
+            char* e;
+            double v = strtod(s.c_str(), &e);
+            if(s.empty() || *e)
+              fail("malformed number in JSON model.");
+            return v;
+          }
+          const char* q = p_;
+          while(q != end_ && (isdigit((unsigned char)*q) || *q == '-'
+                              || *q == '+' || *q == '.' || *q == 'e'
+                              || *q == 'E'))
+            ++q;
+          char* e;
+          double v = strtod(p_, &e);
+          if(q == p_ || e != q)
+            fail("malformed number in JSON model.");
+          p_ = q;
+          return v;
+        }
+
+        void numbers(vector<double>& v){
+          v.clear();
+          for(bool m = begin('['); m; m = next(']'))
+            v.push_back(number());
+        }
+
+        int index(){
+          double v = number();
+          if(v < 0 || v > numeric_limits<int>::max() || v != (int)v)
+            fail("malformed index in JSON model.");
+          return (int)v;
+        }
+
+        void utf8(unsigned long c, string& out){
+          if(c < 0x80)
+            out += (char)c;
+          else if(c < 0x800){
+            out += (char)(0xc0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3f));
+          }
+          else if(c < 0x10000){
+            out += (char)(0xe0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3f));
+            out += (char)(0x80 | (c & 0x3f));
+          }
+          else{
+            out += (char)(0xf0 | (c >> 18));
+            out += (char)(0x80 | ((c >> 12) & 0x3f));
+            out += (char)(0x80 | ((c >> 6) & 0x3f));
+            out += (char)(0x80 | (c & 0x3f));
+          }
+        }
+
+        unsigned long hex4(){
+          if(end_ - p_ < 4)
+            fail("malformed string in JSON model.");
+          char digits[5] = {p_[0], p_[1], p_[2], p_[3], 0};
+          char* e;
+          unsigned long c = strtoul(digits, &e, 16);
+          if(*e)
+            fail("malformed string in JSON model.");
+          p_ += 4;
+          return c;
+        }
+
+        void str(string& out){
+          expect('"');
+          out.clear();
+          for(;;){
+            const char* run = p_;
+            while(p_ != end_ && *p_ != '"' && *p_ != '\\')
+              ++p_;
+            out.append(run, p_);
+            if(p_ == end_)
+              fail("unterminated string in JSON model.");
+            if(*p_++ == '"')
+              return;
+            if(p_ == end_)
+              fail("unterminated string in JSON model.");
+            char c = *p_++;
+            switch(c){
+              case 'b': out += '\b'; break;
+              case 'f': out += '\f'; break;
+              case 'n': out += '\n'; break;
+              case 'r': out += '\r'; break;
+              case 't': out += '\t'; break;
+              case 'u': {
+                unsigned long u = hex4();
+                // a surrogate pair encodes one character beyond the BMP
+                if(u >= 0xd800 && u < 0xdc00 && end_ - p_ >= 6
+                   && p_[0] == '\\' && p_[1] == 'u'){
+                  p_ += 2;
+                  unsigned long low = hex4();
+                  u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+                }
+                utf8(u, out);
+                break;
+              }
+              default: out += c; break;
+            }
+          }
+        }
+
+        void skip(){
+          space();
+          if(p_ == end_)
+            fail("malformed JSON model.");
+          string s;
+          if(*p_ == '{'){
+            for(bool m = begin('{'); m; m = next('}')){
+              member(s);
+              skip();
+            }
+          }
+          else if(*p_ == '[')
+            for(bool m = begin('['); m; m = next(']'))
+              skip();
+          else if(*p_ == '"')
+            str(s);
+          else if(!literal("true") && !literal("false") && !literal("null"))
+            number();
+        }
+
+        void cluster(ModelCluster& cl){
+          string key;
+          for(bool more = begin('{'); more; more = next('}')){
+            member(key);
+            if(key == "center")
+              numbers(cl.center);
+            else if(key == "regressors"){
+              cl.weights.clear();
+              cl.functions.clear();
+              for(bool m = begin('['); m; m = next(']'))
+                regressor(cl);
+            }
+            else
+              skip();
+          }
+        }
+
+        void regressor(ModelCluster& cl){
+          ModelFunction fn;
+          fn.kind = ModelFunction::IDENTITY;
+          fn.i = fn.j = -1;
+          fn.exponent = 0.0;
+          double weight = 0.0;
+          bool kind = false, weighted = false;
+          int i = -1, j = -1;
+          string key, name;
+          for(bool more = begin('{'); more; more = next('}')){
+            member(key);
+            if(key == "function"){
+              str(name);
+              kind = true;
+              if(name == "identity") fn.kind = ModelFunction::IDENTITY;
+              else if(name == "power") fn.kind = ModelFunction::POWER;
+              else if(name == "product") fn.kind = ModelFunction::PRODUCT;
+              else if(name == "sqrt") fn.kind = ModelFunction::SQRT;
+              else if(name == "log") fn.kind = ModelFunction::LOG;
+              else if(name == "quotient") fn.kind = ModelFunction::QUOTIENT;
+              else if(name == "hinge") fn.kind = ModelFunction::HINGE;
+              else if(name == "mirror") fn.kind = ModelFunction::MIRROR;
+              else fail("unknown function in JSON model.");
+            }
+            else if(key == "index" || key == "first_idx")
+              i = index();
+            else if(key == "second_idx")
+              j = index();
+            else if(key == "exponent" || key == "knot")
+              fn.exponent = number();
+            else if(key == "weight"){
+              weight = number();
+              weighted = true;
+            }
+            else
+              skip();
+          }
+          if(!kind || !weighted)
+            fail("regressor without a function or weight in JSON model.");
+          bool one = fn.kind == ModelFunction::POWER
+                     || fn.kind == ModelFunction::SQRT
+                     || fn.kind == ModelFunction::LOG
+                     || fn.kind == ModelFunction::HINGE
+                     || fn.kind == ModelFunction::MIRROR;
+          bool two = fn.kind == ModelFunction::PRODUCT
+                     || fn.kind == ModelFunction::QUOTIENT;
+          if((one || two) && i < 0)
+            fail("regressor without an index in JSON model.");
+          if(two && j < 0)
+            fail("regressor without a second index in JSON model.");
+          if(fn.kind != ModelFunction::IDENTITY)
+            fn.i = i;
+          if(two)
+            fn.j = j;
+          cl.functions.push_back(fn);
+          cl.weights.push_back(weight);
+        }
+    };
+
+  } // end anonymous namespace
+
+  Model::Model() {}
+
+  Model::Model(const vector<string>& names,
+               const vector<double>& means,
+               const vector<double>& stdevs,
+               const vector<double>& rotation,
+               const vector<ModelCluster>& clusters)
+    : names_(names), means_(means), stdevs_(stdevs), rotation_(rotation),
+      clusters_(clusters) {
+    check();
+  }
+
+  void Model::check(){
+    size_t c = means_.size();
+    if(stdevs_.size() != c || rotation_.size() != names_.size() * c)
+      throw "model rotation, means and stdevs do not agree.";
+    if(clusters_.empty())
+      throw "model has no clusters.";
+    for(size_t k = 0; k < clusters_.size(); ++k){
+      const ModelCluster& cl = clusters_[k];
+      if(cl.center.size() != c || cl.weights.size() != cl.functions.size())
+        throw "model cluster does not match the model.";
+      for(size_t f = 0; f < cl.functions.size(); ++f)
+        if(!cl.functions[f].valid(c))
+          throw "model function uses a missing component.";
+    }
+    index_.clear();
+    for(size_t m = 0; m < names_.size(); ++m)
+      index_[names_[m]] = m;
+  }
+
+  Model Model::read(istream& in){
+    // Eiger.py looks only at the first character
+    int first = in.peek();
+    if(first == '{')
+      return readJSON(in);
+    if(first == 0x89)
+      return readBinary(in);
+    return readBespoke(in);
+  }
+
+  Model Model::readBespoke(istream& in){
+    ModelParser parse(in);
+    string line = parse.need();
+    char* end;
+    long n = strtol(line.c_str(), &end, 10);
+    if(*end || n < 0)
+      parse.fail("expected the number of metrics in model file.");
+    Model model;
+    for(long m = 0; m < n; ++m)
+      model.names_.push_back(parse.need());
+    vector<size_t> dims;
+    model.means_ = parse.array(parse.need(), dims);
+    if(dims.size() != 1)
+      parse.fail("means must be a vector in model file.");
+    size_t c = dims[0];
+    model.stdevs_ = parse.vec(c);
+    model.rotation_ = parse.array(parse.need(), dims);
+    if(dims.size() != 2 || dims[0] != (size_t)n || dims[1] != c)
+      parse.fail("rotation matrix does not match the metrics in model file.");
+    while(parse.next(line)){
+      if(line.compare(0, 6, "Model ") != 0)
+        parse.fail("expected a Model line in model file.");
+      model.clusters_.push_back(ModelCluster());
+      ModelCluster& cl = model.clusters_.back();
+      cl.center = parse.vec(c);
+      cl.weights = parse.array(parse.need(), dims);
+      if(dims.size() != 1)
+        parse.fail("weights must be a vector in model file.");
+      for(size_t f = 0; f < cl.weights.size(); ++f){
+        cl.functions.push_back(parse.function());
+        if(!cl.functions.back().valid(c))
+          parse.fail("model function uses a missing component in model file.");
+      }
+    }
+    model.check();
+    return model;
+  }
+
+  Model Model::readJSON(istream& in){
+    ostringstream buffer;
+    buffer << in.rdbuf();
+    string text = buffer.str();
+    Model model;
+    size_t cols;
+    JSONModelParser(text).model(model.names_, model.means_, model.stdevs_,
+                                model.rotation_, cols, model.clusters_);
+    if(!model.names_.empty() && cols != model.means_.size())
+      throw "rotation matrix does not match the means in model file.";
+    model.check();
+    return model;
+  }
+
+  Model Model::readFile(const string& filename){
+    ifstream in(filename.c_str(), ios::in | ios::binary);
+    if(!in)
+      throw "can't open model file.";
+    return read(in);
+  }
+
+  int Model::metricIndex(const string& name) const {
+    map<string,int>::const_iterator it = index_.find(name);
+    return it == index_.end() ? -1 : it->second;
+  }
+
+  double Model::predict(const double* metrics, double* scratch) const {
+    const size_t n = names_.size(), c = means_.size();
+    double* rotated = scratch;
+    double* normal = scratch + c;
+    for(size_t k = 0; k < c; ++k)
+      rotated[k] = 0.0;
+    for(size_t m = 0; m < n; ++m){
+      const double* row = &rotation_[m * c];
+      for(size_t k = 0; k < c; ++k)
+        rotated[k] += metrics[m] * row[k];
+    }
+    for(size_t k = 0; k < c; ++k)
+      normal[k] = (rotated[k] - means_[k])
+                  / (stdevs_[k] == 0.0 ? 1.0 : stdevs_[k]);
+
+    // the nearest center picks the regression; ties go to the first
+    size_t best = 0;
+    double bestdist = numeric_limits<double>::infinity();
+    for(size_t cl = 0; cl < clusters_.size(); ++cl){
+      const double* center = &clusters_[cl].center[0];
+      double dist = 0.0;
+      for(size_t k = 0; k < c; ++k)
+        dist += (normal[k] - center[k]) * (normal[k] - center[k]);
+      if(dist < bestdist){
+        bestdist = dist;
+        best = cl;
+      }
+    }
+
+    const ModelCluster& model = clusters_[best];
+    double sum = 0.0;
+    for(size_t f = 0; f < model.functions.size(); ++f)
+      sum += model.weights[f] * model.functions[f](rotated);
+    return fabs(sum);
+  }
+
+  double Model::predict(ModelInput& in) const {
+    if(in.model_ != this)
+      throw "model input belongs to a different model.";
+    return predict(&in.values_[0], &in.scratch_[0]);
+  }
+
+  namespace kernel{
+
+    // one lane, for processors without a SIMD kernel
+    struct ScalarLanes {
+      typedef double reg;
+      typedef bool mask;
+      static const size_t width = 1;
+      static reg load(const double* p) { return *p; }
+      static void store(double* p, reg a) { *p = a; }
+      static reg set1(double a) { return a; }
+      static reg add(reg a, reg b) { return a + b; }
+      static reg sub(reg a, reg b) { return a - b; }
+      static reg mul(reg a, reg b) { return a * b; }
+      static reg div(reg a, reg b) { return a / b; }
+      static reg sqrt(reg a) { return std::sqrt(a); }
+      static reg abs(reg a) { return fabs(a); }
+      static mask less(reg a, reg b) { return a < b; }
+      static mask equal(reg a, reg b) { return a == b; }
+      static reg select(mask m, reg a, reg b) { return m ? a : b; }
+    };
+
+    void predict_scalar(const Model& model, const double* metrics,
+                        size_t count, double* predictions, double* scratch){
+      predict<ScalarLanes>(model, metrics, count, predictions, scratch);
+    }
+
+    vector<BatchKernel> batch_kernels(){
+      vector<BatchKernel> kernels;
+      BatchKernel scalar = {"scalar", predict_scalar};
+      kernels.push_back(scalar);
+#ifdef HAVE_AVX2_KERNEL
+      if(__builtin_cpu_supports("avx2")){
+        BatchKernel avx2 = {"avx2", predict_avx2};
+        kernels.push_back(avx2);
+      }
+#endif
+#ifdef HAVE_AVX512_KERNEL
+      if(__builtin_cpu_supports("avx512f")){
+        BatchKernel avx512 = {"avx512", predict_avx512};
+        kernels.push_back(avx512);
+      }
+#endif
+      return kernels;
+    }
+
+    // the fastest kernel, or the one EIGER_MODEL_SIMD names
+    static BatchKernel choose(){
+      vector<BatchKernel> kernels = batch_kernels();
+      const char* want = getenv("EIGER_MODEL_SIMD");
+      for(size_t k = 0; want && k < kernels.size(); ++k)
+        if(string(want) == kernels[k].name)
+          return kernels[k];
+      return kernels.back();
+    }
+
+    static const BatchKernel& chosen(){
+      static const BatchKernel kernel = choose();
+      return kernel;
+    }
+
+  } // end namespace kernel
+
+  size_t Model::batchScratchSize() const {
+    return kernel::scratch_size(inputs(), components());
+  }
+
+  void Model::predict(const double* metrics, size_t count,
+                      double* predictions, double* scratch) const {
+    kernel::chosen().run(*this, metrics, count, predictions, scratch);
+  }
+
+  void Model::predict(const double* metrics, size_t count,
+                      double* predictions) const {
+    vector<double> scratch(batchScratchSize());
+    predict(metrics, count, predictions, &scratch[0]);
+  }
+
+  const char* Model::batchKernel(){
+    return kernel::chosen().name;
+  }
+
+  ModelInput::ModelInput(const Model& model)
+    : model_(&model), values_(model.inputs() + 1, 0.0),
+      scratch_(model.scratchSize() + 1) {}
+
+  void ModelInput::set(const string& name, double value){
+    int m = model_->metricIndex(name);
+    if(m < 0)
+      throw "model does not use this metric.";
+    values_[m] = value;
+  }
+
+} // end namespace eiger
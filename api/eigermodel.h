@@ -0,0 +1,185 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Runtime for the performance models written by Eiger.py,
+* for simulators and other C++ programs that need
+* predictions without Python.
+*
+**********************************************************/
+
+#ifndef EIGERMODEL_H_INCLUDED
+#define EIGERMODEL_H_INCLUDED
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace eiger{
+
+  // One regressor function of a model, in the encoding of the model file.
+  struct ModelFunction {
+    enum kind_t {
+      IDENTITY = 0, // 1
+      POWER = 1,    // |x_i|^exponent, 1 where x_i is 0
+      PRODUCT = 2,  // x_i * x_j
+      SQRT = 3,     // sqrt(|x_i|)
+      LOG = 4,      // log2(|x_i|), 1 where x_i is 0
+      QUOTIENT = 5, // x_i / x_j, or 1 / x_i when j is -1
+      HINGE = 6,    // x_i - exponent where x_i > exponent, else 0
+      MIRROR = 7    // exponent - x_i where x_i < exponent, else 0
+    };
+    kind_t kind;
+    int i, j;
+    double exponent;
+
+    // x_i is x[i * stride]
+    double operator()(const double* x, size_t stride = 1) const;
+    // true if i and j are what the kind needs among this many components:
+    // both -1 for IDENTITY, j -1 or a component for QUOTIENT's, and
+    // components for the other indices it reads
+    bool valid(size_t components) const;
+  };
+
+  // The regression of one cluster: prediction = |sum weights[k] * f_k(x)|.
+  struct ModelCluster {
+    std::vector<double> center;
+    std::vector<double> weights;
+    std::vector<ModelFunction> functions;
+  };
+
+  class ModelInput;
+
+  // A trained Eiger model: the PCA rotation of the input metrics, the
+  // normalization and centers used to pick a cluster, and the regression
+  // of each cluster. Predictions match Eiger.py.
+  class Model {
+    public:
+      Model();
+
+      // Parse a model file in any format, chosen like Eiger.py does by its
+      // first character; throws a string describing the problem.
+      static Model read(std::istream& in);
+      static Model readFile(const std::string& filename);
+      // the bespoke text format of writeToFile
+      static Model readBespoke(std::istream& in);
+      // the JSON format of writeToFileJSON
+      static Model readJSON(std::istream& in);
+      // the binary format of writeBinary, which starts with 0x89
+      static Model readBinary(std::istream& in);
+
+      // Write the model in the binary format, which MappedModel uses in
+      // place; doubles are stored exactly, unlike in the text formats.
+      void writeBinary(std::ostream& out) const;
+
+      // input metrics in the order predict() expects them
+      const std::vector<std::string>& metricNames() const { return names_; }
+      size_t inputs() const { return names_.size(); }
+      // principal components the metrics are rotated onto
+      size_t components() const { return means_.size(); }
+      // position of the named metric, -1 if the model does not use it
+      int metricIndex(const std::string& name) const;
+
+      const std::vector<double>& means() const { return means_; }
+      const std::vector<double>& stdevs() const { return stdevs_; }
+      // inputs() x components(), row-major
+      const std::vector<double>& rotation() const { return rotation_; }
+      const std::vector<ModelCluster>& clusters() const { return clusters_; }
+
+      // Predict from metric values in metricNames() order. scratch must hold
+      // scratchSize() doubles; nothing is allocated.
+      double predict(const double* metrics, double* scratch) const;
+      size_t scratchSize() const { return 2 * components(); }
+      // Predict from the values set on in.
+      double predict(ModelInput& in) const;
+
+      // Predict count metric vectors at once, row-major in metricNames()
+      // order, with SIMD instructions where the processor has them. scratch
+      // must hold batchScratchSize() doubles. Powers of 0, +-0.5, +-1 and
+      // +-2 are computed without pow, so a prediction can differ from the
+      // single one in the last bits.
+      void predict(const double* metrics, size_t count, double* predictions,
+                   double* scratch) const;
+      size_t batchScratchSize() const;
+      // allocates its own scratch
+      void predict(const double* metrics, size_t count,
+                   double* predictions) const;
+      // the instruction set batch predictions use: "avx512", "avx2" or
+      // "scalar"; EIGER_MODEL_SIMD in the environment can choose a slower one
+      static const char* batchKernel();
+
+      // Build a model from its parts; throws if they don't fit together.
+      Model(const std::vector<std::string>& names,
+            const std::vector<double>& means,
+            const std::vector<double>& stdevs,
+            const std::vector<double>& rotation,
+            const std::vector<ModelCluster>& clusters);
+
+    private:
+      std::vector<std::string> names_;
+      std::map<std::string,int> index_;
+      std::vector<double> means_, stdevs_, rotation_;
+      std::vector<ModelCluster> clusters_;
+
+      void check();
+  };
+
+  // Named metric values for one model. Set every metric, then predict as
+  // often as needed; the buffers are sized once, here.
+  class ModelInput {
+    public:
+      explicit ModelInput(const Model& model);
+
+      // throws for a metric the model does not use
+      void set(const std::string& name, double value);
+      void set(size_t index, double value) { values_[index] = value; }
+      double* values() { return &values_[0]; }
+
+    private:
+      friend class Model;
+      const Model* model_;
+      std::vector<double> values_, scratch_;
+  };
+
+  // A model file in the binary format, memory-mapped and evaluated where it
+  // lies: opening one reads only the header and metric names, and programs
+  // that map the same file share its pages. Predictions are the same bits
+  // as those of a Model read from the file.
+  class MappedModel {
+    public:
+      // throws if the file can't be mapped or is not a binary model
+      explicit MappedModel(const std::string& filename);
+      ~MappedModel();
+
+      const std::vector<std::string>& metricNames() const { return names_; }
+      size_t inputs() const { return names_.size(); }
+      size_t components() const { return c_; }
+      size_t clusterCount() const { return clusters_; }
+      int metricIndex(const std::string& name) const;
+
+      // as Model::predict, scratch holding scratchSize() doubles
+      double predict(const double* metrics, double* scratch) const;
+      size_t scratchSize() const { return 2 * c_; }
+
+      // a Model with the same parts, e.g. for batch predictions
+      Model model() const;
+
+    private:
+      void* map_;
+      size_t size_;
+      size_t c_, clusters_;
+      const double *means_, *stdevs_, *rotation_, *centers_, *weights_;
+      const uint32_t* starts_;
+      const ModelFunction* functions_;
+      std::vector<std::string> names_;
+      std::map<std::string,int> index_;
+
+      MappedModel(const MappedModel&);
+      MappedModel& operator=(const MappedModel&);
+  };
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,53 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The batch prediction kernel with AVX2, four predictions
+* to a register. Built with -mavx2 and only called on
+* processors that have it.
+*
+**********************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h>
+
+#include "eigermodel_kernel.h"
+
+namespace eiger{
+namespace kernel{
+
+  struct AVX2Lanes {
+    typedef __m256d reg;
+    typedef __m256d mask;
+    static const size_t width = 4;
+    static reg load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, reg a) { _mm256_storeu_pd(p, a); }
+    static reg set1(double a) { return _mm256_set1_pd(a); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+    static reg sqrt(reg a) { return _mm256_sqrt_pd(a); }
+    static reg abs(reg a) {
+      return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+    }
+    static mask less(reg a, reg b) {
+      return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+    }
+    static mask equal(reg a, reg b) {
+      return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+    }
+    static reg select(mask m, reg a, reg b) {
+      return _mm256_blendv_pd(b, a, m);
+    }
+  };
+
+  void predict_avx2(const Model& model, const double* metrics, size_t count,
+                    double* predictions, double* scratch){
+    predict<AVX2Lanes>(model, metrics, count, predictions, scratch);
+  }
+
+} // end namespace kernel
+} // end namespace eiger
@@ -0,0 +1,56 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The batch prediction kernel with AVX-512, eight
+* predictions to a register. Built with -mavx512f, without
+* fused multiply-adds, and only called on processors that
+* have it.
+*
+**********************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h>
+
+#include "eigermodel_kernel.h"
+
+namespace eiger{
+namespace kernel{
+
+  struct AVX512Lanes {
+    typedef __m512d reg;
+    typedef __mmask8 mask;
+    static const size_t width = 8;
+    static reg load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, reg a) { _mm512_storeu_pd(p, a); }
+    static reg set1(double a) { return _mm512_set1_pd(a); }
+    static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+    // the zero-masked form; _mm512_sqrt_pd trips -Wmaybe-uninitialized
+    static reg sqrt(reg a) { return _mm512_maskz_sqrt_pd(0xff, a); }
+    static reg abs(reg a) {
+      return _mm512_castsi512_pd(_mm512_and_epi64(
+          _mm512_castpd_si512(a), _mm512_set1_epi64(0x7fffffffffffffffLL)));
+    }
+    static mask less(reg a, reg b) {
+      return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ);
+    }
+    static mask equal(reg a, reg b) {
+      return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ);
+    }
+    static reg select(mask m, reg a, reg b) {
+      return _mm512_mask_blend_pd(m, b, a);
+    }
+  };
+
+  void predict_avx512(const Model& model, const double* metrics, size_t count,
+                      double* predictions, double* scratch){
+    predict<AVX512Lanes>(model, metrics, count, predictions, scratch);
+  }
+
+} // end namespace kernel
+} // end namespace eiger
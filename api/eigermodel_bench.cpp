@@ -0,0 +1,108 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Throughput of the model runtime: single predictions and
+* each batch kernel this processor can run, over random
+* metric vectors.
+*
+* usage: eigermodel_bench [model file] [vectors]
+* Without a model file, a model of 8 metrics, 4 components
+* and 4 clusters of 12 functions is made up.
+*
+**********************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "eigermodel.h"
+#include "eigermodel_kernel.h"
+
+using namespace std;
+
+typedef chrono::steady_clock clock_type;
+
+static double seconds(clock_type::time_point since) {
+  return chrono::duration<double>(clock_type::now() - since).count();
+}
+
+// the kinds and exponents of Eiger.py's candidate pool
+static eiger::Model synthetic(mt19937_64& rng) {
+  const size_t n = 8, c = 4, clusters = 4, functions = 12;
+  normal_distribution<double> gauss(0.0, 1.0);
+  vector<string> names;
+  for (size_t m = 0; m < n; ++m) names.push_back("metric" + to_string(m));
+  vector<double> means(c), stdevs(c), rotation(n * c);
+  for (size_t k = 0; k < c; ++k) {
+    means[k] = gauss(rng);
+    stdevs[k] = 1.0 + fabs(gauss(rng));
+  }
+  for (size_t k = 0; k < rotation.size(); ++k) rotation[k] = gauss(rng);
+  const double exponents[] = {-2, -1, -0.5, 0.5, 1, 2};
+  vector<eiger::ModelCluster> models(clusters);
+  for (size_t cl = 0; cl < clusters; ++cl) {
+    for (size_t k = 0; k < c; ++k) models[cl].center.push_back(gauss(rng));
+    for (size_t f = 0; f < functions; ++f) {
+      eiger::ModelFunction fn;
+      fn.kind = eiger::ModelFunction::kind_t(rng() % 6);
+      fn.i = fn.kind == eiger::ModelFunction::IDENTITY ? -1 : rng() % c;
+      fn.j = fn.kind == eiger::ModelFunction::PRODUCT
+             || fn.kind == eiger::ModelFunction::QUOTIENT ? rng() % c : -1;
+      fn.exponent = exponents[rng() % 6];
+      models[cl].functions.push_back(fn);
+      models[cl].weights.push_back(gauss(rng));
+    }
+  }
+  return eiger::Model(names, means, stdevs, rotation, models);
+}
+
+int main(int argc, char** argv) {
+  mt19937_64 rng(1);
+  size_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+  try {
+    eiger::Model model = argc > 1 && string(argv[1]) != "-"
+                         ? eiger::Model::readFile(argv[1]) : synthetic(rng);
+    const size_t n = model.inputs();
+    uniform_real_distribution<double> value(1.0, 1000.0);
+    vector<double> metrics(count * n), single(count), batch(count);
+    for (size_t k = 0; k < metrics.size(); ++k) metrics[k] = value(rng);
+    printf("%zu metrics, %zu components, %zu clusters, %zu vectors\n", n,
+           model.components(), model.clusters().size(), count);
+
+    vector<double> scratch(model.scratchSize() + 1);
+    clock_type::time_point start = clock_type::now();
+    for (size_t k = 0; k < count; ++k) {
+      single[k] = model.predict(&metrics[k * n], &scratch[0]);
+    }
+    const double base = count / seconds(start);
+    printf("%-8s %8.2f M predictions/s\n", "single", base / 1e6);
+
+    vector<eiger::kernel::BatchKernel> kernels =
+        eiger::kernel::batch_kernels();
+    scratch.resize(model.batchScratchSize());
+    for (size_t kn = 0; kn < kernels.size(); ++kn) {
+      start = clock_type::now();
+      kernels[kn].run(model, &metrics[0], count, &batch[0], &scratch[0]);
+      const double rate = count / seconds(start);
+      double worst = 0.0;
+      for (size_t k = 0; k < count; ++k) {
+        double err = fabs(batch[k] - single[k]) / fabs(single[k]);
+        if (err > worst) worst = err;
+      }
+      printf("%-8s %8.2f M predictions/s  %.1f x single  "
+             "worst relative difference %.1e\n",
+             kernels[kn].name, rate / 1e6, rate / base, worst);
+    }
+  } catch (const char* msg) {
+    fprintf(stderr, "%s\n", msg);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,343 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The binary model format: a 128 byte header followed by
+* the model's arrays as raw doubles and integers, each
+* aligned to 64 bytes, so that a mapped file can be
+* evaluated without parsing or copying.
+*
+**********************************************************/
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "eigermodel.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace{
+
+    // like PNG's: not text, and spoiled by newline conversion
+    const char magic[8] = {'\x89', 'E', 'I', 'G', 'M', 'O', 'D', '\n'};
+    const uint32_t version = 1;
+    // written in the byte order of the writer, which Eiger.py makes
+    // little-endian
+    const uint32_t byte_order = 0x01020304;
+    const size_t alignment = 64;
+
+    enum section {
+      NAMES,     // the metric names, each ending in a NUL
+      MEANS,     // double[components]
+      STDEVS,    // double[components]
+      ROTATION,  // double[inputs][components]
+      CENTERS,   // double[clusters][components]
+      STARTS,    // uint32[clusters + 1], the first function of each cluster
+      WEIGHTS,   // double[functions]
+      FUNCTIONS, // BinaryFunction[functions]
+      SECTIONS
+    };
+
+    struct BinaryHeader {
+      char magic[8];
+      uint32_t version, byte_order;
+      uint32_t inputs, components, clusters, functions;
+      uint64_t size;       // of the whole file
+      uint64_t names_size; // bytes in the NAMES section
+      uint64_t offset[SECTIONS];
+      char reserved[16];
+    };
+    static_assert(sizeof(BinaryHeader) == 128, "binary header is 128 bytes");
+
+    // a ModelFunction as stored, with kind one of its encodings
+    struct BinaryFunction {
+      int32_t kind, i, j, reserved;
+      double exponent;
+    };
+    static_assert(sizeof(ModelFunction) == sizeof(BinaryFunction)
+                  && sizeof(ModelFunction::kind_t) == sizeof(int32_t)
+                  && offsetof(ModelFunction, kind)
+                     == offsetof(BinaryFunction, kind)
+                  && offsetof(ModelFunction, i) == offsetof(BinaryFunction, i)
+                  && offsetof(ModelFunction, j) == offsetof(BinaryFunction, j)
+                  && offsetof(ModelFunction, exponent)
+                     == offsetof(BinaryFunction, exponent),
+                  "stored functions are used as ModelFunctions in place");
+
+    // The parts of a binary model, pointing into its bytes.
+    struct BinaryModel {
+      size_t n, c, clusters, functions;
+      const char* names;
+      const double *means, *stdevs, *rotation, *centers, *weights;
+      const uint32_t* starts;
+      const ModelFunction* fns;
+    };
+
+    // Checks the header and every array of a binary model, so that
+    // predictions need not.
+    BinaryModel parse_binary(const char* data, size_t size){
+      const BinaryHeader* h = (const BinaryHeader*)data;
+      if(size < sizeof(BinaryHeader) || memcmp(h->magic, magic, 8) != 0)
+        throw "not a binary model file.";
+      if(h->byte_order != byte_order)
+        throw "binary model file is in another byte order.";
+      if(h->version != version)
+        throw "unsupported binary model file version.";
+      if(h->size != size)
+        throw "binary model file has the wrong size.";
+
+      BinaryModel b;
+      b.n = h->inputs;
+      b.c = h->components;
+      b.clusters = h->clusters;
+      b.functions = h->functions;
+      if(b.clusters == 0)
+        throw "model has no clusters.";
+      // n * c and clusters * c, products of two 32-bit counts, can overflow,
+      // as can clusters + 1 where size_t has 32 bits; each section must fit
+      // in the file, so none of them may exceed its size
+      if(b.clusters > size
+         || (b.c && (b.n > size / b.c || b.clusters > size / b.c)))
+        throw "binary model file section is out of place.";
+      const size_t count[SECTIONS] = {
+        (size_t)h->names_size, b.c, b.c, b.n * b.c, b.clusters * b.c,
+        b.clusters + 1, b.functions, b.functions};
+      const size_t width[SECTIONS] = {
+        1, sizeof(double), sizeof(double), sizeof(double), sizeof(double),
+        sizeof(uint32_t), sizeof(double), sizeof(BinaryFunction)};
+      const void* at[SECTIONS];
+      for(int s = 0; s < SECTIONS; ++s){
+        uint64_t offset = h->offset[s];
+        if(offset % sizeof(double) != 0 || offset < sizeof(BinaryHeader)
+           || offset > size || count[s] > (size - offset) / width[s])
+          throw "binary model file section is out of place.";
+        at[s] = data + offset;
+      }
+
+      b.names = (const char*)at[NAMES];
+      size_t names = 0;
+      for(size_t k = 0; k < count[NAMES]; ++k)
+        names += b.names[k] == '\0';
+      if(names != b.n || (count[NAMES] && b.names[count[NAMES] - 1] != '\0'))
+        throw "binary model file has the wrong number of metric names.";
+      b.means = (const double*)at[MEANS];
+      b.stdevs = (const double*)at[STDEVS];
+      b.rotation = (const double*)at[ROTATION];
+      b.centers = (const double*)at[CENTERS];
+      b.starts = (const uint32_t*)at[STARTS];
+      b.weights = (const double*)at[WEIGHTS];
+      for(size_t cl = 0; cl < b.clusters; ++cl)
+        if(b.starts[cl] > b.starts[cl + 1])
+          throw "model cluster does not match the model.";
+      if(b.starts[0] != 0 || b.starts[b.clusters] != b.functions)
+        throw "model cluster does not match the model.";
+
+      const BinaryFunction* fns = (const BinaryFunction*)at[FUNCTIONS];
+      b.fns = (const ModelFunction*)fns;
+      for(size_t f = 0; f < b.functions; ++f){
+        if(fns[f].kind < ModelFunction::IDENTITY
+           || fns[f].kind > ModelFunction::MIRROR)
+          throw "unknown function encoding in model file.";
+        if(!b.fns[f].valid(b.c))
+          throw "model function uses a missing component.";
+      }
+      return b;
+    }
+
+    vector<string> names_of(const BinaryModel& b){
+      vector<string> names;
+      for(const char* name = b.names; names.size() < b.n;
+          name += strlen(name) + 1)
+        names.push_back(name);
+      return names;
+    }
+
+    Model model_of(const BinaryModel& b){
+      vector<ModelCluster> clusters(b.clusters);
+      for(size_t cl = 0; cl < b.clusters; ++cl){
+        const double* center = b.centers + cl * b.c;
+        clusters[cl].center.assign(center, center + b.c);
+        clusters[cl].weights.assign(b.weights + b.starts[cl],
+                                    b.weights + b.starts[cl + 1]);
+        clusters[cl].functions.assign(b.fns + b.starts[cl],
+                                      b.fns + b.starts[cl + 1]);
+      }
+      return Model(names_of(b),
+                   vector<double>(b.means, b.means + b.c),
+                   vector<double>(b.stdevs, b.stdevs + b.c),
+                   vector<double>(b.rotation, b.rotation + b.n * b.c),
+                   clusters);
+    }
+
+    size_t aligned(size_t offset){
+      return (offset + alignment - 1) / alignment * alignment;
+    }
+
+  } // end anonymous namespace
+
+  Model Model::readBinary(istream& in){
+    ostringstream buffer;
+    buffer << in.rdbuf();
+    string text = buffer.str();
+    // a copy that is aligned for the doubles
+    vector<double> data(text.size() / sizeof(double) + 1);
+    memcpy(&data[0], text.data(), text.size());
+    return model_of(parse_binary((const char*)&data[0], text.size()));
+  }
+
+  void Model::writeBinary(ostream& out) const {
+    const size_t n = names_.size(), c = means_.size();
+    vector<uint32_t> starts(1, 0);
+    vector<double> weights;
+    vector<BinaryFunction> fns;
+    vector<double> centers;
+    for(size_t cl = 0; cl < clusters_.size(); ++cl){
+      const ModelCluster& cluster = clusters_[cl];
+      centers.insert(centers.end(), cluster.center.begin(),
+                     cluster.center.end());
+      weights.insert(weights.end(), cluster.weights.begin(),
+                     cluster.weights.end());
+      for(size_t f = 0; f < cluster.functions.size(); ++f){
+        const ModelFunction& fn = cluster.functions[f];
+        BinaryFunction stored = {fn.kind, fn.i, fn.j, 0, fn.exponent};
+        fns.push_back(stored);
+      }
+      starts.push_back(weights.size());
+    }
+    string names;
+    for(size_t m = 0; m < n; ++m)
+      names += names_[m] + '\0';
+
+    const void* data[SECTIONS] = {
+      names.data(), means_.data(), stdevs_.data(), rotation_.data(),
+      centers.data(), starts.data(), weights.data(), fns.data()};
+    const size_t bytes[SECTIONS] = {
+      names.size(), c * sizeof(double), c * sizeof(double),
+      rotation_.size() * sizeof(double), centers.size() * sizeof(double),
+      starts.size() * sizeof(uint32_t), weights.size() * sizeof(double),
+      fns.size() * sizeof(BinaryFunction)};
+
+    BinaryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, 8);
+    h.version = version;
+    h.byte_order = byte_order;
+    h.inputs = n;
+    h.components = c;
+    h.clusters = clusters_.size();
+    h.functions = fns.size();
+    h.names_size = names.size();
+    size_t offset = sizeof(h);
+    for(int s = 0; s < SECTIONS; ++s){
+      offset = aligned(offset);
+      h.offset[s] = offset;
+      offset += bytes[s];
+    }
+    h.size = offset;
+
+    const char zeros[alignment] = {0};
+    out.write((const char*)&h, sizeof(h));
+    offset = sizeof(h);
+    for(int s = 0; s < SECTIONS; ++s){
+      out.write(zeros, h.offset[s] - offset);
+      out.write((const char*)data[s], bytes[s]);
+      offset = h.offset[s] + bytes[s];
+    }
+    if(!out)
+      throw "can't write binary model.";
+  }
+
+  MappedModel::MappedModel(const string& filename) : map_(MAP_FAILED) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+      throw "can't open model file.";
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BinaryHeader)){
+      close(fd);
+      throw "not a binary model file.";
+    }
+    size_ = st.st_size;
+    map_ = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map_ == MAP_FAILED)
+      throw "can't map model file.";
+
+    try{
+      BinaryModel b = parse_binary((const char*)map_, size_);
+      names_ = names_of(b);
+      c_ = b.c;
+      clusters_ = b.clusters;
+      means_ = b.means;
+      stdevs_ = b.stdevs;
+      rotation_ = b.rotation;
+      centers_ = b.centers;
+      starts_ = b.starts;
+      weights_ = b.weights;
+      functions_ = b.fns;
+    }
+    catch(const char*){
+      munmap(map_, size_);
+      throw;
+    }
+    for(size_t m = 0; m < names_.size(); ++m)
+      index_[names_[m]] = m;
+  }
+
+  MappedModel::~MappedModel(){
+    munmap(map_, size_);
+  }
+
+  int MappedModel::metricIndex(const string& name) const {
+    map<string,int>::const_iterator it = index_.find(name);
+    return it == index_.end() ? -1 : it->second;
+  }
+
+  // the operations of Model::predict, in its order
+  double MappedModel::predict(const double* metrics, double* scratch) const {
+    const size_t n = names_.size(), c = c_;
+    double* rotated = scratch;
+    double* normal = scratch + c;
+    for(size_t k = 0; k < c; ++k)
+      rotated[k] = 0.0;
+    for(size_t m = 0; m < n; ++m){
+      const double* row = rotation_ + m * c;
+      for(size_t k = 0; k < c; ++k)
+        rotated[k] += metrics[m] * row[k];
+    }
+    for(size_t k = 0; k < c; ++k)
+      normal[k] = (rotated[k] - means_[k])
+                  / (stdevs_[k] == 0.0 ? 1.0 : stdevs_[k]);
+
+    size_t best = 0;
+    double bestdist = numeric_limits<double>::infinity();
+    for(size_t cl = 0; cl < clusters_; ++cl){
+      const double* center = centers_ + cl * c;
+      double dist = 0.0;
+      for(size_t k = 0; k < c; ++k)
+        dist += (normal[k] - center[k]) * (normal[k] - center[k]);
+      if(dist < bestdist){
+        bestdist = dist;
+        best = cl;
+      }
+    }
+
+    double sum = 0.0;
+    for(uint32_t f = starts_[best]; f < starts_[best + 1]; ++f)
+      sum += weights_[f] * functions_[f](rotated);
+    return fabs(sum);
+  }
+
+  Model MappedModel::model() const {
+    return model_of(parse_binary((const char*)map_, size_));
+  }
+
+} // end namespace eiger
@@ -0,0 +1,89 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Support for models compiled into C++ by eiger-modelc.
+* Each generated header specializes CompiledModel for the
+* tag type of its model:
+*
+*   #include "gold_model.h"
+*   typedef eiger::CompiledModel<eiger::models::gold> gold;
+*   double metrics[gold::inputs] = {1024};
+*   double time = gold::predict(metrics);
+*
+* Predictions follow eiger::Model::predict() on the model
+* file operation for operation, but the compiler may
+* specialize calls like pow(x, 2.0) for their constant
+* exponents, so they can differ from it in the last bits.
+*
+**********************************************************/
+
+#ifndef EIGERMODEL_COMPILED_H_INCLUDED
+#define EIGERMODEL_COMPILED_H_INCLUDED
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+
+namespace eiger{
+
+  // tag types of compiled models
+  namespace models{}
+
+  // specialized by the headers eiger-modelc writes; each specialization has
+  // inputs, components and clusters, metric(m) and predict(metrics)
+  template<class Tag> struct CompiledModel;
+
+  namespace compiled{
+
+    // the model functions, as eiger::ModelFunction evaluates them
+    inline double power(double x, double exponent){
+      if(x == 0.0)
+        return 1.0;
+      double p = std::pow(std::fabs(x), exponent);
+      return std::isinf(p) ? 0.0 : p;
+    }
+
+    inline double log2(double x){
+      return x == 0.0 ? 1.0 : std::log(std::fabs(x)) / std::log(2.0);
+    }
+
+    // Compares a compiled model with an interpreted one (an eiger::Model
+    // read from the same file) over trials random metric vectors, which mix
+    // zeros, signs and magnitudes from 1e-3 to 1e6. Returns how many
+    // predictions differ by more than tolerance, relative to the
+    // interpreted prediction; all of them if the metrics differ.
+    template<class Tag, class Interpreted>
+    size_t mismatches(const Interpreted& model, size_t trials,
+                      double tolerance = 1e-12, unsigned long seed = 1){
+      typedef CompiledModel<Tag> compiled_model;
+      if(model.inputs() != compiled_model::inputs)
+        return trials;
+      for(size_t m = 0; m < model.inputs(); ++m)
+        if(model.metricNames()[m] != compiled_model::metric(m))
+          return trials;
+      std::mt19937_64 rng(seed);
+      std::uniform_real_distribution<double> exponent(-3.0, 6.0);
+      double metrics[compiled_model::inputs + 1];
+      double scratch[2 * compiled_model::components + 1];
+      size_t differ = 0;
+      for(size_t t = 0; t < trials; ++t){
+        for(size_t m = 0; m < compiled_model::inputs; ++m){
+          unsigned long r = rng();
+          metrics[m] = r % 16 == 0 ? 0.0
+                       : (r & 16 ? -1.0 : 1.0) * std::pow(10.0, exponent(rng));
+        }
+        double want = model.predict(metrics, scratch);
+        double got = compiled_model::predict(metrics);
+        bool same = want == got || (std::isnan(want) && std::isnan(got))
+                    || std::fabs(got - want) <= tolerance * std::fabs(want);
+        if(!same)
+          ++differ;
+      }
+      return differ;
+    }
+
+  } // end namespace compiled
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,38 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks models compiled by eiger-modelc against the same
+* model files read by the model runtime, over random metric
+* vectors.
+*
+**********************************************************/
+#include <cstdio>
+
+#include "eigermodel.h"
+#include "gold_model.h"
+#include "multi_model.h"
+
+static int failures = 0;
+
+template <class Tag>
+static void check(const char* filename) {
+  const size_t trials = 100000;
+  eiger::Model model = eiger::Model::readFile(filename);
+  size_t differ = eiger::compiled::mismatches<Tag>(model, trials);
+  if (differ) {
+    printf("%s: %zu of %zu compiled predictions differ\n", filename, differ,
+           trials);
+    ++failures;
+  }
+}
+
+int main() {
+  try {
+    check<eiger::models::gold>(GOLD_MODEL);
+    check<eiger::models::multi>(MULTI_MODEL);
+  } catch (const char* msg) {
+    printf("%s\n", msg);
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The batch prediction kernel of the model runtime, written
+* once over a vector of lanes and compiled for each
+* instruction set libeigermodel supports.
+*
+**********************************************************/
+
+#ifndef EIGERMODEL_KERNEL_H_INCLUDED
+#define EIGERMODEL_KERNEL_H_INCLUDED
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "eigermodel.h"
+
+namespace eiger{
+namespace kernel{
+
+  // Metric vectors are predicted a block at a time, transposed so that each
+  // pass runs over one value of every vector in the block.
+  static const size_t block = 64;
+  // room past the block for the last, partial vector of lanes
+  static const size_t stride = block + 8;
+
+  inline size_t scratch_size(size_t inputs, size_t components){
+    return (inputs + 3 * components + 4) * stride;
+  }
+
+  typedef void (*batch_fn)(const Model& model, const double* metrics,
+                           size_t count, double* predictions, double* scratch);
+
+  struct BatchKernel {
+    const char* name;
+    batch_fn run;
+  };
+
+  // the kernels this build can run on this processor, fastest last
+  std::vector<BatchKernel> batch_kernels();
+
+  void predict_scalar(const Model&, const double*, size_t, double*, double*);
+#ifdef HAVE_AVX2_KERNEL
+  void predict_avx2(const Model&, const double*, size_t, double*, double*);
+#endif
+#ifdef HAVE_AVX512_KERNEL
+  void predict_avx512(const Model&, const double*, size_t, double*, double*);
+#endif
+
+  // Powers with these exponents are computed from products, quotients and
+  // square roots, which can differ from pow in the last bit.
+  inline bool fast_power(double e){
+    return e == 0.0 || e == 1.0 || e == 2.0 || e == -1.0 || e == -2.0
+        || e == 0.5 || e == -0.5;
+  }
+
+  // Accumulates the regression of cl into sum for lanes [lo, hi) of the
+  // components x, laid out stride apart; hi - lo is a multiple of the width.
+  template<class V>
+  void regression(const ModelCluster& cl, const double* x, size_t lo,
+                  size_t hi, double* sum, double* term){
+    typedef typename V::reg reg;
+    const reg zero = V::set1(0.0), one = V::set1(1.0);
+    const reg inf = V::set1(std::numeric_limits<double>::infinity());
+    const double ln2 = std::log(2.0);
+    for(size_t b = lo; b < hi; b += V::width)
+      V::store(sum + b, zero);
+
+    for(size_t f = 0; f < cl.functions.size(); ++f){
+      const ModelFunction& fn = cl.functions[f];
+      const reg w = V::set1(cl.weights[f]);
+      const double* xi = fn.i < 0 ? x : x + fn.i * stride;
+      const double* xj = fn.j < 0 ? x : x + fn.j * stride;
+      switch(fn.kind){
+        case ModelFunction::IDENTITY:
+          for(size_t b = lo; b < hi; b += V::width)
+            V::store(sum + b, V::add(V::load(sum + b), V::mul(w, one)));
+          break;
+        case ModelFunction::PRODUCT:
+          for(size_t b = lo; b < hi; b += V::width){
+            reg t = V::mul(V::load(xi + b), V::load(xj + b));
+            V::store(sum + b, V::add(V::load(sum + b), V::mul(w, t)));
+          }
+          break;
+        case ModelFunction::SQRT:
+          for(size_t b = lo; b < hi; b += V::width){
+            reg t = V::sqrt(V::abs(V::load(xi + b)));
+            V::store(sum + b, V::add(V::load(sum + b), V::mul(w, t)));
+          }
+          break;
+        case ModelFunction::QUOTIENT:
+          for(size_t b = lo; b < hi; b += V::width){
+            reg t = fn.j < 0 ? V::div(one, V::load(xi + b))
+                             : V::div(V::load(xi + b), V::load(xj + b));
+            V::store(sum + b, V::add(V::load(sum + b), V::mul(w, t)));
+          }
+          break;
+        case ModelFunction::HINGE:
+        case ModelFunction::MIRROR: {
+          const reg knot = V::set1(fn.exponent);
+          for(size_t b = lo; b < hi; b += V::width){
+            reg t = fn.kind == ModelFunction::HINGE
+                    ? V::sub(V::load(xi + b), knot)
+                    : V::sub(knot, V::load(xi + b));
+            t = V::select(V::less(zero, t), t, zero);
+            V::store(sum + b, V::add(V::load(sum + b), V::mul(w, t)));
+          }
+          break;
+        }
+        case ModelFunction::POWER:
+          if(fast_power(fn.exponent)){
+            const double e = fn.exponent;
+            for(size_t b = lo; b < hi; b += V::width){
+              reg v = V::load(xi + b), a = V::abs(v), t;
+              if(e == 0.0) t = one;
+              else if(e == 1.0) t = a;
+              else if(e == 2.0) t = V::mul(a, a);
+              else if(e == -1.0) t = V::div(one, a);
+              else if(e == -2.0) t = V::div(one, V::mul(a, a));
+              else if(e == 0.5) t = V::sqrt(a);
+              else t = V::div(one, V::sqrt(a));
+              t = V::select(V::equal(t, inf), zero, t);
+              t = V::select(V::equal(v, zero), one, t);
+              V::store(sum + b, V::add(V::load(sum + b), V::mul(w, t)));
+            }
+            break;
+          }
+          // other powers, like logs, go through libm a lane at a time
+          for(size_t b = lo; b < hi; ++b){
+            double p = std::pow(std::fabs(xi[b]), fn.exponent);
+            term[b] = xi[b] == 0.0 ? 1.0 : std::isinf(p) ? 0.0 : p;
+          }
+          for(size_t b = lo; b < hi; b += V::width)
+            V::store(sum + b, V::add(V::load(sum + b),
+                                     V::mul(w, V::load(term + b))));
+          break;
+        case ModelFunction::LOG:
+          for(size_t b = lo; b < hi; ++b)
+            term[b] = xi[b] == 0.0 ? 1.0 : std::log(std::fabs(xi[b])) / ln2;
+          for(size_t b = lo; b < hi; b += V::width)
+            V::store(sum + b, V::add(V::load(sum + b),
+                                     V::mul(w, V::load(term + b))));
+          break;
+      }
+    }
+  }
+
+  // Model::predict over count metric vectors, with the scratch of
+  // scratch_size doubles.
+  template<class V>
+  void predict(const Model& model, const double* metrics, size_t count,
+               double* predictions, double* scratch){
+    typedef typename V::reg reg;
+    const size_t n = model.inputs(), c = model.components();
+    const std::vector<ModelCluster>& clusters = model.clusters();
+    const double* rotation = model.rotation().data();
+    double* x = scratch;
+    double* rotated = x + n * stride;
+    double* normal = rotated + c * stride;
+    double* grouped = normal + c * stride;
+    double* best = grouped + c * stride;
+    double* sum = best + stride;
+    double* term = sum + stride;
+
+    for(size_t first = 0; first < count; first += block){
+      const size_t nb = count - first < block ? count - first : block;
+      const size_t np = (nb + V::width - 1) / V::width * V::width;
+      const double* in = metrics + first * n;
+      double* out = predictions + first;
+
+      for(size_t m = 0; m < n; ++m){
+        double* row = x + m * stride;
+        for(size_t b = 0; b < nb; ++b)
+          row[b] = in[b * n + m];
+        for(size_t b = nb; b < np; ++b)
+          row[b] = 0.0;
+      }
+
+      // rotation, in the order of the single prediction
+      for(size_t k = 0; k < c; ++k)
+        for(size_t b = 0; b < np; b += V::width)
+          V::store(rotated + k * stride + b, V::set1(0.0));
+      for(size_t m = 0; m < n; ++m){
+        const double* row = x + m * stride;
+        for(size_t k = 0; k < c; ++k){
+          const reg r = V::set1(rotation[m * c + k]);
+          double* rk = rotated + k * stride;
+          for(size_t b = 0; b < np; b += V::width)
+            V::store(rk + b, V::add(V::load(rk + b),
+                                    V::mul(V::load(row + b), r)));
+        }
+      }
+
+      if(clusters.size() == 1){
+        regression<V>(clusters[0], rotated, 0, np, sum, term);
+        for(size_t b = 0; b < nb; ++b)
+          out[b] = std::fabs(sum[b]);
+        continue;
+      }
+
+      for(size_t k = 0; k < c; ++k){
+        const double sd = model.stdevs()[k];
+        const reg mean = V::set1(model.means()[k]);
+        const reg scale = V::set1(sd == 0.0 ? 1.0 : sd);
+        for(size_t b = 0; b < np; b += V::width)
+          V::store(normal + k * stride + b,
+                   V::div(V::sub(V::load(rotated + k * stride + b), mean),
+                          scale));
+      }
+
+      // nearest center; ties and NaN distances keep the earlier cluster
+      for(size_t b = 0; b < np; b += V::width){
+        reg bestdist = V::set1(std::numeric_limits<double>::infinity());
+        reg which = V::set1(0.0);
+        for(size_t cl = 0; cl < clusters.size(); ++cl){
+          const double* center = clusters[cl].center.data();
+          reg dist = V::set1(0.0);
+          for(size_t k = 0; k < c; ++k){
+            reg d = V::sub(V::load(normal + k * stride + b),
+                           V::set1(center[k]));
+            dist = V::add(dist, V::mul(d, d));
+          }
+          typename V::mask closer = V::less(dist, bestdist);
+          bestdist = V::select(closer, dist, bestdist);
+          which = V::select(closer, V::set1((double)cl), which);
+        }
+        V::store(best + b, which);
+      }
+
+      // gather the lanes of each cluster together and run its regression
+      unsigned char lane[block];
+      size_t p = 0;
+      for(size_t cl = 0; cl < clusters.size() && p < nb; ++cl){
+        const size_t start = p;
+        for(size_t b = 0; b < nb; ++b)
+          if(best[b] == (double)cl)
+            lane[p++] = b;
+        if(p == start)
+          continue;
+        for(size_t k = 0; k < c; ++k){
+          const double* from = rotated + k * stride;
+          double* to = grouped + k * stride;
+          for(size_t q = start; q < p; ++q)
+            to[q] = from[lane[q]];
+        }
+        const size_t end = start + (p - start + V::width - 1)
+                                   / V::width * V::width;
+        regression<V>(clusters[cl], grouped, start, end, sum, term);
+        for(size_t q = start; q < p; ++q)
+          out[lane[q]] = std::fabs(sum[q]);
+      }
+    }
+  }
+
+} // end namespace kernel
+} // end namespace eiger
+
+#endif
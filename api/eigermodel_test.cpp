@@ -0,0 +1,367 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks the C++ model runtime against predictions made
+* the Eiger.py way for examples/gold.model, a model that
+* uses every regression function and more than one
+* cluster and one of MARS hinge functions, in all three
+* model file formats, one at a time and in batches.
+*
+**********************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "eigermodel.h"
+#include "eigermodel_kernel.h"
+
+static int failures = 0;
+
+static const char* gold_model =
+  "1\n"
+  "size\n"
+  "[1](255.0)\n"
+  "[1](145.773797371)\n"
+  "[1,1]((1.0))\n"
+  "Model 0\n"
+  "[1](1.7763568394e-17)\n"
+  "[4](1.0037181792658046e-05, -0.0088573713956641049, "
+  "0.18572017261061566, -0.15834192882186315)\n"
+  "1 0 2\n"
+  "1 0 1\n"
+  "1 0 0.5\n"
+  "4 0\n";
+
+static const char* multi_model =
+  "3\n"
+  "flops\n"
+  "bytes\n"
+  "ranks\n"
+  "[2](1000.0,50.0)\n"
+  "[2](400.0,0.0)\n"
+  "[3,2]((0.5,0.1),(0.25,-0.2),(1.0,0.0))\n"
+  "Model 0\n"
+  "[2](-1.0,0.0)\n"
+  "[6](2.5,0.001,-0.75,3.0,0.125,1e-05)\n"
+  "0\n"
+  "1 0 -0.5\n"
+  "2 0 1\n"
+  "3 1\n"
+  "4 0\n"
+  "5 0 1\n"
+  "Model 1\n"
+  "[2](1.0,3.0)\n"
+  "[4](1.5,-2.0,0.5,7.0)\n"
+  "1 1 2\n"
+  "5 1\n"
+  "1 0 1e6\n"
+  "4 1\n";
+
+// multi_model as writeToFileJSON writes it, except that the single index
+// quotient becomes x_1 / x_0; the second cluster has the string fields of a
+// converted bespoke model
+static const char* multi_json =
+  "{\n"
+  "    \"metric_names\": [\"flops\", \"bytes\", \"ranks\"],\n"
+  "    \"means\": [1000.0, 50.0],\n"
+  "    \"std_devs\": [400.0, 0.0],\n"
+  "    \"rotation_matrix\": [[0.5, 0.1], [0.25, -0.2], [1.0, 0.0]],\n"
+  "    \"comment\": {\"skipped\": [true, null, \"\\u00e9\"]},\n"
+  "    \"clusters\": [\n"
+  "        {\"center\": [-1.0, 0.0], \"regressors\": [\n"
+  "            {\"function\": \"identity\", \"weight\": 2.5},\n"
+  "            {\"function\": \"power\", \"index\": 0, \"exponent\": -0.5,"
+  " \"weight\": 0.001},\n"
+  "            {\"function\": \"product\", \"first_idx\": 0,"
+  " \"second_idx\": 1, \"weight\": -0.75},\n"
+  "            {\"function\": \"sqrt\", \"index\": 1, \"weight\": 3.0},\n"
+  "            {\"function\": \"log\", \"index\": 0, \"weight\": 0.125},\n"
+  "            {\"weight\": 1e-05, \"function\": \"quotient\","
+  " \"first_idx\": 0, \"second_idx\": 1}]},\n"
+  "        {\"center\": [1.0, 3.0], \"regressors\": [\n"
+  "            {\"function\": \"power\", \"index\": \"1\", \"exponent\": \"2\","
+  " \"weight\": 1.5},\n"
+  "            {\"function\": \"quotient\", \"first_idx\": \"1\","
+  " \"second_idx\": \"0\", \"weight\": -2.0},\n"
+  "            {\"function\": \"power\", \"index\": \"0\","
+  " \"exponent\": \"1e6\", \"weight\": 0.5},\n"
+  "            {\"function\": \"log\", \"index\": \"1\", \"weight\": 7.0}]}\n"
+  "    ]\n"
+  "}\n";
+
+// the hinge functions of an additive MARS model, in both text formats
+static const char* hinge_model =
+  "1\n"
+  "size\n"
+  "[1](0.0)\n"
+  "[1](1.0)\n"
+  "[1,1]((1.0))\n"
+  "Model 0\n"
+  "[1](0.0)\n"
+  "[3](1.0,2.0,-0.5)\n"
+  "0\n"
+  "6 0 10\n"
+  "7 0 4.5\n";
+
+static const char* hinge_json =
+  "{\"metric_names\": [\"size\"], \"means\": [0.0], \"std_devs\": [1.0],"
+  " \"rotation_matrix\": [[1.0]], \"clusters\": [{\"center\": [0.0],"
+  " \"regressors\": [{\"function\": \"identity\", \"weight\": 1.0},"
+  " {\"function\": \"hinge\", \"index\": 0, \"knot\": 10.0, \"weight\": 2.0},"
+  " {\"function\": \"mirror\", \"index\": \"0\", \"knot\": \"4.5\","
+  " \"weight\": -0.5}]}]}";
+
+static eiger::Model parse(const char* text) {
+  std::istringstream in(text);
+  return eiger::Model::read(in);
+}
+
+static void expect(const char* what, double got, double want) {
+  if (std::fabs(got - want) > 1e-13 * std::fabs(want)) {
+    printf("%s: predicted %.17g, expected %.17g\n", what, got, want);
+    ++failures;
+  }
+}
+
+// Every batch kernel must give the same bits, and those must agree with the
+// single prediction up to the powers the batch kernels compute without pow.
+static void check_batch(const char* what, const eiger::Model& model) {
+  const size_t count = 1000;  // not a whole number of blocks
+  const size_t n = model.inputs();
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> value(-5000.0, 5000.0);
+  std::vector<double> metrics(count * n);
+  for (size_t k = 0; k < metrics.size(); ++k) metrics[k] = value(rng);
+
+  std::vector<double> single(count), scratch(model.scratchSize() + 1);
+  for (size_t k = 0; k < count; ++k) {
+    single[k] = model.predict(&metrics[k * n], &scratch[0]);
+  }
+
+  std::vector<eiger::kernel::BatchKernel> kernels =
+      eiger::kernel::batch_kernels();
+  std::vector<double> first(count), batch(count);
+  scratch.resize(model.batchScratchSize());
+  for (size_t kn = 0; kn < kernels.size(); ++kn) {
+    std::vector<double>& out = kn == 0 ? first : batch;
+    kernels[kn].run(model, &metrics[0], count, &out[0], &scratch[0]);
+    for (size_t k = 0; k < count; ++k) {
+      bool ok = kn == 0
+          ? std::fabs(out[k] - single[k]) <= 1e-12 * std::fabs(single[k])
+          : memcmp(&out[k], &first[k], sizeof(double)) == 0;
+      if (!ok) {
+        printf("%s: %s kernel predicted %.17g for vector %zu, expected %.17g\n",
+               what, kernels[kn].name, out[k], k,
+               kn == 0 ? single[k] : first[k]);
+        ++failures;
+        break;
+      }
+    }
+  }
+}
+
+// The binary format must round-trip exactly, and a mapped file predict the
+// same bits as the model it was written from.
+static std::string check_binary(const char* what, const eiger::Model& model) {
+  std::ostringstream out;
+  model.writeBinary(out);
+  const std::string bytes = out.str();
+  std::istringstream in(bytes);
+  const eiger::Model back = eiger::Model::read(in);
+  std::ostringstream again;
+  back.writeBinary(again);
+  if (again.str() != bytes) {
+    printf("%s: binary model does not round-trip\n", what);
+    ++failures;
+  }
+
+  char filename[] = "/tmp/eigermodel_test.XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0 || write(fd, bytes.data(), bytes.size()) != (ssize_t)bytes.size()) {
+    printf("%s: can't write %s\n", what, filename);
+    ++failures;
+    return bytes;
+  }
+  close(fd);
+  const eiger::MappedModel mapped(filename);
+  unlink(filename);
+  const eiger::Model copied = mapped.model();
+  if (mapped.metricNames() != model.metricNames() ||
+      mapped.clusterCount() != model.clusters().size()) {
+    printf("%s: mapped model has the wrong shape\n", what);
+    ++failures;
+  }
+
+  const size_t n = model.inputs();
+  std::mt19937_64 rng(7);
+  std::uniform_real_distribution<double> value(-5000.0, 5000.0);
+  std::vector<double> metrics(n + 1), scratch(model.scratchSize() + 1);
+  for (int k = 0; k < 1000; ++k) {
+    for (size_t m = 0; m < n; ++m) metrics[m] = k % 10 ? value(rng) : 0.0;
+    const double want = model.predict(&metrics[0], &scratch[0]);
+    const double got[] = {back.predict(&metrics[0], &scratch[0]),
+                          mapped.predict(&metrics[0], &scratch[0]),
+                          copied.predict(&metrics[0], &scratch[0])};
+    for (int g = 0; g < 3; ++g) {
+      if (memcmp(&got[g], &want, sizeof(double)) != 0) {
+        printf("%s: binary model %d predicted %.17g, expected %.17g\n", what,
+               g, got[g], want);
+        ++failures;
+        return bytes;
+      }
+    }
+  }
+  return bytes;
+}
+
+static void expect_binary_error(const std::string& bytes) {
+  try {
+    std::istringstream in(bytes);
+    eiger::Model::readBinary(in);
+    printf("accepted a malformed binary model\n");
+    ++failures;
+  } catch (const char*) {
+  }
+}
+
+static void expect_error(const char* text) {
+  try {
+    parse(text);
+    printf("accepted a malformed model:\n%s", text);
+    ++failures;
+  } catch (const char*) {
+  }
+}
+
+int main() {
+  try {
+    eiger::Model gold = parse(gold_model);
+    eiger::ModelInput in(gold);
+    const double sizes[] = {1, 16, 255, 1000, 0};
+    const double gold_want[] = {0.17687283839674423, 0.029635448636695205,
+                                0.093910024846326712, 5.4747964200295876,
+                                0.018530909574881071};
+    for (int k = 0; k < 5; ++k) {
+      in.set("size", sizes[k]);
+      expect("gold.model", gold.predict(in), gold_want[k]);
+    }
+
+    eiger::Model multi = parse(multi_model);
+    if (multi.metricIndex("ranks") != 2 || multi.metricIndex("time") != -1) {
+      printf("metric indices are wrong\n");
+      ++failures;
+    }
+    // the third point overflows 1 0 1e6, which Eiger.py scores as 0
+    const double points[][3] = {{100, 2000, 16}, {3000, 10, 64},
+                                {1e4, -1e5, 8}, {0.5, 0.3, 0.125}};
+    const double multi_want[] = {165617.88836277506, 133263.52746823383,
+                                 661500100.50661671, 2.6604153253043687};
+    eiger::ModelInput named(multi);
+    double scratch[4];
+    for (int k = 0; k < 4; ++k) {
+      named.set("flops", points[k][0]);
+      named.set("bytes", points[k][1]);
+      named.set("ranks", points[k][2]);
+      expect("named metrics", multi.predict(named), multi_want[k]);
+      expect("metric array", multi.predict(points[k], scratch), multi_want[k]);
+    }
+
+    eiger::Model json = parse(multi_json);
+    const double json_want[] = {165617.88836277506, 133263.15371363622,
+                                661500102.60755229, 2.6604153253043687};
+    if (json.metricNames() != multi.metricNames()) {
+      printf("JSON metric names are wrong\n");
+      ++failures;
+    }
+    for (int k = 0; k < 4; ++k) {
+      expect("JSON model", json.predict(points[k], scratch), json_want[k]);
+    }
+
+    eiger::Model hinge = parse(hinge_model);
+    eiger::Model hinge_from_json = parse(hinge_json);
+    const double hinge_sizes[] = {1, 4.5, 10, 12};
+    const double hinge_want[] = {0.75, 1, 1, 5};
+    for (int k = 0; k < 4; ++k) {
+      expect("hinge model", hinge.predict(&hinge_sizes[k], scratch),
+             hinge_want[k]);
+      expect("JSON hinge model", hinge_from_json.predict(&hinge_sizes[k],
+                                                         scratch),
+             hinge_want[k]);
+    }
+
+    check_batch("gold.model", gold);
+    check_batch("multiple clusters", multi);
+    check_batch("JSON model", json);
+    check_batch("hinge model", hinge);
+
+    check_binary("gold.model", gold);
+    check_binary("JSON model", json);
+    check_binary("hinge model", hinge);
+    const std::string bytes = check_binary("multiple clusters", multi);
+    expect_binary_error(bytes.substr(0, bytes.size() - 8));
+    std::string corrupt = bytes;
+    corrupt[8] = 2;  // version
+    expect_binary_error(corrupt);
+    uint64_t functions;  // the offset of the first function's kind
+    memcpy(&functions, &bytes[104], sizeof(functions));
+    corrupt = bytes;
+    corrupt[functions] = 9;
+    expect_binary_error(corrupt);
+    corrupt = bytes;
+    corrupt[0] = '{';
+    expect_binary_error(corrupt);
+    // a product of x_0 and x_-1 would read before the metrics
+    const int32_t product[] = {eiger::ModelFunction::PRODUCT, 0, -1};
+    corrupt = bytes;
+    memcpy(&corrupt[functions], product, sizeof(product));
+    expect_binary_error(corrupt);
+
+    std::vector<eiger::ModelCluster> clusters(1);
+    clusters[0].center.assign(1, 0.0);
+    clusters[0].weights.assign(1, 1.0);
+    eiger::ModelFunction fn = {eiger::ModelFunction::PRODUCT, -1, 0, 0.0};
+    clusters[0].functions.assign(1, fn);
+    try {
+      eiger::Model(std::vector<std::string>(1, "size"),
+                   std::vector<double>(1, 0.0), std::vector<double>(1, 1.0),
+                   std::vector<double>(1, 1.0), clusters);
+      printf("accepted a product of a missing component\n");
+      ++failures;
+    } catch (const char*) {
+    }
+  } catch (const char* msg) {
+    printf("%s\n", msg);
+    return 1;
+  }
+
+  expect_error("");
+  expect_error("1\nsize\n[2](1.0,2.0)\n[2](1.0,1.0)\n[1,1]((1.0))\n");
+  expect_error("1\nsize\n[1](1.0)\n[1](1.0)\n[1,1]((1.0))\n");
+  expect_error("1\nsize\n[1](1.0)\n[1](1.0)\n[1,1]((1.0))\n"
+               "Model 0\n[1](0.0)\n[1](1.0)\n2 0 1\n");
+  expect_error("1\nsize\n[1](1.0)\n[1](1.0)\n[1,1]((1.0))\n"
+               "Model 0\n[1](0.0)\n[1](1.0)\n8 0 1\n");
+  expect_error("1\nsize\n[1](1.0)\n[1](1.0)\n[1,1]((1.0))\n"
+               "Model 0\n[1](0.0)\n[2](1.0,2.0)\n0\n");
+  expect_error("{\"metric_names\": [\"size\"], \"means\": [1.0]");
+  expect_error("{\"metric_names\": [\"size\"], \"means\": [1.0],"
+               " \"std_devs\": [1.0], \"rotation_matrix\": [[1.0]],"
+               " \"clusters\": [{\"center\": [0.0], \"regressors\":"
+               " [{\"function\": \"power\", \"weight\": 1.0}]}]}");
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,432 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Native parts of model training for Eiger.py, which calls
+* them through the C functions at the end of this file
+* (see eiger/native.py).
+*
+**********************************************************/
+
+#ifndef EIGERTRAIN_H_INCLUDED
+#define EIGERTRAIN_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "eigermodel.h"
+
+namespace eiger{
+
+  namespace train{
+
+    // A fixed set of threads that share out the chunks of parallelFor loops.
+    // Each thread has a queue of its own chunks and takes from the front of
+    // another's when its own is empty. A thread waiting for a loop to finish
+    // runs chunks meanwhile, so loops may be nested in the chunks of others.
+    class ThreadPool {
+      public:
+        // threads counts the calling thread; 0 means one per core
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+
+        size_t size() const { return queues_.size(); }
+
+        // Calls body(first, last) over [begin, end) in chunks of at most
+        // grain indices, on the pool's threads and the calling one, and
+        // returns once every chunk has. Rethrows the first exception a
+        // chunk threw.
+        void parallelFor(size_t begin, size_t end, size_t grain,
+                         const std::function<void(size_t, size_t)>& body);
+
+      private:
+        struct Loop;
+        struct Chunk {
+          Loop* loop;
+          size_t begin, end;
+        };
+        struct Queue {
+          std::mutex lock;
+          std::deque<Chunk> chunks;
+        };
+
+        std::vector<std::unique_ptr<Queue> > queues_;
+        std::vector<std::thread> workers_;
+        std::atomic<size_t> queued_;
+        std::mutex sleep_;
+        std::condition_variable wake_;
+        bool stopping_;
+
+        void work(size_t self);
+        // runs one chunk from self's queue or another's; false if none
+        bool runOne(size_t self);
+        size_t self() const;
+    };
+
+    // threads->parallelFor, or the whole range in one call without threads
+    void parallelFor(ThreadPool* threads, size_t begin, size_t end,
+                     size_t grain,
+                     const std::function<void(size_t, size_t)>& body);
+
+    // Fills basis with every function of a pool evaluated on each row of
+    // the row-major profile, rows by inputs. basis is column-major, a column
+    // of rows values to a function, so a Fortran-ordered NumPy array can be
+    // filled in place. Each function is one pass over the columns of the
+    // metrics it names, and functions of the same metric share its
+    // absolute value, square and square root. Powers are computed as the
+    // batch kernel of the model runtime computes them.
+    void basis(const double* profile, size_t rows, size_t inputs,
+               const std::vector<ModelFunction>& functions, double* basis,
+               ThreadPool* threads = 0);
+
+    // The count, means and co-moments (sums of products of deviations from
+    // the means) of the rows of a table seen so far. Rows are added in
+    // blocks of a fixed size, each reduced about its own means and then
+    // merged with the pairwise update of Chan, Golub and LeVeque, so the
+    // result doesn't depend on the number of threads and a table needn't
+    // fit in memory at once.
+    struct Moments {
+      size_t count;
+      std::vector<double> mean;
+      // columns by columns
+      std::vector<double> comoment;
+
+      explicit Moments(size_t columns = 0);
+
+      size_t columns() const { return mean.size(); }
+      // adds n rows of the row-major table rows
+      void add(const double* rows, size_t n, ThreadPool* threads = 0);
+      void merge(const Moments& other);
+    };
+
+    // The principal components of a table, as PCA.PCA finds them without
+    // its rotation: the eigenvalues of X'X for the table X centred, and
+    // scaled by the standard deviation of each column unless scale is
+    // false, largest first. Eigenvalues too small to tell from rounding
+    // are 0. There are min(rows, columns) components, each a column of
+    // components (columns by that many), with its largest entry positive.
+    struct PrincipalComponents {
+      std::vector<double> loadings;
+      std::vector<double> components;
+    };
+    PrincipalComponents principalComponents(const Moments& moments,
+                                            bool scale = true);
+
+    // Eigenvalues and eigenvectors of the symmetric n by n matrix a, by
+    // Householder reduction to tridiagonal form and the implicit QL method.
+    // Leaves the eigenvectors in the columns of a, in ascending order of
+    // their eigenvalues.
+    std::vector<double> symmetricEigen(std::vector<double>& a, size_t n);
+
+    // How kmeans searches.
+    struct KMeansOptions {
+      // runs from different seedings; the one with the least inertia wins
+      size_t restarts;
+      // the most iterations of Lloyd's algorithm, or mini-batches
+      size_t iterations;
+      // stop once the centers move less than this in a step (the sum of
+      // their squared moves), relative to the mean variance of the points
+      double tolerance;
+      // points sampled to a mini-batch, or 0 for Lloyd's algorithm over
+      // every point; with batches, the restarts only choose the seeding
+      size_t batch;
+      uint64_t seed;
+
+      // 10 restarts of at most 300 Lloyd iterations, tolerance 1e-4, as
+      // sklearn's KMeans
+      KMeansOptions();
+    };
+
+    // k centers of a set of points, in the normalized component space of
+    // the model file, a row to a center.
+    struct Clustering {
+      std::vector<double> centers;
+      // the center of each point
+      std::vector<size_t> labels;
+      // the sum of squared distances from the points to their centers
+      double inertia;
+    };
+
+    // k-means of n points, a row of dimensions values to a point, seeded by
+    // greedy k-means++ and refined by Lloyd's algorithm or, with a batch,
+    // by Sculley's mini-batch updates. Points are processed in blocks of a
+    // fixed size whose sums are combined in order, so the clustering is
+    // the same on any number of threads.
+    Clustering kmeans(const double* points, size_t n, size_t dimensions,
+                      size_t k, const KMeansOptions& options,
+                      ThreadPool* threads = 0);
+
+    // The nearest of k centers to each of n points, with ties and NaN
+    // distances going to the earlier center, as in the model runtime.
+    void assignClusters(const double* points, size_t n, size_t dimensions,
+                        const double* centers, size_t k, size_t* labels,
+                        ThreadPool* threads = 0);
+
+    // The functions a stepwise regression picked, in the order it picked
+    // them, with their least squares weights.
+    struct StepwiseFit {
+      std::vector<size_t> selected;
+      std::vector<double> weights;
+      // of the predictions for the test rows; 0 and -inf with no functions
+      double r2, r2_adjusted;
+    };
+
+    // Forward stepwise regression as LinearRegression.search_regression
+    // does it. train and test are row-major tables of every function of the
+    // pool evaluated on each row, functions values wide. Each step adds the
+    // function whose least squares fit to train_y gives the best adjusted
+    // R^2 on the test rows, for as long as that improves on the previous
+    // step by more than threshold; ties go to the first function.
+    //
+    // The fit is kept as a QR factorization that grows by a column a step,
+    // and every function still in the pool is kept orthogonalized against
+    // it, so scoring a function costs a pass over its column rather than a
+    // new least squares solve. A function whose training column depends
+    // linearly on those already picked is scored with a weight of 0.
+    //
+    // With a thread pool, candidates are scored and updated in parallel.
+    // Each candidate's arithmetic is the same whichever thread does it and
+    // the best is picked in pool order, so the fit doesn't depend on the
+    // number of threads.
+    StepwiseFit stepwise(const double* train, const double* train_y,
+                         size_t train_rows, const double* test,
+                         const double* test_y, size_t test_rows,
+                         size_t functions, double threshold,
+                         ThreadPool* threads = 0);
+
+    // The rows of one fold of a cross validation.
+    struct Fold {
+      std::vector<size_t> train, test;
+    };
+
+    // stepwise() on each fold of lookup, every function of the pool
+    // evaluated on all rows and stored a column of rows values to a function
+    // (as basis() makes it), with every fold searching the whole pool. The
+    // folds run concurrently on threads.
+    std::vector<StepwiseFit> stepwiseFolds(const double* lookup,
+                                           const double* y, size_t rows,
+                                           size_t functions,
+                                           const std::vector<Fold>& folds,
+                                           double threshold,
+                                           ThreadPool& threads);
+
+    // One factor of a MARS term: max(x - knot, 0) on a variable when
+    // positive, otherwise max(knot - x, 0).
+    struct Hinge {
+      size_t variable;
+      double knot;
+      bool positive;
+    };
+
+    // A MARS model: its terms, each a product of hinges on different
+    // variables (the constant term has none), and their least squares
+    // weights.
+    struct MarsFit {
+      std::vector<std::vector<Hinge> > terms;
+      std::vector<double> weights;
+      // the residual sum of squares and generalized cross validation score
+      // of the fit
+      double rss, gcv;
+    };
+
+    // Multivariate adaptive regression splines as MARS.MARS fits them, for
+    // rows of variables values in the row-major table x. The forward pass
+    // adds the pair of mirrored hinges, on a variable and at a knot taken
+    // from the rows, times a term already in the model, that most reduces
+    // the residual sum of squares, until there are max_terms terms (the
+    // last pair may pass it by one). A term has at most max_interactions
+    // hinges. The backward pass then drops a term at a time, the one whose
+    // removal costs least, and keeps the model with the least GCV, with
+    // penalty 3 per pair of hinges.
+    //
+    // Every knot of a variable and parent term is scored in one pass over
+    // the rows in decreasing order of the variable, from running sums of
+    // the hinge's products with the residual and an orthonormal basis of
+    // the model (Friedman, "Fast MARS", 1993), rather than by refitting the
+    // model. Variables are searched in parallel on threads, and the best
+    // pair is picked in order of parent term, variable and knot, so the
+    // model doesn't depend on the number of threads.
+    MarsFit mars(const double* x, const double* y, size_t rows,
+                 size_t variables, size_t max_terms, size_t max_interactions,
+                 ThreadPool* threads = 0);
+
+    // The regression of fit as the model runtime evaluates it, with a
+    // HINGE or MIRROR function to a term; throws if a term has more than
+    // one hinge.
+    ModelCluster marsCluster(const MarsFit& fit);
+
+    // A k-d tree over the rows of a table of points, which it copies. Each
+    // node splits its points at the median of the dimension in which they
+    // spread most, down to leaves of a few points stored side by side.
+    class KDTree {
+      public:
+        // A point found by a search: its row of the table and squared
+        // Euclidean distance. Ordered by distance, then row.
+        typedef std::pair<double, size_t> Neighbor;
+        // throws unless every coordinate is finite
+        KDTree(const double* points, size_t n, size_t dimensions);
+        size_t size() const { return rows_.size(); }
+        size_t dimensions() const { return dimensions_; }
+        // The k nearest points to query, nearest first, with ties going to
+        // the earlier row; all of them if there are no more than k.
+        void nearest(const double* query, size_t k,
+                     std::vector<Neighbor>& neighbors) const;
+        // The rows of every point within squared distance radius2 of query,
+        // in order.
+        void within(const double* query, double radius2,
+                    std::vector<size_t>& rows) const;
+      private:
+        struct Node {
+          // the node's points, [begin, end) of points_
+          size_t begin, end;
+          // children, or 0 for a leaf; the left one holds the points with
+          // coordinates up to split in dimension, the right those from it
+          size_t left, right;
+          size_t dimension;
+          double split;
+        };
+        size_t dimensions_;
+        std::vector<Node> nodes_;
+        // the points in the order of the leaves, and the row of each
+        std::vector<double> points_;
+        std::vector<size_t> rows_;
+        size_t build(const double* points, std::vector<size_t>& order,
+                     size_t begin, size_t end);
+        double distance(const double* query, size_t point) const;
+        void nearest(size_t node, const double* query, size_t k,
+                     std::vector<Neighbor>& heap) const;
+        void within(size_t node, const double* query, double radius2,
+                    std::vector<size_t>& rows) const;
+    };
+    // Predictions of y, a value to each point of tree, for n query points as
+    // NearestNeighbors.NearestNeighbors makes them: the mean of y over the
+    // points a query matches exactly, if any, otherwise the mean over its k
+    // nearest weighted by the inverse of their distance. Queries with a
+    // coordinate that is not a number predict NaN. Queries are answered in
+    // parallel on threads, each the same way whichever thread answers it.
+    void nearestNeighbors(const KDTree& tree, const double* y,
+                          const double* queries, size_t n, size_t k,
+                          double* predictions, ThreadPool* threads = 0);
+
+  } // end namespace train
+
+} // end namespace eiger
+
+extern "C" {
+#endif
+
+/* The message of the last call that failed on this thread. */
+const char* eiger_train_error(void);
+
+/* eiger::train::stepwise. selected and weights must hold functions entries;
+   count is set to the number picked. Returns 0, or -1 on failure. */
+int eiger_stepwise(const double* train, const double* train_y,
+                   size_t train_rows, const double* test,
+                   const double* test_y, size_t test_rows, size_t functions,
+                   double threshold, size_t* selected, double* weights,
+                   size_t* count, double* r2, double* r2_adjusted);
+
+/* eiger::train::basis on threads threads, 0 for one per core, with
+   function f given by kind[f], i[f], j[f] and exponent[f] as in
+   eiger::ModelFunction. basis holds rows * functions values. Returns 0, or
+   -1 on failure. */
+int eiger_basis(const double* profile, size_t rows, size_t inputs,
+                const int* kind, const int* i, const int* j,
+                const double* exponent, size_t functions, size_t threads,
+                double* basis);
+
+/* Moments::add on threads threads, 0 for one per core, to the moments in
+   *total, mean (columns entries) and comoment (columns * columns).
+   Returns 0, or -1 on failure. */
+int eiger_moments_add(const double* rows, size_t count, size_t columns,
+                      size_t threads, size_t* total, double* mean,
+                      double* comoment);
+
+/* eiger::train::principalComponents of the moments given as for
+   eiger_moments_add. loadings holds columns entries and components
+   columns * columns, of which the first min(total, columns) are set;
+   *count is set to that. Returns 0, or -1 on failure. */
+int eiger_pca(size_t total, const double* mean, const double* comoment,
+              size_t columns, int scale, double* loadings,
+              double* components, size_t* count);
+
+/* eiger::train::kmeans on threads threads, 0 for one per core. centers
+   holds k * dimensions values and labels n. Returns 0, or -1 on
+   failure. */
+int eiger_kmeans(const double* points, size_t n, size_t dimensions, size_t k,
+                 size_t restarts, size_t iterations, double tolerance,
+                 size_t batch, uint64_t seed, size_t threads, double* centers,
+                 size_t* labels, double* inertia);
+
+/* eiger::train::assignClusters on threads threads, 0 for one per core.
+   Returns 0, or -1 on failure. */
+int eiger_assign_clusters(const double* points, size_t n, size_t dimensions,
+                          const double* centers, size_t k, size_t threads,
+                          size_t* labels);
+
+/* eiger::train::mars on threads threads, 0 for one per core. term_count
+   gets the number of terms, and factors, weights and the hinges of each
+   term room for max_terms + 1 terms: hinge f of term t is on variable
+   variable[t * max_interactions + f] at knot[...], positive[...] saying
+   which way it faces. Returns 0, or -1 on failure. */
+int eiger_mars(const double* x, const double* y, size_t rows,
+               size_t variables, size_t max_terms, size_t max_interactions,
+               size_t threads, size_t* term_count, size_t* factors,
+               size_t* variable, double* knot, int* positive,
+               double* weights, double* rss, double* gcv);
+/* eiger::train::nearestNeighbors of the queries (count rows of dimensions
+   values) with a tree over the rows training points of x and their values
+   y, on threads threads, 0 for one per core. predictions holds count
+   values. Returns 0, or -1 on failure. */
+int eiger_nearest_neighbors(const double* x, const double* y, size_t rows,
+                            size_t dimensions, const double* queries,
+                            size_t count, size_t k, size_t threads,
+                            double* predictions);
+
+/* A k-d tree over training points and their values, built once for any
+   number of queries, with its own threads. */
+typedef struct eiger_knn eiger_knn;
+
+/* A tree over the rows training points of x (dimensions values each) and
+   their values y, both copied, queried on threads threads, 0 for one per
+   core. Returns NULL on failure. */
+eiger_knn* eiger_knn_create(const double* x, const double* y, size_t rows,
+                            size_t dimensions, size_t threads);
+
+/* eiger::train::nearestNeighbors of the queries (count rows of the tree's
+   dimensions) with tree. predictions holds count values. Returns 0, or -1
+   on failure. Queries of one tree must not overlap. */
+int eiger_knn_query(eiger_knn* tree, const double* queries, size_t count,
+                    size_t k, double* predictions);
+
+/* Frees a tree from eiger_knn_create; NULL is ignored. */
+void eiger_knn_free(eiger_knn* tree);
+
+/* eiger::train::stepwiseFolds on threads threads, 0 for one per core.
+   Fold f trains on the train_count[f] rows of train_index that follow
+   those of the folds before it, and tests on its rows of test_index
+   likewise. selected and weights hold functions entries per fold and
+   count, r2 and r2_adjusted one. Returns 0, or -1 on failure. */
+int eiger_stepwise_folds(const double* lookup, const double* y, size_t rows,
+                         size_t functions, size_t folds,
+                         const size_t* train_index, const size_t* train_count,
+                         const size_t* test_index, const size_t* test_count,
+                         double threshold, size_t threads, size_t* selected,
+                         double* weights, size_t* count, double* r2,
+                         double* r2_adjusted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
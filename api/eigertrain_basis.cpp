@@ -0,0 +1,176 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Evaluates a pool of regressor functions on every row of
+* a training profile, a column at a time.
+*
+**********************************************************/
+
+#include <cmath>
+#include <limits>
+
+#include "eigermodel_kernel.h"
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+
+      // What the functions of a pool need of each metric besides its column.
+      struct Shared {
+        bool abs, square, root;
+      };
+
+      // |x_i|^e for the exponents of kernel::fast_power, from the shared
+      // columns of x_i, as the batch kernel computes them
+      void shared_power(double e, const double* __restrict x,
+                        const double* __restrict a,
+                        const double* __restrict square,
+                        const double* __restrict root, size_t rows,
+                        double* __restrict out){
+        const double inf = numeric_limits<double>::infinity();
+        if(e == 0.0)
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = 1.0;
+        else if(e == 1.0)
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = a[r];
+        else if(e == 2.0)
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = square[r];
+        else if(e == -1.0)
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = 1.0 / a[r];
+        else if(e == -2.0)
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = 1.0 / square[r];
+        else if(e == 0.5)
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = root[r];
+        else
+          for(size_t r = 0; r < rows; ++r)
+            out[r] = 1.0 / root[r];
+        // Python's math.pow raises on overflow and Eiger.py scores it as 0
+        for(size_t r = 0; r < rows; ++r)
+          out[r] = x[r] == 0.0 ? 1.0 : out[r] == inf ? 0.0 : out[r];
+      }
+
+    } // end anonymous namespace
+
+    void basis(const double* profile, size_t rows, size_t inputs,
+               const vector<ModelFunction>& functions, double* basis,
+               ThreadPool* threads){
+      const int n = int(inputs);
+      vector<Shared> shared(inputs, Shared());
+      for(size_t f = 0; f < functions.size(); ++f){
+        const ModelFunction& fn = functions[f];
+        if(fn.kind == ModelFunction::IDENTITY)
+          continue;
+        bool binary = fn.kind == ModelFunction::PRODUCT ||
+                      (fn.kind == ModelFunction::QUOTIENT && fn.j >= 0);
+        if(fn.i < 0 || fn.i >= n || (binary && (fn.j < 0 || fn.j >= n)))
+          throw "a basis function names a metric the profile doesn't have.";
+        if(fn.kind == ModelFunction::SQRT)
+          shared[fn.i].root = true;
+        if(fn.kind != ModelFunction::POWER ||
+           !kernel::fast_power(fn.exponent))
+          continue;
+        const double e = fn.exponent;
+        shared[fn.i].abs |= e == 1.0 || e == -1.0;
+        shared[fn.i].square |= e == 2.0 || e == -2.0;
+        shared[fn.i].root |= e == 0.5 || e == -0.5;
+      }
+
+      // the profile a column to a metric, followed by the shared columns
+      vector<double> x(inputs * rows);
+      vector<vector<double> > a(inputs), square(inputs), root(inputs);
+      const size_t grain = 1 + 16384 / (rows + 1);
+      auto columns = [&](size_t first, size_t last){
+        for(size_t m = first; m < last; ++m){
+          double* xm = &x[m * rows];
+          for(size_t r = 0; r < rows; ++r)
+            xm[r] = profile[r * inputs + m];
+          if(!shared[m].abs && !shared[m].square && !shared[m].root)
+            continue;
+          a[m].resize(rows);
+          for(size_t r = 0; r < rows; ++r)
+            a[m][r] = fabs(xm[r]);
+          if(shared[m].square){
+            square[m].resize(rows);
+            for(size_t r = 0; r < rows; ++r)
+              square[m][r] = a[m][r] * a[m][r];
+          }
+          if(shared[m].root){
+            root[m].resize(rows);
+            for(size_t r = 0; r < rows; ++r)
+              root[m][r] = sqrt(a[m][r]);
+          }
+        }
+      };
+      parallelFor(threads, 0, inputs, grain, columns);
+
+      const double ln2 = log(2.0);
+      auto evaluate = [&](size_t first, size_t last){
+        for(size_t f = first; f < last; ++f){
+          const ModelFunction& fn = functions[f];
+          double* __restrict out = basis + f * rows;
+          const double* xi = fn.i < 0 ? 0 : &x[fn.i * rows];
+          const double* xj = fn.j < 0 ? 0 : &x[fn.j * rows];
+          switch(fn.kind){
+            case ModelFunction::IDENTITY:
+              for(size_t r = 0; r < rows; ++r)
+                out[r] = 1.0;
+              break;
+            case ModelFunction::PRODUCT:
+              for(size_t r = 0; r < rows; ++r)
+                out[r] = xi[r] * xj[r];
+              break;
+            case ModelFunction::SQRT:
+              for(size_t r = 0; r < rows; ++r)
+                out[r] = root[fn.i][r];
+              break;
+            case ModelFunction::QUOTIENT:
+              if(fn.j < 0)
+                for(size_t r = 0; r < rows; ++r)
+                  out[r] = 1.0 / xi[r];
+              else
+                for(size_t r = 0; r < rows; ++r)
+                  out[r] = xi[r] / xj[r];
+              break;
+            case ModelFunction::POWER:
+              if(kernel::fast_power(fn.exponent)){
+                shared_power(fn.exponent, xi, a[fn.i].data(),
+                             square[fn.i].data(), root[fn.i].data(), rows,
+                             out);
+                break;
+              }
+              for(size_t r = 0; r < rows; ++r){
+                double p = pow(fabs(xi[r]), fn.exponent);
+                out[r] = xi[r] == 0.0 ? 1.0 : std::isinf(p) ? 0.0 : p;
+              }
+              break;
+            case ModelFunction::LOG:
+              for(size_t r = 0; r < rows; ++r)
+                out[r] = xi[r] == 0.0 ? 1.0 : log(fabs(xi[r])) / ln2;
+              break;
+            case ModelFunction::HINGE:
+              for(size_t r = 0; r < rows; ++r)
+                out[r] = xi[r] > fn.exponent ? xi[r] - fn.exponent : 0.0;
+              break;
+            case ModelFunction::MIRROR:
+              for(size_t r = 0; r < rows; ++r)
+                out[r] = xi[r] < fn.exponent ? fn.exponent - xi[r] : 0.0;
+              break;
+          }
+        }
+      };
+      parallelFor(threads, 0, functions.size(), grain, evaluate);
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
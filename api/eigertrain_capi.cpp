@@ -0,0 +1,336 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The C interface of libeigertrain, which turns exceptions
+* into a return value and a message.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <new>
+#include <system_error>
+
+#include "eigertrain.h"
+
+namespace{
+  thread_local const char* train_error = "";
+}
+
+struct eiger_knn {
+  eiger::train::KDTree tree;
+  std::vector<double> y;
+  eiger::train::ThreadPool pool;
+
+  eiger_knn(const double* x, const double* y, size_t rows, size_t dimensions,
+            size_t threads)
+    : tree(x, rows, dimensions), y(y, y + rows), pool(threads) {}
+};
+
+const char* eiger_train_error(void){
+  return train_error;
+}
+
+int eiger_stepwise(const double* train, const double* train_y,
+                   size_t train_rows, const double* test,
+                   const double* test_y, size_t test_rows, size_t functions,
+                   double threshold, size_t* selected, double* weights,
+                   size_t* count, double* r2, double* r2_adjusted){
+  try{
+    eiger::train::StepwiseFit fit =
+      eiger::train::stepwise(train, train_y, train_rows, test, test_y,
+                             test_rows, functions, threshold);
+    for(size_t f = 0; f < fit.selected.size(); ++f){
+      selected[f] = fit.selected[f];
+      weights[f] = fit.weights[f];
+    }
+    *count = fit.selected.size();
+    *r2 = fit.r2;
+    *r2_adjusted = fit.r2_adjusted;
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  return -1;
+}
+
+int eiger_stepwise_folds(const double* lookup, const double* y, size_t rows,
+                         size_t functions, size_t folds,
+                         const size_t* train_index, const size_t* train_count,
+                         const size_t* test_index, const size_t* test_count,
+                         double threshold, size_t threads, size_t* selected,
+                         double* weights, size_t* count, double* r2,
+                         double* r2_adjusted){
+  try{
+    std::vector<eiger::train::Fold> fold(folds);
+    for(size_t f = 0; f < folds; ++f){
+      fold[f].train.assign(train_index, train_index + train_count[f]);
+      fold[f].test.assign(test_index, test_index + test_count[f]);
+      train_index += train_count[f];
+      test_index += test_count[f];
+    }
+    eiger::train::ThreadPool pool(threads);
+    std::vector<eiger::train::StepwiseFit> fits =
+      eiger::train::stepwiseFolds(lookup, y, rows, functions, fold,
+                                  threshold, pool);
+    for(size_t f = 0; f < folds; ++f){
+      for(size_t i = 0; i < fits[f].selected.size(); ++i){
+        selected[f * functions + i] = fits[f].selected[i];
+        weights[f * functions + i] = fits[f].weights[i];
+      }
+      count[f] = fits[f].selected.size();
+      r2[f] = fits[f].r2;
+      r2_adjusted[f] = fits[f].r2_adjusted;
+    }
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+int eiger_basis(const double* profile, size_t rows, size_t inputs,
+                const int* kind, const int* i, const int* j,
+                const double* exponent, size_t functions, size_t threads,
+                double* basis){
+  try{
+    std::vector<eiger::ModelFunction> pool(functions);
+    for(size_t f = 0; f < functions; ++f){
+      if(kind[f] < eiger::ModelFunction::IDENTITY ||
+         kind[f] > eiger::ModelFunction::MIRROR)
+        throw "unknown basis function kind.";
+      pool[f].kind = eiger::ModelFunction::kind_t(kind[f]);
+      pool[f].i = i[f];
+      pool[f].j = j[f];
+      pool[f].exponent = exponent[f];
+    }
+    eiger::train::ThreadPool workers(threads);
+    eiger::train::basis(profile, rows, inputs, pool, basis, &workers);
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+int eiger_moments_add(const double* rows, size_t count, size_t columns,
+                      size_t threads, size_t* total, double* mean,
+                      double* comoment){
+  try{
+    eiger::train::Moments moments(columns);
+    moments.count = *total;
+    std::copy(mean, mean + columns, moments.mean.begin());
+    std::copy(comoment, comoment + columns * columns,
+              moments.comoment.begin());
+    eiger::train::ThreadPool pool(threads);
+    moments.add(rows, count, &pool);
+    *total = moments.count;
+    std::copy(moments.mean.begin(), moments.mean.end(), mean);
+    std::copy(moments.comoment.begin(), moments.comoment.end(), comoment);
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+int eiger_pca(size_t total, const double* mean, const double* comoment,
+              size_t columns, int scale, double* loadings,
+              double* components, size_t* count){
+  try{
+    eiger::train::Moments moments(columns);
+    moments.count = total;
+    std::copy(mean, mean + columns, moments.mean.begin());
+    std::copy(comoment, comoment + columns * columns,
+              moments.comoment.begin());
+    eiger::train::PrincipalComponents pc =
+      eiger::train::principalComponents(moments, scale != 0);
+    const size_t k = pc.loadings.size();
+    std::copy(pc.loadings.begin(), pc.loadings.end(), loadings);
+    for(size_t i = 0; i < columns; ++i)
+      std::copy(&pc.components[i * k], &pc.components[i * k] + k,
+                components + i * columns);
+    *count = k;
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  return -1;
+}
+
+int eiger_kmeans(const double* points, size_t n, size_t dimensions, size_t k,
+                 size_t restarts, size_t iterations, double tolerance,
+                 size_t batch, uint64_t seed, size_t threads, double* centers,
+                 size_t* labels, double* inertia){
+  try{
+    eiger::train::KMeansOptions options;
+    options.restarts = restarts;
+    options.iterations = iterations;
+    options.tolerance = tolerance;
+    options.batch = batch;
+    options.seed = seed;
+    eiger::train::ThreadPool pool(threads);
+    eiger::train::Clustering result =
+      eiger::train::kmeans(points, n, dimensions, k, options, &pool);
+    std::copy(result.centers.begin(), result.centers.end(), centers);
+    std::copy(result.labels.begin(), result.labels.end(), labels);
+    *inertia = result.inertia;
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+int eiger_assign_clusters(const double* points, size_t n, size_t dimensions,
+                          const double* centers, size_t k, size_t threads,
+                          size_t* labels){
+  try{
+    eiger::train::ThreadPool pool(threads);
+    eiger::train::assignClusters(points, n, dimensions, centers, k, labels,
+                                 &pool);
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+int eiger_mars(const double* x, const double* y, size_t rows,
+               size_t variables, size_t max_terms, size_t max_interactions,
+               size_t threads, size_t* term_count, size_t* factors,
+               size_t* variable, double* knot, int* positive,
+               double* weights, double* rss, double* gcv){
+  try{
+    eiger::train::ThreadPool pool(threads);
+    eiger::train::MarsFit fit =
+      eiger::train::mars(x, y, rows, variables, max_terms, max_interactions,
+                         &pool);
+    for(size_t t = 0; t < fit.terms.size(); ++t){
+      factors[t] = fit.terms[t].size();
+      for(size_t f = 0; f < fit.terms[t].size(); ++f){
+        const size_t at = t * max_interactions + f;
+        variable[at] = fit.terms[t][f].variable;
+        knot[at] = fit.terms[t][f].knot;
+        positive[at] = fit.terms[t][f].positive ? 1 : 0;
+      }
+      weights[t] = fit.weights[t];
+    }
+    *term_count = fit.terms.size();
+    *rss = fit.rss;
+    *gcv = fit.gcv;
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+int eiger_nearest_neighbors(const double* x, const double* y, size_t rows,
+                            size_t dimensions, const double* queries,
+                            size_t count, size_t k, size_t threads,
+                            double* predictions){
+  try{
+    eiger::train::ThreadPool pool(threads);
+    const eiger::train::KDTree tree(x, rows, dimensions);
+    eiger::train::nearestNeighbors(tree, y, queries, count, k, predictions,
+                                   &pool);
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return -1;
+}
+
+eiger_knn* eiger_knn_create(const double* x, const double* y, size_t rows,
+                            size_t dimensions, size_t threads){
+  try{
+    return new eiger_knn(x, y, rows, dimensions, threads);
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  catch(const std::system_error&){
+    train_error = "unable to start the training threads.";
+  }
+  return NULL;
+}
+
+int eiger_knn_query(eiger_knn* tree, const double* queries, size_t count,
+                    size_t k, double* predictions){
+  try{
+    eiger::train::nearestNeighbors(tree->tree, tree->y.data(), queries, count,
+                                   k, predictions, &tree->pool);
+    return 0;
+  }
+  catch(const char* msg){
+    train_error = msg;
+  }
+  catch(const std::bad_alloc&){
+    train_error = "out of memory.";
+  }
+  return -1;
+}
+
+void eiger_knn_free(eiger_knn* tree){
+  delete tree;
+}
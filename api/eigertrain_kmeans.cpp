@@ -0,0 +1,431 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* k-means clustering of a training profile in the space of
+* its normalized principal components.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+
+      // points whose distances to a center are computed together, a
+      // dimension at a time, so that the loop over them vectorizes
+      const size_t block_points = 256;
+      // points reduced together before their sums are combined in order;
+      // fixed, so that the rounding is the same on any number of threads
+      const size_t chunk_points = 4096;
+
+      // Random numbers from mt19937_64, whose output the standard fixes,
+      // rather than std:: distributions, whose output it does not.
+      class Random {
+        public:
+          explicit Random(uint64_t seed) : gen_(seed) {}
+          // uniform on [0, 1)
+          double uniform() {
+            return (gen_() >> 11) * (1.0 / 9007199254740992.0);
+          }
+          // uniform on [0, n)
+          size_t below(size_t n) {
+            return min(size_t(uniform() * n), n - 1);
+          }
+        private:
+          mt19937_64 gen_;
+      };
+
+      // The rows of a row-major table that are being clustered: all of
+      // them, or those the index picks.
+      struct Points {
+        const double* rows;
+        size_t dimensions;
+        const size_t* index;
+        size_t count;
+
+        const double* operator[](size_t i) const {
+          return rows + (index ? index[i] : i) * dimensions;
+        }
+      };
+
+      size_t chunks(size_t n){
+        return (n + chunk_points - 1) / chunk_points;
+      }
+
+      // The squared distance from points first to last to the nearest of
+      // the k centers and its label, a block of points at a time, summing
+      // the squares in the order of the dimensions as the model runtime
+      // does so that the labels agree with its predictions.
+      void nearest(const Points& p, size_t first, size_t last,
+                   const double* centers, size_t k, size_t* labels,
+                   double* distances){
+        const size_t d = p.dimensions;
+        vector<double> columns(block_points * d);
+        double step[block_points];
+        for(size_t b = first; b < last; b += block_points){
+          const size_t m = min(block_points, last - b);
+          for(size_t r = 0; r < m; ++r){
+            const double* row = p[b + r];
+            for(size_t j = 0; j < d; ++j)
+              columns[j * block_points + r] = row[j];
+          }
+          // a short block is padded, so the loops below have a fixed count
+          for(size_t j = 0; j < d && m < block_points; ++j)
+            fill(&columns[j * block_points + m],
+                 &columns[(j + 1) * block_points], 0.0);
+          double* __restrict best = distances + b;
+          size_t* __restrict label = labels + b;
+          for(size_t r = 0; r < m; ++r){
+            best[r] = numeric_limits<double>::infinity();
+            label[r] = 0;
+          }
+          for(size_t c = 0; c < k; ++c){
+            const double* center = centers + c * d;
+            for(size_t r = 0; r < block_points; ++r)
+              step[r] = 0.0;
+            for(size_t j = 0; j < d; ++j){
+              const double* __restrict x = &columns[j * block_points];
+              const double cj = center[j];
+              for(size_t r = 0; r < block_points; ++r)
+                step[r] += (x[r] - cj) * (x[r] - cj);
+            }
+            for(size_t r = 0; r < m; ++r)
+              if(step[r] < best[r]){
+                best[r] = step[r];
+                label[r] = c;
+              }
+          }
+        }
+      }
+
+      // sum of body(first, last) over the chunks of n points, in order
+      double sumChunks(size_t n, ThreadPool* threads,
+                       const function<double(size_t, size_t)>& body,
+                       vector<double>* partial = 0){
+        vector<double> local;
+        if(!partial)
+          partial = &local;
+        partial->assign(chunks(n), 0.0);
+        parallelFor(threads, 0, partial->size(), 1,
+                    [&](size_t begin, size_t end){
+                      for(size_t c = begin; c < end; ++c)
+                        (*partial)[c] =
+                          body(c * chunk_points,
+                               min(n, (c + 1) * chunk_points));
+                    });
+        double sum = 0.0;
+        for(size_t c = 0; c < partial->size(); ++c)
+          sum += (*partial)[c];
+        return sum;
+      }
+
+      // a point drawn with probability proportional to its weight, given
+      // the sums of the weights by chunk
+      size_t draw(const vector<double>& weight, const vector<double>& partial,
+                  double total, Random& random){
+        const size_t n = weight.size();
+        if(!(total > 0.0))
+          return random.below(n);
+        double r = random.uniform() * total;
+        size_t c = 0;
+        while(c + 1 < partial.size() && r >= partial[c])
+          r -= partial[c++];
+        const size_t last = min(n, (c + 1) * chunk_points);
+        size_t i = c * chunk_points, pick = i;
+        for(; i < last; ++i){
+          if(weight[i] > 0.0)
+            pick = i;
+          if(r < weight[i])
+            break;
+          r -= weight[i];
+        }
+        return i < last ? i : pick;
+      }
+
+      // Greedy k-means++ of Arthur and Vassilvitskii: each center after
+      // the first is the best of a few candidates drawn in proportion to
+      // their squared distance from the centers so far.
+      vector<double> seed(const Points& p, size_t k, Random& random,
+                          ThreadPool* threads){
+        const size_t n = p.count, d = p.dimensions;
+        const size_t trials = 2 + size_t(log(double(k)));
+        vector<double> centers(k * d);
+        vector<size_t> labels(n);
+        vector<double> closest(n), candidate(n), best(n), partial;
+        const double* first = p[random.below(n)];
+        copy(first, first + d, centers.begin());
+        double potential = sumChunks(n, threads, [&](size_t b, size_t e){
+            nearest(p, b, e, &centers[0], 1, &labels[0], &closest[0]);
+            double sum = 0.0;
+            for(size_t i = b; i < e; ++i)
+              sum += closest[i];
+            return sum;
+          }, &partial);
+
+        for(size_t c = 1; c < k; ++c){
+          double least = numeric_limits<double>::infinity();
+          size_t pick = 0;
+          for(size_t t = 0; t < trials; ++t){
+            const size_t i = draw(closest, partial, potential, random);
+            const double* point = p[i];
+            double sum = sumChunks(n, threads, [&](size_t b, size_t e){
+                nearest(p, b, e, point, 1, &labels[0], &candidate[0]);
+                double s = 0.0;
+                for(size_t r = b; r < e; ++r)
+                  s += min(closest[r], candidate[r]);
+                return s;
+              });
+            if(t == 0 || sum < least){
+              least = sum;
+              pick = i;
+              best.swap(candidate);
+            }
+          }
+          copy(p[pick], p[pick] + d, &centers[c * d]);
+          potential = sumChunks(n, threads, [&](size_t b, size_t e){
+              double s = 0.0;
+              for(size_t r = b; r < e; ++r){
+                closest[r] = min(closest[r], best[r]);
+                s += closest[r];
+              }
+              return s;
+            }, &partial);
+        }
+        return centers;
+      }
+
+      // the mean over the dimensions of the variance of the points
+      double meanVariance(const Points& p, ThreadPool* threads){
+        const size_t n = p.count, d = p.dimensions;
+        vector<double> variance(d);
+        parallelFor(threads, 0, d, 1, [&](size_t begin, size_t end){
+            for(size_t j = begin; j < end; ++j){
+              double mean = 0.0, sum = 0.0;
+              for(size_t i = 0; i < n; ++i)
+                mean += p[i][j];
+              mean /= n;
+              for(size_t i = 0; i < n; ++i)
+                sum += (p[i][j] - mean) * (p[i][j] - mean);
+              variance[j] = sum / n;
+            }
+          });
+        double sum = 0.0;
+        for(size_t j = 0; j < d; ++j)
+          sum += variance[j];
+        return d ? sum / d : 0.0;
+      }
+
+      // the sum of the squared moves from the centers to next
+      double shift(const vector<double>& centers, const vector<double>& next){
+        double sum = 0.0;
+        for(size_t i = 0; i < centers.size(); ++i)
+          sum += (next[i] - centers[i]) * (next[i] - centers[i]);
+        return sum;
+      }
+
+      // Lloyd's algorithm from the given centers, leaving the labels and
+      // inertia of the centers it stops at.
+      void lloyd(const Points& p, size_t k, const KMeansOptions& options,
+                 double tolerance, Clustering& result, ThreadPool* threads){
+        const size_t n = p.count, d = p.dimensions;
+        vector<double> distances(n);
+        // per chunk, the sums of the points of each cluster and their counts
+        const size_t stride = k * (d + 1);
+        vector<double> sums(chunks(n) * stride);
+        result.labels.resize(n);
+        for(size_t iteration = 0; ; ++iteration){
+          result.inertia = sumChunks(n, threads, [&](size_t b, size_t e){
+              nearest(p, b, e, &result.centers[0], k, &result.labels[0],
+                      &distances[0]);
+              double* sum = &sums[(b / chunk_points) * stride];
+              fill(sum, sum + stride, 0.0);
+              double s = 0.0;
+              for(size_t i = b; i < e; ++i){
+                double* cluster = sum + result.labels[i] * (d + 1);
+                const double* point = p[i];
+                for(size_t j = 0; j < d; ++j)
+                  cluster[j] += point[j];
+                cluster[d] += 1.0;
+                s += distances[i];
+              }
+              return s;
+            });
+          if(iteration == options.iterations)
+            break;
+
+          vector<double> total(stride, 0.0);
+          for(size_t c = 0; c < sums.size() / stride; ++c)
+            for(size_t i = 0; i < stride; ++i)
+              total[i] += sums[c * stride + i];
+          vector<double> next(k * d);
+          vector<size_t> empty;
+          for(size_t c = 0; c < k; ++c){
+            const double count = total[c * (d + 1) + d];
+            if(count == 0.0)
+              empty.push_back(c);
+            for(size_t j = 0; j < d; ++j)
+              next[c * d + j] = count == 0.0 ? result.centers[c * d + j]
+                                             : total[c * (d + 1) + j] / count;
+          }
+          if(!empty.empty()){
+            // an empty cluster moves to the point farthest from its center
+            vector<size_t> order(n);
+            for(size_t i = 0; i < n; ++i)
+              order[i] = i;
+            partial_sort(order.begin(), order.begin() + empty.size(),
+                         order.end(), [&](size_t a, size_t b){
+                           return distances[a] > distances[b] ||
+                                  (distances[a] == distances[b] && a < b);
+                         });
+            for(size_t e = 0; e < empty.size(); ++e)
+              copy(p[order[e]], p[order[e]] + d, &next[empty[e] * d]);
+          }
+          const bool converged = shift(result.centers, next) <= tolerance;
+          result.centers.swap(next);
+          if(converged && empty.empty())
+            break;
+        }
+      }
+
+      // a sample of count of the points, with replacement, in order
+      vector<size_t> sample(size_t n, size_t count, Random& random){
+        vector<size_t> index(count);
+        for(size_t i = 0; i < count; ++i)
+          index[i] = random.below(n);
+        sort(index.begin(), index.end());
+        return index;
+      }
+
+      // the sum of the squared distances from the points to the centers
+      double inertia(const Points& p, const vector<double>& centers,
+                     size_t k, ThreadPool* threads){
+        vector<size_t> labels(p.count);
+        vector<double> distances(p.count);
+        return sumChunks(p.count, threads, [&](size_t b, size_t e){
+            nearest(p, b, e, &centers[0], k, &labels[0], &distances[0]);
+            double s = 0.0;
+            for(size_t i = b; i < e; ++i)
+              s += distances[i];
+            return s;
+          });
+      }
+
+      // Sculley's mini-batch k-means from the given centers: each batch is
+      // assigned to the centers in parallel, then each center moves toward
+      // its points in turn by the inverse of the points it has had so far.
+      void miniBatch(const Points& all, size_t k, const KMeansOptions& options,
+                     double tolerance, vector<double>& centers,
+                     Random& random, ThreadPool* threads){
+        const size_t d = all.dimensions;
+        vector<double> counts(k, 0.0);
+        vector<size_t> labels(options.batch);
+        vector<double> distances(options.batch);
+        for(size_t iteration = 0; iteration < options.iterations;
+            ++iteration){
+          vector<size_t> index = sample(all.count, options.batch, random);
+          Points batch = {all.rows, d, &index[0], index.size()};
+          parallelFor(threads, 0, batch.count, chunk_points,
+                      [&](size_t b, size_t e){
+                        nearest(batch, b, e, &centers[0], k, &labels[0],
+                                &distances[0]);
+                      });
+          vector<double> next(centers);
+          for(size_t i = 0; i < batch.count; ++i){
+            double* center = &next[labels[i] * d];
+            const double rate = 1.0 / ++counts[labels[i]];
+            const double* point = batch[i];
+            for(size_t j = 0; j < d; ++j)
+              center[j] += rate * (point[j] - center[j]);
+          }
+          const bool converged = shift(centers, next) <= tolerance;
+          centers.swap(next);
+          if(converged)
+            break;
+        }
+      }
+
+    } // end anonymous namespace
+
+    KMeansOptions::KMeansOptions()
+      : restarts(10), iterations(300), tolerance(1e-4), batch(0), seed(0) {}
+
+    void assignClusters(const double* points, size_t n, size_t dimensions,
+                        const double* centers, size_t k, size_t* labels,
+                        ThreadPool* threads){
+      if(k == 0)
+        throw "points can't be assigned to no clusters.";
+      Points p = {points, dimensions, 0, n};
+      vector<double> distances(n);
+      parallelFor(threads, 0, n, chunk_points, [&](size_t b, size_t e){
+          nearest(p, b, e, centers, k, labels, &distances[0]);
+        });
+    }
+
+    Clustering kmeans(const double* points, size_t n, size_t dimensions,
+                      size_t k, const KMeansOptions& options,
+                      ThreadPool* threads){
+      if(k == 0)
+        throw "k-means needs at least one cluster.";
+      if(n < k)
+        throw "k-means needs at least as many points as clusters.";
+      Random random(options.seed);
+      Points all = {points, dimensions, 0, n};
+      const double tolerance =
+        options.tolerance * meanVariance(all, threads);
+      const size_t restarts = max(options.restarts, size_t(1));
+
+      Clustering best;
+      if(options.batch == 0){
+        for(size_t run = 0; run < restarts; ++run){
+          Clustering result;
+          result.centers = seed(all, k, random, threads);
+          lloyd(all, k, options, tolerance, result, threads);
+          if(run == 0 || result.inertia < best.inertia)
+            best = result;
+        }
+        return best;
+      }
+
+      // as sklearn's MiniBatchKMeans, the restarts only choose the seeding,
+      // each from its own sample, by its inertia on a common one
+      const size_t size = min(n, max(3 * options.batch, 3 * k));
+      vector<size_t> check = sample(n, size, random);
+      Points validation = {points, dimensions, &check[0], size};
+      double least = 0.0;
+      for(size_t run = 0; run < restarts; ++run){
+        vector<size_t> index = sample(n, size, random);
+        Points init = {points, dimensions, &index[0], size};
+        vector<double> centers = seed(init, k, random, threads);
+        const double e = inertia(validation, centers, k, threads);
+        if(run == 0 || e < least){
+          least = e;
+          best.centers.swap(centers);
+        }
+      }
+      miniBatch(all, k, options, tolerance, best.centers, random, threads);
+      best.labels.resize(n);
+      vector<double> distances(n);
+      best.inertia = sumChunks(n, threads, [&](size_t b, size_t e){
+          nearest(all, b, e, &best.centers[0], k, &best.labels[0],
+                  &distances[0]);
+          double s = 0.0;
+          for(size_t i = b; i < e; ++i)
+            s += distances[i];
+          return s;
+        });
+      return best;
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
@@ -0,0 +1,115 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks the k-means clustering of libeigertrain on
+* separated blobs of points.
+*
+**********************************************************/
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+static int failures = 0;
+
+// points around k centers far apart, in a random order
+static vector<double> blobs(size_t n, size_t d, size_t k,
+                            vector<double>& centers, unsigned seed) {
+  mt19937_64 rng(seed);
+  normal_distribution<double> gauss(0.0, 1.0);
+  centers.resize(k * d);
+  for (size_t c = 0; c < k; ++c)
+    for (size_t j = 0; j < d; ++j) centers[c * d + j] = 20.0 * gauss(rng);
+  vector<double> x(n * d);
+  for (size_t i = 0; i < n; ++i) {
+    size_t c = rng() % k;
+    for (size_t j = 0; j < d; ++j)
+      x[i * d + j] = centers[c * d + j] + 0.5 * gauss(rng);
+  }
+  return x;
+}
+
+static double distance(const double* a, const double* b, size_t d) {
+  double sum = 0.0;
+  for (size_t j = 0; j < d; ++j) sum += (a[j] - b[j]) * (a[j] - b[j]);
+  return sum;
+}
+
+static void check(const char* name, size_t n, size_t d, size_t k,
+                  size_t batch) {
+  vector<double> truth;
+  vector<double> x = blobs(n, d, k, truth, 7);
+  eiger::train::KMeansOptions options;
+  options.batch = batch;
+  options.restarts = 3;
+  eiger::train::Clustering serial =
+      eiger::train::kmeans(&x[0], n, d, k, options);
+  eiger::train::ThreadPool pool(4);
+  eiger::train::Clustering threaded =
+      eiger::train::kmeans(&x[0], n, d, k, options, &pool);
+
+  if (serial.centers != threaded.centers || serial.labels != threaded.labels ||
+      serial.inertia != threaded.inertia) {
+    printf("%s: the clustering depends on the threads\n", name);
+    ++failures;
+  }
+  // every point is a center of its own
+  if (n == k && serial.inertia != 0.0) {
+    printf("%s: the inertia of a point to a cluster is %g\n", name,
+           serial.inertia);
+    ++failures;
+  }
+  // every blob has a center close to it
+  for (size_t t = 0; n > 100 * k && t < k; ++t) {
+    double best = INFINITY;
+    for (size_t c = 0; c < k; ++c)
+      best = min(best, distance(&truth[t * d], &serial.centers[c * d], d));
+    if (best > 0.1 * d) {
+      printf("%s: blob %zu is %g from the nearest center\n", name, t,
+             sqrt(best));
+      ++failures;
+    }
+  }
+  // the labels are the nearest centers, as the runtime finds them
+  vector<size_t> labels(n);
+  eiger::train::assignClusters(&x[0], n, d, &serial.centers[0], k,
+                               &labels[0], &pool);
+  double inertia = 0.0;
+  for (size_t i = 0; i < n; ++i)
+    inertia += distance(&x[i * d], &serial.centers[labels[i] * d], d);
+  if (labels != serial.labels ||
+      fabs(inertia - serial.inertia) > 1e-9 * inertia) {
+    printf("%s: the labels or the inertia %.17g (%.17g) are wrong\n", name,
+           serial.inertia, inertia);
+    ++failures;
+  }
+}
+
+int main() {
+  check("lloyd", 20000, 5, 6, 0);
+  check("one cluster", 1000, 3, 1, 0);
+  check("as many clusters as points", 8, 2, 8, 0);
+  check("mini-batch", 300000, 4, 5, 1024);
+
+  // ties go to the earlier center
+  double points[] = {0.0, 1.0, 2.0};
+  double centers[] = {0.0, 2.0};
+  size_t labels[1];
+  eiger::train::assignClusters(points + 1, 1, 1, centers, 2, labels);
+  if (labels[0] != 0) {
+    printf("a point between two centers went to the second\n");
+    ++failures;
+  }
+
+  try {
+    eiger::train::kmeans(points, 3, 1, 4, eiger::train::KMeansOptions());
+    printf("clustered 3 points into 4\n");
+    ++failures;
+  } catch (const char*) {
+  }
+  return failures ? 1 : 0;
+}
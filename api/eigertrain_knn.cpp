@@ -0,0 +1,207 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* k-nearest-neighbor predictions from a k-d tree over the
+* training profile.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+
+      // the most points a leaf holds; a leaf of equal points may hold more
+      const size_t leaf_points = 16;
+      // queries a thread answers at a time
+      const size_t query_grain = 64;
+
+    } // end anonymous namespace
+
+    KDTree::KDTree(const double* points, size_t n, size_t dimensions)
+      : dimensions_(dimensions) {
+      if(n == 0)
+        throw "there are no points to search for neighbors.";
+      for(size_t i = 0; i < n * dimensions; ++i)
+        if(!std::isfinite(points[i]))
+          throw "the points to search for neighbors are not all finite.";
+
+      vector<size_t> order(n);
+      for(size_t i = 0; i < n; ++i)
+        order[i] = i;
+      nodes_.reserve(2 * (n / leaf_points) + 1);
+      build(points, order, 0, n);
+
+      points_.resize(n * dimensions);
+      for(size_t i = 0; i < n; ++i)
+        copy(points + order[i] * dimensions,
+             points + (order[i] + 1) * dimensions,
+             points_.begin() + i * dimensions);
+      rows_.swap(order);
+    }
+
+    size_t KDTree::build(const double* points, vector<size_t>& order,
+                         size_t begin, size_t end){
+      const size_t node = nodes_.size();
+      Node leaf = {begin, end, 0, 0, 0, 0.0};
+      nodes_.push_back(leaf);
+      if(end - begin <= leaf_points)
+        return node;
+
+      // split the dimension the points spread most in, at its median
+      size_t widest = 0;
+      double spread = 0.0;
+      for(size_t d = 0; d < dimensions_; ++d){
+        double lowest = points[order[begin] * dimensions_ + d];
+        double highest = lowest;
+        for(size_t i = begin + 1; i < end; ++i){
+          const double x = points[order[i] * dimensions_ + d];
+          lowest = min(lowest, x);
+          highest = max(highest, x);
+        }
+        if(highest - lowest > spread){
+          widest = d;
+          spread = highest - lowest;
+        }
+      }
+      if(spread == 0.0)
+        return node;
+
+      const size_t middle = begin + (end - begin) / 2;
+      nth_element(order.begin() + begin, order.begin() + middle,
+                  order.begin() + end, [&](size_t a, size_t b){
+        const double xa = points[a * dimensions_ + widest];
+        const double xb = points[b * dimensions_ + widest];
+        return xa < xb || (xa == xb && a < b);
+      });
+      const double split = points[order[middle] * dimensions_ + widest];
+      const size_t left = build(points, order, begin, middle);
+      const size_t right = build(points, order, middle, end);
+      nodes_[node].left = left;
+      nodes_[node].right = right;
+      nodes_[node].dimension = widest;
+      nodes_[node].split = split;
+      return node;
+    }
+
+    double KDTree::distance(const double* query, size_t point) const {
+      const double* x = &points_[point * dimensions_];
+      double sum = 0.0;
+      for(size_t d = 0; d < dimensions_; ++d)
+        sum += (query[d] - x[d]) * (query[d] - x[d]);
+      return sum;
+    }
+
+    void KDTree::nearest(const double* query, size_t k,
+                         vector<Neighbor>& neighbors) const {
+      neighbors.clear();
+      if(k == 0)
+        return;
+      neighbors.reserve(min(k, size()));
+      nearest(0, query, k, neighbors);
+      sort_heap(neighbors.begin(), neighbors.end());
+    }
+
+    // neighbors is a max-heap of the nearest points so far. The bound on
+    // the far side is exact in floating point, since rounded differences,
+    // squares and sums of them are monotonic; a point there as far as the
+    // farthest kept may still be kept for its earlier row.
+    void KDTree::nearest(size_t node, const double* query, size_t k,
+                         vector<Neighbor>& neighbors) const {
+      const Node& n = nodes_[node];
+      if(!n.left){
+        for(size_t i = n.begin; i < n.end; ++i){
+          const Neighbor found(distance(query, i), rows_[i]);
+          if(neighbors.size() < k){
+            neighbors.push_back(found);
+            push_heap(neighbors.begin(), neighbors.end());
+          }
+          else if(found < neighbors.front()){
+            pop_heap(neighbors.begin(), neighbors.end());
+            neighbors.back() = found;
+            push_heap(neighbors.begin(), neighbors.end());
+          }
+        }
+        return;
+      }
+      const double offset = query[n.dimension] - n.split;
+      nearest(offset <= 0.0 ? n.left : n.right, query, k, neighbors);
+      if(neighbors.size() < k || offset * offset <= neighbors.front().first)
+        nearest(offset <= 0.0 ? n.right : n.left, query, k, neighbors);
+    }
+
+    void KDTree::within(const double* query, double radius2,
+                        vector<size_t>& rows) const {
+      rows.clear();
+      within(0, query, radius2, rows);
+      sort(rows.begin(), rows.end());
+    }
+
+    void KDTree::within(size_t node, const double* query, double radius2,
+                        vector<size_t>& rows) const {
+      const Node& n = nodes_[node];
+      if(!n.left){
+        for(size_t i = n.begin; i < n.end; ++i)
+          if(distance(query, i) <= radius2)
+            rows.push_back(rows_[i]);
+        return;
+      }
+      const double offset = query[n.dimension] - n.split;
+      if(offset <= 0.0 || offset * offset <= radius2)
+        within(n.left, query, radius2, rows);
+      if(offset >= 0.0 || offset * offset <= radius2)
+        within(n.right, query, radius2, rows);
+    }
+
+    void nearestNeighbors(const KDTree& tree, const double* y,
+                          const double* queries, size_t n, size_t k,
+                          double* predictions, ThreadPool* threads){
+      if(k == 0)
+        throw "k-nearest neighbors needs k of at least 1.";
+      const size_t dimensions = tree.dimensions();
+      parallelFor(threads, 0, n, query_grain, [&](size_t begin, size_t end){
+        vector<KDTree::Neighbor> neighbors;
+        vector<size_t> matches;
+        for(size_t q = begin; q < end; ++q){
+          const double* query = queries + q * dimensions;
+          bool finite = true;
+          for(size_t d = 0; d < dimensions; ++d)
+            finite = finite && std::isfinite(query[d]);
+          if(!finite){
+            predictions[q] = numeric_limits<double>::quiet_NaN();
+            continue;
+          }
+
+          tree.nearest(query, k, neighbors);
+          if(neighbors[0].first == 0.0){
+            // every exact match counts, however many there are
+            tree.within(query, 0.0, matches);
+            double sum = 0.0;
+            for(size_t i = 0; i < matches.size(); ++i)
+              sum += y[matches[i]];
+            predictions[q] = sum / matches.size();
+            continue;
+          }
+          double weighted = 0.0, total = 0.0;
+          for(size_t i = 0; i < neighbors.size(); ++i){
+            const double weight = 1.0 / sqrt(neighbors[i].first);
+            weighted += weight * y[neighbors[i].second];
+            total += weight;
+          }
+          predictions[q] = weighted / total;
+        }
+      });
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
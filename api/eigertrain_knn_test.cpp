@@ -0,0 +1,203 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks the k-d tree and nearest-neighbor predictions of
+* libeigertrain against a search of every point.
+*
+**********************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+typedef eiger::train::KDTree::Neighbor Neighbor;
+
+static int failures = 0;
+
+// every point, by the tree's own arithmetic
+static vector<Neighbor> everyPoint(const vector<double>& x, size_t dimensions,
+                                   const double* query) {
+  vector<Neighbor> all;
+  for (size_t r = 0; r < x.size() / dimensions; ++r) {
+    double sum = 0.0;
+    for (size_t d = 0; d < dimensions; ++d)
+      sum += (query[d] - x[r * dimensions + d]) *
+             (query[d] - x[r * dimensions + d]);
+    all.push_back(Neighbor(sum, r));
+  }
+  sort(all.begin(), all.end());
+  return all;
+}
+
+static double predict(const vector<Neighbor>& all, const vector<double>& y,
+                      size_t k) {
+  if (all[0].first == 0.0) {
+    double sum = 0.0;
+    size_t matches = 0;
+    for (; matches < all.size() && all[matches].first == 0.0; ++matches)
+      sum += y[all[matches].second];
+    return sum / matches;
+  }
+  double weighted = 0.0, total = 0.0;
+  for (size_t i = 0; i < min(k, all.size()); ++i) {
+    const double weight = 1.0 / sqrt(all[i].first);
+    weighted += weight * y[all[i].second];
+    total += weight;
+  }
+  return weighted / total;
+}
+
+// n training points and as many queries: half of them random, the rest
+// training points and their midpoints; on a grid, most distances tie
+static void check(const char* what, size_t n, size_t dimensions, bool grid) {
+  mt19937_64 rng(n * 31 + dimensions);
+  normal_distribution<double> gauss(0.0, 1.0);
+  vector<double> x(n * dimensions), y(n), queries(n * dimensions);
+  for (size_t i = 0; i < n * dimensions; ++i)
+    x[i] = grid ? double(rng() % 5) : gauss(rng);
+  for (size_t r = 0; r < n; ++r)
+    y[r] = gauss(rng);
+  for (size_t q = 0; q < n; ++q)
+    for (size_t d = 0; d < dimensions; ++d) {
+      const size_t at = q * dimensions + d;
+      if (q % 2 == 0)
+        queries[at] = grid ? double(rng() % 6) - 0.5 : 1.5 * gauss(rng);
+      else if (q % 4 == 1)
+        queries[at] = x[at];
+      else
+        queries[at] = 0.5 * (x[at] + x[(q / 2) * dimensions + d]);
+    }
+
+  eiger::train::KDTree tree(&x[0], n, dimensions);
+  const size_t ks[] = {1, 4, 40, n + 3};
+  vector<Neighbor> found;
+  vector<size_t> rows;
+  for (size_t q = 0; q < n; q += 7) {
+    const double* query = &queries[q * dimensions];
+    const vector<Neighbor> all = everyPoint(x, dimensions, query);
+    for (size_t i = 0; i < 4; ++i) {
+      tree.nearest(query, ks[i], found);
+      const vector<Neighbor> want(all.begin(),
+                                  all.begin() + min(ks[i], all.size()));
+      if (found != want) {
+        printf("%s: the %zu nearest points to query %zu are wrong\n", what,
+               ks[i], q);
+        ++failures;
+        return;
+      }
+    }
+    const double radius2 = all[min(n - 1, size_t(10))].first;
+    tree.within(query, radius2, rows);
+    vector<size_t> inside;
+    for (size_t i = 0; i < all.size() && all[i].first <= radius2; ++i)
+      inside.push_back(all[i].second);
+    sort(inside.begin(), inside.end());
+    if (rows != inside) {
+      printf("%s: %zu points near query %zu, expected %zu\n", what,
+             rows.size(), q, inside.size());
+      ++failures;
+      return;
+    }
+  }
+
+  for (size_t i = 0; i < 4; ++i) {
+    vector<double> serial(n), threaded(n);
+    eiger::train::nearestNeighbors(tree, &y[0], &queries[0], n, ks[i],
+                                   &serial[0]);
+    eiger::train::ThreadPool pool(4);
+    eiger::train::nearestNeighbors(tree, &y[0], &queries[0], n, ks[i],
+                                   &threaded[0], &pool);
+    for (size_t q = 0; q < n; ++q) {
+      const double want =
+          predict(everyPoint(x, dimensions, &queries[q * dimensions]), y,
+                  ks[i]);
+      if (serial[q] != want || threaded[q] != serial[q]) {
+        printf("%s: query %zu with k %zu predicted %.17g and %.17g, "
+               "expected %.17g\n", what, q, ks[i], serial[q], threaded[q],
+               want);
+        ++failures;
+        return;
+      }
+    }
+  }
+}
+
+static void check_errors() {
+  const double x[] = {0.0, 1.0, NAN, 2.0};
+  const double y[] = {1.0, 2.0};
+  try {
+    eiger::train::KDTree tree(x, 2, 2);
+    printf("a point that is not a number was accepted\n");
+    ++failures;
+  } catch (const char*) {
+  }
+  eiger::train::KDTree tree(x, 1, 2);
+  const double queries[] = {NAN, 0.0, 0.0, 1.0};
+  double predictions[2];
+  eiger::train::nearestNeighbors(tree, y, queries, 2, 1, predictions);
+  if (!std::isnan(predictions[0]) || predictions[1] != 1.0) {
+    printf("predicted %g and %g for a query that is not a number and an "
+           "exact match\n", predictions[0], predictions[1]);
+    ++failures;
+  }
+  try {
+    eiger::train::nearestNeighbors(tree, y, queries, 2, 0, predictions);
+    printf("k of 0 was accepted\n");
+    ++failures;
+  } catch (const char*) {
+  }
+}
+
+// a tree handle answers repeated queries as the one-shot call does
+static void check_handle() {
+  const size_t n = 200, dimensions = 3;
+  mt19937_64 rng(7);
+  normal_distribution<double> gauss(0.0, 1.0);
+  vector<double> x(n * dimensions), y(n), queries(n * dimensions);
+  for (size_t i = 0; i < n * dimensions; ++i) {
+    x[i] = gauss(rng);
+    queries[i] = gauss(rng);
+  }
+  for (size_t r = 0; r < n; ++r)
+    y[r] = gauss(rng);
+  eiger_knn* tree = eiger_knn_create(&x[0], &y[0], n, dimensions, 2);
+  if (!tree) {
+    printf("no tree: %s\n", eiger_train_error());
+    ++failures;
+    return;
+  }
+  // the tree keeps its own copy of the values
+  const vector<double> values = y;
+  fill(y.begin(), y.end(), 0.0);
+  for (size_t k = 1; k < 10; k += 4) {
+    vector<double> once(n), kept(n);
+    if (eiger_nearest_neighbors(&x[0], &values[0], n, dimensions,
+                                &queries[0], n, k, 1, &once[0]) != 0 ||
+        eiger_knn_query(tree, &queries[0], n, k, &kept[0]) != 0 ||
+        once != kept) {
+      printf("the tree handle predicted differently with k %zu\n", k);
+      ++failures;
+    }
+  }
+  if (eiger_knn_query(tree, &queries[0], n, 0, &y[0]) == 0) {
+    printf("the tree handle accepted k of 0\n");
+    ++failures;
+  }
+  eiger_knn_free(tree);
+  eiger_knn_free(NULL);
+}
+
+int main() {
+  check("random points", 3000, 4, false);
+  check("grid points", 2000, 3, true);
+  check("one dimension", 500, 1, true);
+  check("few points", 7, 2, false);
+  check_errors();
+  check_handle();
+  return failures ? 1 : 0;
+}
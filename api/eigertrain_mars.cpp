@@ -0,0 +1,411 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Multivariate adaptive regression splines, with every knot
+* of a variable scored in one sorted pass over the rows.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+
+      // the part of a column's squared norm that must be left once it is
+      // orthogonalized for it not to lie in the span of the model
+      const double dependent = 1e-10;
+
+      // the GCV penalty of MARS.find_min_gcv for each pair of hinges
+      const double gcv_penalty = 3.0;
+
+      double dot(const double* a, const double* b, size_t n){
+        double sum = 0.0;
+        for(size_t r = 0; r < n; ++r)
+          sum += a[r] * b[r];
+        return sum;
+      }
+
+      // Orthonormalizes column against q, twice as modified Gram-Schmidt
+      // alone loses orthogonality, and returns whether anything was left of
+      // it. coefficients, if given, gets its coefficients on q and then its
+      // norm once orthogonalized.
+      bool orthogonalize(vector<double>& column,
+                         const vector<vector<double> >& q,
+                         vector<double>* coefficients = 0){
+        const size_t n = column.size();
+        const double norm = dot(&column[0], &column[0], n);
+        if(coefficients)
+          coefficients->assign(q.size() + 1, 0.0);
+        for(int pass = 0; pass < 2; ++pass)
+          for(size_t k = 0; k < q.size(); ++k){
+            const double c = dot(&q[k][0], &column[0], n);
+            for(size_t r = 0; r < n; ++r)
+              column[r] -= c * q[k][r];
+            if(coefficients)
+              (*coefficients)[k] += c;
+          }
+        const double rest = dot(&column[0], &column[0], n);
+        if(!(rest > dependent * norm))
+          return false;
+        const double s = sqrt(rest);
+        for(size_t r = 0; r < n; ++r)
+          column[r] /= s;
+        if(coefficients)
+          (*coefficients)[q.size()] = s;
+        return true;
+      }
+
+      // The best knot for a pair of hinges on a variable times a parent
+      // term, and how much the pair reduces the residual sum of squares.
+      struct Candidate {
+        bool found;
+        double gain;
+        size_t parent, variable, row;
+      };
+
+      // The state of the forward pass.
+      struct Forward {
+        size_t n;
+        // each variable less its mean, a column to a variable, and the rows
+        // in decreasing order of each
+        vector<double> shifted;
+        vector<size_t> order;
+        vector<vector<Hinge> > terms;
+        // the value of each term on each row
+        vector<vector<double> > values;
+        // an orthonormal basis of the terms, and the coefficients of each
+        // term on it; a term that depends on those before it has no column
+        vector<vector<double> > q;
+        vector<vector<double> > coefficients;
+        vector<bool> independent;
+        vector<double> residual;
+
+        bool uses(size_t term, size_t variable) const {
+          for(size_t f = 0; f < terms[term].size(); ++f)
+            if(terms[term][f].variable == variable)
+              return true;
+          return false;
+        }
+
+        void add(const vector<Hinge>& factors, const vector<double>& value){
+          terms.push_back(factors);
+          values.push_back(value);
+          vector<double> column(value), c;
+          independent.push_back(orthogonalize(column, q, &c));
+          if(independent.back()){
+            q.push_back(column);
+            const double p = dot(&residual[0], &column[0], n);
+            for(size_t r = 0; r < n; ++r)
+              residual[r] -= p * column[r];
+          }
+          else
+            c.pop_back();
+          coefficients.push_back(c);
+        }
+
+        // Scores every knot of variable for the pair of hinges it makes
+        // with parent. For b the parent term and a its product with the
+        // variable, the pair spans the same space with the model as a and
+        // the hinge b (x - t)+, which is a - t b on the rows above t; so a
+        // is orthogonalized once, and the hinge's products with the basis
+        // and the residual are running sums as t falls through the rows.
+        Candidate scan(size_t parent, size_t variable) const {
+          Candidate best = {false, 0.0, parent, variable, 0};
+          const double* b = &values[parent][0];
+          const double* x = &shifted[variable * n];
+          vector<double> a(n);
+          for(size_t r = 0; r < n; ++r)
+            a[r] = b[r] * x[r];
+          vector<double> linear(a), residue(residual);
+          double gain = 0.0;
+          vector<const double*> basis;
+          for(size_t k = 0; k < q.size(); ++k)
+            basis.push_back(&q[k][0]);
+          if(orthogonalize(linear, q)){
+            const double c = dot(&residue[0], &linear[0], n);
+            gain = c * c;
+            for(size_t r = 0; r < n; ++r)
+              residue[r] -= c * linear[r];
+            basis.push_back(&linear[0]);
+          }
+
+          const size_t k = basis.size();
+          vector<double> sa(k, 0.0), sb(k, 0.0);
+          double saa = 0.0, sab = 0.0, sbb = 0.0, sra = 0.0, srb = 0.0;
+          double last = 0.0;
+          bool any = false;
+          const size_t* order = &this->order[variable * n];
+          for(size_t i = 0; i < n; ++i){
+            const size_t row = order[i];
+            if(b[row] == 0.0)
+              continue;
+            const double t = x[row];
+            if(any && t < last){
+              // the rows so far are those above t
+              const double hh = saa - 2.0 * t * sab + t * t * sbb;
+              double projected = 0.0;
+              for(size_t j = 0; j < k; ++j){
+                const double h = sa[j] - t * sb[j];
+                projected += h * h;
+              }
+              const double rest = hh - projected;
+              if(rest > dependent * hh){
+                const double c = sra - t * srb;
+                const double g = c * c / rest;
+                if(!best.found || g > best.gain){
+                  best.found = true;
+                  best.gain = g;
+                  best.row = row;
+                }
+              }
+            }
+            for(size_t j = 0; j < k; ++j){
+              sa[j] += basis[j][row] * a[row];
+              sb[j] += basis[j][row] * b[row];
+            }
+            saa += a[row] * a[row];
+            sab += a[row] * b[row];
+            sbb += b[row] * b[row];
+            sra += residue[row] * a[row];
+            srb += residue[row] * b[row];
+            any = true;
+            last = t;
+          }
+          best.gain += gain;
+          return best;
+        }
+      };
+
+      // The least squares fit of the terms subset to y, from the basis
+      // coefficients r (k by k, a column to a term, upper triangular) of
+      // the independent terms and z = Q'y: Householder QR of the columns of
+      // r in subset, which leaves the weights, the residual sum of squares
+      // beyond rss, and for each term how much dropping it would add.
+      struct Subset {
+        vector<double> weights, cost;
+        double rss;
+      };
+
+      Subset fitSubset(const vector<double>& r, size_t k,
+                       const vector<size_t>& subset, const vector<double>& z,
+                       double rss){
+        const size_t s = subset.size();
+        vector<double> a(k * s), y(z);
+        for(size_t j = 0; j < s; ++j)
+          copy(&r[subset[j] * k], &r[subset[j] * k] + k, &a[j * k]);
+        for(size_t j = 0; j < s; ++j){
+          double* v = &a[j * k];
+          double norm = 0.0;
+          for(size_t i = j; i < k; ++i)
+            norm += v[i] * v[i];
+          norm = sqrt(norm);
+          if(norm == 0.0)
+            continue;
+          const double alpha = v[j] > 0 ? -norm : norm;
+          v[j] -= alpha;
+          const double vv = dot(v + j, v + j, k - j);
+          for(size_t c = j + 1; c < s; ++c){
+            double* col = &a[c * k];
+            const double w = 2.0 * dot(v + j, col + j, k - j) / vv;
+            for(size_t i = j; i < k; ++i)
+              col[i] -= w * v[i];
+          }
+          const double w = 2.0 * dot(v + j, &y[j], k - j) / vv;
+          for(size_t i = j; i < k; ++i)
+            y[i] -= w * v[i];
+          v[j] = alpha;
+        }
+
+        Subset fit;
+        fit.rss = rss;
+        for(size_t i = s; i < k; ++i)
+          fit.rss += y[i] * y[i];
+        // T is the upper triangle of a; the weights solve T w = y, and the
+        // inverse of T gives the diagonal of the inverse of X'X
+        #define T(i, j) a[(j) * k + (i)]
+        fit.weights.assign(s, 0.0);
+        for(size_t i = s; i-- > 0; ){
+          double sum = y[i];
+          for(size_t j = i + 1; j < s; ++j)
+            sum -= T(i, j) * fit.weights[j];
+          fit.weights[i] = T(i, i) == 0.0 ? 0.0 : sum / T(i, i);
+        }
+        vector<double> inverse(s * s, 0.0);
+        for(size_t c = 0; c < s; ++c)
+          for(size_t i = c + 1; i-- > 0; ){
+            double sum = i == c ? 1.0 : 0.0;
+            for(size_t j = i + 1; j <= c; ++j)
+              sum -= T(i, j) * inverse[j * s + c];
+            inverse[i * s + c] = T(i, i) == 0.0 ? 0.0 : sum / T(i, i);
+          }
+        #undef T
+        fit.cost.assign(s, 0.0);
+        for(size_t i = 0; i < s; ++i){
+          const double d = dot(&inverse[i * s], &inverse[i * s], s);
+          fit.cost[i] = d > 0.0 ? fit.weights[i] * fit.weights[i] / d : 0.0;
+        }
+        return fit;
+      }
+
+      double gcv(double rss, size_t terms, size_t rows){
+        const double c = terms + gcv_penalty * (terms - 1) / 2.0;
+        if(c >= rows)
+          return numeric_limits<double>::infinity();
+        return rss / (rows * (1.0 - c / rows) * (1.0 - c / rows));
+      }
+
+    } // end anonymous namespace
+
+    MarsFit mars(const double* x, const double* y, size_t rows,
+                 size_t variables, size_t max_terms, size_t max_interactions,
+                 ThreadPool* threads){
+      if(rows == 0)
+        throw "MARS needs at least one row.";
+      const size_t n = rows;
+      Forward f;
+      f.n = n;
+      f.shifted.resize(n * variables);
+      f.order.resize(n * variables);
+      parallelFor(threads, 0, variables, 1, [&](size_t begin, size_t end){
+          for(size_t v = begin; v < end; ++v){
+            double* xv = &f.shifted[v * n];
+            double mean = 0.0;
+            for(size_t r = 0; r < n; ++r)
+              mean += x[r * variables + v];
+            mean /= n;
+            for(size_t r = 0; r < n; ++r)
+              xv[r] = x[r * variables + v] - mean;
+            size_t* order = &f.order[v * n];
+            for(size_t r = 0; r < n; ++r)
+              order[r] = r;
+            stable_sort(order, order + n, [xv](size_t a, size_t b){
+                return xv[a] > xv[b];
+              });
+          }
+        });
+
+      f.residual.assign(y, y + n);
+      f.add(vector<Hinge>(), vector<double>(n, 1.0));
+      const double total = dot(&f.residual[0], &f.residual[0], n);
+
+      while(f.terms.size() < max_terms){
+        vector<Candidate> best(variables);
+        const size_t parents = f.terms.size();
+        parallelFor(threads, 0, variables, 1, [&](size_t begin, size_t end){
+            for(size_t v = begin; v < end; ++v){
+              best[v].found = false;
+              for(size_t m = 0; m < parents; ++m){
+                if(f.terms[m].size() >= max_interactions || f.uses(m, v))
+                  continue;
+                Candidate c = f.scan(m, v);
+                if(c.found && (!best[v].found || c.gain > best[v].gain))
+                  best[v] = c;
+              }
+            }
+          });
+        Candidate pick = {false, 0.0, 0, 0, 0};
+        for(size_t v = 0; v < variables; ++v)
+          if(best[v].found && (!pick.found || best[v].gain > pick.gain ||
+                               (best[v].gain == pick.gain &&
+                                best[v].parent < pick.parent)))
+            pick = best[v];
+        // what is left is rounding
+        if(!pick.found || !(pick.gain > 1e-12 * total))
+          break;
+
+        const double knot = x[pick.row * variables + pick.variable];
+        for(int side = 0; side < 2; ++side){
+          Hinge h = {pick.variable, knot, side == 0};
+          vector<Hinge> factors(f.terms[pick.parent]);
+          factors.push_back(h);
+          vector<double> value(f.values[pick.parent]);
+          for(size_t r = 0; r < n; ++r){
+            const double xv = x[r * variables + pick.variable];
+            value[r] *= h.positive ? (xv > knot ? xv - knot : 0.0)
+                                   : (xv < knot ? knot - xv : 0.0);
+          }
+          f.add(factors, value);
+        }
+      }
+
+      // the backward pass, over the terms that have a column of the basis
+      vector<size_t> columns;
+      for(size_t t = 0; t < f.terms.size(); ++t)
+        if(f.independent[t])
+          columns.push_back(t);
+      const size_t k = columns.size();
+      vector<double> r(k * k, 0.0), z(k);
+      for(size_t j = 0; j < k; ++j){
+        const vector<double>& c = f.coefficients[columns[j]];
+        copy(c.begin(), c.end(), &r[j * k]);
+      }
+      for(size_t i = 0; i < k; ++i)
+        z[i] = dot(&f.q[i][0], y, n);
+      const double rss = dot(&f.residual[0], &f.residual[0], n);
+
+      vector<size_t> subset(k);
+      for(size_t j = 0; j < k; ++j)
+        subset[j] = j;
+      Subset fit = fitSubset(r, k, subset, z, rss);
+      vector<size_t> best_subset(subset);
+      Subset best_fit = fit;
+      double best_gcv = gcv(fit.rss, k, n);
+      while(subset.size() > 1){
+        // the constant term stays
+        size_t drop = 1;
+        for(size_t j = 2; j < subset.size(); ++j)
+          if(fit.cost[j] < fit.cost[drop])
+            drop = j;
+        subset.erase(subset.begin() + drop);
+        fit = fitSubset(r, k, subset, z, rss);
+        const double score = gcv(fit.rss, subset.size(), n);
+        if(score <= best_gcv){
+          best_gcv = score;
+          best_subset = subset;
+          best_fit = fit;
+        }
+      }
+
+      MarsFit result;
+      for(size_t j = 0; j < best_subset.size(); ++j)
+        result.terms.push_back(f.terms[columns[best_subset[j]]]);
+      result.weights = best_fit.weights;
+      result.rss = best_fit.rss;
+      result.gcv = best_gcv;
+      return result;
+    }
+
+    ModelCluster marsCluster(const MarsFit& fit){
+      ModelCluster cluster;
+      for(size_t t = 0; t < fit.terms.size(); ++t){
+        if(fit.terms[t].size() > 1)
+          throw "a MARS term with more than one hinge can't be a model "
+                "function.";
+        ModelFunction fn;
+        fn.kind = ModelFunction::IDENTITY;
+        fn.i = fn.j = -1;
+        fn.exponent = 0.0;
+        if(!fit.terms[t].empty()){
+          const Hinge& h = fit.terms[t][0];
+          fn.kind = h.positive ? ModelFunction::HINGE : ModelFunction::MIRROR;
+          fn.i = int(h.variable);
+          fn.exponent = h.knot;
+        }
+        cluster.functions.push_back(fn);
+        cluster.weights.push_back(fit.weights[t]);
+      }
+      return cluster;
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
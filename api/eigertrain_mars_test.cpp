@@ -0,0 +1,143 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks the MARS fits of libeigertrain on functions made
+* of hinges, and their model runtime form.
+*
+**********************************************************/
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "eigermodel.h"
+#include "eigertrain.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static double hinge(double x, double knot) { return x > knot ? x - knot : 0.0; }
+
+static double predict(const eiger::train::MarsFit& fit, const double* x) {
+  double sum = 0.0;
+  for (size_t t = 0; t < fit.terms.size(); ++t) {
+    double term = fit.weights[t];
+    for (size_t f = 0; f < fit.terms[t].size(); ++f) {
+      const eiger::train::Hinge& h = fit.terms[t][f];
+      term *= h.positive ? hinge(x[h.variable], h.knot)
+                         : hinge(-x[h.variable], -h.knot);
+    }
+    sum += term;
+  }
+  return sum;
+}
+
+// y of rows of variables uniform on [0, 1), made by target
+template <class F>
+static void check(const char* name, size_t rows, size_t variables,
+                  size_t max_terms, size_t max_interactions, double fraction,
+                  F target) {
+  mt19937_64 rng(11);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+  vector<double> x(rows * variables), y(rows);
+  double mean = 0.0;
+  for (size_t r = 0; r < rows; ++r) {
+    for (size_t v = 0; v < variables; ++v) x[r * variables + v] = uniform(rng);
+    y[r] = target(&x[r * variables]);
+    mean += y[r] / rows;
+  }
+  double total = 0.0;
+  for (size_t r = 0; r < rows; ++r) total += (y[r] - mean) * (y[r] - mean);
+
+  eiger::train::MarsFit fit = eiger::train::mars(
+      &x[0], &y[0], rows, variables, max_terms, max_interactions);
+  eiger::train::ThreadPool pool(3);
+  eiger::train::MarsFit threaded = eiger::train::mars(
+      &x[0], &y[0], rows, variables, max_terms, max_interactions, &pool);
+
+  if (fit.rss > fraction * max(total, 1.0)) {
+    printf("%s: left %g of the sum of squares %g\n", name, fit.rss, total);
+    ++failures;
+  }
+  if (fit.terms.empty() || !fit.terms[0].empty() ||
+      fit.terms.size() > max_terms + 1) {
+    printf("%s: %zu terms, the first with %zu hinges\n", name,
+           fit.terms.size(), fit.terms.empty() ? 0 : fit.terms[0].size());
+    ++failures;
+    return;
+  }
+  double rss = 0.0;
+  for (size_t r = 0; r < rows; ++r) {
+    double e = y[r] - predict(fit, &x[r * variables]);
+    rss += e * e;
+  }
+  if (fabs(rss - fit.rss) > 1e-9 * max(total, 1.0)) {
+    printf("%s: the residual sum of squares is %.17g, not %.17g\n", name,
+           fit.rss, rss);
+    ++failures;
+  }
+  bool same = threaded.weights == fit.weights &&
+              threaded.terms.size() == fit.terms.size();
+  for (size_t t = 0; same && t < fit.terms.size(); ++t) {
+    for (size_t f = 0; same && f < fit.terms[t].size(); ++f) {
+      const eiger::train::Hinge &a = fit.terms[t][f], &b = threaded.terms[t][f];
+      same = a.variable == b.variable && a.knot == b.knot &&
+             a.positive == b.positive;
+    }
+  }
+  if (!same) {
+    printf("%s: the fit depends on the threads\n", name);
+    ++failures;
+  }
+  for (size_t t = 0; t < fit.terms.size(); ++t) {
+    if (fit.terms[t].size() > max_interactions) {
+      printf("%s: term %zu has %zu hinges\n", name, t, fit.terms[t].size());
+      ++failures;
+    }
+  }
+
+  // additive fits run in the model runtime
+  if (max_interactions != 1) return;
+  eiger::ModelCluster cluster = eiger::train::marsCluster(fit);
+  for (size_t r = 0; r < rows; ++r) {
+    double sum = 0.0;
+    for (size_t f = 0; f < cluster.functions.size(); ++f)
+      sum += cluster.weights[f] * cluster.functions[f](&x[r * variables]);
+    const double want = predict(fit, &x[r * variables]);
+    if (fabs(sum - want) > 1e-12 * max(1.0, fabs(want))) {
+      printf("%s: the model function predicted %.17g for row %zu, not "
+             "%.17g\n", name, sum, r, want);
+      ++failures;
+      return;
+    }
+  }
+}
+
+int main() {
+  check("additive", 500, 3, 11, 1, 1e-4, [](const double* x) {
+    return 3.0 + 2.0 * hinge(x[0], 0.5) - 4.0 * hinge(-x[1], -0.3);
+  });
+  check("interaction", 800, 3, 15, 2, 1e-3, [](const double* x) {
+    return 1.0 + 10.0 * hinge(x[0], 0.4) * hinge(x[2], 0.6);
+  });
+  check("smooth", 400, 2, 21, 1, 0.02, [](const double* x) {
+    return sin(6.0 * x[0]) + x[1] * x[1];
+  });
+  check("constant", 50, 2, 9, 1, 1e-20, [](const double*) { return 2.5; });
+
+  // a product of hinges has no model function
+  eiger::train::MarsFit fit;
+  fit.terms.resize(1);
+  eiger::train::Hinge h = {0, 0.5, true};
+  fit.terms[0].push_back(h);
+  fit.terms[0].push_back(h);
+  fit.weights.push_back(1.0);
+  try {
+    eiger::train::marsCluster(fit);
+    printf("made a model function of a product of hinges\n");
+    ++failures;
+  } catch (const char*) {
+  }
+  return failures ? 1 : 0;
+}
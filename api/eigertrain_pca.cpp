@@ -0,0 +1,315 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Principal component analysis of a trial profile from its
+* moments, which are gathered a block of rows at a time.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+
+      // rows reduced together before merging; fixed, so that the rounding
+      // is the same on any number of threads
+      const size_t block_rows = 4096;
+      // blocks reduced in parallel before they are merged in order
+      const size_t batch_blocks = 64;
+
+      // moments of count rows by two passes over them
+      void reduce(const double* rows, size_t count, Moments& moments){
+        const size_t m = moments.columns();
+        moments.count = count;
+        fill(moments.mean.begin(), moments.mean.end(), 0.0);
+        fill(moments.comoment.begin(), moments.comoment.end(), 0.0);
+        for(size_t r = 0; r < count; ++r)
+          for(size_t i = 0; i < m; ++i)
+            moments.mean[i] += rows[r * m + i];
+        for(size_t i = 0; i < m; ++i)
+          moments.mean[i] /= count;
+        vector<double> d(m);
+        for(size_t r = 0; r < count; ++r){
+          for(size_t i = 0; i < m; ++i)
+            d[i] = rows[r * m + i] - moments.mean[i];
+          for(size_t i = 0; i < m; ++i){
+            double* ci = &moments.comoment[i * m];
+            for(size_t j = i; j < m; ++j)
+              ci[j] += d[i] * d[j];
+          }
+        }
+        for(size_t i = 0; i < m; ++i)
+          for(size_t j = 0; j < i; ++j)
+            moments.comoment[i * m + j] = moments.comoment[j * m + i];
+      }
+
+      // a into the tridiagonal d (diagonal) and e (subdiagonal, from e[1]),
+      // leaving the orthogonal transformation in a
+      void tridiagonalize(vector<double>& a, size_t n, vector<double>& d,
+                          vector<double>& e){
+        #define A(i, j) a[(i) * n + (j)]
+        for(size_t j = 0; j < n; ++j)
+          d[j] = A(n - 1, j);
+        for(size_t i = n - 1; i > 0; --i){
+          double scale = 0.0, h = 0.0;
+          for(size_t k = 0; k < i; ++k)
+            scale += fabs(d[k]);
+          if(scale == 0.0){
+            e[i] = d[i - 1];
+            for(size_t j = 0; j < i; ++j){
+              d[j] = A(i - 1, j);
+              A(i, j) = 0.0;
+              A(j, i) = 0.0;
+            }
+          }
+          else{
+            for(size_t k = 0; k < i; ++k){
+              d[k] /= scale;
+              h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = f > 0 ? -sqrt(h) : sqrt(h);
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for(size_t j = 0; j < i; ++j)
+              e[j] = 0.0;
+            for(size_t j = 0; j < i; ++j){
+              f = d[j];
+              A(j, i) = f;
+              g = e[j] + A(j, j) * f;
+              for(size_t k = j + 1; k < i; ++k){
+                g += A(k, j) * d[k];
+                e[k] += A(k, j) * f;
+              }
+              e[j] = g;
+            }
+            f = 0.0;
+            for(size_t j = 0; j < i; ++j){
+              e[j] /= h;
+              f += e[j] * d[j];
+            }
+            const double hh = f / (h + h);
+            for(size_t j = 0; j < i; ++j)
+              e[j] -= hh * d[j];
+            for(size_t j = 0; j < i; ++j){
+              f = d[j];
+              g = e[j];
+              for(size_t k = j; k < i; ++k)
+                A(k, j) -= f * e[k] + g * d[k];
+              d[j] = A(i - 1, j);
+              A(i, j) = 0.0;
+            }
+          }
+          d[i] = h;
+        }
+
+        // accumulate the transformations
+        for(size_t i = 0; i + 1 < n; ++i){
+          A(n - 1, i) = A(i, i);
+          A(i, i) = 1.0;
+          const double h = d[i + 1];
+          if(h != 0.0){
+            for(size_t k = 0; k <= i; ++k)
+              d[k] = A(k, i + 1) / h;
+            for(size_t j = 0; j <= i; ++j){
+              double g = 0.0;
+              for(size_t k = 0; k <= i; ++k)
+                g += A(k, i + 1) * A(k, j);
+              for(size_t k = 0; k <= i; ++k)
+                A(k, j) -= g * d[k];
+            }
+          }
+          for(size_t k = 0; k <= i; ++k)
+            A(k, i + 1) = 0.0;
+        }
+        for(size_t j = 0; j < n; ++j){
+          d[j] = A(n - 1, j);
+          A(n - 1, j) = 0.0;
+        }
+        A(n - 1, n - 1) = 1.0;
+        e[0] = 0.0;
+        #undef A
+      }
+
+      // the implicit QL method on the tridiagonal d and e, applying its
+      // rotations to the columns of a
+      void diagonalize(vector<double>& a, size_t n, vector<double>& d,
+                       vector<double>& e){
+        #define A(i, j) a[(i) * n + (j)]
+        for(size_t i = 1; i < n; ++i)
+          e[i - 1] = e[i];
+        e[n - 1] = 0.0;
+        double f = 0.0, largest = 0.0;
+        for(size_t l = 0; l < n; ++l){
+          largest = max(largest, fabs(d[l]) + fabs(e[l]));
+          size_t m = l;
+          while(m < n && fabs(e[m]) > DBL_EPSILON * largest)
+            ++m;
+          if(m > l){
+            size_t iterations = 0;
+            do{
+              if(++iterations > 30 * n)
+                throw "the eigenvalues of the profile did not converge.";
+              double g = d[l];
+              double p = (d[l + 1] - g) / (2.0 * e[l]);
+              double r = hypot(p, 1.0);
+              if(p < 0)
+                r = -r;
+              d[l] = e[l] / (p + r);
+              d[l + 1] = e[l] * (p + r);
+              const double dl1 = d[l + 1];
+              double h = g - d[l];
+              for(size_t i = l + 2; i < n; ++i)
+                d[i] -= h;
+              f += h;
+
+              p = d[m];
+              double c = 1.0, c2 = c, c3 = c, s = 0.0, s2 = 0.0;
+              const double el1 = e[l + 1];
+              for(size_t i = m; i-- > l; ){
+                c3 = c2;
+                c2 = c;
+                s2 = s;
+                g = c * e[i];
+                h = c * p;
+                r = hypot(p, e[i]);
+                e[i + 1] = s * r;
+                s = e[i] / r;
+                c = p / r;
+                p = c * d[i] - s * g;
+                d[i + 1] = h + s * (c * g + s * d[i]);
+                for(size_t k = 0; k < n; ++k){
+                  h = A(k, i + 1);
+                  A(k, i + 1) = s * A(k, i) + c * h;
+                  A(k, i) = c * A(k, i) - s * h;
+                }
+              }
+              p = -s * s2 * c3 * el1 * e[l] / dl1;
+              e[l] = s * p;
+              d[l] = c * p;
+            } while(fabs(e[l]) > DBL_EPSILON * largest);
+          }
+          d[l] += f;
+          e[l] = 0.0;
+        }
+        #undef A
+      }
+
+    } // end anonymous namespace
+
+    Moments::Moments(size_t columns)
+      : count(0), mean(columns, 0.0), comoment(columns * columns, 0.0) {}
+
+    void Moments::merge(const Moments& other){
+      if(other.columns() != columns())
+        throw "moments of tables with different columns can't be merged.";
+      if(other.count == 0)
+        return;
+      if(count == 0){
+        *this = other;
+        return;
+      }
+      const size_t m = columns();
+      const double na = count, nb = other.count, n = na + nb;
+      vector<double> delta(m);
+      for(size_t i = 0; i < m; ++i)
+        delta[i] = other.mean[i] - mean[i];
+      for(size_t i = 0; i < m; ++i)
+        for(size_t j = 0; j < m; ++j)
+          comoment[i * m + j] += other.comoment[i * m + j] +
+                                 delta[i] * delta[j] * (na * nb / n);
+      for(size_t i = 0; i < m; ++i)
+        mean[i] += delta[i] * (nb / n);
+      count += other.count;
+    }
+
+    void Moments::add(const double* rows, size_t n, ThreadPool* threads){
+      const size_t m = columns();
+      const size_t blocks = (n + block_rows - 1) / block_rows;
+      vector<Moments> batch(min(blocks, batch_blocks), Moments(m));
+      for(size_t first = 0; first < blocks; first += batch_blocks){
+        const size_t size = min(blocks - first, batch_blocks);
+        parallelFor(threads, 0, size, 1, [&](size_t begin, size_t end){
+            for(size_t b = begin; b < end; ++b){
+              const size_t row = (first + b) * block_rows;
+              reduce(rows + row * m, min(block_rows, n - row), batch[b]);
+            }
+          });
+        for(size_t b = 0; b < size; ++b)
+          merge(batch[b]);
+      }
+    }
+
+    vector<double> symmetricEigen(vector<double>& a, size_t n){
+      vector<double> d(n), e(n);
+      if(n == 0)
+        return d;
+      tridiagonalize(a, n, d, e);
+      diagonalize(a, n, d, e);
+      // ascending, the vectors with them
+      for(size_t i = 0; i + 1 < n; ++i){
+        size_t k = i;
+        for(size_t j = i + 1; j < n; ++j)
+          if(d[j] < d[k])
+            k = j;
+        if(k == i)
+          continue;
+        swap(d[i], d[k]);
+        for(size_t r = 0; r < n; ++r)
+          swap(a[r * n + i], a[r * n + k]);
+      }
+      return d;
+    }
+
+    PrincipalComponents principalComponents(const Moments& moments,
+                                            bool scale){
+      const size_t m = moments.columns();
+      if(moments.count < 2)
+        throw "principal components need at least two rows.";
+      vector<double> s(m, 1.0);
+      if(scale)
+        for(size_t i = 0; i < m; ++i){
+          double sd = sqrt(moments.comoment[i * m + i] / (moments.count - 1));
+          // as PCA.pretreat, columns that don't vary are left as they are
+          if(sd != 0.0)
+            s[i] = sd;
+        }
+      vector<double> a(m * m);
+      for(size_t i = 0; i < m; ++i)
+        for(size_t j = 0; j < m; ++j)
+          a[i * m + j] = moments.comoment[i * m + j] / (s[i] * s[j]);
+      vector<double> values = symmetricEigen(a, m);
+
+      const size_t k = min(moments.count, m);
+      PrincipalComponents pc;
+      pc.loadings.resize(k);
+      pc.components.resize(m * k);
+      const double largest = m ? max(values[m - 1], 0.0) : 0.0;
+      const double tolerance = m * DBL_EPSILON * largest;
+      for(size_t c = 0; c < k; ++c){
+        const size_t v = m - 1 - c;
+        pc.loadings[c] = values[v] > tolerance ? values[v] : 0.0;
+        size_t top = 0;
+        for(size_t i = 1; i < m; ++i)
+          if(fabs(a[i * m + v]) > fabs(a[top * m + v]))
+            top = i;
+        const double sign = a[top * m + v] < 0 ? -1.0 : 1.0;
+        for(size_t i = 0; i < m; ++i)
+          pc.components[i * k + c] = sign * a[i * m + v];
+      }
+      return pc;
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
@@ -0,0 +1,168 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks the moments and principal components of
+* libeigertrain against direct computation.
+*
+**********************************************************/
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static bool close(double a, double b, double tolerance) {
+  return fabs(a - b) <= tolerance * max(1.0, fabs(b));
+}
+
+// rows of correlated metrics with large offsets, as trial profiles have
+static vector<double> profile(size_t rows, size_t columns, unsigned seed) {
+  mt19937_64 rng(seed);
+  normal_distribution<double> gauss(0.0, 1.0);
+  vector<double> x(rows * columns);
+  for (size_t r = 0; r < rows; ++r) {
+    double common = gauss(rng);
+    for (size_t c = 0; c < columns; ++c)
+      x[r * columns + c] = 1e6 * (c + 1) + (c % 3 + 1) * common +
+                           0.1 * (c + 1) * gauss(rng);
+    // the last column repeats the first
+    x[r * columns + columns - 1] = x[r * columns];
+  }
+  return x;
+}
+
+static void check_moments(size_t rows, size_t columns) {
+  vector<double> x = profile(rows, columns, 1);
+  vector<long double> mean(columns, 0.0L);
+  for (size_t r = 0; r < rows; ++r)
+    for (size_t c = 0; c < columns; ++c) mean[c] += x[r * columns + c];
+  for (size_t c = 0; c < columns; ++c) mean[c] /= rows;
+
+  eiger::train::Moments whole(columns), pieces(columns), threaded(columns);
+  whole.add(&x[0], rows);
+  // uneven pieces, merged as a stream would be
+  for (size_t first = 0, size = 1; first < rows; first += size, size *= 3) {
+    eiger::train::Moments piece(columns);
+    piece.add(&x[first * columns], min(size, rows - first));
+    pieces.merge(piece);
+  }
+  eiger::train::ThreadPool pool(4);
+  threaded.add(&x[0], rows, &pool);
+
+  if (whole.count != rows || pieces.count != rows) {
+    printf("counted %zu and %zu rows of %zu\n", whole.count, pieces.count,
+           rows);
+    ++failures;
+    return;
+  }
+  for (size_t i = 0; i < columns; ++i) {
+    for (size_t j = 0; j < columns; ++j) {
+      long double want = 0.0L;
+      for (size_t r = 0; r < rows; ++r)
+        want += (x[r * columns + i] - mean[i]) * (x[r * columns + j] - mean[j]);
+      double got = whole.comoment[i * columns + j];
+      if (!close(got, want, 1e-9) ||
+          !close(pieces.comoment[i * columns + j], want, 1e-9) ||
+          threaded.comoment[i * columns + j] != got) {
+        printf("co-moment %zu,%zu is %.17g, pieces %.17g, threaded %.17g; "
+               "expected %.17Lg\n", i, j, got, pieces.comoment[i * columns + j],
+               threaded.comoment[i * columns + j], want);
+        ++failures;
+        return;
+      }
+    }
+    if (!close(whole.mean[i], mean[i], 1e-13) ||
+        threaded.mean[i] != whole.mean[i]) {
+      printf("mean %zu is %.17g, expected %.17Lg\n", i, whole.mean[i],
+             mean[i]);
+      ++failures;
+    }
+  }
+}
+
+static void check_components(size_t rows, size_t columns) {
+  vector<double> x = profile(rows, columns, 2);
+  eiger::train::Moments moments(columns);
+  moments.add(&x[0], rows);
+  eiger::train::PrincipalComponents pc =
+      eiger::train::principalComponents(moments);
+  const size_t k = pc.loadings.size();
+  if (k != min(rows, columns)) {
+    printf("%zu components of %zu by %zu\n", k, rows, columns);
+    ++failures;
+    return;
+  }
+
+  // the scaled co-moments the components diagonalize
+  vector<double> a(columns * columns);
+  for (size_t i = 0; i < columns; ++i)
+    for (size_t j = 0; j < columns; ++j)
+      a[i * columns + j] =
+          moments.comoment[i * columns + j] /
+          sqrt(moments.comoment[i * columns + i] *
+               moments.comoment[j * columns + j]) * (rows - 1);
+  for (size_t c = 0; c < k; ++c) {
+    if (c > 0 && pc.loadings[c] > pc.loadings[c - 1]) {
+      printf("loading %zu is larger than the one before\n", c);
+      ++failures;
+    }
+    for (size_t i = 0; i < columns; ++i) {
+      double av = 0.0;
+      for (size_t j = 0; j < columns; ++j)
+        av += a[i * columns + j] * pc.components[j * k + c];
+      if (!close(av, pc.loadings[c] * pc.components[i * k + c],
+                 1e-9 * pc.loadings[0])) {
+        printf("component %zu is not an eigenvector\n", c);
+        ++failures;
+        return;
+      }
+    }
+    for (size_t d = 0; d <= c; ++d) {
+      double dot = 0.0;
+      for (size_t i = 0; i < columns; ++i)
+        dot += pc.components[i * k + c] * pc.components[i * k + d];
+      if (!close(dot, c == d ? 1.0 : 0.0, 1e-12)) {
+        printf("components %zu and %zu are not orthonormal\n", c, d);
+        ++failures;
+      }
+    }
+  }
+  // the repeated column leaves one direction without variance
+  if (rows > columns && pc.loadings[k - 1] != 0.0) {
+    printf("the loading of the repeated column is %.17g\n",
+           pc.loadings[k - 1]);
+    ++failures;
+  }
+  if (rows > columns && pc.loadings[k - 2] == 0.0) {
+    printf("too many loadings are 0\n");
+    ++failures;
+  }
+
+  // a diagonal matrix comes back as it is, sorted
+  vector<double> diagonal(9, 0.0);
+  diagonal[0] = 2.0;
+  diagonal[4] = -1.0;
+  diagonal[8] = 5.0;
+  vector<double> values = eiger::train::symmetricEigen(diagonal, 3);
+  if (values[0] != -1.0 || values[1] != 2.0 || values[2] != 5.0 ||
+      fabs(diagonal[1 * 3 + 0]) != 1.0) {
+    printf("the eigenvalues of diag(2, -1, 5) are %g, %g, %g\n", values[0],
+           values[1], values[2]);
+    ++failures;
+  }
+}
+
+int main() {
+  check_moments(10000, 7);
+  check_moments(5, 3);
+  check_components(20000, 12);
+  check_components(6, 10);
+  check_components(500, 60);
+  return failures ? 1 : 0;
+}
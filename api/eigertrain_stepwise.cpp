@@ -0,0 +1,218 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Forward stepwise regression over a pool of functions,
+* growing a QR factorization of the picked columns one
+* column at a time.
+*
+**********************************************************/
+
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+
+      double dot(const double* a, const double* b, size_t n){
+        double sum = 0.0;
+        for(size_t i = 0; i < n; ++i)
+          sum += a[i] * b[i];
+        return sum;
+      }
+
+      // a -= factor * b
+      void subtract(double* a, double factor, const double* b, size_t n){
+        for(size_t i = 0; i < n; ++i)
+          a[i] -= factor * b[i];
+      }
+
+      // For every function j still in the pool, w_j is its training column
+      // less its projection onto the columns picked so far, g_j the weights
+      // of that projection (a_j = A g_j + w_j) and v_j its test column less
+      // A's test rows times g_j. Adding function j with weight beta to the
+      // fit then changes the training residual by -beta w_j and the test
+      // residual by -beta v_j, and picking a function is a rank-one update
+      // of the rest. w and v start out as the columns of the pool, one
+      // after another.
+      StepwiseFit search(vector<double>& w, vector<double>& v, size_t mt,
+                         size_t me, size_t p, const double* train_y,
+                         const double* test_y, double threshold,
+                         ThreadPool* threads){
+        if(mt == 0 || me == 0)
+          throw "stepwise regression needs training and test rows.";
+        // enough candidates to a chunk to be worth handing to another thread
+        const size_t grain = 1 + 16384 / (mt + me);
+        vector<double> norms(p);
+        parallelFor(threads, 0, p, grain, [&](size_t first, size_t last){
+            for(size_t j = first; j < last; ++j)
+              norms[j] = dot(&w[j * mt], &w[j * mt], mt);
+          });
+        vector<vector<double> > g(p);
+        vector<size_t> pool(p);
+        for(size_t j = 0; j < p; ++j)
+          pool[j] = j;
+
+        // columns this close to the span of the picked ones are dependent
+        const double tolerance = (mt + 1) * DBL_EPSILON;
+        vector<double> r(train_y, train_y + mt), e(test_y, test_y + me);
+        double mean = 0.0;
+        for(size_t i = 0; i < me; ++i)
+          mean += test_y[i];
+        mean /= me;
+        double sstot = 0.0;
+        for(size_t i = 0; i < me; ++i)
+          sstot += (test_y[i] - mean) * (test_y[i] - mean);
+        double sserr = dot(&e[0], &e[0], me);
+
+        const double n = me;
+        StepwiseFit fit;
+        fit.r2 = 0.0;
+        fit.r2_adjusted = -numeric_limits<double>::infinity();
+        vector<double> betas(p), sserrs(p);
+        vector<char> dependent(p);
+        while(true){
+          const double k = fit.selected.size() + 1;
+          parallelFor(threads, 0, pool.size(), grain,
+                      [&](size_t first, size_t last){
+              for(size_t c = first; c < last; ++c){
+                const double* wj = &w[pool[c] * mt];
+                const double* vj = &v[pool[c] * me];
+                const double ww = dot(wj, wj, mt);
+                dependent[c] = ww <= tolerance * tolerance * norms[pool[c]];
+                betas[c] = 0.0;
+                sserrs[c] = sserr;
+                if(!dependent[c]){
+                  betas[c] = dot(wj, &r[0], mt) / ww;
+                  sserrs[c] = 0.0;
+                  for(size_t i = 0; i < me; ++i){
+                    double d = e[i] - betas[c] * vj[i];
+                    sserrs[c] += d * d;
+                  }
+                }
+              }
+            });
+          double best_adjusted = -numeric_limits<double>::infinity();
+          double best_r2 = 0.0;
+          size_t best = 0;
+          bool found = false;
+          for(size_t c = 0; c < pool.size(); ++c){
+            double r2 = 1.0 - sserrs[c] / sstot;
+            double adjusted = 1.0 - (1.0 - r2) * (n - 1.0) / (n - k - 1.0);
+            if(adjusted > best_adjusted){
+              best_adjusted = adjusted;
+              best_r2 = r2;
+              best = c;
+              found = true;
+            }
+          }
+          if(!found || !(best_adjusted - fit.r2_adjusted > threshold))
+            break;
+
+          const size_t s = pool[best];
+          const double best_beta = betas[best];
+          const bool best_dependent = dependent[best];
+          sserr = sserrs[best];
+          pool.erase(pool.begin() + best);
+          const double* ws = &w[s * mt];
+          const double* vs = &v[s * me];
+          const vector<double>& gs = g[s];
+          for(size_t t = 0; t < fit.weights.size(); ++t)
+            fit.weights[t] -= best_beta * gs[t];
+          fit.weights.push_back(best_beta);
+          fit.selected.push_back(s);
+          fit.r2 = best_r2;
+          fit.r2_adjusted = best_adjusted;
+          if(best_dependent){
+            for(size_t c = 0; c < pool.size(); ++c)
+              g[pool[c]].push_back(0.0);
+            continue;
+          }
+
+          subtract(&r[0], best_beta, ws, mt);
+          subtract(&e[0], best_beta, vs, me);
+          const double ww = dot(ws, ws, mt);
+          parallelFor(threads, 0, pool.size(), grain,
+                      [&](size_t first, size_t last){
+              for(size_t c = first; c < last; ++c){
+                const size_t j = pool[c];
+                const double gamma = dot(ws, &w[j * mt], mt) / ww;
+                subtract(&w[j * mt], gamma, ws, mt);
+                subtract(&v[j * me], gamma, vs, me);
+                for(size_t t = 0; t < gs.size(); ++t)
+                  g[j][t] -= gamma * gs[t];
+                g[j].push_back(gamma);
+              }
+            });
+        }
+        return fit;
+      }
+
+    } // end anonymous namespace
+
+    StepwiseFit stepwise(const double* train, const double* train_y,
+                         size_t train_rows, const double* test,
+                         const double* test_y, size_t test_rows,
+                         size_t functions, double threshold,
+                         ThreadPool* threads){
+      const size_t mt = train_rows, me = test_rows, p = functions;
+      vector<double> w(p * mt), v(p * me);
+      parallelFor(threads, 0, p, 1 + 16384 / (mt + me + 1),
+                  [&](size_t first, size_t last){
+          for(size_t j = first; j < last; ++j){
+            for(size_t i = 0; i < mt; ++i)
+              w[j * mt + i] = train[i * p + j];
+            for(size_t i = 0; i < me; ++i)
+              v[j * me + i] = test[i * p + j];
+          }
+        });
+      return search(w, v, mt, me, p, train_y, test_y, threshold, threads);
+    }
+
+    vector<StepwiseFit> stepwiseFolds(const double* lookup, const double* y,
+                                      size_t rows, size_t functions,
+                                      const vector<Fold>& folds,
+                                      double threshold, ThreadPool& threads){
+      for(size_t f = 0; f < folds.size(); ++f){
+        for(size_t i = 0; i < folds[f].train.size(); ++i)
+          if(folds[f].train[i] >= rows)
+            throw "a fold names a row past the end of the table.";
+        for(size_t i = 0; i < folds[f].test.size(); ++i)
+          if(folds[f].test[i] >= rows)
+            throw "a fold names a row past the end of the table.";
+      }
+      vector<StepwiseFit> fits(folds.size());
+      threads.parallelFor(0, folds.size(), 1, [&](size_t first, size_t last){
+          for(size_t f = first; f < last; ++f){
+            const Fold& fold = folds[f];
+            const size_t mt = fold.train.size(), me = fold.test.size();
+            vector<double> w(functions * mt), v(functions * me);
+            vector<double> train_y(mt), test_y(me);
+            for(size_t j = 0; j < functions; ++j){
+              const double* column = lookup + j * rows;
+              for(size_t i = 0; i < mt; ++i)
+                w[j * mt + i] = column[fold.train[i]];
+              for(size_t i = 0; i < me; ++i)
+                v[j * me + i] = column[fold.test[i]];
+            }
+            for(size_t i = 0; i < mt; ++i)
+              train_y[i] = y[fold.train[i]];
+            for(size_t i = 0; i < me; ++i)
+              test_y[i] = y[fold.test[i]];
+            fits[f] = search(w, v, mt, me, functions, train_y.data(),
+                             test_y.data(), threshold, &threads);
+          }
+        });
+      return fits;
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
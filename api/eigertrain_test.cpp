@@ -0,0 +1,318 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks the native stepwise regression against a direct
+* transcription of LinearRegression.search_regression,
+* which solves a new least squares problem for every
+* candidate function, and its folds on several threads
+* against the serial search, and the basis of a pool
+* against the model runtime's evaluation of it.
+*
+**********************************************************/
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+static int failures = 0;
+
+// Least squares weights of the columns cols of the row-major table x, from
+// the normal equations in long double.
+static vector<double> solve(const vector<double>& x, const vector<double>& y,
+                            size_t rows, size_t width,
+                            const vector<size_t>& cols) {
+  const size_t k = cols.size();
+  vector<vector<long double> > a(k, vector<long double>(k + 1, 0.0L));
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t p = 0; p < k; ++p) {
+      for (size_t q = 0; q < k; ++q)
+        a[p][q] += (long double)x[i * width + cols[p]] * x[i * width + cols[q]];
+      a[p][k] += (long double)x[i * width + cols[p]] * y[i];
+    }
+  }
+  for (size_t p = 0; p < k; ++p) {
+    size_t pivot = p;
+    for (size_t q = p + 1; q < k; ++q)
+      if (fabsl(a[q][p]) > fabsl(a[pivot][p])) pivot = q;
+    swap(a[p], a[pivot]);
+    for (size_t q = 0; q < k; ++q) {
+      if (q == p) continue;
+      long double f = a[q][p] / a[p][p];
+      for (size_t c = p; c <= k; ++c) a[q][c] -= f * a[p][c];
+    }
+  }
+  vector<double> beta(k);
+  for (size_t p = 0; p < k; ++p) beta[p] = a[p][k] / a[p][p];
+  return beta;
+}
+
+static eiger::train::StepwiseFit reference(
+    const vector<double>& train, const vector<double>& train_y,
+    const vector<double>& test, const vector<double>& test_y, size_t width,
+    double threshold) {
+  const size_t mt = train_y.size(), me = test_y.size();
+  vector<size_t> pool;
+  for (size_t j = 0; j < width; ++j) pool.push_back(j);
+  double mean = 0.0;
+  for (size_t i = 0; i < me; ++i) mean += test_y[i];
+  mean /= me;
+  double sstot = 0.0;
+  for (size_t i = 0; i < me; ++i)
+    sstot += (test_y[i] - mean) * (test_y[i] - mean);
+
+  eiger::train::StepwiseFit fit;
+  fit.r2 = 0.0;
+  fit.r2_adjusted = -numeric_limits<double>::infinity();
+  while (true) {
+    double best_adjusted = -numeric_limits<double>::infinity(), best_r2 = 0;
+    size_t best = 0;
+    vector<double> best_beta;
+    for (size_t c = 0; c < pool.size(); ++c) {
+      vector<size_t> cols = fit.selected;
+      cols.push_back(pool[c]);
+      vector<double> beta = solve(train, train_y, mt, width, cols);
+      double sserr = 0.0;
+      for (size_t i = 0; i < me; ++i) {
+        double yhat = 0.0;
+        for (size_t p = 0; p < cols.size(); ++p)
+          yhat += test[i * width + cols[p]] * beta[p];
+        sserr += (test_y[i] - yhat) * (test_y[i] - yhat);
+      }
+      double r2 = 1.0 - sserr / sstot;
+      double n = me, k = cols.size();
+      double adjusted = 1.0 - (1.0 - r2) * (n - 1.0) / (n - k - 1.0);
+      if (adjusted > best_adjusted) {
+        best_adjusted = adjusted;
+        best_r2 = r2;
+        best = c;
+        best_beta = beta;
+      }
+    }
+    if (best_adjusted == -numeric_limits<double>::infinity() ||
+        !(best_adjusted - fit.r2_adjusted > threshold))
+      break;
+    fit.selected.push_back(pool[best]);
+    pool.erase(pool.begin() + best);
+    fit.weights = best_beta;
+    fit.r2 = best_r2;
+    fit.r2_adjusted = best_adjusted;
+  }
+  return fit;
+}
+
+static bool close(double a, double b, double tolerance) {
+  return fabs(a - b) <= tolerance * max(1.0, fabs(b));
+}
+
+static void check(const char* what, size_t mt, size_t me, size_t width,
+                  double threshold, unsigned seed) {
+  mt19937_64 rng(seed);
+  normal_distribution<double> gauss(0.0, 1.0);
+  vector<double> train(mt * width), test(me * width), train_y(mt), test_y(me);
+  // a few functions matter, and the last repeats function 3
+  const double truth[] = {3.0, -2.0, 0.5, 0.25};
+  const size_t used[] = {2, 7, 11, 0};
+  for (int part = 0; part < 2; ++part) {
+    vector<double>& x = part ? test : train;
+    vector<double>& y = part ? test_y : train_y;
+    for (size_t i = 0; i < y.size(); ++i) {
+      for (size_t j = 0; j < width; ++j)
+        x[i * width + j] = j == 0 ? 1.0 : gauss(rng);
+      x[i * width + width - 1] = x[i * width + 3];
+      y[i] = 0.1 * gauss(rng);
+      for (int t = 0; t < 4; ++t) y[i] += truth[t] * x[i * width + used[t]];
+    }
+  }
+
+  eiger::train::StepwiseFit want =
+      reference(train, train_y, test, test_y, width, threshold);
+  eiger::train::StepwiseFit got = eiger::train::stepwise(
+      &train[0], &train_y[0], mt, &test[0], &test_y[0], me, width, threshold);
+  bool same = got.selected == want.selected &&
+              got.weights.size() == want.weights.size() &&
+              close(got.r2, want.r2, 1e-9) &&
+              close(got.r2_adjusted, want.r2_adjusted, 1e-9);
+  for (size_t f = 0; same && f < got.weights.size(); ++f)
+    same = close(got.weights[f], want.weights[f], 1e-8);
+  if (!same) {
+    printf("%s: picked", what);
+    for (size_t f = 0; f < got.selected.size(); ++f)
+      printf(" %zu (%g)", got.selected[f], got.weights[f]);
+    printf(", R^2 %.12g; expected", got.r2);
+    for (size_t f = 0; f < want.selected.size(); ++f)
+      printf(" %zu (%g)", want.selected[f], want.weights[f]);
+    printf(", R^2 %.12g\n", want.r2);
+    ++failures;
+  }
+}
+
+// Every fold, on pools of several sizes, must pick exactly what the serial
+// search picks for it.
+static void check_folds(size_t rows, size_t width, size_t nfolds,
+                        unsigned seed) {
+  mt19937_64 rng(seed);
+  normal_distribution<double> gauss(0.0, 1.0);
+  // a column to a function
+  vector<double> lookup(rows * width), y(rows);
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < width; ++j)
+      lookup[j * rows + i] = j == 0 ? 1.0 : gauss(rng);
+    y[i] = 2.0 * lookup[rows + i] - lookup[5 * rows + i] +
+           0.5 * lookup[rows + i] * lookup[2 * rows + i] + 0.1 * gauss(rng);
+  }
+  vector<eiger::train::Fold> folds(nfolds);
+  for (size_t i = 0; i < rows; ++i)
+    for (size_t f = 0; f < nfolds; ++f)
+      (i % nfolds == f ? folds[f].test : folds[f].train).push_back(i);
+
+  vector<eiger::train::StepwiseFit> serial;
+  for (size_t f = 0; f < nfolds; ++f) {
+    vector<double> train, train_y, test, test_y;
+    for (size_t i = 0; i < folds[f].train.size(); ++i) {
+      size_t row = folds[f].train[i];
+      for (size_t j = 0; j < width; ++j)
+        train.push_back(lookup[j * rows + row]);
+      train_y.push_back(y[row]);
+    }
+    for (size_t i = 0; i < folds[f].test.size(); ++i) {
+      size_t row = folds[f].test[i];
+      for (size_t j = 0; j < width; ++j)
+        test.push_back(lookup[j * rows + row]);
+      test_y.push_back(y[row]);
+    }
+    serial.push_back(eiger::train::stepwise(
+        &train[0], &train_y[0], train_y.size(), &test[0], &test_y[0],
+        test_y.size(), width, 0.0));
+  }
+
+  const size_t threads[] = {1, 2, 3, 8};
+  for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+    eiger::train::ThreadPool pool(threads[t]);
+    vector<eiger::train::StepwiseFit> fits = eiger::train::stepwiseFolds(
+        &lookup[0], &y[0], rows, width, folds, 0.0, pool);
+    for (size_t f = 0; f < nfolds; ++f) {
+      // the same arithmetic in the same order, so exactly equal
+      if (fits[f].selected != serial[f].selected ||
+          fits[f].weights != serial[f].weights ||
+          fits[f].r2 != serial[f].r2) {
+        printf("fold %zu on %zu threads picked %zu functions, R^2 %.17g; "
+               "serially %zu, R^2 %.17g\n", f, threads[t],
+               fits[f].selected.size(), fits[f].r2,
+               serial[f].selected.size(), serial[f].r2);
+        ++failures;
+      }
+    }
+  }
+
+  // a failing fold fails the whole call, whichever thread ran it
+  folds[nfolds - 1].test.clear();
+  eiger::train::ThreadPool pool(4);
+  try {
+    eiger::train::stepwiseFolds(&lookup[0], &y[0], rows, width, folds, 0.0,
+                                pool);
+    printf("a fold without test rows was searched\n");
+    ++failures;
+  } catch (const char*) {
+  }
+}
+
+// The basis of a pool with every kind of function, against the model
+// runtime's evaluation of each function, and the same on any threads.
+static void check_basis(size_t rows, unsigned seed) {
+  mt19937_64 rng(seed);
+  normal_distribution<double> gauss(0.0, 1.0);
+  const size_t inputs = 3;
+  vector<double> profile(rows * inputs);
+  for (size_t i = 0; i < profile.size(); ++i)
+    profile[i] = i % 7 == 0 ? 0.0 : gauss(rng) * 1e3;
+  profile[inputs + 1] = 1e-200;  // overflows x^-2
+
+  vector<eiger::ModelFunction> pool;
+  eiger::ModelFunction fn = {eiger::ModelFunction::IDENTITY, -1, -1, 0.0};
+  pool.push_back(fn);
+  const double exponents[] = {-2, -1, -0.5, 0, 0.5, 1, 2, 3, 1.5};
+  for (int i = 0; i < int(inputs); ++i) {
+    for (size_t e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e) {
+      eiger::ModelFunction power = {eiger::ModelFunction::POWER, i, -1,
+                                    exponents[e]};
+      pool.push_back(power);
+    }
+    eiger::ModelFunction sqrt = {eiger::ModelFunction::SQRT, i, -1, 0.0};
+    eiger::ModelFunction log = {eiger::ModelFunction::LOG, i, -1, 0.0};
+    eiger::ModelFunction inverse = {eiger::ModelFunction::QUOTIENT, i, -1,
+                                    0.0};
+    pool.push_back(sqrt);
+    pool.push_back(log);
+    pool.push_back(inverse);
+    for (int j = 0; j < int(inputs); ++j) {
+      eiger::ModelFunction product = {eiger::ModelFunction::PRODUCT, i, j,
+                                      0.0};
+      eiger::ModelFunction quotient = {eiger::ModelFunction::QUOTIENT, i, j,
+                                       0.0};
+      pool.push_back(product);
+      pool.push_back(quotient);
+    }
+  }
+
+  vector<double> serial(rows * pool.size());
+  eiger::train::basis(&profile[0], rows, inputs, pool, &serial[0]);
+  for (size_t f = 0; f < pool.size(); ++f) {
+    for (size_t r = 0; r < rows; ++r) {
+      double want = pool[f](&profile[r * inputs]);
+      double got = serial[f * rows + r];
+      // fast powers may round differently from pow, as in the kernels
+      if (!(got == want || (std::isnan(got) && std::isnan(want)) ||
+            fabs(got - want) <= 4 * DBL_EPSILON * fabs(want))) {
+        printf("function %zu (kind %d) of row %zu is %.17g, expected "
+               "%.17g\n", f, int(pool[f].kind), r, got, want);
+        ++failures;
+        return;
+      }
+    }
+  }
+  eiger::train::ThreadPool threads(3);
+  vector<double> parallel(rows * pool.size());
+  eiger::train::basis(&profile[0], rows, inputs, pool, &parallel[0],
+                      &threads);
+  if (memcmp(&serial[0], &parallel[0], serial.size() * sizeof(double))) {
+    printf("the basis differs on threads\n");
+    ++failures;
+  }
+
+  fn.kind = eiger::ModelFunction::PRODUCT;
+  fn.i = 0;
+  fn.j = int(inputs);
+  pool.push_back(fn);
+  try {
+    eiger::train::basis(&profile[0], rows, inputs, pool, &parallel[0]);
+    printf("a function of a missing metric was evaluated\n");
+    ++failures;
+  } catch (const char*) {
+  }
+}
+
+int main() {
+  check("small pool", 40, 30, 16, 0.0, 1);
+  check("threshold", 80, 50, 24, 1e-3, 2);
+  check("wide pool", 200, 120, 90, 0.0, 3);
+  check_folds(600, 400, 5, 4);
+  check_basis(1000, 5);
+
+  double x[] = {1.0, 2.0}, y[] = {1.0};
+  size_t selected[1], count;
+  double weights[1], r2, r2_adjusted;
+  if (eiger_stepwise(x, y, 1, x, y, 0, 1, 0.0, selected, weights, &count, &r2,
+                     &r2_adjusted) == 0 ||
+      *eiger_train_error() == '\0') {
+    printf("the C interface took a problem without test rows\n");
+    ++failures;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The thread pool that training runs its loops on.
+*
+**********************************************************/
+
+#include <exception>
+
+#include "eigertrain.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace train{
+
+    namespace{
+      // the pool the current thread works for and its queue there
+      thread_local const ThreadPool* current_pool = 0;
+      thread_local size_t current_queue = 0;
+    }
+
+    struct ThreadPool::Loop {
+      const function<void(size_t, size_t)>* body;
+      atomic<size_t> pending;
+      mutex lock;
+      exception_ptr error;
+    };
+
+    ThreadPool::ThreadPool(size_t threads)
+      : queued_(0), stopping_(false){
+      if(threads == 0)
+        threads = thread::hardware_concurrency();
+      if(threads == 0)
+        threads = 1;
+      for(size_t t = 0; t < threads; ++t)
+        queues_.push_back(unique_ptr<Queue>(new Queue));
+      // the thread calling parallelFor works from queue 0
+      for(size_t t = 1; t < threads; ++t)
+        workers_.push_back(thread(&ThreadPool::work, this, t));
+    }
+
+    ThreadPool::~ThreadPool(){
+      {
+        lock_guard<mutex> guard(sleep_);
+        stopping_ = true;
+      }
+      wake_.notify_all();
+      for(size_t t = 0; t < workers_.size(); ++t)
+        workers_[t].join();
+    }
+
+    size_t ThreadPool::self() const {
+      return current_pool == this ? current_queue : 0;
+    }
+
+    void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain,
+                                 const function<void(size_t, size_t)>& body){
+      if(begin >= end)
+        return;
+      if(grain == 0)
+        grain = 1;
+      const size_t chunks = (end - begin + grain - 1) / grain;
+      if(chunks == 1 || size() == 1){
+        body(begin, end);
+        return;
+      }
+
+      Loop loop;
+      loop.body = &body;
+      loop.pending = chunks;
+      const size_t queue = self();
+      {
+        lock_guard<mutex> guard(queues_[queue]->lock);
+        for(size_t first = begin; first < end; first += grain){
+          Chunk chunk = {&loop, first, min(end, first + grain)};
+          queues_[queue]->chunks.push_back(chunk);
+        }
+      }
+      queued_ += chunks;
+      {
+        lock_guard<mutex> guard(sleep_);
+      }
+      wake_.notify_all();
+
+      while(loop.pending != 0)
+        if(!runOne(queue))
+          this_thread::yield();
+      if(loop.error)
+        rethrow_exception(loop.error);
+    }
+
+    bool ThreadPool::runOne(size_t self){
+      Chunk chunk;
+      bool found = false;
+      {
+        // our own chunks from the back, the most recently split
+        lock_guard<mutex> guard(queues_[self]->lock);
+        if(!queues_[self]->chunks.empty()){
+          chunk = queues_[self]->chunks.back();
+          queues_[self]->chunks.pop_back();
+          found = true;
+        }
+      }
+      for(size_t k = 1; !found && k < queues_.size(); ++k){
+        // others' from the front, the largest they have left
+        Queue& victim = *queues_[(self + k) % queues_.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if(!victim.chunks.empty()){
+          chunk = victim.chunks.front();
+          victim.chunks.pop_front();
+          found = true;
+        }
+      }
+      if(!found)
+        return false;
+      --queued_;
+
+      try{
+        (*chunk.loop->body)(chunk.begin, chunk.end);
+      }
+      catch(...){
+        lock_guard<mutex> guard(chunk.loop->lock);
+        if(!chunk.loop->error)
+          chunk.loop->error = current_exception();
+      }
+      // the loop may be gone as soon as this is done
+      --chunk.loop->pending;
+      return true;
+    }
+
+    void ThreadPool::work(size_t self){
+      current_pool = this;
+      current_queue = self;
+      while(true){
+        if(runOne(self))
+          continue;
+        unique_lock<mutex> guard(sleep_);
+        wake_.wait(guard, [this]{ return stopping_ || queued_ > 0; });
+        if(stopping_)
+          return;
+      }
+    }
+
+    void parallelFor(ThreadPool* threads, size_t begin, size_t end,
+                     size_t grain,
+                     const function<void(size_t, size_t)>& body){
+      if(threads)
+        threads->parallelFor(begin, end, grain, body);
+      else if(begin < end)
+        body(begin, end);
+    }
+
+  } // end namespace train
+
+} // end namespace eiger
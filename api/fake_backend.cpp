@@ -1,12 +1,19 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <vector>
 #include <string>
-#include <algorithm>
 #include <fstream>
-#include <iterator>
+#include <memory>
+
+#include <unistd.h>
 
 #include "fakekeywords.h"
+#include "fakelog.h"
 #include "eiger.h"
 
 using std::string;
@@ -14,7 +21,158 @@ using std::vector;
 
 namespace eiger{
 
-void do_disconnect(const string& dbname, 
+// EIGER_FAKE_FORMAT=binary selects the binary log, anything else the
+// character log.
+static log_format_t log_format(){
+  const char* format = getenv("EIGER_FAKE_FORMAT");
+  if(format != NULL && strcmp(format, KWBINFORMAT) == 0){
+    return BINARY_LOG;
+  }
+  return CHARACTER_LOG;
+}
+
+// EIGER_FAKE_COMPRESS=gzip (or a zlib level 1-9) gzips the log; plain gzip
+// favors the fastest level so compression adds little to the program's exit.
+static int compress_level(){
+  const char* compress = getenv("EIGER_FAKE_COMPRESS");
+  if(compress == NULL) return 0;
+  if(strcmp(compress, "gzip") == 0) return 1;
+  int level = atoi(compress);
+  return (level >= 1 && level <= 9) ? level : 0;
+}
+
+// EIGER_FAKE_APPEND=<seconds> writes every commit to the log as it happens
+// and makes the log durable at least that often; 0 syncs every commit.
+// Returns -1 when the log is written only at disconnect.
+static int append_interval(){
+  const char* append = getenv("EIGER_FAKE_APPEND");
+  if(append == NULL || *append == '\0') return -1;
+  int seconds = atoi(append);
+  return seconds < 0 ? 0 : seconds;
+}
+
+// An open fakeeiger.log.XXXXXX and the writer stack on top of it.
+struct FakeLog {
+  int fd;
+  std::fstream file;
+  std::unique_ptr<gz_ostreambuf> gzbuf;
+  std::unique_ptr<std::ostream> out;
+  std::unique_ptr<LogWriter> writer;
+
+  FakeLog() : fd(-1) {
+    char tmpname[] = "fakeeiger.log.XXXXXX";
+    fd = mkstemp(tmpname);
+    if(fd == -1){
+      throw "Unable to open unique output file";
+    }
+    file.open(tmpname,std::fstream::out|std::fstream::trunc|std::fstream::binary);
+    int level = compress_level();
+    if(level > 0){
+      gzbuf.reset(new gz_ostreambuf(file, level));
+    }
+    out.reset(new std::ostream(gzbuf ? (std::streambuf*)gzbuf.get()
+                                     : file.rdbuf()));
+    writer.reset(new LogWriter(*out, log_format()));
+    writer->header();
+  }
+
+  // push everything written so far to stable storage
+  void sync(){
+    writer->flush();
+    out->flush();
+    file.flush();
+    fsync(fd);
+  }
+
+  void close(bool durable){
+    writer->end();
+    writer->flush();
+    if(gzbuf) gzbuf->finish();
+    file.close();
+    if(durable) fsync(fd);
+    ::close(fd);
+  }
+};
+
+/********
+ * Append mode
+ */
+static std::unique_ptr<FakeLog> append_log;
+static int sync_interval;
+static time_t last_sync;
+
+static void appended(){
+  time_t now = time(NULL);
+  if(now - last_sync >= sync_interval){
+    append_log->sync();
+    last_sync = now;
+  }
+}
+
+void do_connect(const string& dbname){
+  sync_interval = append_interval();
+  if(sync_interval < 0) return;
+  append_log.reset(new FakeLog);
+  append_log->writer->connect(dbname);
+  append_log->sync();
+  last_sync = time(NULL);
+}
+
+void do_commit(const DataCollection& dc, int id){
+  if(!append_log) return;
+  append_log->writer->write(dc, id);
+  appended();
+}
+
+void do_commit(const Application& app, int id){
+  if(!append_log) return;
+  append_log->writer->write(app, id);
+  appended();
+}
+
+void do_commit(const Dataset& ds, int id){
+  if(!append_log) return;
+  append_log->writer->write(ds, id);
+  appended();
+}
+
+void do_commit(const Machine& ma, int id){
+  if(!append_log) return;
+  append_log->writer->write(ma, id);
+  appended();
+}
+
+void do_commit(const Trial& tr, int id){
+  if(!append_log) return;
+  append_log->writer->write(tr, id);
+  appended();
+}
+
+void do_commit(const Metric& me, int id){
+  if(!append_log) return;
+  append_log->writer->write(me, id);
+  appended();
+}
+
+void do_commit(const NondeterministicMetric& ndm){
+  if(!append_log) return;
+  append_log->writer->write(ndm);
+  appended();
+}
+
+void do_commit(const DeterministicMetric& dm){
+  if(!append_log) return;
+  append_log->writer->write(dm);
+  appended();
+}
+
+void do_commit(const MachineMetric& mm){
+  if(!append_log) return;
+  append_log->writer->write(mm);
+  appended();
+}
+
+void do_disconnect(const string& dbname,
                    const vector<DataCollection>& datacollections,
                    const vector<Application>& applications,
                    const vector<Dataset>& datasets,
@@ -24,39 +182,18 @@ void do_disconnect(const string& dbname,
                    const vector<NondeterministicMetric>& nondet_metrics,
                    const vector<DeterministicMetric>& det_metrics,
                    const vector<MachineMetric>& machine_metrics){
-  char* tmpname = strdup("fakeeiger.log.XXXXXX");
-  if(mkstemp(tmpname) == -1){
-    throw "Unable to open unique output file";
+  if(append_log){
+    // every record is already in the log
+    append_log->writer->disconnect();
+    append_log->close(true);
+    append_log.reset();
+    return;
   }
-  std::fstream fake_log;
-  fake_log.open(tmpname,std::fstream::out|std::fstream::trunc); 
-  fake_log.precision(18);
-  fake_log << FEVERSION<<";2\n";
-  fake_log << FEFORMAT << ";" KWFORMAT "\n";
-  fake_log << FECONNECT << ";" << dbname << "\n";
-
-  std::copy(datacollections.begin(), datacollections.end(),
-            std::ostream_iterator<DataCollection>(fake_log, "\n"));
-  std::copy(applications.begin(), applications.end(),
-            std::ostream_iterator<Application>(fake_log, "\n"));
-  std::copy(datasets.begin(), datasets.end(),
-            std::ostream_iterator<Dataset>(fake_log, "\n"));
-  std::copy(machines.begin(), machines.end(),
-            std::ostream_iterator<Machine>(fake_log, "\n"));
-  std::copy(trials.begin(), trials.end(),
-            std::ostream_iterator<Trial>(fake_log, "\n"));
-  std::copy(metrics.begin(), metrics.end(),
-            std::ostream_iterator<Metric>(fake_log, "\n"));
-  std::copy(nondet_metrics.begin(), nondet_metrics.end(),
-            std::ostream_iterator<NondeterministicMetric>(fake_log, "\n"));
-  std::copy(det_metrics.begin(), det_metrics.end(),
-            std::ostream_iterator<DeterministicMetric>(fake_log, "\n"));
-  std::copy(machine_metrics.begin(), machine_metrics.end(),
-            std::ostream_iterator<MachineMetric>(fake_log, "\n"));
-  
-  fake_log << FEDISCONNECT << "\n";
-  fake_log.close();
+  FakeLog fake_log;
+  write_log_session(*fake_log.writer, dbname, datacollections, applications,
+                    datasets, machines, trials, metrics, nondet_metrics,
+                    det_metrics, machine_metrics);
+  fake_log.close(false);
 }
 
 } // namespace eiger
-
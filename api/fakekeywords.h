@@ -7,6 +7,13 @@ static int fakekeys = 0; // expect whinage about unused.
 #define FEDISCONNECT "DISCONNECT"
 #define FEVERSION "VERSION"
 #define FEFORMAT "FORMAT"
+// last line of a complete log; logs written before it existed end at
+// DISCONNECT.
+#define FEEND "END"
+// FORMAT;binary;<FEBINVERSION> is followed by binary records up to the end
+// of the log; see fakelog.h for the record layout.
+#define KWBINFORMAT "binary"
+#define FEBINVERSION 1
 
 #ifdef FAKE_KEYS_FULL
 // we don't care about logging performance in the small
@@ -0,0 +1,363 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Reading and writing of the fakeeiger log files shared by
+* libfakeeiger, eiger-loader and eiger-logconvert.
+*
+**********************************************************/
+
+#ifndef FAKELOG_H_INCLUDED
+#define FAKELOG_H_INCLUDED
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "eiger.h"
+
+namespace eiger{
+
+  enum log_format_t { CHARACTER_LOG, BINARY_LOG };
+
+  // Record tags of the binary format. They mirror the character keywords.
+  enum binary_tag_t {
+    BIN_CONNECT = '<',
+    BIN_DISCONNECT = '>',
+    BIN_DATACOLLECTION = 'C',
+    BIN_APPLICATION = 'A',
+    BIN_DATASET = 'S',
+    BIN_MACHINE = 'H',
+    BIN_TRIAL = 'T',
+    BIN_MACHINEMETRIC = 'R',
+    BIN_DETERMINISTICMETRIC = 'D',
+    BIN_NONDETERMINISTICMETRIC = 'N',
+    BIN_METRIC = 'v',
+    BIN_END = '.'
+  };
+
+  // Binary values are raw little-endian, strings are prefixed by a uint32
+  // length. On little-endian hosts every put is a plain memcpy.
+  class BinaryWriter {
+    public:
+      BinaryWriter(std::ostream& out) : out_(out) { buf_.reserve(bufsize); }
+      ~BinaryWriter() { flush(); }
+
+      void put_tag(binary_tag_t tag) { put_u8(tag); }
+      void put_u8(unsigned char x) { buf_.push_back(x); spill(); }
+      void put_i32(int x) { put_raw(&x, sizeof(x)); }
+      void put_f64(double x) { put_raw(&x, sizeof(x)); }
+      void put_str(const std::string& s) {
+        unsigned int len = s.size();
+        put_raw(&len, sizeof(len));
+        buf_.append(s);
+        spill();
+      }
+      void flush() { out_.write(buf_.data(), buf_.size()); buf_.clear(); }
+
+    private:
+      static const size_t bufsize = 1 << 20;
+      std::ostream& out_;
+      std::string buf_;
+
+      void spill() { if(buf_.size() >= bufsize) flush(); }
+      void put_raw(const void* p, size_t n) {
+        char tmp[8];
+        memcpy(tmp, p, n);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        std::reverse(tmp, tmp + n);
+#endif
+        buf_.append(tmp, n);
+        spill();
+      }
+  };
+
+  // Shortest decimal string that strtod reads back as exactly x, written to
+  // buf without a terminator. buf needs room for max_double_chars; returns
+  // the number of characters written.
+  static const size_t max_double_chars = 32;
+  size_t format_double(double x, char* buf);
+
+  // Exact inverse of format_double. Returns false if s is not a complete
+  // number.
+  bool parse_double(const std::string& s, double& x);
+
+  // Buffered writer for the character records; values are formatted in place
+  // rather than through iostreams.
+  class TextWriter {
+    public:
+      TextWriter(std::ostream& out) : out_(out) { buf_.reserve(bufsize); }
+      ~TextWriter() { flush(); }
+
+      TextWriter& put(char c) { buf_.push_back(c); return *this; }
+      TextWriter& put(const char* s) { buf_.append(s); return *this; }
+      TextWriter& put(const std::string& s) { buf_.append(s); return *this; }
+      TextWriter& put_i32(int x) {
+        char tmp[12];
+        char* p = tmp + sizeof(tmp);
+        unsigned int u = x < 0 ? 0u - (unsigned int)x : (unsigned int)x;
+        do { *--p = '0' + u % 10; u /= 10; } while(u != 0);
+        if(x < 0) *--p = '-';
+        buf_.append(p, tmp + sizeof(tmp) - p);
+        return *this;
+      }
+      TextWriter& put_f64(double x) {
+        char tmp[max_double_chars];
+        buf_.append(tmp, format_double(x, tmp));
+        return *this;
+      }
+      // ends a record and spills the buffer when it is full
+      void endl() { buf_.push_back('\n'); if(buf_.size() >= bufsize) flush(); }
+      void flush() { out_.write(buf_.data(), buf_.size()); buf_.clear(); }
+
+    private:
+      static const size_t bufsize = 1 << 20;
+      std::ostream& out_;
+      std::string buf_;
+  };
+
+  // Buffered reader for the binary records. get_* return false only when the
+  // stream ends before the value is complete.
+  class BinaryReader {
+    public:
+      BinaryReader(std::istream& in) : in_(in), pos_(0), end_(0),
+                                       buf_(bufsize) {}
+
+      bool get_u8(unsigned char& x) { return get_raw(&x, sizeof(x)); }
+      bool get_i32(int& x) { return get_raw(&x, sizeof(x)); }
+      bool get_f64(double& x) { return get_raw(&x, sizeof(x)); }
+      bool get_str(std::string& s) {
+        unsigned int len;
+        if(!get_raw(&len, sizeof(len))) return false;
+        s.resize(len);
+        return len == 0 || get_bytes(&s[0], len);
+      }
+
+    private:
+      static const size_t bufsize = 1 << 20;
+      std::istream& in_;
+      size_t pos_, end_;
+      std::vector<char> buf_;
+
+      bool get_bytes(char* p, size_t n) {
+        while(n > 0){
+          if(pos_ == end_){
+            in_.read(&buf_[0], buf_.size());
+            pos_ = 0;
+            end_ = in_.gcount();
+            if(end_ == 0) return false;
+          }
+          size_t chunk = std::min(n, end_ - pos_);
+          memcpy(p, &buf_[pos_], chunk);
+          pos_ += chunk;
+          p += chunk;
+          n -= chunk;
+        }
+        return true;
+      }
+      bool get_raw(void* p, size_t n) {
+        char tmp[8];
+        if(!get_bytes(tmp, n)) return false;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        std::reverse(tmp, tmp + n);
+#endif
+        memcpy(p, tmp, n);
+        return true;
+      }
+  };
+
+  // Writes log records one at a time in either format. Each object is
+  // written with the ID it was given on commit.
+  class LogWriter {
+    public:
+      LogWriter(std::ostream& out, log_format_t format);
+
+      // VERSION and FORMAT lines that start every log.
+      void header();
+      void connect(const std::string& db);
+      void disconnect();
+      // marks a log as complete; a log without it may have been cut short.
+      void end();
+      void write(const DataCollection& dc, int id);
+      void write(const Application& app, int id);
+      void write(const Dataset& ds, int id);
+      void write(const Machine& ma, int id);
+      void write(const Trial& tr, int id);
+      void write(const Metric& me, int id);
+      void write(const NondeterministicMetric& ndm);
+      void write(const DeterministicMetric& dm);
+      void write(const MachineMetric& mm);
+      // push buffered records to the stream
+      void flush();
+
+    private:
+      std::ostream& out_;
+      log_format_t format_;
+      TextWriter txt_;
+      BinaryWriter bin_;
+  };
+
+  // A complete CONNECT ... DISCONNECT session. The ID written for each
+  // object is its position in its vector, which is the ID libfakeeiger
+  // assigns on commit.
+  void write_log_session(LogWriter& w, const std::string& db,
+                         const std::vector<DataCollection>& datacollections,
+                         const std::vector<Application>& applications,
+                         const std::vector<Dataset>& datasets,
+                         const std::vector<Machine>& machines,
+                         const std::vector<Trial>& trials,
+                         const std::vector<Metric>& metrics,
+                         const std::vector<NondeterministicMetric>& nondet_metrics,
+                         const std::vector<DeterministicMetric>& det_metrics,
+                         const std::vector<MachineMetric>& machine_metrics);
+
+  // Compresses everything written through it into a gzip stream on out.
+  // Input is collected into large blocks so that deflate runs rarely.
+  // finish() (or destruction) writes the gzip trailer.
+  class gz_ostreambuf : public std::streambuf {
+    public:
+      gz_ostreambuf(std::ostream& out, int level);
+      ~gz_ostreambuf();
+      void finish();
+
+    protected:
+      int_type overflow(int_type c);
+      std::streamsize xsputn(const char* s, std::streamsize n);
+      int sync();
+
+    private:
+      static const size_t blocksize = 1 << 20;
+      struct state;
+      std::ostream& out_;
+      std::vector<char> in_, zout_;
+      state* z_;
+      bool finished_;
+
+      void deflate_pending(int flush);
+      gz_ostreambuf(const gz_ostreambuf&);
+      gz_ostreambuf& operator=(const gz_ostreambuf&);
+  };
+
+  // Decompresses a gzip stream read from in. Concatenated gzip members are
+  // read as one stream.
+  class gz_istreambuf : public std::streambuf {
+    public:
+      gz_istreambuf(std::istream& in);
+      ~gz_istreambuf();
+
+    protected:
+      int_type underflow();
+
+    private:
+      static const size_t blocksize = 1 << 18;
+      struct state;
+      std::istream& in_;
+      std::vector<char> zin_, out_;
+      state* z_;
+      bool done_;
+
+      gz_istreambuf(const gz_istreambuf&);
+      gz_istreambuf& operator=(const gz_istreambuf&);
+  };
+
+  // true if in starts with the gzip magic number; rewinds in.
+  bool is_gzip(std::istream& in);
+
+  /********
+   * Log parsing
+   */
+
+  // Receives the commits of a log as they are parsed. IDs inside the records
+  // are the ones written by libfakeeiger, i.e. local to one CONNECT/DISCONNECT
+  // session of one log file.
+  class Sink {
+    public:
+      virtual ~Sink() {}
+      virtual void connect(const std::string& db) = 0;
+      virtual void disconnect() = 0;
+      virtual void add(const DataCollection& dc) = 0;
+      virtual void add(const Application& app) = 0;
+      virtual void add(const Dataset& ds) = 0;
+      virtual void add(const Machine& ma) = 0;
+      virtual void add(const Trial& tr) = 0;
+      virtual void add(const Metric& me) = 0;
+      virtual void add(const NondeterministicMetric& ndm) = 0;
+      virtual void add(const DeterministicMetric& dm) = 0;
+      virtual void add(const MachineMetric& mm) = 0;
+  };
+
+  // Everything committed between one CONNECT and its DISCONNECT. An object's
+  // local ID is its position in the corresponding vector.
+  struct Session {
+    std::string db;
+    std::vector<DataCollection> datacollections;
+    std::vector<Application> applications;
+    std::vector<Dataset> datasets;
+    std::vector<Machine> machines;
+    std::vector<Trial> trials;
+    std::vector<Metric> metrics;
+    std::vector<NondeterministicMetric> nondet_metrics;
+    std::vector<DeterministicMetric> det_metrics;
+    std::vector<MachineMetric> machine_metrics;
+  };
+
+  // Collects the sessions of one log in memory, touching no shared state, so
+  // that any number of files can be parsed concurrently.
+  class SessionSink : public Sink {
+    public:
+      std::vector<Session> sessions;
+
+      void connect(const std::string& db) {
+        sessions.push_back(Session());
+        sessions.back().db = db;
+        open = true;
+      }
+      void disconnect() { current(); open = false; }
+      void add(const DataCollection& dc) {
+        current().datacollections.push_back(dc);
+      }
+      void add(const Application& app) {
+        current().applications.push_back(app);
+      }
+      void add(const Dataset& ds) { current().datasets.push_back(ds); }
+      void add(const Machine& ma) { current().machines.push_back(ma); }
+      void add(const Trial& tr) { current().trials.push_back(tr); }
+      void add(const Metric& me) { current().metrics.push_back(me); }
+      void add(const NondeterministicMetric& ndm) {
+        current().nondet_metrics.push_back(ndm);
+      }
+      void add(const DeterministicMetric& dm) {
+        current().det_metrics.push_back(dm);
+      }
+      void add(const MachineMetric& mm) {
+        current().machine_metrics.push_back(mm);
+      }
+
+      SessionSink() : open(false) {}
+
+    private:
+      bool open;
+      Session& current() {
+        if (!open) throw "fakeeiger record outside of CONNECT/DISCONNECT.";
+        return sessions.back();
+      }
+  };
+
+  // set up the keyword map used by parseFile; call once before parsing.
+  void initmaps();
+
+  enum log_status_t {
+    LOG_MISSING,   // could not be opened
+    LOG_COMPLETE,
+    LOG_TRUNCATED  // cut short; every complete record was still parsed
+  };
+
+  // Parse one log of either format, plain or gzipped, into sink.
+  log_status_t parseFile(const std::string& filename, Sink& sink);
+
+} // end namespace eiger
+
+#endif
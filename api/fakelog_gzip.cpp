@@ -0,0 +1,188 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* gzip stream buffers for compressed fakeeiger logs.
+*
+**********************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "fakelog.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+namespace eiger{
+
+#ifdef HAVE_LIBZ
+
+// 16 + MAX_WBITS asks zlib for a gzip header and trailer, 32 + MAX_WBITS
+// detects gzip or zlib when reading.
+static const int gzip_wbits = 16 + MAX_WBITS;
+static const int detect_wbits = 32 + MAX_WBITS;
+
+struct gz_ostreambuf::state {
+  z_stream zs;
+};
+
+gz_ostreambuf::gz_ostreambuf(std::ostream& out, int level)
+  : out_(out), in_(blocksize), zout_(blocksize), z_(new state),
+    finished_(false) {
+  z_->zs.zalloc = Z_NULL;
+  z_->zs.zfree = Z_NULL;
+  z_->zs.opaque = Z_NULL;
+  if(deflateInit2(&z_->zs, level, Z_DEFLATED, gzip_wbits, 8,
+                  Z_DEFAULT_STRATEGY) != Z_OK){
+    throw "Unable to initialize gzip compression";
+  }
+  setp(&in_[0], &in_[0] + in_.size());
+}
+
+gz_ostreambuf::~gz_ostreambuf(){
+  finish();
+  deflateEnd(&z_->zs);
+  delete z_;
+}
+
+void gz_ostreambuf::deflate_pending(int flush){
+  z_->zs.next_in = (Bytef*)pbase();
+  z_->zs.avail_in = pptr() - pbase();
+  int ret;
+  do {
+    z_->zs.next_out = (Bytef*)&zout_[0];
+    z_->zs.avail_out = zout_.size();
+    ret = deflate(&z_->zs, flush);
+    out_.write(&zout_[0], zout_.size() - z_->zs.avail_out);
+  } while(z_->zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+  setp(&in_[0], &in_[0] + in_.size());
+}
+
+gz_ostreambuf::int_type gz_ostreambuf::overflow(int_type c){
+  deflate_pending(Z_NO_FLUSH);
+  if(!traits_type::eq_int_type(c, traits_type::eof())){
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize gz_ostreambuf::xsputn(const char* s, std::streamsize n){
+  std::streamsize done = 0;
+  while(done < n){
+    std::streamsize room = epptr() - pptr();
+    if(room == 0){
+      deflate_pending(Z_NO_FLUSH);
+      continue;
+    }
+    std::streamsize chunk = std::min(room, n - done);
+    std::copy(s + done, s + done + chunk, pptr());
+    pbump(chunk);
+    done += chunk;
+  }
+  return n;
+}
+
+int gz_ostreambuf::sync(){
+  deflate_pending(Z_SYNC_FLUSH);
+  out_.flush();
+  return out_.good() ? 0 : -1;
+}
+
+void gz_ostreambuf::finish(){
+  if(finished_) return;
+  deflate_pending(Z_FINISH);
+  out_.flush();
+  finished_ = true;
+}
+
+struct gz_istreambuf::state {
+  z_stream zs;
+};
+
+gz_istreambuf::gz_istreambuf(std::istream& in)
+  : in_(in), zin_(blocksize), out_(blocksize), z_(new state), done_(false) {
+  z_->zs.zalloc = Z_NULL;
+  z_->zs.zfree = Z_NULL;
+  z_->zs.opaque = Z_NULL;
+  z_->zs.next_in = Z_NULL;
+  z_->zs.avail_in = 0;
+  if(inflateInit2(&z_->zs, detect_wbits) != Z_OK){
+    throw "Unable to initialize gzip decompression";
+  }
+  setg(&out_[0], &out_[0], &out_[0]);
+}
+
+gz_istreambuf::~gz_istreambuf(){
+  inflateEnd(&z_->zs);
+  delete z_;
+}
+
+gz_istreambuf::int_type gz_istreambuf::underflow(){
+  if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  size_t produced = 0;
+  while(produced == 0 && !done_){
+    if(z_->zs.avail_in == 0){
+      in_.read(&zin_[0], zin_.size());
+      z_->zs.next_in = (Bytef*)&zin_[0];
+      z_->zs.avail_in = in_.gcount();
+      if(z_->zs.avail_in == 0){
+        // a stream cut short simply ends; the log reader decides what an
+        // incomplete log means.
+        done_ = true;
+        break;
+      }
+    }
+    z_->zs.next_out = (Bytef*)&out_[0];
+    z_->zs.avail_out = out_.size();
+    int ret = inflate(&z_->zs, Z_NO_FLUSH);
+    produced = out_.size() - z_->zs.avail_out;
+    if(ret == Z_STREAM_END){
+      // concatenated gzip members continue the same log
+      inflateReset(&z_->zs);
+    } else if(ret != Z_OK && ret != Z_BUF_ERROR){
+      throw "corrupt compressed fakeeiger log.";
+    }
+  }
+  setg(&out_[0], &out_[0], &out_[0] + produced);
+  if(produced == 0) return traits_type::eof();
+  return traits_type::to_int_type(*gptr());
+}
+
+#else // HAVE_LIBZ
+
+struct gz_ostreambuf::state {};
+gz_ostreambuf::gz_ostreambuf(std::ostream& out, int) : out_(out), z_(NULL) {
+  throw "fakeeiger was built without zlib; compressed logs are unavailable";
+}
+gz_ostreambuf::~gz_ostreambuf(){}
+void gz_ostreambuf::deflate_pending(int){}
+gz_ostreambuf::int_type gz_ostreambuf::overflow(int_type c){ return c; }
+std::streamsize gz_ostreambuf::xsputn(const char*, std::streamsize n){ return n; }
+int gz_ostreambuf::sync(){ return -1; }
+void gz_ostreambuf::finish(){}
+
+struct gz_istreambuf::state {};
+gz_istreambuf::gz_istreambuf(std::istream& in) : in_(in), z_(NULL) {
+  throw "eiger-loader was built without zlib; cannot read compressed logs";
+}
+gz_istreambuf::~gz_istreambuf(){}
+gz_istreambuf::int_type gz_istreambuf::underflow(){ return traits_type::eof(); }
+
+#endif // HAVE_LIBZ
+
+bool is_gzip(std::istream& in){
+  int first = in.get();
+  int second = in.get();
+  in.clear();
+  in.seekg(0);
+  return first == 0x1f && second == 0x8b;
+}
+
+} // namespace eiger
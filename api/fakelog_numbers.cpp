@@ -0,0 +1,56 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The exact decimal form of doubles shared by the fakeeiger
+* logs and eiger-export.
+*
+**********************************************************/
+#include <string>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fakelog.h"
+
+namespace eiger{
+
+size_t format_double(double x, char* buf) {
+  // integral values, the usual case for sizes and counts, skip printf
+  if(std::fabs(x) < 1e15 && x == (double)(long long)x &&
+     !(x == 0 && std::signbit(x))){
+    long long i = (long long)x;
+    char tmp[max_double_chars];
+    char* p = tmp + sizeof(tmp);
+    unsigned long long u = i < 0 ? 0ull - (unsigned long long)i
+                                 : (unsigned long long)i;
+    do { *--p = '0' + u % 10; u /= 10; } while(u != 0);
+    if(i < 0) *--p = '-';
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, n);
+    return n;
+  }
+  // Every decimal of up to 15 digits survives a trip through a double, so
+  // %.15g is exact whenever anything that short is; otherwise the nearest
+  // 16 digits round-trip if any do, and 17 always do. Subnormals carry
+  // fewer digits and are searched from the start.
+  int n = 0;
+  for(int precision = std::fabs(x) < DBL_MIN ? 1 : 15; precision <= 17;
+      ++precision){
+    n = snprintf(buf, max_double_chars, "%.*g", precision, x);
+    if(strtod(buf, NULL) == x) break;
+  }
+  return n;
+}
+
+// strtod rounds correctly, so it reads format_double's output back to the
+// same bits.
+bool parse_double(const std::string& s, double& x) {
+  if (s.empty()) return false;
+  char* end;
+  x = strtod(s.c_str(), &end);
+  return end == s.c_str() + s.size();
+}
+
+} // namespace eiger
@@ -0,0 +1,343 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Parser for fakeeiger logs, split out of eiger-loader so
+* that the log tools share one reader.
+*
+**********************************************************/
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "fakekeywords.h"
+#include "fakelog.h"
+
+static const int version = 2;
+
+enum dispatch {
+  Metric,
+  Metric_commit,
+  DataCollection,
+  DataCollection_commit,
+  Application,
+  Application_commit,
+  Dataset,
+  Dataset_commit,
+  Machine,
+  Machine_commit,
+  Trial,
+  Trial_commit,
+  MachineMetric,
+  MachineMetric_commit,
+  DeterministicMetric,
+  DeterministicMetric_commit,
+  NondeterministicMetric,
+  NondeterministicMetric_commit,
+  CONNECT,
+  LVERSION,
+  LFORMAT,
+  DISCONNECT,
+  LEND
+};
+
+static std::map<std::string,dispatch> domap;
+
+static double toDouble(const std::string& s) {
+  double x;
+  if (!eiger::parse_double(s, x)) throw "malformed number in fakeeiger log.";
+  return x;
+}
+
+static int toInt(const std::string& s) {
+  return (int)strtol(s.c_str(), NULL, 10);
+}
+
+static eiger::metric_type_t toMetricType(const std::string& s) {
+  if(s.compare("deterministic") == 0) return eiger::DETERMINISTIC;
+  if(s.compare("nondeterministic") == 0) return eiger::NONDETERMINISTIC;
+  if(s.compare("machine") == 0) return eiger::MACHINE;
+  throw "unexpected metric commit type";
+}
+
+// What has been seen of the log so far.
+struct LogState {
+  bool in_session; // CONNECT without its DISCONNECT yet
+  bool ended;      // END marker
+  LogState() : in_session(false), ended(false) {}
+};
+
+// returns true when a FORMAT line switches the rest of the log to binary.
+static bool one(std::string s, eiger::Sink& sink, LogState& state) {
+  std::vector<std::string> v;
+  if (s.size()==0 ) return false;
+  std::stringstream sstream{s};
+  std::string elem;
+  while(std::getline(sstream, elem, ';')){
+    v.push_back(elem);
+  }
+  dispatch d;
+  std::map<std::string,dispatch>::const_iterator di = domap.find(v[0]);
+  if (di != domap.end()) {
+    d = di->second;
+  } else {
+    std::cerr << "unknown fakeeiger keyword "<< v[0] << "\n";
+    return false;
+  }
+  // we will merrily assume enough and correct args
+  switch (d) {
+  case CONNECT:
+    sink.connect(v[1]);
+    state.in_session = true;
+    break;
+  case DISCONNECT:
+    sink.disconnect();
+    state.in_session = false;
+    break;
+  case LEND:
+    state.ended = true;
+    break;
+  case LVERSION:
+    {
+      int filever = toInt(v[1]);
+      if (filever != version) {
+        std::cout << "VERSION: " << version <<" != " << filever <<"\n";
+        throw "fakeeiger log file version mismatch.";
+      }
+    }
+    break;
+  case LFORMAT:
+    {
+      if (v[1] == KWBINFORMAT) {
+        int binver = v.size() > 2 ? toInt(v[2]) : 0;
+        if (binver != FEBINVERSION) {
+          std::cout << FEFORMAT ": " KWBINFORMAT " version " << binver
+                    << " != " << FEBINVERSION << "\n";
+          throw "fakeeiger binary log version mismatch.";
+        }
+        return true;
+      }
+      if (v[1] != KWFORMAT) {
+        std::cout << FEFORMAT ": " << v[1] <<" does not match compiled in format " KWFORMAT "\n";
+        throw "fakeeiger log file format mismatch.";
+      }
+    }
+    break;
+  /* this batch don't really need to do anything yet. ctors. */
+  case DataCollection:
+  case Application:
+  case Dataset:
+  case Machine:
+  case Trial:
+  case MachineMetric:
+  case DeterministicMetric:
+  case NondeterministicMetric:
+  case Metric:
+    break;
+  /* these do something */
+  case DataCollection_commit:
+    sink.add(eiger::DataCollection(v[1], v[2]));
+    break;
+  case Application_commit:
+    sink.add(eiger::Application(v[1], v[2]));
+    break;
+  case Dataset_commit:
+    {
+      eiger::ApplicationID ai(toInt(v[1]),0);
+      sink.add(eiger::Dataset(ai, v[2], v[3], v[4]));
+    }
+    break;
+  case Machine_commit:
+    sink.add(eiger::Machine(v[1], v[2]));
+    break;
+  case Trial_commit:
+    {
+      eiger::DataCollectionID dci(toInt(v[1]),0);
+      eiger::MachineID mi(toInt(v[2]),0);
+      eiger::ApplicationID ai(toInt(v[3]),0);
+      eiger::DatasetID dsi(toInt(v[4]),0);
+      sink.add(eiger::Trial(dci,mi,ai,dsi));
+    }
+    break;
+  case MachineMetric_commit:
+    {
+      eiger::MachineID mai(toInt(v[1]),0);
+      eiger::MetricID mi(toInt(v[2]),0);
+      sink.add(eiger::MachineMetric(mai,mi,toDouble(v[3])));
+    }
+    break;
+  case DeterministicMetric_commit:
+    {
+      eiger::DatasetID dsi(toInt(v[1]),0);
+      eiger::MetricID mi(toInt(v[2]),0);
+      sink.add(eiger::DeterministicMetric(dsi,mi,toDouble(v[3])));
+    }
+    break;
+  case NondeterministicMetric_commit:
+    {
+      eiger::TrialID ti(toInt(v[1]),0);
+      eiger::MetricID mi(toInt(v[2]),0);
+      sink.add(eiger::NondeterministicMetric(ti,mi,toDouble(v[3])));
+    }
+    break;
+  case Metric_commit:
+    sink.add(eiger::Metric(toMetricType(v[1]),v[2],v[3]));
+    break;
+  default:
+    throw "unexpected enum value in one() handling";
+  } // end switch
+  return false;
+} // end one()
+
+// Binary records run from the FORMAT line to the end of the log. Returns
+// false if the log stops inside a record.
+static bool binary(std::istream& in, eiger::Sink& sink,
+                   LogState& state) {
+  eiger::BinaryReader r(in);
+  unsigned char tag;
+  while (!state.ended && r.get_u8(tag)) {
+    bool ok = true;
+    std::string s1, s2, s3;
+    int i1 = 0, i2 = 0, i3 = 0, i4 = 0;
+    unsigned char type = 0;
+    double x = 0;
+    switch (tag) {
+    case eiger::BIN_CONNECT:
+      ok = r.get_str(s1);
+      if (ok) {
+        sink.connect(s1);
+        state.in_session = true;
+      }
+      break;
+    case eiger::BIN_DISCONNECT:
+      sink.disconnect();
+      state.in_session = false;
+      break;
+    case eiger::BIN_END:
+      state.ended = true;
+      break;
+    case eiger::BIN_DATACOLLECTION:
+      ok = r.get_str(s1) && r.get_str(s2);
+      if (ok) sink.add(eiger::DataCollection(s1, s2));
+      break;
+    case eiger::BIN_APPLICATION:
+      ok = r.get_str(s1) && r.get_str(s2);
+      if (ok) sink.add(eiger::Application(s1, s2));
+      break;
+    case eiger::BIN_DATASET:
+      ok = r.get_i32(i1) && r.get_str(s1) && r.get_str(s2) && r.get_str(s3);
+      if (ok) sink.add(eiger::Dataset(eiger::ApplicationID(i1,0), s1, s2, s3));
+      break;
+    case eiger::BIN_MACHINE:
+      ok = r.get_str(s1) && r.get_str(s2);
+      if (ok) sink.add(eiger::Machine(s1, s2));
+      break;
+    case eiger::BIN_TRIAL:
+      ok = r.get_i32(i1) && r.get_i32(i2) && r.get_i32(i3) && r.get_i32(i4);
+      if (ok) sink.add(eiger::Trial(eiger::DataCollectionID(i1,0),
+                                    eiger::MachineID(i2,0),
+                                    eiger::ApplicationID(i3,0),
+                                    eiger::DatasetID(i4,0)));
+      break;
+    case eiger::BIN_METRIC:
+      ok = r.get_u8(type) && r.get_str(s1) && r.get_str(s2);
+      if (ok) {
+        if (type > eiger::MACHINE) throw "unexpected metric commit type";
+        sink.add(eiger::Metric((eiger::metric_type_t)type, s1, s2));
+      }
+      break;
+    case eiger::BIN_NONDETERMINISTICMETRIC:
+      ok = r.get_i32(i1) && r.get_i32(i2) && r.get_f64(x);
+      if (ok) sink.add(eiger::NondeterministicMetric(eiger::TrialID(i1,0),
+                                                     eiger::MetricID(i2,0), x));
+      break;
+    case eiger::BIN_DETERMINISTICMETRIC:
+      ok = r.get_i32(i1) && r.get_i32(i2) && r.get_f64(x);
+      if (ok) sink.add(eiger::DeterministicMetric(eiger::DatasetID(i1,0),
+                                                  eiger::MetricID(i2,0), x));
+      break;
+    case eiger::BIN_MACHINEMETRIC:
+      ok = r.get_i32(i1) && r.get_i32(i2) && r.get_f64(x);
+      if (ok) sink.add(eiger::MachineMetric(eiger::MachineID(i1,0),
+                                            eiger::MetricID(i2,0), x));
+      break;
+    default:
+      throw "unknown fakeeiger binary record tag.";
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+eiger::log_status_t eiger::parseFile(const std::string& filename,
+                                     Sink& sink) {
+  std::ifstream rawfile (filename.c_str(), std::ios::in | std::ios::binary);
+  if (!rawfile.is_open()) return LOG_MISSING;
+  // compressed logs are recognized by the gzip magic number, not the name
+  std::unique_ptr<eiger::gz_istreambuf> gzbuf;
+  if (eiger::is_gzip(rawfile)) {
+    gzbuf.reset(new eiger::gz_istreambuf(rawfile));
+  }
+  std::istream myfile (gzbuf ? (std::streambuf*)gzbuf.get() : rawfile.rdbuf());
+  LogState state;
+  bool whole = true; // no partial record at the end
+  std::string line;
+  while ( myfile.good() && !state.ended )
+  {
+    getline (myfile,line);
+    if (myfile.eof() && !line.empty()) {
+      // the last line lost its newline; its values may be cut short too
+      whole = false;
+      break;
+    }
+    if (one(line, sink, state)) {
+      whole = binary(myfile, sink, state);
+      break;
+    }
+  }
+  rawfile.close();
+  if (state.ended) return LOG_COMPLETE;
+  if (state.in_session) {
+    // keep everything read before the log was cut off
+    sink.disconnect();
+    return LOG_TRUNCATED;
+  }
+  // logs from before the END marker stop after their last DISCONNECT
+  return whole ? LOG_COMPLETE : LOG_TRUNCATED;
+}
+
+// set up a hash map to convert switching over strings into switching on enum.
+// Outside namespace eiger, whose classes share the dispatch names.
+static void fill_domap() {
+  domap[DATACOLLECTION_COMMIT] =DataCollection_commit;
+  domap[DATACOLLECTION] =DataCollection;
+  domap[APPLICATION_COMMIT] =Application_commit;
+  domap[APPLICATION] =Application;
+  domap[DATASET_COMMIT] =Dataset_commit;
+  domap[DATASET] =Dataset;
+  domap[FEMACHINE_COMMIT] =Machine_commit;
+  domap[FEMACHINE] =Machine;
+  domap[TRIAL_COMMIT] =Trial_commit;
+  domap[TRIAL] =Trial;
+  domap[MACHINEMETRIC_COMMIT]=MachineMetric_commit;
+  domap[MACHINEMETRIC]=MachineMetric;
+  domap[DETERMINISTICMETRIC_COMMIT]=DeterministicMetric_commit;
+  domap[DETERMINISTICMETRIC]=DeterministicMetric;
+  domap[NONDETERMINISTICMETRIC_COMMIT]=NondeterministicMetric_commit;
+  domap[NONDETERMINISTICMETRIC]=NondeterministicMetric;
+  domap[METRIC_COMMIT]=Metric_commit;
+  domap[FEMETRIC]=Metric;
+  domap[FECONNECT]=CONNECT;
+  domap[FEDISCONNECT]=DISCONNECT;
+  domap[FEVERSION]=LVERSION;
+  domap[FEFORMAT]=LFORMAT;
+  domap[FEEND]=LEND;
+}
+
+void eiger::initmaps() {
+  fill_domap();
+}
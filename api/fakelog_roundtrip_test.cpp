@@ -0,0 +1,145 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Round-trip fuzz test for the doubles of character logs:
+* every value written by libfakeeiger must load back with
+* the same bits, and no longer than it has to be.
+*
+**********************************************************/
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fakelog.h"
+
+static int failures = 0;
+
+static bool same_bits(double a, double b) {
+  return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// digits of the mantissa without leading or trailing zeros
+static int significant_digits(const std::string& s) {
+  std::string digits;
+  for (size_t i = 0; i < s.size() && s[i] != 'e'; ++i) {
+    if (s[i] >= '0' && s[i] <= '9') digits.push_back(s[i]);
+  }
+  size_t first = digits.find_first_not_of('0');
+  if (first == std::string::npos) return 1;
+  return digits.find_last_not_of('0') - first + 1;
+}
+
+static void check(double x) {
+  char buf[eiger::max_double_chars];
+  size_t n = eiger::format_double(x, buf);
+  std::string s(buf, n);
+  double y;
+  if (!eiger::parse_double(s, y) || !same_bits(x, y)) {
+    if (++failures <= 10) {
+      printf("%a formatted as %s read back as %a\n", x, s.c_str(), y);
+    }
+    return;
+  }
+  // no fewer significant digits may read back as x
+  int shortest = 17;
+  char shorter[64];
+  for (int precision = 1; precision < 17; ++precision) {
+    snprintf(shorter, sizeof(shorter), "%.*g", precision, x);
+    if (strtod(shorter, NULL) == x) {
+      shortest = precision;
+      break;
+    }
+  }
+  if (significant_digits(s) > shortest && ++failures <= 10) {
+    printf("%a formatted as %s but %s also reads back\n", x, s.c_str(),
+           shorter);
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned long seed = argc > 1 ? strtoul(argv[1], NULL, 10) : 20121018;
+  long count = argc > 2 ? atol(argv[2]) : 200000;
+  std::mt19937_64 rng(seed);
+
+  const double special[] = {
+    0.0, -0.0, 1.0, -1.0, 0.1, 1.0/3, 30, 2.5e9, 1e15, 1e15 - 1, -1e15,
+    9007199254740992.0, 9007199254740993.0, 1e16, 1e21, 1e22, 1e23,
+    DBL_MIN, -DBL_MIN, DBL_MAX, -DBL_MAX, DBL_EPSILON,
+    std::numeric_limits<double>::denorm_min(), 1.00371817926580460e-05,
+    std::numeric_limits<double>::infinity(),
+    -std::numeric_limits<double>::infinity()
+  };
+  std::vector<double> values(special, special + sizeof(special)/sizeof(double));
+
+  // arbitrary bit patterns cover every exponent; small integers and short
+  // decimals cover what performance counters actually record.
+  std::uniform_int_distribution<long long> ints(-1000000000000LL,
+                                                1000000000000LL);
+  for (long i = 0; i < count; ++i) {
+    unsigned long long bits = rng();
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    if (std::isnan(x)) continue;
+    values.push_back(x);
+    values.push_back((double)ints(rng));
+    values.push_back(ints(rng) / 1000.0);
+  }
+  for (size_t i = 0; i < values.size(); ++i) {
+    check(values[i]);
+  }
+
+  // the same values through a whole character log
+  eiger::initmaps();
+  char tmpname[] = "fakelog_roundtrip.XXXXXX";
+  int fd = mkstemp(tmpname);
+  if (fd == -1) {
+    perror("mkstemp");
+    return 1;
+  }
+  {
+    std::ofstream file(tmpname, std::ios::out | std::ios::binary);
+    eiger::LogWriter w(file, eiger::CHARACTER_LOG);
+    w.header();
+    w.connect("roundtrip.db");
+    for (size_t i = 0; i < values.size(); ++i) {
+      w.write(eiger::DeterministicMetric(eiger::DatasetID(0, 0),
+                                         eiger::MetricID(0, 0), values[i]));
+    }
+    w.disconnect();
+    w.end();
+    w.flush();
+  }
+  eiger::SessionSink sink;
+  eiger::log_status_t status = eiger::parseFile(tmpname, sink);
+  close(fd);
+  unlink(tmpname);
+  if (status != eiger::LOG_COMPLETE || sink.sessions.size() != 1 ||
+      sink.sessions[0].det_metrics.size() != values.size()) {
+    printf("log of %lu values did not load back\n",
+           (unsigned long)values.size());
+    ++failures;
+  } else {
+    const std::vector<eiger::DeterministicMetric>& dm =
+      sink.sessions[0].det_metrics;
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (!same_bits(dm[i].value, values[i]) && ++failures <= 10) {
+        printf("log value %lu: wrote %a, read %a\n", (unsigned long)i,
+               values[i], dm[i].value);
+      }
+    }
+  }
+
+  printf("%lu values, seed %lu: %d failures\n", (unsigned long)values.size(),
+         seed, failures);
+  return failures == 0 ? 0 : 1;
+}
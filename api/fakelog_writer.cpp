@@ -0,0 +1,234 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Writer for fakeeiger logs in either the character or the
+* binary format.
+*
+**********************************************************/
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "fakekeywords.h"
+#include "fakelog.h"
+
+using std::string;
+using std::vector;
+
+namespace eiger{
+
+static const char* metricTypeName(metric_type_t type) {
+  switch(type){
+    case DETERMINISTIC:
+      return "deterministic";
+    case NONDETERMINISTIC:
+      return "nondeterministic";
+    case MACHINE:
+      return "machine";
+    default:
+      assert(0 && "Must have correct metric type.");
+  }
+  return "";
+}
+
+LogWriter::LogWriter(std::ostream& out, log_format_t format)
+  : out_(out), format_(format), txt_(out), bin_(out) {
+}
+
+void LogWriter::header() {
+  txt_.put(FEVERSION ";2").endl();
+  if(format_ == BINARY_LOG){
+    txt_.put(FEFORMAT ";" KWBINFORMAT ";").put_i32(FEBINVERSION).endl();
+  } else {
+    txt_.put(FEFORMAT ";" KWFORMAT).endl();
+  }
+  // binary records are buffered separately and must follow the header
+  txt_.flush();
+}
+
+void LogWriter::connect(const string& db) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_CONNECT);
+    bin_.put_str(db);
+  } else {
+    txt_.put(FECONNECT ";").put(db).endl();
+  }
+}
+
+void LogWriter::disconnect() {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_DISCONNECT);
+  } else {
+    txt_.put(FEDISCONNECT).endl();
+  }
+}
+
+void LogWriter::end() {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_END);
+  } else {
+    txt_.put(FEEND).endl();
+  }
+}
+
+void LogWriter::write(const DataCollection& dc, int id) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_DATACOLLECTION);
+    bin_.put_str(dc.name);
+    bin_.put_str(dc.description);
+  } else {
+    txt_.put(DATACOLLECTION_COMMIT ";").put(dc.name).put(';')
+        .put(dc.description).put(';').put_i32(id).endl();
+  }
+}
+
+void LogWriter::write(const Application& app, int id) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_APPLICATION);
+    bin_.put_str(app.name);
+    bin_.put_str(app.description);
+  } else {
+    txt_.put(APPLICATION_COMMIT ";").put(app.name).put(';')
+        .put(app.description).put(';').put_i32(id).endl();
+  }
+}
+
+void LogWriter::write(const Dataset& ds, int id) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_DATASET);
+    bin_.put_i32(ds.applicationID);
+    bin_.put_str(ds.name);
+    bin_.put_str(ds.description);
+    bin_.put_str(ds.url);
+  } else {
+    txt_.put(DATASET_COMMIT ";").put_i32(ds.applicationID).put(';')
+        .put(ds.name).put(';').put(ds.description).put(';').put(ds.url)
+        .put(';').put_i32(id).endl();
+  }
+}
+
+void LogWriter::write(const Machine& ma, int id) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_MACHINE);
+    bin_.put_str(ma.name);
+    bin_.put_str(ma.description);
+  } else {
+    txt_.put(FEMACHINE_COMMIT ";").put(ma.name).put(';')
+        .put(ma.description).put(';').put_i32(id).endl();
+  }
+}
+
+void LogWriter::write(const Trial& tr, int id) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_TRIAL);
+    bin_.put_i32(tr.dataCollectionID);
+    bin_.put_i32(tr.machineID);
+    bin_.put_i32(tr.applicationID);
+    bin_.put_i32(tr.datasetID);
+  } else {
+    txt_.put(TRIAL_COMMIT ";").put_i32(tr.dataCollectionID).put(';')
+        .put_i32(tr.machineID).put(';')
+        .put_i32(tr.applicationID).put(';')
+        .put_i32(tr.datasetID).put(';').put_i32(id).endl();
+  }
+}
+
+void LogWriter::write(const Metric& me, int id) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_METRIC);
+    bin_.put_u8(me.type);
+    bin_.put_str(me.name);
+    bin_.put_str(me.description);
+  } else {
+    txt_.put(METRIC_COMMIT ";").put(metricTypeName(me.type)).put(';')
+        .put(me.name).put(';').put(me.description).put(';').put_i32(id).endl();
+  }
+}
+
+void LogWriter::write(const NondeterministicMetric& ndm) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_NONDETERMINISTICMETRIC);
+    bin_.put_i32(ndm.trialID);
+    bin_.put_i32(ndm.metricID);
+    bin_.put_f64(ndm.value);
+  } else {
+    txt_.put(NONDETERMINISTICMETRIC_COMMIT ";").put_i32(ndm.trialID)
+        .put(';').put_i32(ndm.metricID).put(';').put_f64(ndm.value)
+        .endl();
+  }
+}
+
+void LogWriter::write(const DeterministicMetric& dm) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_DETERMINISTICMETRIC);
+    bin_.put_i32(dm.datasetID);
+    bin_.put_i32(dm.metricID);
+    bin_.put_f64(dm.value);
+  } else {
+    txt_.put(DETERMINISTICMETRIC_COMMIT ";").put_i32(dm.datasetID)
+        .put(';').put_i32(dm.metricID).put(';').put_f64(dm.value)
+        .endl();
+  }
+}
+
+void LogWriter::write(const MachineMetric& mm) {
+  if(format_ == BINARY_LOG){
+    bin_.put_tag(BIN_MACHINEMETRIC);
+    bin_.put_i32(mm.machineID);
+    bin_.put_i32(mm.metricID);
+    bin_.put_f64(mm.value);
+  } else {
+    txt_.put(MACHINEMETRIC_COMMIT ";").put_i32(mm.machineID)
+        .put(';').put_i32(mm.metricID).put(';').put_f64(mm.value)
+        .endl();
+  }
+}
+
+void LogWriter::flush() {
+  txt_.flush();
+  bin_.flush();
+}
+
+void write_log_session(LogWriter& w, const string& db,
+                       const vector<DataCollection>& datacollections,
+                       const vector<Application>& applications,
+                       const vector<Dataset>& datasets,
+                       const vector<Machine>& machines,
+                       const vector<Trial>& trials,
+                       const vector<Metric>& metrics,
+                       const vector<NondeterministicMetric>& nondet_metrics,
+                       const vector<DeterministicMetric>& det_metrics,
+                       const vector<MachineMetric>& machine_metrics){
+  w.connect(db);
+  for(size_t i = 0; i < datacollections.size(); ++i){
+    w.write(datacollections[i], i);
+  }
+  for(size_t i = 0; i < applications.size(); ++i){
+    w.write(applications[i], i);
+  }
+  for(size_t i = 0; i < datasets.size(); ++i){
+    w.write(datasets[i], i);
+  }
+  for(size_t i = 0; i < machines.size(); ++i){
+    w.write(machines[i], i);
+  }
+  for(size_t i = 0; i < trials.size(); ++i){
+    w.write(trials[i], i);
+  }
+  for(size_t i = 0; i < metrics.size(); ++i){
+    w.write(metrics[i], i);
+  }
+  for(const auto& ndm : nondet_metrics){
+    w.write(ndm);
+  }
+  for(const auto& dm : det_metrics){
+    w.write(dm);
+  }
+  for(const auto& mm : machine_metrics){
+    w.write(mm);
+  }
+  w.disconnect();
+}
+
+} // namespace eiger
@@ -0,0 +1,67 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The ledger of fakeeiger logs loaded into a database, kept
+* by the sqlite backend for eiger-loader.
+*
+**********************************************************/
+
+#ifndef LEDGER_H_INCLUDED
+#define LEDGER_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "eiger.h"
+
+namespace eiger{
+
+  // A log loaded into a database, identified by a hash of its contents.
+  // records and prefix say how far it has been loaded, so that a log that
+  // was cut short or interrupted can be resumed once it has grown.
+  struct LoadedLog {
+    std::string hash;
+    std::string filename;
+    std::string status;  // "complete", "truncated" or "partial"
+    int databases;       // how many databases the log writes to
+    long long records;   // how many of its records for the database are in it
+    std::string prefix;  // a hash of those records; empty if not known
+    // The database IDs of the trials it inserted, as runs (first, last). Not
+    // read back by loaded_logs.
+    std::vector< std::pair<int,int> > trials;
+    // The hash of an earlier load of the same log whose place this one takes
+    // in the ledger; do_disconnect removes its rows first. Not stored.
+    std::string replaces;
+
+    LoadedLog() : databases(0), records(0) {}
+  };
+
+  // Adds trial ID id to runs, extending the last run if it follows it.
+  void add_trial(std::vector< std::pair<int,int> >& runs, int id);
+
+  // The ledger of db by log hash. Empty for a database that does not exist
+  // yet or predates the ledger.
+  std::map<std::string,LoadedLog> loaded_logs(const std::string& db);
+
+  // do_disconnect that also records logs in the ledger of db, in the same
+  // transaction as their records. Here the trials of each log are runs of
+  // indices into trials, recorded as the IDs those trials get; a log that
+  // replaces another has the other's rows removed first. Dataset and machine
+  // metric values already in db are not added again.
+  void do_disconnect(const std::string& db,
+                     const std::vector<DataCollection>& datacollections,
+                     const std::vector<Application>& applications,
+                     const std::vector<Dataset>& datasets,
+                     const std::vector<Machine>& machines,
+                     const std::vector<Trial>& trials,
+                     const std::vector<Metric>& metrics,
+                     const std::vector<NondeterministicMetric>& nondet_metrics,
+                     const std::vector<DeterministicMetric>& det_metrics,
+                     const std::vector<MachineMetric>& machine_metrics,
+                     const std::vector<LoadedLog>& logs);
+
+} // end namespace eiger
+
+#endif
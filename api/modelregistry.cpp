@@ -0,0 +1,180 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Loads models from the models table of an Eiger database
+* for ModelRegistry.
+*
+**********************************************************/
+
+#include <functional>
+#include <sstream>
+
+#include "sqlite3.h"
+
+#include "modelregistry.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace{
+
+    // the ID of the newest model of source, -1 if it has none
+    int source_model(sqlite3* db, const string& source){
+      sqlite3_stmt* statement;
+      if(sqlite3_prepare_v2(db, "SELECT models.ID FROM models "
+                            "JOIN model_sources "
+                            "ON model_sources.ID = models.source_id "
+                            "WHERE model_sources.name = ? "
+                            "ORDER BY models.ID DESC LIMIT 1",
+                            -1, &statement, NULL) != SQLITE_OK)
+        throw "database has no models table.";
+      sqlite3_bind_text(statement, 1, source.c_str(), -1, SQLITE_STATIC);
+      int id = -1;
+      if(sqlite3_step(statement) == SQLITE_ROW)
+        id = sqlite3_column_int(statement, 0);
+      sqlite3_finalize(statement);
+      return id;
+    }
+
+    Model read_model(sqlite3* db, int id){
+      sqlite3_stmt* statement;
+      if(sqlite3_prepare_v2(db, "SELECT data FROM models WHERE ID = ?",
+                            -1, &statement, NULL) != SQLITE_OK)
+        throw "database has no models table.";
+      sqlite3_bind_int(statement, 1, id);
+      if(sqlite3_step(statement) != SQLITE_ROW
+         || sqlite3_column_type(statement, 0) == SQLITE_NULL){
+        sqlite3_finalize(statement);
+        throw "no such model in database.";
+      }
+      const char* data = (const char*)sqlite3_column_blob(statement, 0);
+      string text(data, sqlite3_column_bytes(statement, 0));
+      sqlite3_finalize(statement);
+      istringstream in(text);
+      return Model::read(in);
+    }
+
+  } // end anonymous namespace
+
+  template<class Key>
+  ModelRegistry::Index<Key>::Table::Table(size_t size)
+    : mask(size - 1), slots(new atomic<const Entry*>[size]()) {}
+
+  template<class Key>
+  void ModelRegistry::Index<Key>::Table::place(const Entry* entry){
+    size_t i = hash<Key>()(entry->key) & mask;
+    while(slots[i].load(memory_order_relaxed))
+      i = (i + 1) & mask;
+    slots[i].store(entry, memory_order_release);
+  }
+
+  template<class Key>
+  ModelRegistry::Index<Key>::Index() : size_(0) {
+    tables_.push_back(unique_ptr<Table>(new Table(16)));
+    current_.store(tables_.back().get(), memory_order_release);
+  }
+
+  // Never more than half full, so the probe ends at an empty slot.
+  template<class Key>
+  const Model* ModelRegistry::Index<Key>::find(const Key& key) const {
+    const Table* table = current_.load(memory_order_acquire);
+    for(size_t i = hash<Key>()(key) & table->mask; ;
+        i = (i + 1) & table->mask){
+      const Entry* entry = table->slots[i].load(memory_order_acquire);
+      if(!entry)
+        return 0;
+      if(entry->key == key)
+        return entry->model;
+    }
+  }
+
+  template<class Key>
+  void ModelRegistry::Index<Key>::insert(const Key& key, const Model* model){
+    Table* table = current_.load(memory_order_relaxed);
+    if(2 * (entries_.size() + 1) > table->mask + 1){
+      unique_ptr<Table> grown(new Table(2 * (table->mask + 1)));
+      for(size_t e = 0; e < entries_.size(); ++e)
+        grown->place(entries_[e].get());
+      tables_.push_back(move(grown));
+      table = tables_.back().get();
+      current_.store(table, memory_order_release);
+    }
+    entries_.push_back(unique_ptr<Entry>(new Entry{key, model}));
+    table->place(entries_.back().get());
+    size_.store(entries_.size(), memory_order_release);
+  }
+
+  template<class Key>
+  size_t ModelRegistry::Index<Key>::size() const {
+    return size_.load(memory_order_acquire);
+  }
+
+  ModelRegistry::ModelRegistry(const string& db) : dbname_(db), db_(0) {}
+
+  ModelRegistry::~ModelRegistry(){
+    if(db_)
+      sqlite3_close(db_);
+  }
+
+  const Model& ModelRegistry::byId(int id) const {
+    const Model* model = ids_.find(id);
+    return model ? *model : load(id, 0);
+  }
+
+  const Model& ModelRegistry::bySource(const string& source) const {
+    const Model* model = sources_.find(source);
+    return model ? *model : load(-1, &source);
+  }
+
+  size_t ModelRegistry::size() const {
+    return ids_.size();
+  }
+
+  // One connection, shared by the threads loading models; sqlite serializes
+  // their statements.
+  sqlite3* ModelRegistry::open() const {
+    lock_guard<mutex> lock(open_);
+    if(!db_){
+      sqlite3* db;
+      if(sqlite3_open_v2(dbname_.c_str(), &db,
+                         SQLITE_OPEN_READONLY | SQLITE_OPEN_FULLMUTEX, NULL)
+         != SQLITE_OK){
+        sqlite3_close(db);
+        throw "can't open model database.";
+      }
+      db_ = db;
+    }
+    return db_;
+  }
+
+  // Reads and parses the model without a lock, then adds it under one. Two
+  // threads that miss the same model at once both parse it, and the first
+  // to add it wins.
+  const Model& ModelRegistry::load(int id, const string* source) const {
+    if(source){
+      id = source_model(open(), *source);
+      if(id < 0)
+        throw "no models of that source in database.";
+    }
+    unique_ptr<Model> parsed;
+    if(!ids_.find(id))
+      parsed.reset(new Model(read_model(open(), id)));
+
+    lock_guard<mutex> lock(publish_);
+    if(source){
+      if(const Model* model = sources_.find(*source))
+        return *model;
+    }
+    const Model* model = ids_.find(id);
+    if(!model){
+      models_.push_back(move(parsed));
+      model = models_.back().get();
+      ids_.insert(id, model);
+    }
+    if(source)
+      sources_.insert(*source, model);
+    return *model;
+  }
+
+} // end namespace eiger
@@ -0,0 +1,101 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Models stored in an Eiger database (the models table that
+* Eiger.py's import fills), parsed once and shared.
+*
+**********************************************************/
+
+#ifndef MODELREGISTRY_H_INCLUDED
+#define MODELREGISTRY_H_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "eigermodel.h"
+
+struct sqlite3;
+
+namespace eiger{
+
+  // Loads models from db as they are first asked for and keeps them for the
+  // registry's lifetime. One registry can be shared by any number of
+  // threads: lookups of models already loaded take no lock and write no
+  // memory the threads share, and the first lookup of a model reads and
+  // parses it while other threads, including those loading other models,
+  // keep going. The models are const; each thread predicts with its own
+  // ModelInput or scratch.
+  class ModelRegistry {
+    public:
+      // db is opened read-only on the first lookup
+      explicit ModelRegistry(const std::string& db);
+      ~ModelRegistry();
+
+      // the model with this ID in the models table; throws if there is none
+      // or it doesn't parse
+      const Model& byId(int id) const;
+      // the newest model of the named source, as of its first lookup
+      const Model& bySource(const std::string& source) const;
+
+      // models loaded so far
+      size_t size() const;
+
+    private:
+      // Keys to models in an open-addressing table that lookups probe
+      // without locking. Entries are only ever added, one at a time by the
+      // holder of publish_; a table half full is replaced by one twice its
+      // size. Lookups may still be reading a replaced table, so it is kept
+      // until the registry goes, which at most doubles the memory tables use.
+      template<class Key>
+      class Index {
+        public:
+          Index();
+          // the model of key, or NULL; takes no lock
+          const Model* find(const Key& key) const;
+          // key must not be there yet
+          void insert(const Key& key, const Model* model);
+          size_t size() const;
+
+        private:
+          struct Entry {
+            Key key;
+            const Model* model;
+          };
+          struct Table {
+            size_t mask; // slots - 1, the slots being a power of 2
+            std::unique_ptr<std::atomic<const Entry*>[]> slots;
+            explicit Table(size_t size);
+            void place(const Entry* entry);
+          };
+
+          std::atomic<Table*> current_;
+          std::atomic<size_t> size_;
+          std::vector<std::unique_ptr<Table> > tables_;
+          std::vector<std::unique_ptr<Entry> > entries_;
+
+          Index(const Index&);
+          Index& operator=(const Index&);
+      };
+
+      std::string dbname_;
+      mutable Index<int> ids_;
+      mutable Index<std::string> sources_;
+      mutable std::mutex open_;    // guards db_ being opened
+      mutable std::mutex publish_; // guards models_ and adding to the indices
+      mutable sqlite3* db_;
+      mutable std::vector<std::unique_ptr<Model> > models_;
+
+      const Model& load(int id, const std::string* source) const;
+      sqlite3* open() const;
+
+      ModelRegistry(const ModelRegistry&);
+      ModelRegistry& operator=(const ModelRegistry&);
+  };
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,157 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks ModelRegistry against a database holding two
+* models of one source, looked up from several threads at
+* once.
+*
+**********************************************************/
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "sqlite3.h"
+
+#include "modelregistry.h"
+
+static int failures = 0;
+
+static std::string slurp(const char* filename) {
+  std::ifstream in(filename);
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+static void exec(sqlite3* db, const char* sql) {
+  if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+    printf("%s: %s\n", sql, sqlite3_errmsg(db));
+    ++failures;
+  }
+}
+
+static void add_model(sqlite3* db, const std::string& data) {
+  sqlite3_stmt* statement;
+  sqlite3_prepare_v2(db, "INSERT INTO models(description, source_id, data) "
+                         "VALUES('test', 1, ?)", -1, &statement, NULL);
+  sqlite3_bind_blob(statement, 1, data.data(), data.size(), SQLITE_STATIC);
+  if (sqlite3_step(statement) != SQLITE_DONE) ++failures;
+  sqlite3_finalize(statement);
+}
+
+template <class F>
+static void expect_error(const char* what, F lookup) {
+  try {
+    lookup();
+    printf("%s did not throw\n", what);
+    ++failures;
+  } catch (const char*) {
+  }
+}
+
+int main() {
+  char dbname[] = "/tmp/modelregistry_test.XXXXXX";
+  int fd = mkstemp(dbname);
+  if (fd < 0) return 1;
+  close(fd);
+
+  std::string gold = slurp(GOLD_MODEL), multi = slurp(MULTI_MODEL);
+  sqlite3* db;
+  sqlite3_open(dbname, &db);
+  exec(db, "CREATE TABLE model_sources(ID INTEGER PRIMARY KEY, "
+           "name TEXT UNIQUE)");
+  exec(db, "CREATE TABLE models(ID INTEGER PRIMARY KEY, description TEXT, "
+           "created TEXT, source_id INTEGER, data BLOB)");
+  exec(db, "INSERT INTO model_sources(name) VALUES('matmul')");
+  add_model(db, gold);
+  add_model(db, multi);
+  sqlite3_close(db);
+
+  std::istringstream gold_in(gold), multi_in(multi);
+  const eiger::Model want_gold = eiger::Model::read(gold_in);
+  const eiger::Model want_multi = eiger::Model::read(multi_in);
+  const double x[3] = {100, 2000, 16};
+  double scratch[8];
+  const double gold_want = want_gold.predict(x, scratch);
+  const double multi_want = want_multi.predict(x, scratch);
+
+  try {
+    const eiger::ModelRegistry registry(dbname);
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.push_back(std::thread([&registry, &wrong, &x, gold_want,
+                                     multi_want, t]() {
+        double scratch[8];
+        for (int k = 0; k < 10000; ++k) {
+          // the newest model of the source is the second
+          const eiger::Model& a = (k + t) % 2 ? registry.bySource("matmul")
+                                              : registry.byId(2);
+          const eiger::Model& b = registry.byId(1);
+          if (a.predict(x, scratch) != multi_want ||
+              b.predict(x, scratch) != gold_want)
+            ++wrong;
+        }
+      }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+    if (wrong) {
+      printf("%d lookups gave the wrong model\n", wrong.load());
+      ++failures;
+    }
+    if (registry.size() != 2 ||
+        &registry.bySource("matmul") != &registry.byId(2)) {
+      printf("models were loaded more than once\n");
+      ++failures;
+    }
+    expect_error("a missing ID", [&registry]() { registry.byId(3); });
+    expect_error("a missing source",
+                 [&registry]() { registry.bySource("stencil"); });
+  } catch (const char* msg) {
+    printf("%s\n", msg);
+    ++failures;
+  }
+  // enough models that the registry's tables grow while other threads are
+  // looking models up in them
+  sqlite3_open(dbname, &db);
+  for (int m = 3; m <= 200; ++m) add_model(db, gold);
+  sqlite3_close(db);
+  try {
+    const eiger::ModelRegistry registry(dbname);
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.push_back(std::thread([&registry, &wrong, &x, gold_want,
+                                     multi_want, t]() {
+        double scratch[8];
+        for (int k = 0; k < 2000; ++k) {
+          const int id = 1 + (k * (2 * t + 1) + 37 * t) % 200;
+          if (registry.byId(id).predict(x, scratch) !=
+              (id == 2 ? multi_want : gold_want))
+            ++wrong;
+        }
+      }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+    if (wrong || registry.size() != 200) {
+      printf("%d of the lookups of 200 models gave the wrong model, and "
+             "%zu were loaded\n", wrong.load(), registry.size());
+      ++failures;
+    }
+  } catch (const char* msg) {
+    printf("%s\n", msg);
+    ++failures;
+  }
+  expect_error("a missing database", []() {
+    eiger::ModelRegistry("/nonexistent/eiger.db").byId(1);
+  });
+
+  unlink(dbname);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Requests predictions from eiger-predictd.
+*
+**********************************************************/
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "predictionclient.h"
+#include "predictionprotocol.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace{
+
+    void write_all(int fd, const void* data, size_t size){
+      const char* p = (const char*)data;
+      while(size > 0){
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+          continue;
+        if(n <= 0)
+          throw "lost the connection to the prediction daemon.";
+        p += n;
+        size -= n;
+      }
+    }
+
+  } // end anonymous namespace
+
+  PredictionClient::PredictionClient(const string& socket) : fd_(-1) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(socket.size() >= sizeof(addr.sun_path))
+      throw "prediction daemon socket name is too long.";
+    strcpy(addr.sun_path, socket.c_str());
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd_ < 0 || connect(fd_, (sockaddr*)&addr, sizeof(addr)) != 0){
+      if(fd_ >= 0)
+        close(fd_);
+      throw "can't connect to the prediction daemon.";
+    }
+  }
+
+  PredictionClient::~PredictionClient(){
+    close(fd_);
+  }
+
+  void PredictionClient::predict(int model, const double* metrics,
+                                 size_t count, size_t inputs,
+                                 double* predictions){
+    send(protocol::PREDICT_BY_ID, model, "", metrics, count, inputs);
+    if(receive() != count * sizeof(double))
+      throw "prediction daemon answered with the wrong size.";
+    read(predictions, count * sizeof(double));
+  }
+
+  void PredictionClient::predict(const string& source, const double* metrics,
+                                 size_t count, size_t inputs,
+                                 double* predictions){
+    send(protocol::PREDICT_BY_SOURCE, -1, source, metrics, count, inputs);
+    if(receive() != count * sizeof(double))
+      throw "prediction daemon answered with the wrong size.";
+    read(predictions, count * sizeof(double));
+  }
+
+  string PredictionClient::stats(){
+    send(protocol::STATS, -1, "", 0, 0, 0);
+    string text(receive(), '\0');
+    read(&text[0], text.size());
+    return text;
+  }
+
+  void PredictionClient::send(unsigned type, int model, const string& source,
+                              const double* metrics, size_t count,
+                              size_t inputs){
+    if(count > protocol::max_count || inputs > protocol::max_inputs
+       || count * inputs > protocol::max_request_bytes / sizeof(double))
+      throw "request is too large for the prediction daemon.";
+    protocol::RequestHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = protocol::request_magic;
+    h.type = type;
+    h.id = model;
+    h.source_size = source.size();
+    h.count = count;
+    h.inputs = inputs;
+    write_all(fd_, &h, sizeof(h));
+    write_all(fd_, source.data(), source.size());
+    write_all(fd_, metrics, count * inputs * sizeof(double));
+  }
+
+  size_t PredictionClient::receive(){
+    protocol::ResponseHeader h;
+    read(&h, sizeof(h));
+    if(h.magic != protocol::response_magic)
+      throw "prediction daemon answered with garbage.";
+    if(h.status != protocol::OK){
+      error_.assign(h.size, '\0');
+      read(&error_[0], error_.size());
+      throw "prediction daemon refused the request.";
+    }
+    return h.size;
+  }
+
+  void PredictionClient::read(void* data, size_t size){
+    char* p = (char*)data;
+    while(size > 0){
+      ssize_t n = recv(fd_, p, size, 0);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+        throw "lost the connection to the prediction daemon.";
+      p += n;
+      size -= n;
+    }
+  }
+
+} // end namespace eiger
@@ -0,0 +1,62 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Client of eiger-predictd, the daemon that serves the
+* models of an Eiger database to the processes of a node
+* from one copy.
+*
+**********************************************************/
+
+#ifndef PREDICTIONCLIENT_H_INCLUDED
+#define PREDICTIONCLIENT_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+namespace eiger{
+
+  // One connection to eiger-predictd. Requests are answered in turn, so a
+  // client must not be shared between threads without a lock; give each
+  // thread its own instead. Sending many vectors per request lets the
+  // daemon fill its batches.
+  class PredictionClient {
+    public:
+      // connects to the daemon's socket; throws if it can't
+      explicit PredictionClient(const std::string& socket);
+      ~PredictionClient();
+
+      // Predict count vectors of inputs metrics each, row-major in the
+      // model's metricNames() order, into predictions. Throws if the daemon
+      // refuses the request, with its reason in error(), and without asking
+      // it if the request is larger than protocol::max_count vectors,
+      // protocol::max_inputs metrics a vector or protocol::max_request_bytes
+      // of metrics.
+      void predict(int model, const double* metrics, size_t count,
+                   size_t inputs, double* predictions);
+      // with the newest model of the named source
+      void predict(const std::string& source, const double* metrics,
+                   size_t count, size_t inputs, double* predictions);
+
+      // the daemon's request and latency statistics since it started
+      std::string stats();
+
+      // why the daemon refused the last request it refused
+      const std::string& error() const { return error_; }
+
+    private:
+      int fd_;
+      std::string error_;
+
+      void send(unsigned type, int model, const std::string& source,
+                const double* metrics, size_t count, size_t inputs);
+      // the size of the answer, which is left to read
+      size_t receive();
+      void read(void* data, size_t size);
+
+      PredictionClient(const PredictionClient&);
+      PredictionClient& operator=(const PredictionClient&);
+  };
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,59 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The messages eiger-predictd and PredictionClient
+* exchange over the daemon's Unix domain socket. Both ends
+* are on one machine, so fields are in its byte order.
+*
+**********************************************************/
+
+#ifndef PREDICTIONPROTOCOL_H_INCLUDED
+#define PREDICTIONPROTOCOL_H_INCLUDED
+
+#include <cstdint>
+
+namespace eiger{
+
+  namespace protocol{
+
+    const uint32_t request_magic = 0x45505251;  // "EPRQ"
+    const uint32_t response_magic = 0x45505253; // "EPRS"
+
+    enum request_t {
+      PREDICT_BY_ID = 1,     // the model with this ID in the models table
+      PREDICT_BY_SOURCE = 2, // the newest model of the named source
+      STATS = 3              // a line of the daemon's latency statistics
+    };
+
+    // Followed by source_size bytes of source name, then count vectors of
+    // inputs doubles. A connection carries any number of requests, one at a
+    // time.
+    struct RequestHeader {
+      uint32_t magic, type;
+      int32_t id;
+      uint32_t source_size;
+      uint64_t count;
+      uint32_t inputs, reserved;
+    };
+
+    enum status_t {
+      OK = 0,    // followed by size predictions, or size bytes of statistics
+      ERROR = 1  // followed by a message of size bytes
+    };
+
+    struct ResponseHeader {
+      uint32_t magic, status;
+      uint64_t size;
+    };
+
+    // requests of more vectors, of more metrics a vector, or whose metrics
+    // take more bytes, are refused
+    const uint64_t max_count = 1 << 24;
+    const uint32_t max_inputs = 1 << 16;
+    const uint64_t max_request_bytes = 1 << 28;
+
+  } // end namespace protocol
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,431 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Serves predictions over a Unix domain socket: a thread
+* per connection reads requests and queues them, and one
+* worker predicts everything queued for a model as one
+* batch.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "predictionprotocol.h"
+#include "predictionserver.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace{
+
+    const size_t octaves = 40, sub_buckets = 16;
+    const size_t buckets = 1 + octaves * sub_buckets;
+    // longer source names are refused
+    const uint32_t max_source = 4096;
+
+    size_t bucket(double us){
+      if(us < 1.0)
+        return 0;
+      int e;
+      double m = frexp(us, &e);  // us = m * 2^e, m in [0.5, 1)
+      size_t b = 1 + (e - 1) * sub_buckets
+                 + (size_t)((2.0 * m - 1.0) * sub_buckets);
+      return min(b, buckets - 1);
+    }
+
+    // the upper end of a bucket
+    double bucket_limit(size_t b){
+      if(b == 0)
+        return 1.0;
+      size_t octave = (b - 1) / sub_buckets, sub = (b - 1) % sub_buckets;
+      return ldexp(1.0 + (sub + 1.0) / sub_buckets, octave);
+    }
+
+    double percentile(const vector<uint64_t>& counts, double q){
+      uint64_t total = 0;
+      for(size_t b = 0; b < counts.size(); ++b)
+        total += counts[b];
+      if(total == 0)
+        return 0.0;
+      uint64_t want = (uint64_t)ceil(q * total), seen = 0;
+      for(size_t b = 0; b < counts.size(); ++b){
+        seen += counts[b];
+        if(seen >= want)
+          return bucket_limit(b);
+      }
+      return bucket_limit(counts.size() - 1);
+    }
+
+    string describe(uint64_t requests, uint64_t vectors, uint64_t batches,
+                    const vector<uint64_t>& latencies){
+      char line[256];
+      snprintf(line, sizeof(line), "%llu requests, %llu vectors in %llu "
+               "batches (%.1f each), latency p50 %.0f us, p99 %.0f us",
+               (unsigned long long)requests, (unsigned long long)vectors,
+               (unsigned long long)batches,
+               batches ? (double)vectors / batches : 0.0,
+               percentile(latencies, 0.5), percentile(latencies, 0.99));
+      return line;
+    }
+
+    // false if the connection closed before the first byte
+    bool read_all(int fd, void* data, size_t size){
+      char* p = (char*)data;
+      bool started = false;
+      while(size > 0){
+        ssize_t n = recv(fd, p, size, 0);
+        if(n < 0 && errno == EINTR)
+          continue;
+        if(n == 0 && !started)
+          return false;
+        if(n <= 0)
+          throw "connection lost.";
+        started = true;
+        p += n;
+        size -= n;
+      }
+      return true;
+    }
+
+    // reads and drops size bytes, keeping the connection in step
+    void discard(int fd, size_t size){
+      char buffer[65536];
+      while(size > 0){
+        size_t n = min(size, sizeof(buffer));
+        if(!read_all(fd, buffer, n))
+          throw "connection lost.";
+        size -= n;
+      }
+    }
+
+    void write_all(int fd, const void* data, size_t size){
+      const char* p = (const char*)data;
+      while(size > 0){
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+          continue;
+        if(n <= 0)
+          throw "connection lost.";
+        p += n;
+        size -= n;
+      }
+    }
+
+    void respond(int fd, uint32_t status, const void* data, size_t size){
+      protocol::ResponseHeader h;
+      h.magic = protocol::response_magic;
+      h.status = status;
+      h.size = size;
+      write_all(fd, &h, sizeof(h));
+      write_all(fd, data, size);
+    }
+
+    void refuse(int fd, const string& message){
+      respond(fd, protocol::ERROR, message.data(), message.size());
+    }
+
+  } // end anonymous namespace
+
+  PredictionServer::Options::Options()
+    : batch(4096), window(100), interval(10), report(0) {}
+
+  PredictionServer::PredictionServer(const ModelRegistry& models,
+                                     const Options& options)
+    : models_(models), options_(options), queued_(0), stopping_(false),
+      listener_(-1), requests_(0), vectors_(0), batches_(0),
+      latencies_(buckets) {
+    worker_ = thread(&PredictionServer::work, this);
+    if(options_.report && options_.interval.count() > 0)
+      reporter_ = thread(&PredictionServer::reportEvery, this);
+  }
+
+  PredictionServer::~PredictionServer(){
+    stop();
+    worker_.join();
+    if(reporter_.joinable())
+      reporter_.join();
+    unique_lock<mutex> lock(lock_);
+    closed_.wait(lock, [this]{ return connections_.empty(); });
+  }
+
+  void PredictionServer::run(const string& path){
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path))
+      throw "socket name is too long.";
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+      throw "can't make a socket.";
+    unlink(path.c_str());
+    if(bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0){
+      close(fd);
+      throw "can't listen on the socket.";
+    }
+    {
+      lock_guard<mutex> lock(lock_);
+      if(stopping_){
+        close(fd);
+        unlink(path.c_str());
+        return;
+      }
+      listener_ = fd;
+    }
+
+    while(true){
+      int connection = accept(fd, NULL, NULL);
+      int error = errno;
+      unique_lock<mutex> lock(lock_);
+      if(stopping_){
+        if(connection >= 0)
+          close(connection);
+        break;
+      }
+      if(connection >= 0){
+        connections_.insert(connection);
+        thread(&PredictionServer::serve, this, connection).detach();
+      }
+      else if(error != EINTR && error != ECONNABORTED){
+        // out of descriptors, most likely; let some connections close
+        lock.unlock();
+        this_thread::sleep_for(chrono::milliseconds(10));
+      }
+    }
+    lock_guard<mutex> lock(lock_);
+    close(fd);
+    listener_ = -1;
+    unlink(path.c_str());
+  }
+
+  void PredictionServer::stop(){
+    lock_guard<mutex> lock(lock_);
+    stopping_ = true;
+    // wakes accept() and the connections' reads
+    if(listener_ >= 0)
+      shutdown(listener_, SHUT_RDWR);
+    for(set<int>::iterator it = connections_.begin();
+        it != connections_.end(); ++it)
+      shutdown(*it, SHUT_RDWR);
+    work_.notify_all();
+    done_.notify_all();
+    stopped_.notify_all();
+  }
+
+  PredictionServer::Stats PredictionServer::stats() const {
+    lock_guard<mutex> lock(lock_);
+    Stats s;
+    s.requests = requests_;
+    s.vectors = vectors_;
+    s.batches = batches_;
+    s.p50 = percentile(latencies_, 0.5);
+    s.p99 = percentile(latencies_, 0.99);
+    return s;
+  }
+
+  string PredictionServer::statsLine() const {
+    lock_guard<mutex> lock(lock_);
+    return describe(requests_, vectors_, batches_, latencies_);
+  }
+
+  void PredictionServer::serve(int fd){
+    try{
+      while(answer(fd))
+        ;
+    }
+    catch(const char*){
+      // the client went away
+    }
+    catch(const exception&){
+      // out of memory, most likely; only this connection is dropped
+    }
+    lock_guard<mutex> lock(lock_);
+    connections_.erase(fd);
+    close(fd);
+    closed_.notify_all();
+  }
+
+  // Answers one request; false once the connection should close.
+  bool PredictionServer::answer(int fd){
+    protocol::RequestHeader h;
+    if(!read_all(fd, &h, sizeof(h)) || h.magic != protocol::request_magic
+       || h.source_size > max_source)
+      return false;
+    // latency counts the time taken to receive the metrics
+    const clock_type::time_point arrival = clock_type::now();
+    string source(h.source_size, '\0');
+    if(!read_all(fd, &source[0], source.size()))
+      return false;
+    if(h.type == protocol::STATS){
+      string line = statsLine();
+      respond(fd, protocol::OK, line.data(), line.size());
+      return true;
+    }
+    if(h.count > protocol::max_count || h.inputs > protocol::max_inputs
+       || h.count * h.inputs > protocol::max_request_bytes / sizeof(double)){
+      // the metrics can't be skipped sensibly
+      refuse(fd, "request is too large.");
+      return false;
+    }
+    const size_t bytes = h.count * h.inputs * sizeof(double);
+
+    // the model first, so that nothing is allocated for a request it refuses
+    const Model* model;
+    try{
+      if(h.type == protocol::PREDICT_BY_ID)
+        model = &models_.byId(h.id);
+      else if(h.type == protocol::PREDICT_BY_SOURCE)
+        model = &models_.bySource(source);
+      else
+        throw "unknown request.";
+    }
+    catch(const char* msg){
+      discard(fd, bytes);
+      refuse(fd, msg);
+      return true;
+    }
+    if(h.inputs != model->inputs()){
+      discard(fd, bytes);
+      refuse(fd, "request has the wrong number of metrics for the model.");
+      return true;
+    }
+    vector<double> metrics(h.count * h.inputs);
+    if(!read_all(fd, metrics.data(), bytes))
+      return false;
+
+    vector<double> predictions(h.count);
+    Job job = {model, metrics.data(), (size_t)h.count, predictions.data(),
+               arrival, false};
+    if(job.count > 0){
+      unique_lock<mutex> lock(lock_);
+      queue_.push_back(&job);
+      queued_ += job.count;
+      work_.notify_all();
+      // once the worker has taken a job it finishes it, even when stopping
+      done_.wait(lock, [this, &job]{
+        return job.done || (stopping_ && find(queue_.begin(), queue_.end(),
+                                              &job) != queue_.end());
+      });
+      if(!job.done){
+        queue_.erase(remove(queue_.begin(), queue_.end(), &job),
+                     queue_.end());
+        return false;
+      }
+    }
+    respond(fd, protocol::OK, predictions.data(),
+            predictions.size() * sizeof(double));
+    return true;
+  }
+
+  void PredictionServer::work(){
+    vector<Job*> jobs;
+    vector<double> buffer, scratch;
+    unique_lock<mutex> lock(lock_);
+    while(true){
+      work_.wait(lock, [this]{ return stopping_ || !queue_.empty(); });
+      if(stopping_)
+        break;
+      // give other clients a moment to fill the batch
+      if(queued_ < options_.batch && options_.window.count() > 0){
+        clock_type::time_point deadline =
+          queue_.front()->arrival + options_.window;
+        work_.wait_until(lock, deadline, [this]{
+          return stopping_ || queued_ >= options_.batch;
+        });
+        if(stopping_)
+          break;
+      }
+      jobs.assign(queue_.begin(), queue_.end());
+      queue_.clear();
+      queued_ = 0;
+      lock.unlock();
+
+      size_t batches = predict(jobs, buffer, scratch);
+      clock_type::time_point now = clock_type::now();
+
+      lock.lock();
+      for(size_t k = 0; k < jobs.size(); ++k){
+        double us = chrono::duration<double, micro>(now - jobs[k]->arrival)
+                    .count();
+        ++latencies_[bucket(us)];
+        vectors_ += jobs[k]->count;
+        jobs[k]->done = true;
+      }
+      requests_ += jobs.size();
+      batches_ += batches;
+      done_.notify_all();
+    }
+  }
+
+  size_t PredictionServer::predict(vector<Job*>& jobs, vector<double>& buffer,
+                                   vector<double>& scratch){
+    stable_sort(jobs.begin(), jobs.end(), [](const Job* a, const Job* b){
+      return less<const Model*>()(a->model, b->model);
+    });
+    size_t batches = 0;
+    for(size_t first = 0, last; first < jobs.size(); first = last){
+      const Model& model = *jobs[first]->model;
+      size_t total = 0;
+      for(last = first; last < jobs.size() && jobs[last]->model == &model;
+          ++last)
+        total += jobs[last]->count;
+      scratch.resize(max(scratch.size(), model.batchScratchSize()));
+      ++batches;
+      if(last - first == 1){
+        model.predict(jobs[first]->metrics, total, jobs[first]->predictions,
+                      scratch.data());
+        continue;
+      }
+      // gather the vectors of every request for the model
+      const size_t n = model.inputs();
+      buffer.resize(total * (n + 1));
+      double* metrics = buffer.data();
+      double* predictions = metrics + total * n;
+      size_t at = 0;
+      for(size_t k = first; k < last; ++k){
+        copy(jobs[k]->metrics, jobs[k]->metrics + jobs[k]->count * n,
+             metrics + at * n);
+        at += jobs[k]->count;
+      }
+      model.predict(metrics, total, predictions, scratch.data());
+      at = 0;
+      for(size_t k = first; k < last; ++k){
+        copy(predictions + at, predictions + at + jobs[k]->count,
+             jobs[k]->predictions);
+        at += jobs[k]->count;
+      }
+    }
+    return batches;
+  }
+
+  void PredictionServer::reportEvery(){
+    unique_lock<mutex> lock(lock_);
+    uint64_t requests = 0, vectors = 0, batches = 0;
+    vector<uint64_t> latencies(buckets);
+    while(!stopped_.wait_for(lock, options_.interval,
+                             [this]{ return stopping_; })){
+      vector<uint64_t> recent(buckets);
+      for(size_t b = 0; b < buckets; ++b)
+        recent[b] = latencies_[b] - latencies[b];
+      *options_.report << describe(requests_ - requests, vectors_ - vectors,
+                                   batches_ - batches, recent)
+                       << endl;
+      requests = requests_;
+      vectors = vectors_;
+      batches = batches_;
+      latencies = latencies_;
+    }
+  }
+
+} // end namespace eiger
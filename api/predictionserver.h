@@ -0,0 +1,107 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* The server of eiger-predictd: answers PredictionClient
+* requests from the models of a ModelRegistry, batching
+* the vectors of concurrent requests together.
+*
+**********************************************************/
+
+#ifndef PREDICTIONSERVER_H_INCLUDED
+#define PREDICTIONSERVER_H_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "modelregistry.h"
+
+namespace eiger{
+
+  class PredictionServer {
+    public:
+      struct Options {
+        // a batch of this many vectors runs as soon as they are queued
+        size_t batch;
+        // how long a smaller batch waits for more requests
+        std::chrono::microseconds window;
+        // statistics are written to report this often, if report is set
+        std::chrono::seconds interval;
+        std::ostream* report;
+
+        Options();
+      };
+
+      struct Stats {
+        uint64_t requests, vectors, batches;
+        // request latency in microseconds, from the arrival of a request's
+        // header to its predictions being ready
+        double p50, p99;
+      };
+
+      PredictionServer(const ModelRegistry& models, const Options& options);
+      ~PredictionServer();
+
+      // Listens on a Unix domain socket at path, replacing any file there,
+      // and serves until stop() is called; throws if it can't listen.
+      void run(const std::string& path);
+      // can be called from any thread, also before run()
+      void stop();
+
+      // everything since the server was made
+      Stats stats() const;
+      // one line summing up stats()
+      std::string statsLine() const;
+
+    private:
+      typedef std::chrono::steady_clock clock_type;
+
+      struct Job {
+        const Model* model;
+        const double* metrics;
+        size_t count;
+        double* predictions;
+        clock_type::time_point arrival;
+        bool done;
+      };
+
+      const ModelRegistry& models_;
+      const Options options_;
+
+      mutable std::mutex lock_;
+      // work_ wakes the worker, done_ the requests it finished, closed_
+      // the destructor as connections end and stopped_ the reporter
+      std::condition_variable work_, done_, closed_, stopped_;
+      std::deque<Job*> queue_;
+      size_t queued_;
+      bool stopping_;
+      int listener_;
+      std::set<int> connections_;
+      uint64_t requests_, vectors_, batches_;
+      // counts of request latencies, in buckets a sixteenth of a power of
+      // two wide
+      std::vector<uint64_t> latencies_;
+      std::thread worker_, reporter_;
+
+      void serve(int fd);
+      bool answer(int fd);
+      void work();
+      // returns the number of batches, one per model
+      size_t predict(std::vector<Job*>& jobs, std::vector<double>& buffer,
+                     std::vector<double>& scratch);
+      void reportEvery();
+
+      PredictionServer(const PredictionServer&);
+      PredictionServer& operator=(const PredictionServer&);
+  };
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,249 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks eiger-predictd's server: clients on several
+* threads must get the predictions of the models they ask
+* for, batched or not, and refused requests must leave the
+* connection usable.
+*
+**********************************************************/
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sqlite3.h"
+
+#include "modelregistry.h"
+#include "predictionclient.h"
+#include "predictionprotocol.h"
+#include "predictionserver.h"
+
+static int failures = 0;
+
+static std::string slurp(const char* filename) {
+  std::ifstream in(filename);
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+static void make_database(const char* dbname) {
+  sqlite3* db;
+  sqlite3_open(dbname, &db);
+  sqlite3_exec(db, "CREATE TABLE model_sources(ID INTEGER PRIMARY KEY, "
+                   "name TEXT UNIQUE);"
+                   "CREATE TABLE models(ID INTEGER PRIMARY KEY, "
+                   "description TEXT, created TEXT, source_id INTEGER, "
+                   "data BLOB);"
+                   "INSERT INTO model_sources(name) VALUES('matmul');",
+               NULL, NULL, NULL);
+  const std::string models[] = {slurp(GOLD_MODEL), slurp(MULTI_MODEL)};
+  for (int k = 0; k < 2; ++k) {
+    sqlite3_stmt* statement;
+    sqlite3_prepare_v2(db, "INSERT INTO models(description, source_id, data) "
+                           "VALUES('test', 1, ?)", -1, &statement, NULL);
+    sqlite3_bind_blob(statement, 1, models[k].data(), models[k].size(),
+                      SQLITE_STATIC);
+    sqlite3_step(statement);
+    sqlite3_finalize(statement);
+  }
+  sqlite3_close(db);
+}
+
+// a client, once the server listens
+static eiger::PredictionClient* connect(const std::string& socket) {
+  for (int tries = 0;; ++tries) {
+    try {
+      return new eiger::PredictionClient(socket);
+    } catch (const char*) {
+      if (tries == 1000) throw;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+}
+
+// a connection of the test's own, for requests no client sends
+static int raw_connect(const std::string& socket) {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket.c_str());
+  if (fd >= 0 && ::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static eiger::protocol::RequestHeader header(uint64_t count,
+                                             uint32_t inputs) {
+  eiger::protocol::RequestHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = eiger::protocol::request_magic;
+  h.type = eiger::protocol::PREDICT_BY_ID;
+  h.id = 1;
+  h.count = count;
+  h.inputs = inputs;
+  return h;
+}
+
+// A header asking for more metrics than the daemon takes must be refused
+// before any are sent, not make it allocate them.
+static void expect_too_large(const std::string& socket) {
+  int fd = raw_connect(socket);
+  const eiger::protocol::RequestHeader h =
+      header(eiger::protocol::max_count, 4096);
+  eiger::protocol::ResponseHeader r;
+  if (fd < 0 || send(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+      recv(fd, &r, sizeof(r), MSG_WAITALL) != (ssize_t)sizeof(r) ||
+      r.status != eiger::protocol::ERROR) {
+    printf("an oversized request was not refused\n");
+    ++failures;
+  }
+  if (fd >= 0) close(fd);
+}
+
+// A client that hangs up after the header of a request model 1 would take
+// must be dropped, not answered as if it had sent metrics of 0.
+static void expect_hang_up(const std::string& socket, uint32_t inputs) {
+  int fd = raw_connect(socket);
+  const eiger::protocol::RequestHeader h = header(1, inputs);
+  eiger::protocol::ResponseHeader r;
+  if (fd < 0 || send(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+      shutdown(fd, SHUT_WR) != 0 ||
+      recv(fd, &r, sizeof(r), MSG_WAITALL) != 0) {
+    printf("a request without its metrics was answered\n");
+    ++failures;
+  }
+  if (fd >= 0) close(fd);
+}
+
+template <class F>
+static void expect_refusal(const char* what, eiger::PredictionClient& client,
+                           F request) {
+  try {
+    request();
+    printf("%s was not refused\n", what);
+    ++failures;
+  } catch (const char*) {
+    if (client.error().empty()) {
+      printf("%s was refused without a reason\n", what);
+      ++failures;
+    }
+  }
+}
+
+int main() {
+  char dir[] = "/tmp/predictionserver_test.XXXXXX";
+  if (!mkdtemp(dir)) return 1;
+  const std::string dbname = std::string(dir) + "/eiger.db";
+  const std::string socket = std::string(dir) + "/predictd.sock";
+  make_database(dbname.c_str());
+
+  std::istringstream gold_in(slurp(GOLD_MODEL)), multi_in(slurp(MULTI_MODEL));
+  const eiger::Model gold = eiger::Model::read(gold_in);
+  const eiger::Model multi = eiger::Model::read(multi_in);
+
+  const int threads = 4, requests = 50;
+  try {
+    const eiger::ModelRegistry registry(dbname);
+    eiger::PredictionServer::Options options;
+    options.window = std::chrono::microseconds(2000);
+    eiger::PredictionServer server(registry, options);
+    std::thread listener([&server, &socket]() {
+      try {
+        server.run(socket);
+      } catch (const char* msg) {
+        printf("%s\n", msg);
+        ++failures;
+      }
+    });
+
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> clients;
+    for (int t = 0; t < threads; ++t) {
+      clients.push_back(std::thread([&, t]() {
+        std::unique_ptr<eiger::PredictionClient> client(connect(socket));
+        std::mt19937_64 rng(t);
+        std::uniform_real_distribution<double> value(1.0, 5000.0);
+        for (int r = 0; r < requests; ++r) {
+          // gold by its ID, or the newest matmul model, multi
+          const bool by_source = (r + t) % 2;
+          const eiger::Model& model = by_source ? multi : gold;
+          const size_t count = 1 + rng() % 300, n = model.inputs();
+          std::vector<double> metrics(count * n), got(count), want(count);
+          for (size_t k = 0; k < metrics.size(); ++k) metrics[k] = value(rng);
+          model.predict(metrics.data(), count, want.data());
+          if (by_source)
+            client->predict("matmul", metrics.data(), count, n, got.data());
+          else
+            client->predict(1, metrics.data(), count, n, got.data());
+          if (memcmp(got.data(), want.data(), count * sizeof(double)) != 0)
+            ++wrong;
+        }
+      }));
+    }
+    for (size_t t = 0; t < clients.size(); ++t) clients[t].join();
+    if (wrong) {
+      printf("%d requests got the wrong predictions\n", wrong.load());
+      ++failures;
+    }
+
+    expect_too_large(socket);
+    expect_hang_up(socket, gold.inputs());
+    std::unique_ptr<eiger::PredictionClient> client(connect(socket));
+    double metrics[3] = {100, 2000, 16}, prediction, scratch[16];
+    expect_refusal("a missing model", *client, [&]() {
+      client->predict(3, metrics, 1, 1, &prediction);
+    });
+    expect_refusal("a missing source", *client, [&]() {
+      client->predict("stencil", metrics, 1, 3, &prediction);
+    });
+    expect_refusal("the wrong number of metrics", *client, [&]() {
+      client->predict("matmul", metrics, 1, 2, &prediction);
+    });
+    try {
+      client->predict(1, metrics, 1, eiger::protocol::max_inputs + 1,
+                      &prediction);
+      printf("a request of too many metrics a vector was sent\n");
+      ++failures;
+    } catch (const char*) {
+    }
+    client->predict("matmul", metrics, 1, 3, &prediction);
+    if (prediction != multi.predict(metrics, scratch)) {
+      printf("a refusal spoiled the connection\n");
+      ++failures;
+    }
+
+    eiger::PredictionServer::Stats stats = server.stats();
+    if (stats.requests != threads * requests + 1 ||
+        stats.batches > stats.requests || stats.p50 > stats.p99 ||
+        client->stats().find("latency p50") == std::string::npos) {
+      printf("wrong statistics: %s\n", server.statsLine().c_str());
+      ++failures;
+    }
+    client.reset();
+    server.stop();
+    listener.join();
+  } catch (const char* msg) {
+    printf("%s\n", msg);
+    ++failures;
+  }
+
+  unlink(dbname.c_str());
+  rmdir(dir);
+  return failures ? 1 : 0;
+}
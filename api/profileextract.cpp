@@ -0,0 +1,606 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Reads a data collection out of an Eiger database for
+* eiger-extract and streams it for eiger-export.
+*
+**********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "sqlite3.h"
+
+#include "fakelog.h"
+#include "profileextract.h"
+
+using namespace std;
+
+namespace eiger{
+
+  namespace{
+
+    // rows of the .npy file written at a time
+    const size_t block_rows = 4096;
+
+    // closes the database however extraction ends
+    struct Database {
+      sqlite3* db;
+
+      explicit Database(const string& dbname) : db(0) {
+        if(sqlite3_open_v2(dbname.c_str(), &db, SQLITE_OPEN_READONLY, NULL)
+           != SQLITE_OK){
+          sqlite3_close(db);
+          throw "can't open database.";
+        }
+      }
+      ~Database(){ sqlite3_close(db); }
+    };
+
+    struct Statement {
+      sqlite3_stmt* statement;
+
+      Statement(const Database& database, const string& sql)
+        : statement(0) {
+        if(sqlite3_prepare_v2(database.db, sql.c_str(), -1, &statement, NULL)
+           != SQLITE_OK){
+          sqlite3_finalize(statement);
+          throw "database is not an Eiger database.";
+        }
+      }
+      ~Statement(){ sqlite3_finalize(statement); }
+
+      bool step(){
+        const int status = sqlite3_step(statement);
+        if(status != SQLITE_ROW && status != SQLITE_DONE)
+          throw "unable to read database.";
+        return status == SQLITE_ROW;
+      }
+      bool null(int column) const {
+        return sqlite3_column_type(statement, column) == SQLITE_NULL;
+      }
+      int64_t integer(int column) const {
+        return sqlite3_column_int64(statement, column);
+      }
+      // -1 for NULL, which no row ID is
+      int64_t id(int column) const {
+        return null(column) ? -1 : integer(column);
+      }
+      double real(int column) const {
+        return sqlite3_column_double(statement, column);
+      }
+      string text(int column) const {
+        const unsigned char* text = sqlite3_column_text(statement, column);
+        return text ? string((const char*)text,
+                             sqlite3_column_bytes(statement, column))
+                    : string();
+      }
+    };
+
+    // The columns of a profile as its metrics turn up, by metric ID. A cell
+    // is NaN until it has a value, which no value from the database is.
+    class Columns {
+      public:
+        explicit Columns(size_t rows) : rows_(rows) {}
+
+        vector<double>& operator[](int64_t metric){
+          map<int64_t,size_t>::iterator it = index_.find(metric);
+          if(it == index_.end()){
+            it = index_.insert(make_pair(metric, columns_.size())).first;
+            columns_.push_back(vector<double>(
+                rows_, numeric_limits<double>::quiet_NaN()));
+          }
+          return columns_[it->second];
+        }
+
+        static void store(double& cell, double value){
+          if(std::isnan(cell) || value > cell)
+            cell = value;
+        }
+
+        // moves the columns into profile in order of metric name, with the
+        // metrics' descriptions
+        void finish(const Database& db, Profile& profile){
+          Statement describe(db, "SELECT name, description, type "
+                                 "FROM metrics WHERE ID = ?");
+          vector<pair<string,size_t> > order;
+          vector<Profile::Metric> metrics(columns_.size());
+          for(map<int64_t,size_t>::const_iterator it = index_.begin();
+              it != index_.end(); ++it){
+            sqlite3_bind_int64(describe.statement, 1, it->first);
+            if(!describe.step())
+              throw "database has values of a metric it doesn't define.";
+            Profile::Metric& metric = metrics[it->second];
+            metric.name = describe.text(0);
+            metric.description = describe.text(1);
+            metric.type = describe.text(2);
+            sqlite3_reset(describe.statement);
+            order.push_back(make_pair(metric.name, it->second));
+          }
+          sort(order.begin(), order.end());
+
+          for(size_t c = 0; c < order.size(); ++c){
+            vector<double>& column = columns_[order[c].second];
+            for(size_t r = 0; r < rows_; ++r)
+              if(std::isnan(column[r]))
+                column[r] = 0.0;
+            profile.metrics.push_back(metrics[order[c].second]);
+            profile.columns.push_back(vector<double>());
+            profile.columns.back().swap(column);
+          }
+        }
+
+      private:
+        size_t rows_;
+        map<int64_t,size_t> index_;
+        vector<vector<double> > columns_;
+    };
+
+    // The rows of the trials of each application, machine or dataset, and
+    // the order in which they first appear.
+    struct Owners {
+      map<int64_t,vector<size_t> > rows;
+      vector<int64_t> order;
+
+      void add(int64_t id, size_t row){
+        if(id < 0)
+          return;
+        vector<size_t>& owned = rows[id];
+        if(owned.empty())
+          order.push_back(id);
+        owned.push_back(row);
+      }
+
+      // the values of table (deterministic_metrics, say) of the owners
+      // in column (datasetID) for each of their trials
+      void spread(const Database& db, const string& table,
+                  const string& column, int64_t collection,
+                  Columns& columns) const {
+        Statement values(db, "SELECT " + column + ", metricID, metric "
+                         "FROM " + table + " WHERE " + column + " IN "
+                         "(SELECT " + column + " FROM trials "
+                         "WHERE dataCollectionID = ?)");
+        sqlite3_bind_int64(values.statement, 1, collection);
+        while(values.step()){
+          vector<double>& cells = columns[values.integer(1)];
+          if(values.null(2))
+            continue;
+          map<int64_t,vector<size_t> >::const_iterator it =
+            rows.find(values.integer(0));
+          if(it == rows.end())
+            continue;
+          for(size_t k = 0; k < it->second.size(); ++k)
+            Columns::store(cells[it->second[k]], values.real(2));
+        }
+      }
+
+      // named from table (applications, say)
+      vector<Profile::Group> groups(const Database& db,
+                                    const string& table) const {
+        Statement describe(db, "SELECT name, description FROM " + table +
+                           " WHERE ID = ?");
+        vector<Profile::Group> named;
+        for(size_t k = 0; k < order.size(); ++k){
+          sqlite3_bind_int64(describe.statement, 1, order[k]);
+          if(describe.step()){
+            Profile::Group group;
+            group.name = describe.text(0);
+            group.description = describe.text(1);
+            group.rows = rows.find(order[k])->second;
+            named.push_back(group);
+          }
+          sqlite3_reset(describe.statement);
+        }
+        return named;
+      }
+    };
+
+    void json_string(const string& text, ostream& out){
+      out << '"';
+      for(size_t k = 0; k < text.size(); ++k){
+        const unsigned char c = text[k];
+        if(c == '"' || c == '\\')
+          out << '\\' << c;
+        else if(c < 0x20){
+          char escaped[7];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out << escaped;
+        }
+        else
+          out << c;
+      }
+      out << '"';
+    }
+
+    void json_groups(const char* key, const vector<Profile::Group>& groups,
+                     ostream& out){
+      out << ",\n  \"" << key << "\": [";
+      for(size_t g = 0; g < groups.size(); ++g){
+        out << (g ? ",\n    [" : "\n    [");
+        json_string(groups[g].name, out);
+        out << ", ";
+        json_string(groups[g].description, out);
+        out << ", [";
+        for(size_t k = 0; k < groups[g].rows.size(); ++k)
+          out << (k ? ", " : "") << groups[g].rows[k];
+        out << "]]";
+      }
+      out << "]";
+    }
+
+    bool little_endian(){
+      const uint16_t one = 1;
+      unsigned char first;
+      memcpy(&first, &one, 1);
+      return first == 1;
+    }
+
+    void swap_bytes(double* values, size_t count){
+      for(size_t k = 0; k < count; ++k){
+        unsigned char* bytes = (unsigned char*)&values[k];
+        reverse(bytes, bytes + sizeof(double));
+      }
+    }
+
+    // the preamble and header of a version 1.0 .npy file of a rows by
+    // columns array of little endian doubles, padded with spaces and a
+    // newline so that the values start at a multiple of 64 bytes, as NumPy
+    // writes it
+    void npy_header(size_t rows, size_t columns, bool fortran, ostream& out){
+      ostringstream dict;
+      dict << "{'descr': '<f8', 'fortran_order': "
+           << (fortran ? "True" : "False") << ", 'shape': (" << rows
+           << ", " << columns << "), }";
+      string header = dict.str();
+      header.append(63 - (10 + header.size()) % 64, ' ');
+      header += '\n';
+      const unsigned char preamble[10] = {
+        0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+        (unsigned char)(header.size() & 0xff),
+        (unsigned char)(header.size() >> 8)};
+      out.write((const char*)preamble, sizeof(preamble));
+      out << header;
+    }
+
+    int64_t collection_id(const Database& db, const string& collection){
+      Statement find(db, "SELECT ID FROM datacollections WHERE name = ?");
+      sqlite3_bind_text(find.statement, 1, collection.c_str(), -1,
+                        SQLITE_STATIC);
+      if(!find.step())
+        throw "no data collection of that name in database.";
+      return find.integer(0);
+    }
+
+    // The IDs of the named metrics, or if there are no names, those of
+    // every metric the collection has, in order of name, and their names.
+    vector<int64_t> find_metrics(const Database& db, int64_t collection,
+                                 vector<string>& names){
+      vector<int64_t> ids;
+      if(names.empty()){
+        Statement all(db, "SELECT ID, name FROM metrics WHERE ID IN "
+                          "(SELECT metricID FROM nondeterministic_metrics "
+                          "WHERE trialID IN (SELECT ID FROM trials "
+                          "WHERE dataCollectionID = ?1) "
+                          "UNION SELECT metricID FROM deterministic_metrics "
+                          "WHERE datasetID IN (SELECT datasetID FROM trials "
+                          "WHERE dataCollectionID = ?1) "
+                          "UNION SELECT metricID FROM machine_metrics "
+                          "WHERE machineID IN (SELECT machineID FROM trials "
+                          "WHERE dataCollectionID = ?1)) "
+                          "ORDER BY name");
+        sqlite3_bind_int64(all.statement, 1, collection);
+        while(all.step()){
+          ids.push_back(all.integer(0));
+          names.push_back(all.text(1));
+        }
+        return ids;
+      }
+      Statement find(db, "SELECT ID FROM metrics WHERE name = ?");
+      for(size_t k = 0; k < names.size(); ++k){
+        sqlite3_bind_text(find.statement, 1, names[k].c_str(), -1,
+                          SQLITE_STATIC);
+        if(!find.step())
+          throw "no metric of that name in database.";
+        ids.push_back(find.integer(0));
+        sqlite3_reset(find.statement);
+      }
+      return ids;
+    }
+
+    // the values of table (deterministic_metrics, say) of the owners in
+    // column (datasetID) of the collection's trials, by owner, as the
+    // column of each value in columns
+    typedef map<int64_t,vector<pair<size_t,double> > > OwnerValues;
+
+    OwnerValues owner_values(const Database& db, const string& table,
+                             const string& column, int64_t collection,
+                             const map<int64_t,size_t>& columns){
+      Statement values(db, "SELECT " + column + ", metricID, metric "
+                       "FROM " + table + " WHERE " + column + " IN "
+                       "(SELECT " + column + " FROM trials "
+                       "WHERE dataCollectionID = ?)");
+      sqlite3_bind_int64(values.statement, 1, collection);
+      OwnerValues owned;
+      while(values.step()){
+        map<int64_t,size_t>::const_iterator it =
+          columns.find(values.integer(1));
+        if(it != columns.end() && !values.null(2))
+          owned[values.integer(0)].push_back(make_pair(it->second,
+                                                       values.real(2)));
+      }
+      return owned;
+    }
+
+    void spread(const OwnerValues& owned, int64_t owner,
+                vector<double>& values){
+      OwnerValues::const_iterator it = owned.find(owner);
+      if(it == owned.end())
+        return;
+      for(size_t k = 0; k < it->second.size(); ++k)
+        Columns::store(values[it->second[k].first], it->second[k].second);
+    }
+
+    // a trial's values, with 0 for the metrics it lacks
+    const vector<double>& finish_row(vector<double>& values){
+      for(size_t c = 0; c < values.size(); ++c)
+        if(std::isnan(values[c]))
+          values[c] = 0.0;
+      return values;
+    }
+
+    // Calls row with the values of metrics of each trial of the collection
+    // in turn, in order of trial ID, and returns the number of trials. The
+    // values of datasets and machines, of which there are few, are read
+    // first, then the trials and their own values in a single query that
+    // walks them in order.
+    template<class Row>
+    size_t stream_trials(const Database& db, int64_t collection,
+                         const vector<int64_t>& metrics, Row row){
+      map<int64_t,size_t> columns;
+      for(size_t c = 0; c < metrics.size(); ++c)
+        columns.insert(make_pair(metrics[c], c));
+      const OwnerValues datasets = owner_values(db, "deterministic_metrics",
+                                                "datasetID", collection,
+                                                columns);
+      const OwnerValues machines = owner_values(db, "machine_metrics",
+                                                "machineID", collection,
+                                                columns);
+
+      Statement trials(db, "SELECT t.ID, t.datasetID, t.machineID, "
+                           "ndm.metricID, ndm.metric FROM trials AS t "
+                           "LEFT JOIN nondeterministic_metrics AS ndm "
+                           "ON ndm.trialID = t.ID "
+                           "WHERE t.dataCollectionID = ? ORDER BY t.ID");
+      sqlite3_bind_int64(trials.statement, 1, collection);
+      vector<double> values(metrics.size());
+      size_t count = 0;
+      int64_t current = 0;
+      while(trials.step()){
+        const int64_t trial = trials.integer(0);
+        if(count == 0 || trial != current){
+          if(count > 0)
+            row(finish_row(values));
+          ++count;
+          current = trial;
+          fill(values.begin(), values.end(),
+               numeric_limits<double>::quiet_NaN());
+          spread(datasets, trials.id(1), values);
+          spread(machines, trials.id(2), values);
+        }
+        if(trials.null(3) || trials.null(4))
+          continue;
+        map<int64_t,size_t>::const_iterator it =
+          columns.find(trials.integer(3));
+        if(it != columns.end())
+          Columns::store(values[it->second], trials.real(4));
+      }
+      if(count > 0)
+        row(finish_row(values));
+      return count;
+    }
+
+  } // end anonymous namespace
+
+  vector<string> dataCollections(const string& dbname){
+    Database db(dbname);
+    Statement names(db, "SELECT name FROM datacollections ORDER BY ID");
+    vector<string> collections;
+    while(names.step())
+      collections.push_back(names.text(0));
+    return collections;
+  }
+
+  Profile extractProfile(const string& dbname, const string& collection){
+    Database db(dbname);
+    Profile profile;
+    profile.name = collection;
+
+    const int64_t id = collection_id(db, collection);
+
+    Owners applications, machines, datasets;
+    {
+      Statement trials(db, "SELECT ID, applicationID, machineID, datasetID "
+                           "FROM trials WHERE dataCollectionID = ? "
+                           "ORDER BY ID");
+      sqlite3_bind_int64(trials.statement, 1, id);
+      while(trials.step()){
+        const size_t row = profile.trials.size();
+        profile.trials.push_back(trials.integer(0));
+        applications.add(trials.id(1), row);
+        machines.add(trials.id(2), row);
+        datasets.add(trials.id(3), row);
+      }
+    }
+    const size_t rows = profile.trials.size();
+
+    Columns columns(rows);
+    {
+      // in order of trial, so that each row is found by walking the trials
+      Statement values(db, "SELECT ndm.trialID, ndm.metricID, ndm.metric "
+                           "FROM nondeterministic_metrics AS ndm "
+                           "JOIN trials AS t ON ndm.trialID = t.ID "
+                           "WHERE t.dataCollectionID = ? "
+                           "ORDER BY ndm.trialID");
+      sqlite3_bind_int64(values.statement, 1, id);
+      size_t row = 0;
+      while(values.step()){
+        vector<double>& cells = columns[values.integer(1)];
+        const int64_t trial = values.integer(0);
+        while(row < rows && profile.trials[row] < trial)
+          ++row;
+        if(row < rows && profile.trials[row] == trial && !values.null(2))
+          Columns::store(cells[row], values.real(2));
+      }
+    }
+    datasets.spread(db, "deterministic_metrics", "datasetID", id, columns);
+    machines.spread(db, "machine_metrics", "machineID", id, columns);
+    columns.finish(db, profile);
+
+    profile.applications = applications.groups(db, "applications");
+    profile.machines = machines.groups(db, "machines");
+    profile.datasets = datasets.groups(db, "datasets");
+    return profile;
+  }
+
+  void writeNpy(const Profile& profile, ostream& out){
+    const size_t rows = profile.trials.size();
+    const size_t columns = profile.columns.size();
+    npy_header(rows, columns, false, out);
+
+    const bool swap = !little_endian();
+    vector<double> block(min(rows, block_rows) * columns);
+    for(size_t first = 0; first < rows; first += block_rows){
+      const size_t count = min(block_rows, rows - first);
+      for(size_t r = 0; r < count; ++r)
+        for(size_t c = 0; c < columns; ++c)
+          block[r * columns + c] = profile.columns[c][first + r];
+      if(swap)
+        swap_bytes(&block[0], count * columns);
+      out.write((const char*)&block[0], count * columns * sizeof(double));
+    }
+  }
+
+  void writeMetadata(const Profile& profile, const string& npy,
+                     ostream& out){
+    out << "{\n  \"name\": ";
+    json_string(profile.name, out);
+    out << ",\n  \"profile\": ";
+    json_string(npy, out);
+    out << ",\n  \"trials\": [";
+    for(size_t k = 0; k < profile.trials.size(); ++k)
+      out << (k ? ", " : "") << profile.trials[k];
+    out << "],\n  \"metrics\": [";
+    for(size_t m = 0; m < profile.metrics.size(); ++m){
+      out << (m ? ",\n    [" : "\n    [");
+      json_string(profile.metrics[m].name, out);
+      out << ", ";
+      json_string(profile.metrics[m].description, out);
+      out << ", ";
+      json_string(profile.metrics[m].type, out);
+      out << "]";
+    }
+    out << "]";
+    json_groups("applications", profile.applications, out);
+    json_groups("machines", profile.machines, out);
+    json_groups("datasets", profile.datasets, out);
+    out << "\n}\n";
+  }
+
+  size_t writeCSV(const string& dbname, const string& collection,
+                  const vector<string>& metrics, ostream& out){
+    Database db(dbname);
+    const int64_t id = collection_id(db, collection);
+    vector<string> names(metrics);
+    const vector<int64_t> ids = find_metrics(db, id, names);
+    for(size_t c = 0; c < names.size(); ++c)
+      out << (c ? "," : "") << names[c];
+    out << '\n';
+
+    // written a block at a time rather than a value at a time
+    string text;
+    char value[max_double_chars];
+    const size_t count = stream_trials(db, id, ids,
+                                       [&](const vector<double>& row){
+      for(size_t c = 0; c < row.size(); ++c){
+        if(c)
+          text += ',';
+        text.append(value, format_double(row[c], value));
+      }
+      text += '\n';
+      if(text.size() >= 65536){
+        out.write(text.data(), text.size());
+        text.clear();
+      }
+    });
+    out.write(text.data(), text.size());
+    if(!out)
+      throw "unable to write the profile.";
+    return count;
+  }
+
+  size_t writeColumns(const string& dbname, const string& collection,
+                      const vector<string>& metrics, const string& path){
+    Database db(dbname);
+    // so that the trials counted are the trials read
+    sqlite3_exec(db.db, "BEGIN", NULL, NULL, NULL);
+    const int64_t id = collection_id(db, collection);
+    vector<string> names(metrics);
+    const vector<int64_t> ids = find_metrics(db, id, names);
+    size_t rows;
+    {
+      Statement count(db, "SELECT COUNT(*) FROM trials "
+                          "WHERE dataCollectionID = ?");
+      sqlite3_bind_int64(count.statement, 1, id);
+      count.step();
+      rows = count.integer(0);
+    }
+
+    ofstream out(path.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!out.is_open())
+      throw "unable to write the profile.";
+    npy_header(rows, ids.size(), true, out);
+    const streamoff start = out.tellp();
+
+    // each column's next block_rows values, written to its part of the
+    // file once they are all read
+    const size_t columns = ids.size();
+    const bool swap = !little_endian();
+    vector<double> block(block_rows * columns);
+    size_t first = 0, filled = 0;
+    auto flush = [&](){
+      for(size_t c = 0; c < columns; ++c){
+        double* values = &block[c * block_rows];
+        if(swap)
+          swap_bytes(values, filled);
+        out.seekp(start + (streamoff)((c * rows + first) * sizeof(double)));
+        out.write((const char*)values, filled * sizeof(double));
+      }
+      first += filled;
+      filled = 0;
+    };
+    const size_t count = stream_trials(db, id, ids,
+                                       [&](const vector<double>& row){
+      if(first + filled == rows)
+        throw "database changed while it was read.";
+      for(size_t c = 0; c < columns; ++c)
+        block[c * block_rows + filled] = row[c];
+      if(++filled == block_rows)
+        flush();
+    });
+    flush();
+    if(count != rows)
+      throw "database changed while it was read.";
+    out.close();
+    if(out.fail())
+      throw "unable to write the profile.";
+    return count;
+  }
+
+} // end namespace eiger
@@ -0,0 +1,85 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Reads a data collection out of an Eiger database in one
+* pass over each table of metric values, for eiger-extract
+* to write as a NumPy array that Eiger.py can map rather
+* than query, and streams it a trial at a time for
+* eiger-export.
+*
+**********************************************************/
+
+#ifndef PROFILEEXTRACT_H_INCLUDED
+#define PROFILEEXTRACT_H_INCLUDED
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace eiger{
+
+  // A data collection as DataCollection in eiger/database.py holds it: a
+  // row to each trial and a column to each metric that any of them has.
+  struct Profile {
+    struct Metric {
+      std::string name, description, type;
+    };
+    // an application, machine or dataset, and the rows of its trials
+    struct Group {
+      std::string name, description;
+      std::vector<size_t> rows;
+    };
+
+    std::string name;
+    // the ID of the trial of each row, in increasing order
+    std::vector<int64_t> trials;
+    // in order of name
+    std::vector<Metric> metrics;
+    // in order of their first trial
+    std::vector<Group> applications, machines, datasets;
+    // a column of trials.size() values to each metric. A trial without a
+    // metric has 0, and of several values of a metric the largest is kept,
+    // as in database.iterProfile.
+    std::vector<std::vector<double> > columns;
+  };
+
+  // the names of the data collections in the database file dbname
+  std::vector<std::string> dataCollections(const std::string& dbname);
+
+  // Reads the collection from the database file dbname with a query for
+  // its trials and one for each of the nondeterministic, deterministic and
+  // machine metric tables; throws if there is no such collection.
+  Profile extractProfile(const std::string& dbname,
+                         const std::string& collection);
+
+  // The values of profile as a version 1.0 .npy file of little endian
+  // doubles, a row to each trial, which numpy.load can memory-map.
+  void writeNpy(const Profile& profile, std::ostream& out);
+
+  // The rest of profile as a JSON object, naming npy as the file of its
+  // values.
+  void writeMetadata(const Profile& profile, const std::string& npy,
+                     std::ostream& out);
+
+  // Writes the collection in the database file dbname to out as CSV: a
+  // header of the names of metrics, then a row of their values to each
+  // trial in order of trial ID, the values as in extractProfile. With no
+  // metrics, every metric of the collection is written, in order of name.
+  // Only a trial's values are held at a time, so memory doesn't grow with
+  // the collection. Returns the number of trials; throws if there is no
+  // such collection or metric.
+  size_t writeCSV(const std::string& dbname, const std::string& collection,
+                  const std::vector<std::string>& metrics, std::ostream& out);
+
+  // As writeCSV, but to a version 1.0 .npy file at path of the columns one
+  // after another, in Fortran order, so that each metric's values can be
+  // mapped on their own. A block of rows of each column is held at a time.
+  size_t writeColumns(const std::string& dbname,
+                      const std::string& collection,
+                      const std::vector<std::string>& metrics,
+                      const std::string& path);
+
+} // end namespace eiger
+
+#endif
@@ -0,0 +1,311 @@
+/**********************************************************
+* Eiger Performance Modeling Framework
+*
+* Checks eiger-extract's reading of a data collection and
+* the .npy and JSON files it writes of it, and the CSV and
+* columns eiger-export streams.
+*
+**********************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "sqlite3.h"
+
+#include "fakelog.h"
+#include "profileextract.h"
+
+static int failures = 0;
+
+static void make_database(const char* dbname) {
+  std::ifstream in(SCHEMA);
+  std::stringstream schema;
+  schema << in.rdbuf();
+  sqlite3* db;
+  sqlite3_open(dbname, &db);
+  sqlite3_exec(db, schema.str().c_str(), NULL, NULL, NULL);
+  // trial 2 is of another collection, trial 6 has no dataset, misses has
+  // no value in mine and aaa none at all
+  sqlite3_exec(db,
+      "INSERT INTO datacollections(ID, name) VALUES(1, 'other');"
+      "INSERT INTO datacollections(ID, name) VALUES(2, 'mine');"
+      "INSERT INTO applications VALUES(1, 'hpccg', 'conjugate \"gradient\"');"
+      "INSERT INTO applications VALUES(2, 'lulesh', 'hydro');"
+      "INSERT INTO datasets(ID, applicationID, name) VALUES(1, 1, 'small');"
+      "INSERT INTO datasets(ID, applicationID, name) VALUES(2, 1, 'large');"
+      "INSERT INTO datasets(ID, applicationID, name) VALUES(3, 2, 'cube');"
+      "INSERT INTO machines VALUES(1, 'atom', 'x');"
+      "INSERT INTO machines VALUES(2, 'xeon', 'y');"
+      "INSERT INTO metrics VALUES(1, 'deterministic', 'bytes', 'read');"
+      "INSERT INTO metrics VALUES(2, 'nondeterministic', 'time', 's');"
+      "INSERT INTO metrics VALUES(3, 'machine', 'cores', 'per node');"
+      "INSERT INTO metrics VALUES(4, 'nondeterministic', 'aaa', '');"
+      "INSERT INTO metrics VALUES(5, 'nondeterministic', 'misses', '');"
+      "INSERT INTO metrics VALUES(6, 'nondeterministic', 'energy', 'J');"
+      "INSERT INTO trials VALUES(1, 2, 1, 1, 1);"
+      "INSERT INTO trials VALUES(2, 1, 2, 2, 3);"
+      "INSERT INTO trials VALUES(3, 2, 2, 2, 3);"
+      "INSERT INTO trials VALUES(4, 2, 1, 1, 2);"
+      "INSERT INTO trials VALUES(5, 2, 2, 1, 1);"
+      "INSERT INTO trials VALUES(6, 2, 1, 1, NULL);"
+      "INSERT INTO nondeterministic_metrics VALUES(3, 2, -1.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(1, 2, 3.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(1, 2, 2.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(4, 2, 5.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(5, 2, 7.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(6, 2, 1.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(2, 2, 99.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(2, 4, 0.1);"
+      "INSERT INTO nondeterministic_metrics VALUES(1, 5, NULL);"
+      "INSERT INTO nondeterministic_metrics VALUES(3, 6, -7.0);"
+      "INSERT INTO nondeterministic_metrics VALUES(3, 6, -5.0);"
+      "INSERT INTO deterministic_metrics VALUES(1, 1, 100.0);"
+      "INSERT INTO deterministic_metrics VALUES(2, 1, 200.0);"
+      "INSERT INTO deterministic_metrics VALUES(3, 1, 300.0);"
+      "INSERT INTO machine_metrics VALUES(1, 3, 4.0);"
+      "INSERT INTO machine_metrics VALUES(2, 3, 16.0);",
+      NULL, NULL, NULL);
+  sqlite3_close(db);
+}
+
+// columns bytes, cores, energy, misses and time of trials 1, 3, 4, 5 and 6
+static const double want[5][5] = {{100, 4, 0, 0, 3},
+                                  {300, 16, -5, 0, -1},
+                                  {200, 4, 0, 0, 5},
+                                  {100, 16, 0, 0, 7},
+                                  {0, 4, 0, 0, 1}};
+
+static void expect_rows(const char* what, const eiger::Profile::Group& group,
+                        const char* name, const std::vector<size_t>& rows) {
+  if (group.name != name || group.rows != rows) {
+    printf("%s %s is wrong\n", what, group.name.c_str());
+    ++failures;
+  }
+}
+
+static void check_profile(const eiger::Profile& profile) {
+  const int64_t trials[] = {1, 3, 4, 5, 6};
+  const char* names[] = {"bytes", "cores", "energy", "misses", "time"};
+  if (profile.trials != std::vector<int64_t>(trials, trials + 5) ||
+      profile.metrics.size() != 5 || profile.columns.size() != 5) {
+    printf("%zu trials and %zu metrics, expected 5 and 5\n",
+           profile.trials.size(), profile.metrics.size());
+    ++failures;
+    return;
+  }
+  for (int m = 0; m < 5; ++m) {
+    if (profile.metrics[m].name != names[m]) {
+      printf("metric %d is %s, expected %s\n", m,
+             profile.metrics[m].name.c_str(), names[m]);
+      ++failures;
+    }
+    for (int r = 0; r < 5; ++r)
+      if (profile.columns[m][r] != want[r][m]) {
+        printf("%s of trial %d is %g, expected %g\n", names[m],
+               (int)trials[r], profile.columns[m][r], want[r][m]);
+        ++failures;
+      }
+  }
+  if (profile.metrics[0].type != "deterministic" ||
+      profile.metrics[1].description != "per node") {
+    printf("the metric descriptions are wrong\n");
+    ++failures;
+  }
+
+  if (profile.applications.size() != 2 || profile.machines.size() != 2 ||
+      profile.datasets.size() != 3) {
+    printf("%zu applications, %zu machines and %zu datasets\n",
+           profile.applications.size(), profile.machines.size(),
+           profile.datasets.size());
+    ++failures;
+    return;
+  }
+  expect_rows("application", profile.applications[0], "hpccg", {0, 2, 3, 4});
+  expect_rows("application", profile.applications[1], "lulesh", {1});
+  expect_rows("machine", profile.machines[0], "atom", {0, 2, 4});
+  expect_rows("machine", profile.machines[1], "xeon", {1, 3});
+  expect_rows("dataset", profile.datasets[0], "small", {0, 3});
+  expect_rows("dataset", profile.datasets[1], "cube", {1});
+  expect_rows("dataset", profile.datasets[2], "large", {2});
+}
+
+static void check_files(const eiger::Profile& profile) {
+  std::ostringstream npy;
+  eiger::writeNpy(profile, npy);
+  const std::string bytes = npy.str();
+  const size_t header = (unsigned char)bytes[8] | (unsigned char)bytes[9] << 8;
+  const size_t values = 10 + header;
+  if (bytes.compare(0, 8, "\x93NUMPY\x01\x00", 8) != 0 || values % 64 != 0 ||
+      bytes[values - 1] != '\n' ||
+      bytes.find("{'descr': '<f8', 'fortran_order': False, "
+                 "'shape': (5, 5), }") != 10 ||
+      bytes.size() != values + sizeof(want)) {
+    printf("the .npy header is wrong\n");
+    ++failures;
+    return;
+  }
+  const unsigned char first[8] = {0, 0, 0, 0, 0, 0, 0x59, 0x40};  // 100.0
+  if (memcmp(&bytes[values], first, 8) != 0) {
+    printf("the .npy values are not little endian doubles\n");
+    ++failures;
+  }
+  double got[5][5];
+  memcpy(got, &bytes[values], sizeof(got));
+  if (memcmp(got, want, sizeof(want)) != 0) {
+    printf("the .npy values are wrong\n");
+    ++failures;
+  }
+
+  std::ostringstream json;
+  eiger::writeMetadata(profile, "mine.npy", json);
+  const char* parts[] = {
+    "\"name\": \"mine\"", "\"profile\": \"mine.npy\"",
+    "\"trials\": [1, 3, 4, 5, 6]",
+    "[\"bytes\", \"read\", \"deterministic\"]",
+    "[\"hpccg\", \"conjugate \\\"gradient\\\"\", [0, 2, 3, 4]]",
+    "[\"large\", \"\", [2]]"};
+  for (int k = 0; k < 6; ++k)
+    if (json.str().find(parts[k]) == std::string::npos) {
+      printf("the metadata lacks %s\n", parts[k]);
+      ++failures;
+    }
+}
+
+static void check_export(const std::string& dbname, const char* dir) {
+  std::ostringstream csv;
+  size_t rows = eiger::writeCSV(dbname, "mine", {}, csv);
+  if (rows != 5 || csv.str() != "bytes,cores,energy,misses,time\n"
+                                "100,4,0,0,3\n300,16,-5,0,-1\n"
+                                "200,4,0,0,5\n100,16,0,0,7\n0,4,0,0,1\n") {
+    printf("the CSV of mine is wrong:\n%s", csv.str().c_str());
+    ++failures;
+  }
+  // in the order named, and 0.1 as it was written
+  std::ostringstream some;
+  eiger::writeCSV(dbname, "other", {"aaa", "time", "bytes"}, some);
+  if (some.str() != "aaa,time,bytes\n0.1,99,300\n") {
+    printf("the CSV of some metrics is wrong:\n%s", some.str().c_str());
+    ++failures;
+  }
+  try {
+    std::ostringstream none;
+    eiger::writeCSV(dbname, "mine", {"nothing"}, none);
+    printf("a missing metric was exported\n");
+    ++failures;
+  } catch (const char*) {
+  }
+
+  const std::string path = std::string(dir) + "/mine.npy";
+  rows = eiger::writeColumns(dbname, "mine", {}, path);
+  std::ifstream in(path.c_str(), std::ios::binary);
+  std::stringstream npy;
+  npy << in.rdbuf();
+  unlink(path.c_str());
+  const std::string bytes = npy.str();
+  const size_t values = 10 + ((unsigned char)bytes[8] |
+                              (unsigned char)bytes[9] << 8);
+  if (rows != 5 || values % 64 != 0 ||
+      bytes.find("{'descr': '<f8', 'fortran_order': True, "
+                 "'shape': (5, 5), }") != 10 ||
+      bytes.size() != values + sizeof(want)) {
+    printf("the .npy header of the columns is wrong\n");
+    ++failures;
+    return;
+  }
+  double got[5][5];
+  memcpy(got, &bytes[values], sizeof(got));
+  for (int m = 0; m < 5; ++m)
+    for (int r = 0; r < 5; ++r)
+      if (got[m][r] != want[r][m]) {
+        printf("column %d of trial %d is %g, expected %g\n", m, r,
+               got[m][r], want[r][m]);
+        ++failures;
+      }
+}
+
+// values that need every digit, or are easily written wrong, come back from
+// the CSV with the same bits; not -0, which sqlite stores as 0
+static void check_round_trip(const char* dir) {
+  const double values[] = {0.1 + 0.2, 1.0 / 3.0, 1e15, 123456789012345678.0,
+                           1.5e-7, 4.9e-324, 2.2250738585072009e-308,
+                           1.7976931348623157e308, -2.5};
+  const size_t count = sizeof(values) / sizeof(values[0]);
+  const std::string dbname = std::string(dir) + "/digits.db";
+  make_database(dbname.c_str());
+  sqlite3* db;
+  sqlite3_open(dbname.c_str(), &db);
+  sqlite3_stmt* insert;
+  sqlite3_prepare_v2(db, "INSERT INTO nondeterministic_metrics "
+                         "VALUES(?, 4, ?)", -1, &insert, NULL);
+  for (size_t i = 0; i < count; ++i) {
+    sqlite3_exec(db, "INSERT INTO trials VALUES(NULL, 1, 1, 1, 1)", NULL,
+                 NULL, NULL);
+    sqlite3_bind_int64(insert, 1, sqlite3_last_insert_rowid(db));
+    sqlite3_bind_double(insert, 2, values[i]);
+    sqlite3_step(insert);
+    sqlite3_reset(insert);
+  }
+  sqlite3_finalize(insert);
+  sqlite3_close(db);
+
+  std::ostringstream csv;
+  eiger::writeCSV(dbname, "other", {"aaa"}, csv);
+  unlink(dbname.c_str());
+  std::istringstream lines(csv.str());
+  std::string line;
+  std::getline(lines, line);
+  // trial 2, then those just inserted
+  std::getline(lines, line);
+  for (size_t i = 0; i < count; ++i) {
+    double x;
+    if (!std::getline(lines, line) || !eiger::parse_double(line, x) ||
+        memcmp(&x, &values[i], sizeof(x)) != 0) {
+      printf("%.17g was exported as %s\n", values[i], line.c_str());
+      ++failures;
+    }
+  }
+}
+
+int main() {
+  char dir[] = "/tmp/profileextract_test.XXXXXX";
+  if (!mkdtemp(dir)) return 1;
+  const std::string dbname = std::string(dir) + "/eiger.db";
+  make_database(dbname.c_str());
+
+  try {
+    const std::vector<std::string> collections =
+        eiger::dataCollections(dbname);
+    if (collections.size() != 2 || collections[1] != "mine") {
+      printf("the data collections are wrong\n");
+      ++failures;
+    }
+    const eiger::Profile profile = eiger::extractProfile(dbname, "mine");
+    check_profile(profile);
+    check_files(profile);
+    if (eiger::extractProfile(dbname, "other").metrics.size() != 4) {
+      printf("the other collection has the wrong metrics\n");
+      ++failures;
+    }
+    check_export(dbname, dir);
+    check_round_trip(dir);
+  } catch (const char* msg) {
+    printf("%s\n", msg);
+    ++failures;
+  }
+  try {
+    eiger::extractProfile(dbname, "nothing");
+    printf("a missing data collection was extracted\n");
+    ++failures;
+  } catch (const char*) {
+  }
+
+  unlink(dbname.c_str());
+  rmdir(dir);
+  return failures ? 1 : 0;
+}
@@ -13,6 +13,8 @@ DROP TABLE IF EXISTS datasets;
 DROP TABLE IF EXISTS applications;
 DROP TABLE IF EXISTS datacollections;
 DROP TABLE IF EXISTS r_models;
+DROP TABLE IF EXISTS loaded_log_trials;
+DROP TABLE IF EXISTS loaded_logs;
 
 CREATE TABLE model_sources(
     ID INTEGER PRIMARY KEY,
@@ -28,6 +30,14 @@ CREATE TABLE models(
     data BLOB
 );
 
+-- what an incremental update of a model starts from, as Incremental.py
+-- writes it
+CREATE TABLE model_statistics(
+    modelID INTEGER PRIMARY KEY REFERENCES models(ID)
+        ON DELETE CASCADE ON UPDATE CASCADE,
+    data BLOB
+);
+
 --
 -- Tables to maintain a data collection
 --
@@ -120,3 +130,27 @@ CREATE TABLE deterministic_metrics(
 
 CREATE INDEX det_metrics_dset_idx ON deterministic_metrics(datasetID);
 
+-- Logs loaded by eiger-loader, by a hash of their contents, so that loading
+-- the same logs again skips the ones already here. records and prefix (a
+-- hash of those records) say how far a log that was cut short or whose load
+-- was interrupted got, so that loading it again resumes there.
+CREATE TABLE loaded_logs(
+    hash TEXT PRIMARY KEY,
+    filename TEXT,
+    status TEXT,
+    databases INTEGER,
+    loaded TEXT,
+    records INTEGER,
+    prefix TEXT
+);
+
+-- The trials each loaded log inserted, as runs of consecutive IDs, so that
+-- loading it again can replace them.
+CREATE TABLE loaded_log_trials(
+    hash TEXT REFERENCES loaded_logs(hash),
+    first INTEGER,
+    last INTEGER
+);
+
+CREATE INDEX loaded_log_trials_idx ON loaded_log_trials(hash);
+
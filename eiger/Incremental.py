@@ -0,0 +1,260 @@
+# \file Incremental.py
+#
+# \brief keeps what a trained model needs of its training trials to take in
+#        newly appended trials without training again
+#
+
+import json
+import numpy as np
+
+import LinearRegression
+import native
+
+def _basis(X, functions, threads=0):
+    """Every function evaluated on every row of X, a column to a function."""
+    if native.available():
+        return native.basis(X, functions, threads)
+    return np.array([[function(row) for function in functions] for row in X],
+                    dtype=float).reshape((X.shape[0], len(functions)))
+
+class Statistics:
+    """
+    The sufficient statistics of a model for its training trials:
+        the count, means and co-moments of the metrics, to tell how far new
+        trials have drifted from those the model was trained on;
+        the model's rotation and normalization, which stay fixed;
+        for each cluster, the sum and count of its trials in the normalized
+        space of the centers, whose mean is its center;
+        for each cluster, with its functions F of the rotated trials fixed,
+        F'F, F'y, the sum of y and y'y for the target y, from which its
+        least squares weights and their fit follow.
+
+    Adding trials assigns them to the nearest center and adds them to all of
+    these, so a model updated from new trials has the weights it would have
+    if its functions were fit to all the trials again.
+    """
+    def __init__(self, collection, target, metric_names, last_trial, count,
+                 mean, comoment, rotation_matrix, means, stdevs, clusters):
+        self.collection = collection
+        self.target = target
+        self.metric_names = list(metric_names)
+        # the newest trial that has been added
+        self.last_trial = last_trial
+        self.count = count
+        self.mean = np.asarray(mean, dtype=float)
+        self.comoment = np.asarray(comoment, dtype=float)
+        self.rotation_matrix = np.asarray(rotation_matrix, dtype=float)
+        self.means = np.asarray(means, dtype=float)
+        self.stdevs = np.asarray(stdevs, dtype=float)
+        # dicts of center, sum, count, functions (their encodings), weights,
+        # gram, moment, target_sum and target_squares
+        self.clusters = clusters
+
+    @classmethod
+    def fromTraining(cls, collection, target, metric_names, last_trial,
+                     profile, performance, rotation_matrix, means, stdevs,
+                     centers, labels, models, threads=0):
+        """
+        The statistics of a model just trained on profile, a row of metrics
+        to a trial, for the given performance, with the model's cluster
+        centers and the cluster of each trial.
+        """
+        profile = np.asarray(profile, dtype=float)
+        columns = len(metric_names)
+        stats = cls(collection, target, metric_names, last_trial, 0,
+                    np.zeros(columns), np.zeros((columns, columns)),
+                    rotation_matrix, means, stdevs, [])
+        for center, model in zip(centers, models):
+            functions = [repr(f) for f in model.functions]
+            p = len(functions)
+            stats.clusters.append({
+                'center': np.array(center, dtype=float), 'count': 0,
+                'sum': np.zeros(len(center)), 'functions': functions,
+                'weights': np.array(model.weights, dtype=float).ravel(),
+                'gram': np.zeros((p, p)), 'moment': np.zeros(p),
+                'target_sum': 0.0, 'target_squares': 0.0})
+        stats._add(profile, np.asarray(performance, dtype=float).ravel(),
+                   np.asarray(labels), threads)
+        return stats
+
+    def add(self, profile, performance, threads=0):
+        """
+        Adds new trials, each to the cluster of the nearest center, with the
+        centers as they were before any of them were added.
+        """
+        profile = np.asarray(profile, dtype=float)
+        if profile.shape[0] == 0:
+            return
+        normalized = (np.dot(profile, self.rotation_matrix) - self.means) / \
+                     self.stdevs
+        centers = np.array([self._center(c) for c in self.clusters])
+        distances = np.array([np.sum(np.square(normalized - center), axis=1)
+                              for center in centers])
+        self._add(profile, np.asarray(performance, dtype=float).ravel(),
+                  np.argmin(distances, axis=0), threads)
+
+    def _add(self, profile, performance, labels, threads):
+        # moments merged by the pairwise update of Chan, Golub and LeVeque
+        n = profile.shape[0]
+        if n == 0:
+            return
+        mean = np.mean(profile, axis=0)
+        centred = profile - mean
+        comoment = np.dot(centred.T, centred)
+        total = self.count + n
+        delta = mean - self.mean
+        self.comoment += comoment + np.outer(delta, delta) * self.count * n / \
+                         float(total)
+        self.mean += delta * n / float(total)
+        self.count = total
+
+        rotated = np.dot(profile, self.rotation_matrix)
+        normalized = (rotated - self.means) / self.stdevs
+        for i, cluster in enumerate(self.clusters):
+            members = labels == i
+            if not np.any(members):
+                continue
+            y = performance[members]
+            F = _basis(rotated[members],
+                       [LinearRegression.stringToFunction(f)
+                        for f in cluster['functions']], threads)
+            cluster['sum'] += np.sum(normalized[members], axis=0)
+            cluster['count'] += len(y)
+            cluster['gram'] += np.dot(F.T, F)
+            cluster['moment'] += np.dot(F.T, y)
+            cluster['target_sum'] += float(np.sum(y))
+            cluster['target_squares'] += float(np.dot(y, y))
+
+    def _center(self, cluster):
+        if cluster['count'] == 0:
+            return cluster['center']
+        return cluster['sum'] / cluster['count']
+
+    def drift(self):
+        """
+        How far the trials have moved from the normalization of the model:
+        the largest change, over its components, of the mean or standard
+        deviation of all trials in units of the model's standard deviation.
+        """
+        if self.count < 2:
+            return 0.0
+        mean = np.dot(self.mean, self.rotation_matrix)
+        covariance = np.dot(self.rotation_matrix.T,
+                            np.dot(self.comoment, self.rotation_matrix)) / \
+                     (self.count - 1)
+        stdevs = np.sqrt(np.maximum(np.diag(covariance), 0.0))
+        return float(max(np.max(np.abs(mean - self.means) / self.stdevs),
+                         np.max(np.abs(stdevs / self.stdevs - 1.0))))
+
+    def fit(self):
+        """
+        The centers and least squares weights of every cluster for all the
+        trials added, with the r squared of each fit; a cluster without
+        trials keeps its weights.
+
+        returns (centers, [LinearRegression.Model], [r squared])
+        """
+        centers = []
+        models = []
+        r_squared = []
+        for cluster in self.clusters:
+            centers.append(self._center(cluster))
+            functions = [LinearRegression.stringToFunction(f)
+                         for f in cluster['functions']]
+            n = cluster['count']
+            if n == 0:
+                models.append(LinearRegression.Model(functions,
+                                                     cluster['weights']))
+                r_squared.append(float('nan'))
+                continue
+            # solved with the columns scaled to unit length, so that functions
+            # of very different sizes don't make the solve lose precision
+            gram = cluster['gram']
+            diagonal = np.diag(gram)
+            scale = np.where(diagonal > 0, 1.0 / np.sqrt(np.where(
+                diagonal > 0, diagonal, 1.0)), 0.0)
+            scaled = gram * np.outer(scale, scale)
+            weights = scale * np.dot(np.linalg.pinv(scaled, 1e-12),
+                                     scale * cluster['moment'])
+            cluster['weights'] = weights
+            rss = cluster['target_squares'] - \
+                  2 * np.dot(weights, cluster['moment']) + \
+                  np.dot(weights, np.dot(gram, weights))
+            tss = cluster['target_squares'] - cluster['target_sum'] ** 2 / n
+            models.append(LinearRegression.Model(functions, weights))
+            r_squared.append(1 - max(rss, 0.0) / tss if tss > 0 else 1.0)
+        return (np.array(centers), models, r_squared)
+
+    def toJSON(self):
+        clusters = []
+        for cluster in self.clusters:
+            clusters.append(dict((key, value.tolist()
+                                  if isinstance(value, np.ndarray) else value)
+                                 for key, value in cluster.items()))
+        return json.dumps({'format': 1,
+                           'collection': self.collection,
+                           'target': self.target,
+                           'metric_names': self.metric_names,
+                           'last_trial': self.last_trial,
+                           'count': self.count,
+                           'mean': self.mean.tolist(),
+                           'comoment': self.comoment.tolist(),
+                           'rotation_matrix': self.rotation_matrix.tolist(),
+                           'means': self.means.tolist(),
+                           'stdevs': self.stdevs.tolist(),
+                           'clusters': clusters})
+
+    @classmethod
+    def fromJSON(cls, text):
+        root = json.loads(text)
+        if root.get('format') != 1:
+            raise ValueError('unknown format of model statistics')
+        clusters = []
+        for cluster in root['clusters']:
+            for key in ('center', 'sum', 'weights', 'gram', 'moment'):
+                cluster[key] = np.array(cluster[key], dtype=float)
+            clusters.append(cluster)
+        return cls(root['collection'], root['target'], root['metric_names'],
+                   root['last_trial'], root['count'], root['mean'],
+                   root['comoment'], root['rotation_matrix'], root['means'],
+                   root['stdevs'], clusters)
+
+#################################################################################################
+#
+#
+if __name__ == "__main__":
+    # statistics built from half of the trials and updated with the rest
+    # should have the moments of all the trials, and fit nearly as they do;
+    # only trials the moving centers assign differently fit differently
+    rng = np.random.RandomState(0)
+    X = rng.normal(size=(1000, 3)) * [1, 10, 100] + [0, 50, 500]
+    y = 2 * X[:, 0] + 0.01 * X[:, 2] ** 2 + rng.normal(size=1000)
+    rotation = np.eye(3)
+    means = np.mean(X, axis=0)
+    stdevs = np.std(X, axis=0, ddof=1)
+    normalized = (X - means) / stdevs
+    centers = np.array([[-1.0, 0, 0], [1.0, 0, 0]])
+    for iteration in range(20):
+        labels = np.argmin([np.sum(np.square(normalized - c), axis=1)
+                            for c in centers], axis=0)
+        centers = np.array([np.mean(normalized[labels == i], axis=0)
+                            for i in range(len(centers))])
+    functions = [LinearRegression.identityFunction(),
+                 LinearRegression.powerFunction(0, 1),
+                 LinearRegression.powerFunction(2, 2)]
+    models = [LinearRegression.Model(functions, [0.0] * 3)] * 2
+    whole = Statistics.fromTraining('c', 't', ['a', 'b', 'c'], 1000, X, y,
+                                    rotation, means, stdevs, centers, labels,
+                                    models)
+    half = Statistics.fromTraining('c', 't', ['a', 'b', 'c'], 500, X[:500],
+                                   y[:500], rotation, means, stdevs, centers,
+                                   labels[:500], models)
+    half = Statistics.fromJSON(half.toJSON())
+    half.add(X[500:], y[500:])
+    print "moments agree:", np.allclose(whole.comoment, half.comoment), \
+          np.allclose(whole.mean, half.mean)
+    (_, whole_models, whole_r2) = whole.fit()
+    (_, half_models, half_r2) = half.fit()
+    print "weights:", whole_models[0].weights, half_models[0].weights
+    print "r squared:", whole_r2, half_r2
+    print "drift:", half.drift()
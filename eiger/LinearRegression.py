@@ -13,6 +13,8 @@ import copy
 import math
 from sklearn.cross_validation import KFold
 
+import native
+
 class Function:
     """ 
     Containter for managing different representations of model functions 
@@ -48,6 +50,10 @@ class Function:
             return logFunction(regressor['index'])
         if func == 'quotient':
             return divFunction(regressor['first_idx'], regressor['second_idx'])
+        if func == 'hinge':
+            return hingeFunction(regressor['index'], regressor['knot'])
+        if func == 'mirror':
+            return mirrorFunction(regressor['index'], regressor['knot'])
         raise KeyError('Invalid function type in JSON')
 
 class Model:
@@ -109,17 +115,21 @@ class LinearRegression:
     """
     
     #
-    def __init__(self, X, Y):
+    def __init__(self, X, Y, use_native=False, threads=0):
         """
         Constructs a model selector given a set of data points and their outputs.
         
         X is m-by-n, where m is number of data points and n is number of metrics
         Y is m-by-1
+        use_native searches with libeigertrain (see native.py) instead of numpy,
+        on threads threads (0 for one per core)
         """
         self.X = X
         self.Y = Y
         self.M = X.shape[0]
         self.N = X.shape[1]
+        self.use_native = use_native
+        self.threads = threads
         
         assert(self.M == Y.shape[0])
     
@@ -141,17 +151,19 @@ class LinearRegression:
         else:
             kfold = KFold(self.M, n_folds=folds, shuffle=True)
 
+        if self.use_native:
+            candidates = self._search_folds(threshold, list(kfold), pool)
+        else:
+            candidates = (self.search_regression(threshold, train_index,
+                                                 test_index, list(pool))
+                          for train_index, test_index in kfold)
+
         rsquared = float('-inf')
         rsquared_adj = float('-inf')
         i = 0
-        for train_index, test_index in kfold:
+        for candidate, candidate_rsquared, candidate_rsquared_adj in candidates:
             print "Training fold %s" % i
             i = i + 1
-            candidate, candidate_rsquared, candidate_rsquared_adj = \
-                self.search_regression(threshold,
-                        train_index,
-                        test_index,
-                        pool)
             print "Candidate R^2: %s" % candidate_rsquared
             if(candidate_rsquared > rsquared):
                 model = candidate
@@ -159,6 +171,20 @@ class LinearRegression:
                 rsquared_adj = candidate_rsquared_adj
         return (model, rsquared, rsquared_adj)
 
+    def _search_folds(self, threshold, kfold, pool):
+        """
+        search_regression for every fold of kfold at once, on the threads of
+        libeigertrain. The pool is evaluated on every row just once, also by
+        libeigertrain.
+
+        returns a list of search_regression's results, one per fold
+        """
+        lookup = native.basis(self.X, pool, self.threads)
+        fits = native.stepwise_folds(lookup, self.Y, kfold, threshold,
+                                     self.threads)
+        return [(Model([pool[index] for index in picked], Beta), r2, r2_adj)
+                for (picked, Beta, r2, r2_adj) in fits]
+
     def search_regression(self, threshold, train_index, test_index, pool):
         """
         Performs ordinary least-squares linear regression using the data set X and the
@@ -173,6 +199,15 @@ class LinearRegression:
         test_lookup  = np.matrix([[f(x.flat) for f in pool] 
                                   for x in self.X[test_index]])
 
+        if self.use_native:
+            (picked, Beta, model_r2, model_r2_adj) = \
+                native.stepwise(train_lookup, self.Y[train_index],
+                                test_lookup, self.Y[test_index], threshold)
+            M = [original_pool[index] for index in picked]
+            for func in M:
+                pool.remove(func)
+            return (Model(M, Beta), model_r2, model_r2_adj)
+
         M = []
         Beta = []
         done = False
@@ -247,7 +282,9 @@ def stringToFunction(encoded_string):
                            crossFunction,
                            sqrtFunction,
                            logFunction,
-                           divFunction]
+                           divFunction,
+                           hingeFunction,
+                           mirrorFunction]
     encoding = encoded_string.split()
     return function_generators[int(encoding[0])](*encoding[1:])
 
@@ -280,6 +317,19 @@ def divFunction(i,j):
     json = {"function": "quotient", "first_idx": i, "second_idx": j}
     return Function(fn, '5 %s %s' % (i,j), json, 'x[%s] / x[%s]' % (i,j))
 
+def hingeFunction(i,c):
+    fn = lambda x: x[int(i)] - float(c) if x[int(i)] > float(c) else 0.0
+    json = {"function": "hinge", "index": i, "knot": c}
+    # knots are written exactly, as they come from the data
+    return Function(fn, '6 %s %r' % (i,float(c)), json,
+                    'max(x[%s] - %s, 0)' % (i,c))
+
+def mirrorFunction(i,c):
+    fn = lambda x: float(c) - x[int(i)] if x[int(i)] < float(c) else 0.0
+    json = {"function": "mirror", "index": i, "knot": c}
+    return Function(fn, '7 %s %r' % (i,float(c)), json,
+                    'max(%s - x[%s], 0)' % (c,i))
+
 def powerLadderPool(Xshape):
     pool = [identityFunction()]
     for i in range(Xshape[1]):
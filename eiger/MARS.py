@@ -3,6 +3,9 @@ import numpy as np
 import copy
 import operator
 
+import LinearRegression
+import native
+
 class MARS:
     """
     Multivariate Adaptive Regression Splines
@@ -10,16 +13,27 @@ class MARS:
     A smarter way to do regression. Non-parametric modeling that learns the model
     functions from the data itself.
     """
-    def __init__(self, X, Y, maxM, max_interactions, modelID=None, db=None):
+    def __init__(self, X, Y, maxM, max_interactions, modelID=None, db=None,
+                 use_native=None, threads=0):
         """
         Train the MARS model to up to maxM functions and an order
         of interactions up to max_interactions.
+
+        With libeigertrain (by default whenever it can be loaded), the model
+        is trained natively on threads threads, 0 for one per core, scoring
+        every knot of a variable in one pass over the rows rather than
+        refitting the model for each.
         """
         if modelID is not None:
             self.fromDatabase(modelID, db)
             return
         self.X = X
         self.Y = Y
+        if use_native is None:
+            use_native = native.available()
+        if use_native:
+            self._trainNative(maxM, max_interactions, threads)
+            return
 
         def helper1(i,j):
             return "3 %s %s" % (j, self.X[i,j])
@@ -74,6 +88,15 @@ class MARS:
         self.functions = [[lookup[y] for y in x] for x in model]
         self.weights = [x for x in betas.flat]
 
+    def _trainNative(self, maxM, max_interactions, threads):
+        (terms, weights, self.rss, self.gcv) = native.mars(
+            np.atleast_2d(self.X), self.Y, maxM, max_interactions, threads)
+        # the encodings of toFile
+        self.functions = [["%s %s %r" % (3 if positive else 4, j, c)
+                           for (j, c, positive) in term] or ["0"]
+                          for term in terms]
+        self.weights = weights
+
     def find_min_gcv(self, model, betas, tError):
         """
         Recursive call to find the minimum gcv be eliminating one term at
@@ -202,6 +225,29 @@ class MARS:
         for function in self.functions:
             fid.write("%s\n" % (' '.join(function)))
 
+    def toModel(self):
+        """
+        This model as a LinearRegression.Model of hinge functions, which
+        Eiger.py writes to model files the C++ runtime evaluates. Only a
+        model without interactions fits, as model files have no products
+        of hinges.
+        """
+        functions = []
+        for function in self.functions:
+            if len(function) != 1:
+                raise ValueError('a MARS term with more than one hinge '
+                                 'has no model file encoding')
+            f = function[0].split()
+            if f[0] == '0':
+                functions.append(LinearRegression.identityFunction())
+            elif f[0] == '3':
+                functions.append(LinearRegression.hingeFunction(int(f[1]),
+                                                                float(f[2])))
+            else:
+                functions.append(LinearRegression.mirrorFunction(int(f[1]),
+                                                                 float(f[2])))
+        return LinearRegression.Model(functions, list(self.weights))
+
     def _decode(self, F):
         """
         Given an encoded string F, return a lambda expression evaluating that function
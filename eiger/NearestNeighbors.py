@@ -9,32 +9,74 @@
 import numpy as np
 import math
 
+import native
+
 #
 class NearestNeighbors:
     #
-    def __init__(self, X, Y, k):
+    def __init__(self, X, Y, k, use_native=None, threads=0):
         """
         Constructs a model selector given a set of data points and their outputs.
-        
+
         X is m-by-n, where m is number of data points and n is number of metrics
         Y is m-by-1
+
+        With libeigertrain (by default whenever it can be loaded), queries
+        are answered from a k-d tree over X, on threads threads, 0 for one
+        per core, rather than by measuring the distance to every point.
         """
         self.X = X
         self.Y = Y
         self.M = X.shape[0]
         self.N = X.shape[1]
         self.k = k
-        
+        if use_native is None:
+            use_native = native.available()
+        self.use_native = use_native
+        self.threads = threads
+
         assert(self.M == Y.shape[0])
-    
+
+        # built once, and freed with the selector
+        self.tree = None
+        if use_native:
+            self.tree = native.KDTree(X, Y, threads)
+
 #
     def poll(self, t):
-        distances = {}
-        for x,y in zip(self.X,self.Y):
-            distance = math.sqrt(np.sum(np.square(np.subtract(t,x))))
-            distances[distance] = y
-        if(0 in distances.keys()):
-            return distances[0][0,0]
-        else:
-            return sum([distances[x][0,0]/x for x in sorted(distances.keys())[:self.k]])/self.k #closest k trials
+        return self.predict(np.reshape(np.asarray(t, dtype=float),
+                                       (1, self.N)))[0]
 
+#
+    def predict(self, T):
+        """
+        The prediction for each row of T: the mean output of the data points
+        it matches exactly, if any, otherwise the mean output of its k
+        nearest, weighted by the inverse of their distance. Of data points
+        equally far away, the earlier ones are nearer.
+        """
+        if self.use_native:
+            return self.tree.predict(T, self.k)
+        X = np.asarray(self.X, dtype=float)
+        Y = np.asarray(self.Y, dtype=float).ravel()
+        T = np.asarray(T, dtype=float)
+        predictions = np.zeros(T.shape[0])
+        for q, t in enumerate(T):
+            # squared distances summed a metric at a time, as libeigertrain
+            # sums them
+            distances = np.zeros(self.M)
+            for j in range(self.N):
+                distances += np.square(t[j] - X[:,j])
+            if not np.all(np.isfinite(t)):
+                predictions[q] = float('nan')
+            elif np.any(distances == 0):
+                predictions[q] = np.mean(Y[distances == 0])
+            else:
+                weighted = 0.0
+                total = 0.0
+                for i in np.argsort(distances, kind='mergesort')[:self.k]:
+                    weight = 1.0 / math.sqrt(distances[i])
+                    weighted += weight * Y[i]
+                    total += weight
+                predictions[q] = weighted / total
+        return predictions
@@ -12,6 +12,8 @@ from scipy import linalg
 import numpy as np
 import math, cmath
 
+import native
+
 ####################################################################################################
 #
 #
@@ -44,6 +46,31 @@ class PCA:
         finally:
             np.seterr()
 
+    @classmethod
+    def fromChunks(cls, chunks, columns, scale=True, rotate=True, threads=0):
+        """
+        Constructs a PCA object from an iterable of blocks of rows with
+        columns metrics each, e.g. from database.iterProfile or slices of an
+        archived profile, with libeigertrain (see native.py). Only one block
+        is in memory at a time, and the components are those of the whole
+        profile with eigenvalues too small to tell from rounding set to 0.
+        """
+        moments = native.Moments(columns, threads)
+        for chunk in chunks:
+            moments.add(chunk)
+        pca = cls.__new__(cls)
+        pca.X = None
+        if moments.count.value < 2:
+            # as the constructor treats an empty profile or one row
+            pca.components = np.eye(columns if moments.count.value else 0)
+            pca.loadings = np.zeros((columns if moments.count.value else 0,))
+            return pca
+        (pca.loadings, pca.components) = moments.principalComponents(scale)
+        if rotate is True and pca.components.shape[1] > 0:
+            vmax = VARIMAX(pca.components)
+            (R, pca.components) = vmax.compute()
+        return pca
+
     def pc(self):
         return self.components
 
@@ -59,7 +86,7 @@ class PCA:
         targetComponents - number of components to capture
         Returns (components, loadings, componentCount, captured variance)
         """
-        cols = np.shape(self.X)[1]
+        cols = np.shape(self.components)[0]
         maxComponents = cols if targetComponents == None else targetComponents
         maxVariance = 1.1 if targetVariance == None else targetVariance
         
@@ -1,4 +1,6 @@
+import json
 import numpy as np
+import os
 import sqlite3
 
 def getModels(database_name, source_name=None):
@@ -16,17 +18,58 @@ def addModelFromFile(database_name, model_file, source_name, description=''):
     """Add a model file to DB"""
 
     conn = sqlite3.connect(database_name)
-    cursor = conn.execute('SELECT ID from model_sources where name = "' + str(source_name) + '"')
+    cursor = conn.execute('SELECT ID from model_sources where name = ?', (str(source_name),))
     source_id = cursor.fetchone()
     if source_id is None:
-        conn.execute('INSERT INTO model_sources(name) VALUES(' + str(source_name) + ')')
-        cursor = conn.execute('SELECT ID from model_sources where name = "' + str(source_name) + '"')
+        conn.execute('INSERT INTO model_sources(name) VALUES(?)', (str(source_name),))
+        cursor = conn.execute('SELECT ID from model_sources where name = ?', (str(source_name),))
         source_id = cursor.fetchone()
     with open(model_file, 'rb') as input_file:
         ablob = input_file.read()
-        cmd = 'INSERT INTO models(description,source_id,data) VALUES("' + str(description) + '",' + str(source_id[0]) + ',?)'
-        conn.execute(cmd, [sqlite3.Binary(ablob),])
+        cmd = 'INSERT INTO models(description,source_id,data) VALUES(?,?,?)'
+        cursor = conn.execute(cmd, [str(description), source_id[0], sqlite3.Binary(ablob)])
         conn.commit()
+    return cursor.lastrowid
+
+def addModelStatistics(database_name, model_id, data):
+    """Store the statistics an incremental update of a model starts from."""
+
+    conn = sqlite3.connect(database_name)
+    conn.execute('CREATE TABLE IF NOT EXISTS model_statistics('
+                 'modelID INTEGER PRIMARY KEY REFERENCES models(ID) '
+                 'ON DELETE CASCADE ON UPDATE CASCADE, data BLOB)')
+    conn.execute('INSERT OR REPLACE INTO model_statistics(modelID,data) '
+                 'VALUES(?,?)', (model_id, data))
+    conn.commit()
+
+def getModelStatistics(database_name, source_name):
+    """Get (ID, statistics) of the newest model of the source that has them,
+    or None if it has none."""
+
+    conn = sqlite3.connect(database_name)
+    try:
+        row = conn.execute('SELECT models.ID, model_statistics.data '
+                           'FROM models '
+                           'JOIN model_sources ON model_sources.ID = models.source_id '
+                           'JOIN model_statistics ON model_statistics.modelID = models.ID '
+                           'WHERE model_sources.name = ? '
+                           'ORDER BY models.ID DESC LIMIT 1',
+                           (str(source_name),)).fetchone()
+    except sqlite3.OperationalError:
+        # a database from before the table
+        return None
+    return row
+
+def getLastTrial(database_name, dc_name):
+    """Get the ID of the newest trial of a data collection, None if it has
+    none."""
+
+    conn = sqlite3.connect(database_name)
+    return conn.execute('SELECT MAX(trials.ID) FROM trials '
+                        'JOIN datacollections '
+                        'ON trials.dataCollectionID = datacollections.ID '
+                        'WHERE datacollections.name = ?',
+                        (dc_name,)).fetchone()[0]
 
 def dumpModelToFile(database_name, model_file, ID):
     """Dump model from DB to file"""
@@ -44,6 +87,98 @@ def getDataCollections(database_name):
     return cursor.fetchall()
 
 
+def iterProfile(database_name, dc_name, metric_names, rows=65536,
+                after=None, upto=None):
+    """Yield the profile of a data collection a block of trials at a time.
+
+    Each block has at most rows trials, in order of trial ID, and a column
+    for each of metric_names; metrics a trial lacks are 0, and of several
+    values of a metric the largest is kept, as in DataCollection. Unlike
+    DataCollection, only one block is in memory at a time. If given, only
+    trials with IDs over after and up to upto are read.
+
+    database_name may also be a directory written by eiger-extract, whose
+    profile is mapped rather than read.
+    """
+
+    if os.path.isdir(database_name):
+        collection = DataCollection(dc_name, database_name)
+        index = dict((metric[0], column) for column, metric
+                     in enumerate(collection.metrics))
+        profile = collection.profile
+        trials = np.array(sorted(collection._trial_id_map), dtype=np.int64)
+        begin = 0 if after is None else \
+                int(np.searchsorted(trials, after, side='right'))
+        end = profile.shape[0] if upto is None else \
+              int(np.searchsorted(trials, upto, side='right'))
+        for first in range(begin, end, rows):
+            last = min(first + rows, end)
+            block = np.zeros((last - first, len(metric_names)))
+            for column, name in enumerate(metric_names):
+                if name in index:
+                    block[:, column] = profile[first:last, index[name]]
+            yield block
+        return
+
+    db = sqlite3.connect(database_name)
+    cursor = db.cursor()
+    cursor.execute('SELECT ID FROM datacollections WHERE name=? ',
+                   (dc_name,))
+    my_id = cursor.fetchone()[0]
+    column = dict((name, index) for index, name in enumerate(metric_names))
+    bounds = (-1 if after is None else after,
+              (1 << 63) - 1 if upto is None else upto)
+    cursor.execute('SELECT t.ID,mets.name,dm.metric '
+                   'FROM deterministic_metrics as dm '
+                   'JOIN datasets as ds '
+                   'ON dm.datasetID = ds.ID '
+                   'JOIN metrics as mets '
+                   'ON dm.metricID = mets.ID '
+                   'JOIN trials as t '
+                   'ON t.datasetID = ds.ID '
+                   'WHERE t.dataCollectionID = ? '
+                   'AND t.ID > ? AND t.ID <= ? '
+                   'UNION '
+                   'SELECT tr.ID,mets.name,ndm.metric '
+                   'FROM nondeterministic_metrics as ndm '
+                   'JOIN metrics as mets '
+                   'ON ndm.metricID = mets.ID '
+                   'JOIN trials as tr '
+                   'ON ndm.trialID = tr.ID '
+                   'WHERE tr.dataCollectionID = ? '
+                   'AND tr.ID > ? AND tr.ID <= ? '
+                   'UNION '
+                   'SELECT t.ID,mets.name,mm.metric '
+                   'FROM machine_metrics as mm '
+                   'JOIN machines as mach '
+                   'ON mm.machineID = mach.ID '
+                   'JOIN metrics as mets '
+                   'ON mm.metricID = mets.ID '
+                   'JOIN trials as t '
+                   'ON t.machineID = mach.ID '
+                   'WHERE t.dataCollectionID = ? '
+                   'AND t.ID > ? AND t.ID <= ? '
+                   'ORDER BY 1, 2, 3',
+                   (my_id,) + bounds + (my_id,) + bounds + (my_id,) + bounds)
+    block = np.zeros((rows, len(metric_names)))
+    n = 0
+    current = None
+    for (trial, name, value) in cursor:
+        if trial != current:
+            if current is not None:
+                n += 1
+                if n == rows:
+                    yield block
+                    block = np.zeros((rows, len(metric_names)))
+                    n = 0
+            current = trial
+        index = column.get(name)
+        if index is not None:
+            block[n, index] = value
+    cursor.close()
+    if current is not None:
+        yield block[:n + 1]
+
 class DataCollection:
     """Container object for all the data in a single collection.
     
@@ -73,7 +208,10 @@ class DataCollection:
         self.profile = np.empty((0,0)) #[num trials, num metrics]
 
         if database_name is not None:
-            self._load(database_name)
+            if os.path.isdir(database_name):
+                self._loadExtract(database_name)
+            else:
+                self._load(database_name)
 
     def metricIndexByType(self, *args):
         """ Return column index corresponding to each metric type listed in args """
@@ -85,6 +223,10 @@ class DataCollection:
         return [idx for idx, x in enumerate(self.metrics) \
                 if x[0] in names]
 
+    def lastTrial(self):
+        """ Return the ID of the newest trial, None if there are none """
+        return max(self._trial_id_map) if self._trial_id_map else None
+
     def _load(self, database_name):
         """Load this data collection from the given database."""
         db = sqlite3.connect(database_name)
@@ -175,6 +317,24 @@ class DataCollection:
                 self.profile[self._trial_id_map[trial], idx] = value
         cursor.close()
 
+    def _loadExtract(self, directory):
+        """Load this data collection from the files eiger-extract wrote.
+
+        The profile is memory-mapped from name.npy in directory, read-only,
+        and the rest read from name.json. A metric a trial lacks is 0 rather
+        than undefined.
+        """
+        with open(os.path.join(directory, self.name + '.json')) as f:
+            extract = json.load(f)
+        self._trial_id_map = dict((trial, index) for index, trial
+                                  in enumerate(extract['trials']))
+        self.apps = [tuple(x) for x in extract['applications']]
+        self.machines = [tuple(x) for x in extract['machines']]
+        self.datasets = [tuple(x) for x in extract['datasets']]
+        self.metrics = [tuple(x) for x in extract['metrics']]
+        self.profile = np.load(os.path.join(directory, extract['profile']),
+                               mmap_mode='r')
+
     def _loadObject(self, db, my_id, identifier):
         """Load the top level objects.
         
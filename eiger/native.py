@@ -0,0 +1,416 @@
+# \file native.py
+#
+# \brief Python side of libeigertrain, the native parts of model training
+#
+# libeigertrain is built and installed with the C++ API in api/. It is found
+# through EIGER_TRAIN_LIBRARY, naming the shared library, or the system's
+# library search path; without it, training falls back to pure Python.
+#
+
+import ctypes
+import ctypes.util
+import os
+
+import numpy as np
+
+_library = None
+
+class NativeError(Exception):
+    pass
+
+def load():
+    """
+    Returns libeigertrain as a ctypes library, or None if it can't be found.
+    """
+    global _library
+    if _library is not None:
+        return _library
+    name = os.environ.get('EIGER_TRAIN_LIBRARY') or \
+           ctypes.util.find_library('eigertrain')
+    if name is None:
+        return None
+    try:
+        library = ctypes.CDLL(name)
+    except OSError:
+        return None
+    double_p = ctypes.POINTER(ctypes.c_double)
+    size_p = ctypes.POINTER(ctypes.c_size_t)
+    library.eiger_train_error.restype = ctypes.c_char_p
+    library.eiger_train_error.argtypes = []
+    library.eiger_stepwise.restype = ctypes.c_int
+    library.eiger_stepwise.argtypes = [double_p, double_p, ctypes.c_size_t,
+                                       double_p, double_p, ctypes.c_size_t,
+                                       ctypes.c_size_t, ctypes.c_double,
+                                       size_p, double_p, size_p,
+                                       double_p, double_p]
+    library.eiger_stepwise_folds.restype = ctypes.c_int
+    library.eiger_stepwise_folds.argtypes = [double_p, double_p,
+                                             ctypes.c_size_t, ctypes.c_size_t,
+                                             ctypes.c_size_t, size_p, size_p,
+                                             size_p, size_p, ctypes.c_double,
+                                             ctypes.c_size_t, size_p, double_p,
+                                             size_p, double_p, double_p]
+    int_p = ctypes.POINTER(ctypes.c_int)
+    library.eiger_basis.restype = ctypes.c_int
+    library.eiger_basis.argtypes = [double_p, ctypes.c_size_t, ctypes.c_size_t,
+                                    int_p, int_p, int_p, double_p,
+                                    ctypes.c_size_t, ctypes.c_size_t, double_p]
+    library.eiger_moments_add.restype = ctypes.c_int
+    library.eiger_moments_add.argtypes = [double_p, ctypes.c_size_t,
+                                          ctypes.c_size_t, ctypes.c_size_t,
+                                          size_p, double_p, double_p]
+    library.eiger_pca.restype = ctypes.c_int
+    library.eiger_pca.argtypes = [ctypes.c_size_t, double_p, double_p,
+                                  ctypes.c_size_t, ctypes.c_int, double_p,
+                                  double_p, size_p]
+    library.eiger_kmeans.restype = ctypes.c_int
+    library.eiger_kmeans.argtypes = [double_p, ctypes.c_size_t, ctypes.c_size_t,
+                                     ctypes.c_size_t, ctypes.c_size_t,
+                                     ctypes.c_size_t, ctypes.c_double,
+                                     ctypes.c_size_t, ctypes.c_uint64,
+                                     ctypes.c_size_t, double_p, size_p,
+                                     double_p]
+    library.eiger_assign_clusters.restype = ctypes.c_int
+    library.eiger_assign_clusters.argtypes = [double_p, ctypes.c_size_t,
+                                              ctypes.c_size_t, double_p,
+                                              ctypes.c_size_t, ctypes.c_size_t,
+                                              size_p]
+    library.eiger_mars.restype = ctypes.c_int
+    library.eiger_mars.argtypes = [double_p, double_p, ctypes.c_size_t,
+                                   ctypes.c_size_t, ctypes.c_size_t,
+                                   ctypes.c_size_t, ctypes.c_size_t, size_p,
+                                   size_p, size_p, double_p, int_p, double_p,
+                                   double_p, double_p]
+    library.eiger_nearest_neighbors.restype = ctypes.c_int
+    library.eiger_nearest_neighbors.argtypes = [double_p, double_p,
+                                                ctypes.c_size_t,
+                                                ctypes.c_size_t, double_p,
+                                                ctypes.c_size_t,
+                                                ctypes.c_size_t,
+                                                ctypes.c_size_t, double_p]
+    library.eiger_knn_create.restype = ctypes.c_void_p
+    library.eiger_knn_create.argtypes = [double_p, double_p, ctypes.c_size_t,
+                                         ctypes.c_size_t, ctypes.c_size_t]
+    library.eiger_knn_query.restype = ctypes.c_int
+    library.eiger_knn_query.argtypes = [ctypes.c_void_p, double_p,
+                                        ctypes.c_size_t, ctypes.c_size_t,
+                                        double_p]
+    library.eiger_knn_free.restype = None
+    library.eiger_knn_free.argtypes = [ctypes.c_void_p]
+    _library = library
+    return _library
+
+def available():
+    return load() is not None
+
+def _doubles(array):
+    """A C-contiguous array of doubles, and a pointer to its data."""
+    array = np.ascontiguousarray(array, dtype=np.float64)
+    return array, array.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+
+def _sizes(values):
+    """A C-contiguous array of size_t, and a pointer to its data."""
+    array = np.ascontiguousarray(values, dtype=np.uintp)
+    return array, array.ctypes.data_as(ctypes.POINTER(ctypes.c_size_t))
+
+def stepwise(train_lookup, train_y, test_lookup, test_y, threshold):
+    """
+    Forward stepwise regression as LinearRegression.search_regression does
+    it, over lookup tables of every pool function (columns) on each training
+    and test row.
+
+    returns (indices of the picked functions in order, their weights,
+             rsquared, adjusted rsquared)
+    """
+    library = load()
+    if library is None:
+        raise NativeError('libeigertrain is not available')
+    train, train_p = _doubles(train_lookup)
+    test, test_p = _doubles(test_lookup)
+    train_y, train_y_p = _doubles(np.ravel(train_y))
+    test_y, test_y_p = _doubles(np.ravel(test_y))
+    functions = train.shape[1]
+    if train.ndim != 2 or test.ndim != 2 or test.shape[1] != functions or \
+       train.shape[0] != len(train_y) or test.shape[0] != len(test_y):
+        raise NativeError('lookup tables do not match')
+    selected = (ctypes.c_size_t * max(functions, 1))()
+    weights = (ctypes.c_double * max(functions, 1))()
+    count = ctypes.c_size_t()
+    r2 = ctypes.c_double()
+    r2_adjusted = ctypes.c_double()
+    if library.eiger_stepwise(train_p, train_y_p, train.shape[0],
+                              test_p, test_y_p, test.shape[0], functions,
+                              threshold, selected, weights,
+                              ctypes.byref(count), ctypes.byref(r2),
+                              ctypes.byref(r2_adjusted)) != 0:
+        raise NativeError(library.eiger_train_error())
+    return (list(selected[:count.value]), list(weights[:count.value]),
+            r2.value, r2_adjusted.value)
+
+def _ints(values):
+    """A C-contiguous array of ints, and a pointer to its data."""
+    array = np.ascontiguousarray(values, dtype=np.intc)
+    return array, array.ctypes.data_as(ctypes.POINTER(ctypes.c_int))
+
+def basis(X, pool, threads=0):
+    """
+    Every function of pool evaluated on every row of X, as a Fortran-ordered
+    array with a column to a function, filled in place by libeigertrain on
+    threads threads (0 for one per core).
+    """
+    library = load()
+    if library is None:
+        raise NativeError('libeigertrain is not available')
+    profile, profile_p = _doubles(X)
+    if profile.ndim != 2:
+        raise NativeError('the profile is not a table')
+    # the model file encodings: kind, then the metrics and any exponent or
+    # knot
+    kind, i, j, exponent = [], [], [], []
+    for function in pool:
+        encoding = repr(function).split()
+        kind.append(int(encoding[0]))
+        i.append(int(encoding[1]) if len(encoding) > 1 else -1)
+        if kind[-1] in (1, 6, 7):
+            j.append(-1)
+            exponent.append(float(encoding[2]))
+        else:
+            j.append(int(encoding[2]) if len(encoding) > 2 else -1)
+            exponent.append(0.0)
+    kind, kind_p = _ints(kind)
+    i, i_p = _ints(i)
+    j, j_p = _ints(j)
+    exponent, exponent_p = _doubles(exponent)
+    table = np.empty((profile.shape[0], len(pool)), dtype=np.float64,
+                     order='F')
+    if library.eiger_basis(profile_p, profile.shape[0], profile.shape[1],
+                           kind_p, i_p, j_p, exponent_p, len(pool), threads,
+                           table.ctypes.data_as(ctypes.POINTER(
+                               ctypes.c_double))) != 0:
+        raise NativeError(library.eiger_train_error())
+    return table
+
+def stepwise_folds(lookup, y, folds, threshold, threads=0):
+    """
+    stepwise() on each of folds, a list of (train rows, test rows) of the
+    lookup table of every pool function (columns) on every row, best made
+    by basis() as it is used without a copy in its Fortran order. The folds
+    and their candidates are searched on threads threads, 0 for one per
+    core; the results are the same for any number.
+
+    returns a list of stepwise()'s results, one per fold
+    """
+    library = load()
+    if library is None:
+        raise NativeError('libeigertrain is not available')
+    table = np.asfortranarray(lookup, dtype=np.float64)
+    table_p = table.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+    y, y_p = _doubles(np.ravel(y))
+    if table.ndim != 2 or table.shape[0] != len(y):
+        raise NativeError('lookup table does not match')
+    functions = table.shape[1]
+    train, train_p = _sizes(np.concatenate(
+        [np.asarray(f[0], dtype=np.uintp) for f in folds] +
+        [np.zeros(0, dtype=np.uintp)]))
+    train_count, train_count_p = _sizes([len(f[0]) for f in folds])
+    test, test_p = _sizes(np.concatenate(
+        [np.asarray(f[1], dtype=np.uintp) for f in folds] +
+        [np.zeros(0, dtype=np.uintp)]))
+    test_count, test_count_p = _sizes([len(f[1]) for f in folds])
+    n = len(folds)
+    selected = (ctypes.c_size_t * max(n * functions, 1))()
+    weights = (ctypes.c_double * max(n * functions, 1))()
+    count = (ctypes.c_size_t * max(n, 1))()
+    r2 = (ctypes.c_double * max(n, 1))()
+    r2_adjusted = (ctypes.c_double * max(n, 1))()
+    if library.eiger_stepwise_folds(table_p, y_p, table.shape[0], functions,
+                                    n, train_p, train_count_p, test_p,
+                                    test_count_p, threshold, threads,
+                                    selected, weights, count, r2,
+                                    r2_adjusted) != 0:
+        raise NativeError(library.eiger_train_error())
+    return [(list(selected[f * functions:f * functions + count[f]]),
+             list(weights[f * functions:f * functions + count[f]]),
+             r2[f], r2_adjusted[f]) for f in range(n)]
+
+class Moments:
+    """
+    The count, means and co-moments of the rows of a profile, gathered by
+    libeigertrain a block at a time, so that the profile never has to be in
+    memory whole.
+    """
+    def __init__(self, columns, threads=0):
+        if load() is None:
+            raise NativeError('libeigertrain is not available')
+        self.count = ctypes.c_size_t(0)
+        self.mean = np.zeros(columns)
+        self.comoment = np.zeros((columns, columns))
+        self.threads = threads
+
+    def add(self, rows):
+        rows, rows_p = _doubles(rows)
+        if rows.ndim != 2 or rows.shape[1] != len(self.mean):
+            raise NativeError('rows do not match the moments')
+        if _library.eiger_moments_add(rows_p, rows.shape[0], rows.shape[1],
+                                      self.threads, ctypes.byref(self.count),
+                                      _doubles(self.mean)[1],
+                                      _doubles(self.comoment)[1]) != 0:
+            raise NativeError(_library.eiger_train_error())
+
+    def principalComponents(self, scale=True):
+        """
+        The eigenvalues and eigenvectors PCA.PCA finds by an SVD of the
+        centred (and, with scale, standardized) profile, before its rotation.
+
+        returns (loadings, components with a column to a component)
+        """
+        columns = len(self.mean)
+        loadings = np.zeros(columns)
+        components = np.zeros((columns, columns))
+        count = ctypes.c_size_t()
+        if _library.eiger_pca(self.count.value, _doubles(self.mean)[1],
+                              _doubles(self.comoment)[1], columns,
+                              1 if scale else 0, _doubles(loadings)[1],
+                              _doubles(components)[1],
+                              ctypes.byref(count)) != 0:
+            raise NativeError(_library.eiger_train_error())
+        return (loadings[:count.value], components[:, :count.value])
+
+class KMeans:
+    """
+    k-means clustering by libeigertrain, with the parts of sklearn's KMeans
+    that Eiger.py uses. With a batch_size it samples mini-batches of the
+    points rather than visiting all of them each iteration, for profiles of
+    millions of rows. The clustering depends on random_state but not on the
+    number of threads, 0 for one per core.
+    """
+    def __init__(self, n_clusters=8, n_init=10, max_iter=300, tol=1e-4,
+                 batch_size=0, random_state=0, threads=0):
+        if load() is None:
+            raise NativeError('libeigertrain is not available')
+        self.n_clusters = n_clusters
+        self.n_init = n_init
+        self.max_iter = max_iter
+        self.tol = tol
+        self.batch_size = batch_size
+        self.random_state = random_state
+        self.threads = threads
+
+    def fit(self, X):
+        points, points_p = _doubles(X)
+        if points.ndim != 2:
+            raise NativeError('the points are not a table')
+        n, d = points.shape
+        centers = np.zeros((self.n_clusters, d))
+        labels = np.zeros(n, dtype=np.uintp)
+        inertia = ctypes.c_double()
+        if _library.eiger_kmeans(points_p, n, d, self.n_clusters, self.n_init,
+                                 self.max_iter, self.tol, self.batch_size,
+                                 self.random_state, self.threads,
+                                 _doubles(centers)[1], _sizes(labels)[1],
+                                 ctypes.byref(inertia)) != 0:
+            raise NativeError(_library.eiger_train_error())
+        self.cluster_centers_ = centers
+        self.labels_ = labels.astype(np.intp)
+        self.inertia_ = inertia.value
+        return self
+
+    def fit_predict(self, X):
+        return self.fit(X).labels_
+
+    def predict(self, X):
+        """The nearest center to each row of X, as the model runtime finds it."""
+        points, points_p = _doubles(X)
+        centers, centers_p = _doubles(self.cluster_centers_)
+        if points.ndim != 2 or points.shape[1] != centers.shape[1]:
+            raise NativeError('the points do not match the centers')
+        labels = np.zeros(points.shape[0], dtype=np.uintp)
+        if _library.eiger_assign_clusters(points_p, points.shape[0],
+                                          points.shape[1], centers_p,
+                                          centers.shape[0], self.threads,
+                                          _sizes(labels)[1]) != 0:
+            raise NativeError(_library.eiger_train_error())
+        return labels.astype(np.intp)
+
+def mars(X, Y, max_terms, max_interactions, threads=0):
+    """
+    Multivariate adaptive regression splines of Y on the rows of X, as
+    MARS.MARS fits them, by libeigertrain on threads threads (0 for one per
+    core).
+
+    returns (the terms, each a list of (variable, knot, positive) hinges,
+             their weights, residual sum of squares, GCV)
+    """
+    library = load()
+    if library is None:
+        raise NativeError('libeigertrain is not available')
+    x, x_p = _doubles(X)
+    y, y_p = _doubles(np.ravel(Y))
+    if x.ndim != 2 or x.shape[0] != len(y):
+        raise NativeError('the profile does not match the targets')
+    width = max(max_interactions, 1)
+    room = max_terms + 1
+    count = ctypes.c_size_t()
+    factors = (ctypes.c_size_t * room)()
+    variable = (ctypes.c_size_t * (room * width))()
+    knot = (ctypes.c_double * (room * width))()
+    positive = (ctypes.c_int * (room * width))()
+    weights = (ctypes.c_double * room)()
+    rss = ctypes.c_double()
+    gcv = ctypes.c_double()
+    if library.eiger_mars(x_p, y_p, x.shape[0], x.shape[1], max_terms,
+                          max_interactions, threads, ctypes.byref(count),
+                          factors, variable, knot, positive, weights,
+                          ctypes.byref(rss), ctypes.byref(gcv)) != 0:
+        raise NativeError(library.eiger_train_error())
+    terms = [[(variable[t * width + f], knot[t * width + f],
+               positive[t * width + f] != 0) for f in range(factors[t])]
+             for t in range(count.value)]
+    return (terms, list(weights[:count.value]), rss.value, gcv.value)
+
+class KDTree:
+    """
+    A k-d tree in libeigertrain over the rows of X with their values Y, built
+    once and kept for every query, answered on threads threads (0 for one per
+    core). One tree answers one query at a time.
+    """
+    def __init__(self, X, Y, threads=0):
+        self._tree = None
+        library = load()
+        if library is None:
+            raise NativeError('libeigertrain is not available')
+        x, x_p = _doubles(X)
+        y, y_p = _doubles(np.asarray(Y).ravel())
+        if x.ndim != 2 or x.shape[0] != len(y):
+            raise NativeError('the profile does not match the targets')
+        self._dimensions = x.shape[1]
+        self._tree = library.eiger_knn_create(x_p, y_p, x.shape[0],
+                                              x.shape[1], threads)
+        if not self._tree:
+            self._tree = None
+            raise NativeError(library.eiger_train_error())
+
+    def predict(self, T, k):
+        """
+        Predictions for each row of T, as NearestNeighbors.NearestNeighbors
+        makes them.
+        """
+        if self._tree is None:
+            raise NativeError('the tree has been closed')
+        t, t_p = _doubles(T)
+        if t.ndim != 2 or t.shape[1] != self._dimensions:
+            raise NativeError('the queries do not match the profile')
+        predictions = np.zeros(t.shape[0])
+        if _library.eiger_knn_query(self._tree, t_p, t.shape[0], k,
+                                    _doubles(predictions)[1]) != 0:
+            raise NativeError(_library.eiger_train_error())
+        return predictions
+
+    def close(self):
+        """Frees the tree; it answers no more queries."""
+        if self._tree is not None:
+            _library.eiger_knn_free(self._tree)
+            self._tree = None
+
+    def __del__(self):
+        self.close()